@@ -50,7 +50,7 @@ class Coding_session
 	 * */
 	virtual char*
 	    decode_frame ( char* received_data, int buf_size, int* frame_size, 
-		    std::map<int,int> valid_data) = 0;
+		    const std::map<int,int> &valid_data) = 0;
 };
 
 #endif
@@ -0,0 +1,290 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  ldgm-session-cpu-ref.cpp
+ *
+ *    Description:  Original serial SSE2 encoder and std::map Tanner graph
+ *                  decoder (as before the flat-array rewrite), kept only as
+ *                  a baseline for ldgm-encode -b. Not part of the library.
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#if defined __SSE2__ || _M_IX86_FP == 2
+#include <emmintrin.h>
+#endif
+#include <string.h>
+#include <vector>
+
+#include "ldgm-session-cpu-ref.h"
+
+using namespace std;
+
+static char*
+xor_using_sse (char* source, char* dest, int packet_size)
+{
+    // int a = 0;
+    // int II = packet_size % 16;
+    // a=II*16;
+    // // uint64_t* p1 = (uint64_t*) (source);
+    // // uint64_t* p2 = (uint64_t*) (dest);
+
+    // __int128* p1 = (__int128*) (source);
+    // __int128* p2 = (__int128*) (dest);
+
+    // for(int i=0; i<II; i++){
+    //     *p2 ^= *p1;
+    //     p2++;
+    //     p1++;
+    // }
+    // while(a<packet_size){
+    //     *(dest + a) ^= *(source+a);
+    //     a++;
+    // }
+    //First, do as many 128-bit XORs as possible
+    int iter_bytes_16 = 0;
+    int iter_bytes_4 = 0;
+    int iter_bytes_1 = 0;
+#if defined __SSE2__ || _M_IX86_FP == 2
+    iter_bytes_16 = (packet_size/16)*16;
+
+    if ( iter_bytes_16 > 0)
+    {
+
+        //    printf ( "iter_bytes: %d\n", iter_bytes );
+        __m128i* wrd_ptr = (__m128i *)(void *) source;
+        __m128i* wrd_end = (__m128i *)(void *) (source + iter_bytes_16);
+        __m128i* dst_ptr = (__m128i *)(void *) dest;
+
+        //    printf ( "wrd_ptr address: %p\n", wrd_ptr );
+        do
+        {
+            __m128i xmm1 = _mm_loadu_si128(wrd_ptr);
+            __m128i xmm2 = _mm_loadu_si128(dst_ptr);
+
+            xmm1 = _mm_xor_si128(xmm1, xmm2);     //  XOR  4 32-bit words
+            _mm_storeu_si128(dst_ptr, xmm1);
+            ++wrd_ptr;
+            ++dst_ptr;
+
+        } while (wrd_ptr < wrd_end);
+    }
+#endif
+    //Check, whether further XORing is necessary
+    if ( iter_bytes_16 < packet_size )
+    {
+        char *mark_source = source + iter_bytes_16;
+        char *mark_dest = dest + iter_bytes_16;
+
+        iter_bytes_4 = ((packet_size - iter_bytes_16)/4)*4;
+
+        for ( int i = 0; i < (packet_size - iter_bytes_16)/4; i++)
+        {
+            int *s = ((int*)(void *) mark_source) + i;
+            int *d = ((int*)(void *) mark_dest) + i;
+            *d ^= *s;
+        }
+
+        mark_source += iter_bytes_4;
+        mark_dest += iter_bytes_4;
+
+        iter_bytes_1 = packet_size - iter_bytes_16 - iter_bytes_4;
+
+        for ( int i = 0; i < iter_bytes_1; i++)
+        {
+            *(mark_dest + i) ^= *(mark_source+i);
+        }
+    }
+
+//   printf ( "XORed: %d bytes using SSE, %d bytes as ints and %d bytes byte-per-byte.\n",iter_bytes_16, iter_bytes_4, iter_bytes_1);
+
+    return dest;
+}
+
+void
+LDGM_session_cpu_ref::encode_original ( char* data_ptr, char* parity_ptr )
+{
+    char *parity_packet = (char *) malloc(packet_size);
+    if (!parity_packet)
+    {
+        printf ( "Error while using malloc\n" );
+        return;
+    }
+    memset(parity_packet, 0, packet_size);
+
+    for ( int m = 0; m < param_m; ++m) {
+        //Find out which packets to XOR
+        for ( int k = 0; k < max_row_weight+2; ++k) {
+            int idx = pcm[m*(max_row_weight+2) + k];
+            if (idx > -1 && idx < param_k) {
+                char *ptr = data_ptr + idx*packet_size;
+                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+            }
+        }
+
+        //Add the new parity packet to overall parity
+        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
+    }
+
+    free(parity_packet);
+}		/* -----  end of method LDGM_session_cpu_ref::encode_original  ----- */
+
+char*
+LDGM_session_cpu_ref::decode_frame_original ( char* received, int buf_size, int* frame_size,
+                                              const std::map<int, int> &valid_data )
+{
+    Tanner_graph graph;
+
+    int p_size = buf_size/(param_m+param_k);
+    this->packet_size = p_size;
+    graph.set_data_size(p_size);
+
+    int i;
+    int index = 0;
+
+    //one variable node per each data packet in block K
+    for ( i = 0; i < param_k; ++i )
+        graph.add_node(Node::variable_node, index++, received + i*p_size);
+
+    //one variable node per each parity packet in block M
+    for ( i = 0; i < param_m; ++i)
+        graph.add_node(Node::variable_node, index++, received + (i + param_k)*p_size);
+
+    //one constraint node per each row of generation matrix
+    for ( i = 0; i < param_m; ++i)
+        graph.add_node(Node::constraint_node, index++, NULL);
+
+    create_edges(&graph);
+
+    //We need to merge intervals in the valid data vector
+    map <int, int> merged_intervals;
+    map<int,int>::const_iterator map_it;
+
+    for ( map_it = valid_data.begin(); map_it != valid_data.end(); )
+    {
+        int start = map_it->first;
+        int length = map_it->second;
+        // the original dereferenced end() here
+        while ( ++map_it != valid_data.end() && start + length == map_it->first )
+            length += map_it->second;
+        merged_intervals.insert ( pair<int, int> (start, length) );
+    }
+
+    map<int, Node>::iterator it;
+    if ( merged_intervals.size() != 0)
+    {
+        it = graph.nodes.find(0);
+        const auto variable_node_end_it = graph.nodes.find(param_k+param_m); // == 1st constraint node
+        while (it != variable_node_end_it) {
+            (*it).second.setDone(false);
+            int node_offset = (*it).second.getDataPtr() - received;
+
+            map_it = merged_intervals.begin();
+            //Find the offset in valid data which is equal, or the first offset which is
+            //lower than node offset
+            bool found = false;
+            while ( map_it != merged_intervals.end() && map_it->first <= node_offset )
+            {
+                map_it++;
+                found = true;
+            }
+            if ( found )
+                map_it--;
+
+            //Next, find out if some interval covers this symbol
+            if ( found && (map_it->first + map_it->second) >=
+                    (node_offset + p_size) )
+            {
+                (*it).second.setDone(true);
+            }
+
+            ++it;
+        }
+    }
+
+    for ( it = graph.nodes.begin(); it != graph.nodes.find(param_k); it++)
+    {
+        if ( !it->second.isDone())
+        {
+            memset(it->second.getDataPtr(), 0, p_size);
+        }
+    }
+
+    int iter = 0;
+    while ( needs_decoding(&graph) && iter < 4) {
+        iterate_original(&graph);
+        iter++;
+    }
+
+    int undecoded = 0;
+    it = graph.nodes.find(0);
+    while ( it != graph.nodes.find(param_k) ) {
+        if (!(*it).second.isDone())
+            undecoded++;
+        ++it;
+    }
+
+    if ( undecoded == 0 )
+    {
+        union int_bytes {
+            unsigned int number;
+            unsigned char bytes[4];
+        };
+        union int_bytes fs;
+        memcpy(&(fs.bytes), received, 4);
+        *frame_size = fs.number;
+    }
+    else
+        *frame_size = 0;
+
+    return received + LDGM_session::HEADER_SIZE;
+}		/* -----  end of method LDGM_session_cpu_ref::decode_frame_original  ----- */
+
+void
+LDGM_session_cpu_ref::iterate_original ( Tanner_graph *graph )
+{
+    map<int, Node>::iterator it_c;
+    vector<int> vec;
+
+    //select the first constraint node
+    it_c = graph->nodes.find ( param_k + param_m );
+
+    //iterate through constraint nodes
+    while ( it_c != graph->nodes.end() ) {
+        //iterate the node's neighbours to find out how many of them are not decoded
+        for(vector<int>::iterator j = it_c->second.neighbours.begin();
+                j != it_c->second.neighbours.end(); ++j) {
+            const auto it_v = graph->nodes.find(*j);
+            if ( !it_v->second.isDone() )
+                vec.push_back(*j);
+        }
+
+        //we can restore the missing packet
+        if ( vec.size() == 1)
+        {
+            int r_index = vec.front();
+            auto &node = graph->nodes.at(r_index);
+            memset(node.getDataPtr(), 0, packet_size);
+            char *r_data = node.getDataPtr();
+            //find other nodes connected to this constraint node and XOR their values
+            int count = 0;
+            for(vector<int>::iterator j = it_c->second.neighbours.begin();
+                    j != it_c->second.neighbours.end(); ++j)
+            {
+                if ( *j != r_index )
+                {
+                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
+                    xor_using_sse(g_data, r_data, packet_size);
+                    count++;
+                }
+            }
+            if ( count > 0 )
+                node.setDone(true);
+        }
+        vec.clear();
+
+        ++it_c;
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  ldgm-session-cpu-ref.h
+ *
+ *    Description:  Original serial SSE2 encoder and std::map Tanner graph
+ *                  decoder, kept only as a baseline for ldgm-encode -b
+ *
+ * =====================================================================================
+ */
+
+#ifndef  LDGM_SESSION_CPU_REF_INC
+#define  LDGM_SESSION_CPU_REF_INC
+
+#include <map>
+
+#include "ldgm-session-cpu.h"
+#include "tanner.h"
+
+class LDGM_session_cpu_ref : public LDGM_session_cpu
+{
+    public:
+	void
+	    encode_original (char*, char*);
+
+	char*
+	    decode_frame_original ( char* received_data, int buf_size, int* frame_size,
+		    const std::map<int, int> &valid_data );
+
+    private:
+	void
+	    iterate_original ( Tanner_graph *graph );
+};
+
+#endif   /* ----- #ifndef LDGM_SESSION_CPU_REF_INC  ----- */
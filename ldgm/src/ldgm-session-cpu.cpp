@@ -16,6 +16,7 @@
  * =====================================================================================
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -23,8 +24,14 @@
 #include <emmintrin.h>
 #endif
 #include <string.h>
+#include <thread>
 #include <time.h>
 
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define HAVE_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
 #include "ldgm-session-cpu.h"
 #include "timer-util.h"
 
@@ -54,85 +61,177 @@ static inline void *aligned_malloc(size_t size, size_t alignment)
 #endif
 
 
-static char*
-xor_using_sse (char* source, char* dest, int packet_size)
+/// Encoder processes packets in blocks of this size so that the parity
+/// accumulator stays in L1 cache even for large packets.
+#define ENCODE_BLOCK_SIZE 4096
+/// Column stripes given to the encoder threads are multiples of cache line.
+#define ENCODE_STRIPE_ALIGN 64
+/// Amount of XOR work (in bytes) that justifies spawning another thread.
+#define ENCODE_BYTES_PER_THREAD (512 * 1024)
+#define MAX_DECODE_ITERATIONS 4
+
+static void
+xor_tail (const char* source, char* dest, int len)
 {
-    // int a = 0;
-    // int II = packet_size % 16;
-    // a=II*16;
-    // // uint64_t* p1 = (uint64_t*) (source);
-    // // uint64_t* p2 = (uint64_t*) (dest);
-
-    // __int128* p1 = (__int128*) (source);
-    // __int128* p2 = (__int128*) (dest);
-
-    // for(int i=0; i<II; i++){
-    //     *p2 ^= *p1;
-    //     p2++;
-    //     p1++;
-    // }
-    // while(a<packet_size){
-    //     *(dest + a) ^= *(source+a);
-    //     a++;
-    // }
-    //First, do as many 128-bit XORs as possible
-    int iter_bytes_16 = 0;
-    int iter_bytes_4 = 0;
-    int iter_bytes_1 = 0;
-#if defined __SSE2__ || _M_IX86_FP == 2
-    iter_bytes_16 = (packet_size/16)*16;
+    int iter_bytes_4 = (len/4)*4;
 
-    if ( iter_bytes_16 > 0)
+    for ( int i = 0; i < len/4; i++)
     {
+        uint32_t s, d;
+        memcpy(&s, source + i*4, 4);
+        memcpy(&d, dest + i*4, 4);
+        d ^= s;
+        memcpy(dest + i*4, &d, 4);
+    }
 
-        //    printf ( "iter_bytes: %d\n", iter_bytes );
-        __m128i* wrd_ptr = (__m128i *)(void *) source;
-        __m128i* wrd_end = (__m128i *)(void *) (source + iter_bytes_16);
-        __m128i* dst_ptr = (__m128i *)(void *) dest;
-
-        //    printf ( "wrd_ptr address: %p\n", wrd_ptr );
-        do
-        {
-            __m128i xmm1 = _mm_loadu_si128(wrd_ptr);
-            __m128i xmm2 = _mm_loadu_si128(dst_ptr);
+    for ( int i = iter_bytes_4; i < len; i++)
+    {
+        dest[i] ^= source[i];
+    }
+}
 
-            xmm1 = _mm_xor_si128(xmm1, xmm2);     //  XOR  4 32-bit words
-            _mm_storeu_si128(dst_ptr, xmm1);
-            ++wrd_ptr;
-            ++dst_ptr;
+static void
+xor_scalar (const char* source, char* dest, int len)
+{
+    int iter_bytes_8 = (len/8)*8;
 
-        } while (wrd_ptr < wrd_end);
+    for ( int i = 0; i < iter_bytes_8; i += 8)
+    {
+        uint64_t s, d;
+        memcpy(&s, source + i, 8);
+        memcpy(&d, dest + i, 8);
+        d ^= s;
+        memcpy(dest + i, &d, 8);
     }
-#endif
-    //Check, whether further XORing is necessary
-    if ( iter_bytes_16 < packet_size )
+    xor_tail(source + iter_bytes_8, dest + iter_bytes_8, len - iter_bytes_8);
+}
+
+#if defined __SSE2__ || _M_IX86_FP == 2
+static void
+xor_sse2 (const char* source, char* dest, int len)
+{
+    int iter_bytes_16 = (len/16)*16;
+    const __m128i* wrd_ptr = (const __m128i *)(const void *) source;
+    const __m128i* wrd_end = (const __m128i *)(const void *) (source + iter_bytes_16);
+    __m128i* dst_ptr = (__m128i *)(void *) dest;
+
+    while (wrd_ptr < wrd_end)
     {
-        char *mark_source = source + iter_bytes_16;
-        char *mark_dest = dest + iter_bytes_16;
+        __m128i xmm1 = _mm_loadu_si128(wrd_ptr);
+        __m128i xmm2 = _mm_loadu_si128(dst_ptr);
 
-        iter_bytes_4 = ((packet_size - iter_bytes_16)/4)*4;
+        xmm1 = _mm_xor_si128(xmm1, xmm2);     //  XOR  4 32-bit words
+        _mm_storeu_si128(dst_ptr, xmm1);
+        ++wrd_ptr;
+        ++dst_ptr;
+    }
+    xor_tail(source + iter_bytes_16, dest + iter_bytes_16, len - iter_bytes_16);
+}
+#endif
 
-        for ( int i = 0; i < (packet_size - iter_bytes_16)/4; i++)
-        {
-            int *s = ((int*)(void *) mark_source) + i;
-            int *d = ((int*)(void *) mark_dest) + i;
-            *d ^= *s;
-        }
+#ifdef HAVE_X86_DISPATCH
+__attribute__((target("avx2"))) static void
+xor_avx2 (const char* source, char* dest, int len)
+{
+    int i = 0;
 
-        mark_source += iter_bytes_4;
-        mark_dest += iter_bytes_4;
+    for ( ; i + 128 <= len; i += 128)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(const void *)(source + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(const void *)(source + i + 32));
+        __m256i a2 = _mm256_loadu_si256((const __m256i *)(const void *)(source + i + 64));
+        __m256i a3 = _mm256_loadu_si256((const __m256i *)(const void *)(source + i + 96));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(void *)(dest + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(void *)(dest + i + 32));
+        __m256i b2 = _mm256_loadu_si256((const __m256i *)(void *)(dest + i + 64));
+        __m256i b3 = _mm256_loadu_si256((const __m256i *)(void *)(dest + i + 96));
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i), _mm256_xor_si256(a0, b0));
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i + 32), _mm256_xor_si256(a1, b1));
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i + 64), _mm256_xor_si256(a2, b2));
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i + 96), _mm256_xor_si256(a3, b3));
+    }
+    for ( ; i + 32 <= len; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(const void *)(source + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(void *)(dest + i));
+        _mm256_storeu_si256((__m256i *)(void *)(dest + i), _mm256_xor_si256(a, b));
+    }
+    xor_tail(source + i, dest + i, len - i);
+}
 
-        iter_bytes_1 = packet_size - iter_bytes_16 - iter_bytes_4;
+__attribute__((target("avx512f"))) static void
+xor_avx512 (const char* source, char* dest, int len)
+{
+    int i = 0;
 
-        for ( int i = 0; i < iter_bytes_1; i++)
-        {
-            *(mark_dest + i) ^= *(mark_source+i);
-        }
+    for ( ; i + 256 <= len; i += 256)
+    {
+        __m512i a0 = _mm512_loadu_si512(source + i);
+        __m512i a1 = _mm512_loadu_si512(source + i + 64);
+        __m512i a2 = _mm512_loadu_si512(source + i + 128);
+        __m512i a3 = _mm512_loadu_si512(source + i + 192);
+        __m512i b0 = _mm512_loadu_si512(dest + i);
+        __m512i b1 = _mm512_loadu_si512(dest + i + 64);
+        __m512i b2 = _mm512_loadu_si512(dest + i + 128);
+        __m512i b3 = _mm512_loadu_si512(dest + i + 192);
+        _mm512_storeu_si512(dest + i, _mm512_xor_si512(a0, b0));
+        _mm512_storeu_si512(dest + i + 64, _mm512_xor_si512(a1, b1));
+        _mm512_storeu_si512(dest + i + 128, _mm512_xor_si512(a2, b2));
+        _mm512_storeu_si512(dest + i + 192, _mm512_xor_si512(a3, b3));
     }
+    for ( ; i + 64 <= len; i += 64)
+    {
+        __m512i a = _mm512_loadu_si512(source + i);
+        __m512i b = _mm512_loadu_si512(dest + i);
+        _mm512_storeu_si512(dest + i, _mm512_xor_si512(a, b));
+    }
+    xor_tail(source + i, dest + i, len - i);
+}
+#endif
 
-//   printf ( "XORed: %d bytes using SSE, %d bytes as ints and %d bytes byte-per-byte.\n",iter_bytes_16, iter_bytes_4, iter_bytes_1);
+LDGM_session_cpu::simd_level
+LDGM_session_cpu::set_simd_level ( simd_level level )
+{
+#ifdef HAVE_X86_DISPATCH
+    __builtin_cpu_init();
+    if ( level == SIMD_AUTO )
+    {
+        level = __builtin_cpu_supports("avx512f") ? SIMD_AVX512 :
+            __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE2;
+    }
+    if ( level == SIMD_AVX512 && !__builtin_cpu_supports("avx512f") )
+        level = SIMD_AVX2;
+    if ( level == SIMD_AVX2 && !__builtin_cpu_supports("avx2") )
+        level = SIMD_SSE2;
+#else
+    if ( level == SIMD_AUTO || level == SIMD_AVX2 || level == SIMD_AVX512 )
+        level = SIMD_SSE2;
+#endif
+#if ! (defined __SSE2__ || _M_IX86_FP == 2)
+    if ( level == SIMD_SSE2 )
+        level = SIMD_NONE;
+#endif
 
-    return dest;
+    switch ( level )
+    {
+#ifdef HAVE_X86_DISPATCH
+        case SIMD_AVX512:
+            xor_kernel = xor_avx512;
+            break;
+        case SIMD_AVX2:
+            xor_kernel = xor_avx2;
+            break;
+#endif
+#if defined __SSE2__ || _M_IX86_FP == 2
+        case SIMD_SSE2:
+            xor_kernel = xor_sse2;
+            break;
+#endif
+        default:
+            level = SIMD_NONE;
+            xor_kernel = xor_scalar;
+    }
+    return level;
 }
 
 void *
@@ -148,46 +247,113 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 
 }
 
+/**
+ * Computes parity for byte range <offset, offset+len) of all packets.
+ *
+ * The staircase part of the generator is applied implicitly by not clearing
+ * the accumulator between rows, so parity row m equals parity row m-1 XORed
+ * with the data packets of row m.
+ */
 void
-LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
+LDGM_session_cpu::encode_stripe ( char *data_ptr, char *parity_ptr, int offset, int len )
 {
-//    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
+    alignas(64) char acc[ENCODE_BLOCK_SIZE];
+    const int row_len = max_row_weight + 2;
 
-    char *parity_packet;
-
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
-	if (!parity_packet)
-	{
-		printf ( "Error while using posix_memalign\n" );
-		return;
-	}
-	memset(parity_packet, 0, packet_size);
-
-    for ( int m = 0; m < param_m; ++m) {
-//	printf ( "m: %d\n", m );
-
-//	printf ( "max w: %d\n", max_row_weight );
-        //Find out which packets to XOR
-        for ( int k = 0; k < max_row_weight+2; ++k) {
-            int idx = pcm[m*(max_row_weight+2) + k];
-//	    printf ( "adept: %d\n", idx );
-            if (idx > -1 && idx < param_k) {
-//		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+    for ( int block = offset; block < offset + len; block += ENCODE_BLOCK_SIZE )
+    {
+        int block_len = min(ENCODE_BLOCK_SIZE, offset + len - block);
+        memset(acc, 0, block_len);
+
+        for ( int m = 0; m < param_m; ++m ) {
+            const int *row = pcm + m * row_len;
+            for ( int k = 0; k < row_len; ++k ) {
+                int idx = row[k];
+                if (idx > -1 && idx < param_k) {
+                    xor_kernel(data_ptr + idx*packet_size + block, acc, block_len);
+                }
             }
+            memcpy(parity_ptr + m*packet_size + block, acc, block_len);
         }
+    }
+}
 
-        //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
+void
+LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
+{
+    int ps = packet_size;
+    if ( ps == 0 )
+        return;
+
+    // rows are chained by the staircase, so the work is split by columns
+    long long work = (long long) ps * param_m * (max_row_weight + 1);
+    unsigned int threads = max_threads ? max_threads : thread::hardware_concurrency();
+    threads = max(1u, min<unsigned int>(threads, work / ENCODE_BYTES_PER_THREAD));
+    threads = min<unsigned int>(threads, (ps + ENCODE_STRIPE_ALIGN - 1) / ENCODE_STRIPE_ALIGN);
+
+    int stripe = (ps + threads - 1) / threads;
+    stripe = (stripe + ENCODE_STRIPE_ALIGN - 1) / ENCODE_STRIPE_ALIGN * ENCODE_STRIPE_ALIGN;
+
+    unsigned int stripes = (ps + stripe - 1) / stripe;
+    if ( stripes == 1 ) {
+        encode_stripe(data_ptr, parity_ptr, 0, ps);
+        return;
     }
 
-	aligned_free(parity_packet);
+    unique_lock<mutex> lk(pool_lock);
+    while ( workers.size() < stripes - 1 )
+        workers.emplace_back(&LDGM_session_cpu::encode_worker, this, (unsigned int) workers.size());
+    job = { data_ptr, parity_ptr, stripe, ps, stripes };
+    pending = stripes - 1;
+    job_id++;
+    lk.unlock();
+    job_posted.notify_all();
 
-    return ;
+    encode_stripe(data_ptr, parity_ptr, 0, stripe);
+
+    lk.lock();
+    job_finished.wait(lk, [this] { return pending == 0; });
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
+/**
+ * Encoder thread kept for the session lifetime so that creating threads is
+ * not paid per frame.
+ */
+void
+LDGM_session_cpu::encode_worker ( unsigned int idx )
+{
+    unsigned int seen = 0;
+    unique_lock<mutex> lk(pool_lock);
+    while ( true ) {
+        job_posted.wait(lk, [&] { return pool_exit || job_id != seen; });
+        if ( pool_exit )
+            return;
+        seen = job_id;
+        if ( idx + 1 >= job.stripes )
+            continue;
+        auto j = job;
+        lk.unlock();
+        int offset = (idx + 1) * j.stripe;
+        encode_stripe(j.data_ptr, j.parity_ptr, offset, min(j.stripe, j.len - offset));
+        lk.lock();
+        if ( --pending == 0 )
+            job_finished.notify_one();
+    }
+}
+
+void
+LDGM_session_cpu::stop_workers ()
+{
+    {
+        lock_guard<mutex> lk(pool_lock);
+        pool_exit = true;
+    }
+    job_posted.notify_all();
+    for ( auto &w : workers )
+        w.join();
+    workers.clear();
+}
+
 void
 LDGM_session_cpu::free_out_buf ( char *buf)
 {
@@ -241,179 +407,107 @@ LDGM_session_cpu::encode_naive ( char* data_ptr, char* parity_ptr )
     return ;
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
-void iterate ( Tanner_graph *g);
-
 char*
 LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
-                                 std::map<int, int> valid_data )
+                                 const std::map<int, int> &valid_data )
 {
-//    printf ( "buf_size: %d\n", buf_size );
-
     Timer_util interval;
     interval.start();
 
-
-    Tanner_graph graph;
-
-    int p_size = buf_size/(param_m+param_k);
+    const int node_count = param_k + param_m;
+    int p_size = buf_size/node_count;
     this->packet_size = p_size;
-//    printf ( "p_size %d\n", p_size );
-    graph.set_data_size(p_size);
-
-    //Timer_util timer;
-
-    int i;
-    int index = 0;
-
 
-//    while ( i < (param_k + param_m)*p_size)
-//    {
-//	printf ( "%2d|", (unsigned char)received[i++] );
-//    }
-
-    //one variable node per each data packet in block K
-    for ( i = 0; i < param_k; ++i )
-        graph.add_node(Node::variable_node, index++, received + i*p_size);
-
-    //one variable node per each parity packet in block M
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::variable_node, index++, received + (i + param_k)*p_size);
-
-    //one constraint node per each row of generation matrix
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::constraint_node, index++, NULL);
-
-    create_edges(&graph);
-
-//    printf("Graph created in: %.3f s\n", t);
-
-    /*      printf ( "graf\n" );
-     *     for(map<int, Node>::iterator it = graph.nodes.begin(); it != graph.nodes.end(); ++it) {
-     *      Node n = it->second;
-     *      for ( int i = 0; i < p_size; ++i)
-     *          printf("%2d|", *(unsigned char *)(n.getDataPtr() + i));
-     *      printf ( "---\n" );
-     *      }
-     */
-
-    /*      for(map<int, Node>::iterator it = graph.nodes.begin(); it != graph.nodes.end(); ++it) {
-     *      Node n = it->second;
-     *      printf ( "neigbours of %d (count %lu): ", it->first, (it->second).neighbours.size() );
-     *      for(vector<int>::iterator itr = n.neighbours.begin(); itr != n.neighbours.end(); ++itr)
-     *          printf ( "%d ", *itr );
-     *      printf ( "\n" );
-     *     }
-     */
-
-    //We need to merge intervals in the valid data vector
-    map <int, int> merged_intervals;
-    map<int,int>::iterator map_it;
-
-    if ( valid_data.size() != 0 )
+    // adjacency of constraint nodes (rows of the parity check matrix) in CSR
+    if ( (int) row_start.size() != param_m + 1 )
     {
-        for ( map_it = valid_data.begin(); map_it != valid_data.end(); )
-        {
-            int start = map_it->first;
-            int length = map_it->second;
-            while ( start + length == (++map_it)->first )
-                length += map_it->second;
-            merged_intervals.insert ( pair<int, int> (start, length) );
+        const int row_len = max_row_weight + 2;
+        row_start.assign(1, 0);
+        row_nodes.clear();
+        for ( int m = 0; m < param_m; ++m ) {
+            for ( int k = 0; k < row_len; ++k ) {
+                int idx = pcm[m*row_len + k];
+                if ( idx > -1 )
+                    row_nodes.push_back(idx);
+            }
+            row_start.push_back(row_nodes.size());
         }
     }
-    /*     printf ( "Valid data: \n" );
-     *     for ( map_it = valid_data.begin(); map_it != valid_data.end(); ++map_it)
-     *     {
-     * 	printf ( "|%d-%d| ", map_it->first, map_it->second );
-     *     }
-     *     printf ( "\n" );
-     *
-     *     printf ( "Merged intervals: \n" );
-     *     for ( map_it = merged_intervals.begin(); map_it != merged_intervals.end(); ++map_it)
-     *     {
-     * 	printf ( "|%d-%d| ", map_it->first, map_it->second );
-     *     }
-     *     printf ( "\n" );
-     *
-     */
-
-
-
-    map<int, Node>::iterator it;
-    if ( merged_intervals.size() != 0)
-    {
-        it = graph.nodes.find(0);
-        const auto variable_node_end_it = graph.nodes.find(param_k+param_m); // == 1st constraint node
-        assert(variable_node_end_it != graph.nodes.end());
-        while (it != variable_node_end_it) {
-            (*it).second.setDone(false);
-            int node_offset = (*it).second.getDataPtr() - received;
-//	    printf ( "offset: %d\n", node_offset );
-
-            map_it = merged_intervals.begin();
-            //Find the offset in valid data which is equal, or the first offset which is
-            //lower than node offset
-            bool found = false;
-            while ( (map_it->first <= node_offset) && map_it != merged_intervals.end() )
-            {
-                map_it++;
-                found = true;
-            }
-            if ( found )
-                map_it--;
 
-            //Next, find out if some interval covers this symbol
-            if ( found && (map_it->first + map_it->second) >=
-                    (node_offset + p_size) )
-            {
-                (*it).second.setDone(true);
-//		printf ( "setting node %d with offset %d and size %d as done\n", it->first,
-//			node_offset, p_size);
+    // Mark symbols completely covered by received data as done. Both
+    // received intervals and symbols are sorted by offset, so the adjacent
+    // intervals are merged on the fly.
+    done.assign(node_count, 0);
+    auto map_it = valid_data.begin();
+    int int_start = 0;
+    int int_end = 0;
+    for ( int i = 0; i < node_count; ++i )
+    {
+        int node_offset = i * p_size;
+        while ( int_end < node_offset + p_size && map_it != valid_data.end() )
+        {
+            if ( map_it->first != int_end ) {
+                int_start = map_it->first;
             }
-
-            ++it;
+            int_end = map_it->first + map_it->second;
+            ++map_it;
         }
+        if ( int_start <= node_offset && int_end >= node_offset + p_size )
+            done[i] = 1;
     }
 
-    //int not_done = 0;
-    for ( it = graph.nodes.begin(); it != graph.nodes.find(param_k); it++)
+    int undecoded = 0;
+    for ( int i = 0; i < param_k; ++i )
     {
-        if ( !it->second.isDone())
+        if ( !done[i] )
         {
-            memset(it->second.getDataPtr(), 0, p_size);
-//	    printf ( "resetting node: %d\n", it->first );
-            //not_done++;
+            memset(received + i*p_size, 0, p_size);
+            undecoded++;
         }
     }
-//    printf ( "not done: %d\n", not_done );
-    /*     srand(time(NULL));
-     *     for ( int j = 0; j < 100; j++)
-     *     {
-     * 	it = graph.nodes.find(rand()%(param_k+param_m));
-     * 	(*it).second.setDone(false);
-     *     }
-     */
-    int iter = 0;
-
-    while ( needs_decoding(&graph) && iter < 4) {
-//	printf ( "iteratin\n" );
-        iterate(&graph);
-        iter++;
-    }
 
-//    printf("decoding process: %.3f s\n", t);
-
-    //printf ( "iterations: %d\n", iter );
+    for ( int iter = 0; undecoded > 0 && iter < MAX_DECODE_ITERATIONS; ++iter )
+    {
+        bool progress = false;
+        for ( int m = 0; m < param_m; ++m )
+        {
+            const int *nodes = row_nodes.data() + row_start[m];
+            const int count = row_start[m + 1] - row_start[m];
+            int missing = -1;
+            int missing_count = 0;
+            for ( int j = 0; j < count && missing_count < 2; ++j )
+            {
+                if ( !done[nodes[j]] ) {
+                    missing = nodes[j];
+                    missing_count++;
+                }
+            }
+            //we can restore the missing packet
+            if ( missing_count != 1 || count < 2 )
+                continue;
 
-    int undecoded = 0;
-    it = graph.nodes.find(0);
-    while ( it != graph.nodes.find(param_k) ) {
-        if (!(*it).second.isDone())
-            undecoded++;
-        ++it;
+            char *r_data = received + missing*p_size;
+            bool first = true;
+            for ( int j = 0; j < count; ++j )
+            {
+                if ( nodes[j] == missing )
+                    continue;
+                char *g_data = received + nodes[j]*p_size;
+                if ( first ) {
+                    memcpy(r_data, g_data, p_size);
+                    first = false;
+                } else {
+                    xor_kernel(g_data, r_data, p_size);
+                }
+            }
+            done[missing] = 1;
+            progress = true;
+            if ( missing < param_k )
+                undecoded--;
+        }
+        if ( !progress )
+            break;
     }
-//    printf ( "Number of not recovered data packets: %d\n", undecoded );
-
-    //    printf("rest: %.3f s\n", t);
 
     if ( undecoded == 0 )
     {
@@ -430,92 +524,8 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
 
 
     interval.end();
-    //printf("time: %e\n",elapsed/1000.0 );
     this->elapsed_sum2 += interval.elapsed_time_ms();
     this->no_frames2++;
 
-    if(this->no_frames==150){
-        //printf("TIME: %f ms\n",this->elapsed_sum/(double)this->no_frames );
-    }
-
     return received + LDGM_session::HEADER_SIZE;
 }		/* -----  end ofmethod LDGM_session_cpu::decode  ----- */
-
-
-void
-LDGM_session_cpu::iterate ( Tanner_graph *graph )
-{
-    map<int, Node>::iterator it_c;
-    vector<int> vec;
-
-    //static int recovered = 0;
-
-    //select the first constraint node
-    it_c = graph->nodes.find ( param_k + param_m );
-
-    //iterate through constraint nodes
-    while ( it_c != graph->nodes.end() ) {
-        //iterate the node's neighbours to find out how many of them are not decoded
-        for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                j != it_c->second.neighbours.end(); ++j) {
-            const auto it_v = graph->nodes.find(*j);
-            if ( !it_v->second.isDone() )
-                vec.push_back(*j);
-        }
-//	printf ( "node %d has %d undecoded neighbours\n", it_c->first, vec.size() );
-
-        //we can restore the missing packet
-        if ( vec.size() == 1)
-        {
-            int r_index = vec.front();
-
-//	    if ( r_index == 0 )
-//	    {
-//		printf ( "repairing first block\n" );
-//	    }
-            auto &node = graph->nodes.at(r_index);
-            memset(node.getDataPtr(), 0, packet_size);
-            char *r_data = node.getDataPtr();
-            //find other nodes connected to this constraint node and XOR their values
-            int count = 0;
-            for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                    j != it_c->second.neighbours.end(); ++j)
-            {
-                if ( *j != r_index )
-                {
-//		    printf ( "decode, packet_size: %d\n", packet_size );
-                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
-                    count++;
-                }
-            }
-            /*           //validate recovered packet
-             *          for ( int i = 0; i < param_k; ++i) {
-             *              if(!memcmp(r_data, lost_ptr + i*packet_size, packet_size)) {
-             *                  printf ( "packet ok\n" );
-             *                  break;
-             *              }
-             *          }
-             */
-            if ( count > 0 )
-                node.setDone(true);
-            //recovered++;
-            /*           printf ( "restored data: \n" );
-             *          for ( int  i = 0; i < packet_size; ++i)
-             *              printf ( "%2d|", (unsigned char)(*(it_v->second.getDataPtr() + i)) );
-             *          printf ( "---\n" );
-             */
-
-
-        }
-        vec.clear();
-
-        ++it_c;
-    }
-//    printf ( "recovered: %d\n", recovered );
-
-    return;
-
-}
-
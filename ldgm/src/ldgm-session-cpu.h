@@ -20,6 +20,11 @@
 #ifndef  LDGM_SESSION_CPU_INC
 #define  LDGM_SESSION_CPU_INC
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "ldgm-session.h"
 //#include "timer-util.h"
 
@@ -32,13 +37,28 @@
 class LDGM_session_cpu : public LDGM_session
 {
     public:
+	/**
+	 * Instruction set used by the XOR kernel. SIMD_AUTO selects the widest
+	 * one supported by the running CPU.
+	 */
+	enum simd_level {
+		SIMD_AUTO,
+		SIMD_NONE,
+		SIMD_SSE2,
+		SIMD_AVX2,
+		SIMD_AVX512,
+	};
+
 	/* ====================  LIFECYCLE     ======================================= */
 	LDGM_session_cpu () {
 		printf("CPU LDGM in progress .... \n");
 		elapsed_sum=0.0;
 		no_frames=0;
+		max_threads=0;
+		set_simd_level(SIMD_AUTO);
 	}                            /* constructor */
 	~LDGM_session_cpu () {
+		stop_workers();
 		printf("LDGM TIME CPU: %f ms\n",this->elapsed_sum2/(double)this->no_frames2 );
 	 }                            /* constructor */
 
@@ -50,10 +70,7 @@ class LDGM_session_cpu : public LDGM_session
 
 	char*                                                                             
 	    decode_frame ( char* received_data, int buf_size, int* frame_size,
-		    std::map<int, int> valid_data );
-
-	void
-	    iterate ( Tanner_graph *graph);
+		    const std::map<int, int> &valid_data );
 
 	void
 	    free_out_buf (char *buf);
@@ -61,13 +78,64 @@ class LDGM_session_cpu : public LDGM_session
 	void *
 		alloc_buf(int size);
 
+	/**
+	 * Limits number of threads used for parity computation.
+	 *
+	 * @param count maximal number of threads, 0 means hardware concurrency
+	 */
+	void
+	    set_thread_count ( unsigned int count ) { max_threads = count; }
+
+	/**
+	 * Selects XOR kernel.
+	 *
+	 * @return level that is actually used (requested level may not be
+	 *         supported by the CPU or the compiler)
+	 */
+	simd_level
+	    set_simd_level ( simd_level level );
+
     protected:
 	/* ====================  DATA MEMBERS  ======================================= */
 
     private:
+	typedef void (*xor_func_t)(const char *src, char *dst, int len);
+
+	void
+	    encode_stripe ( char *data_ptr, char *parity_ptr, int offset, int len );
+
+	void
+	    encode_worker ( unsigned int idx );
+
+	void
+	    stop_workers ();
+
 	/* ====================  DATA MEMBERS  ======================================= */
     double elapsed_sum;
 	long no_frames;
+	unsigned int max_threads;
+	xor_func_t xor_kernel;
+
+	/* persistent encoder threads, worker i computes stripe i+1 of a job */
+	std::vector<std::thread> workers;
+	std::mutex pool_lock;
+	std::condition_variable job_posted;
+	std::condition_variable job_finished;
+	struct {
+		char *data_ptr;
+		char *parity_ptr;
+		int stripe;
+		int len;
+		unsigned int stripes;
+	} job;
+	unsigned int job_id = 0;
+	unsigned int pending = 0;
+	bool pool_exit = false;
+
+	/* flat decoder state, reused between frames */
+	std::vector<int> row_start;
+	std::vector<int> row_nodes;
+	std::vector<char> done;
 
 }; /* -----  end of class LDGM_session_cpu  ----- */
 
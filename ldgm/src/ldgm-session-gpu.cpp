@@ -162,7 +162,7 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
 
 }
 
-char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *frame_size, std::map<int, int> valid_data )
+char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *frame_size, const std::map<int, int> &valid_data )
 {
     char *received = received_data;
 
@@ -174,7 +174,7 @@ char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *f
 
     //We need to merge intervals in the valid data vector
     std::map <int, int> merged_intervals;
-    std::map<int, int>::iterator map_it;
+    std::map<int, int>::const_iterator map_it;
 
     if ( valid_data.size() != 0 )
     {
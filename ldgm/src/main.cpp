@@ -23,10 +23,12 @@
 #include <ctype.h>
 #include <string.h>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
 #include "ldgm-session-cpu.h"
+#include "ldgm-session-cpu-ref.h"
 #include "ldgm-session-gpu.h"
 #include "timer-util.h"
 
@@ -45,6 +47,7 @@ void printMatrix ( char **m, int height, int width );
 void printData ( char *data, int count, int packet_size );
 void fillParityMatrix ( char** matrix, int height, int width );
 int demo( int m, int k, int frame_size, char* matrix_fname, char* data_fname, int cpu, int gpu);
+int benchmark( int k, int m, int frame_size, char* matrix_fname );
 void demo_gpu();
 
 /* 
@@ -63,11 +66,15 @@ main ( int argc, char *argv[] )
     int c;
     int gpu = 0;
     int cpu = 0;
+    int bench = 0;
     char fname[32];
     char matrix_fname[32];
 
-    while ( ( c = getopt ( argc, argv, "cf:gk:m:o:t:w:")) != -1 ) {
+    while ( ( c = getopt ( argc, argv, "bcf:gk:m:o:t:w:")) != -1 ) {
 	switch(c) {
+	    case 'b':
+		bench = 1;
+		break;
 	    case 'w':
 		column_weight = atoi ( optarg );
 		break;
@@ -116,6 +123,9 @@ main ( int argc, char *argv[] )
 	}
     }
 
+    if (bench)
+	return benchmark( k, m, frame_size, matrix_fname );
+
     demo( k, m, frame_size, matrix_fname, fname, cpu, gpu);
 
     //    demo_gpu();
@@ -329,6 +339,126 @@ demo(int k, int m, int frame_size, char* matrix_fname, char* data_fname, int cpu
 }
 
 
+#define BENCH_ITERATIONS 50
+#define BENCH_PACKET_SIZE 1392
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  benchmark
+ *  Description:  Measures CPU encoder and decoder throughput against the
+ *                original code (serial SSE2 encoder, std::map Tanner graph
+ *                decoder, see ldgm-session-cpu-ref.cpp) and the naive encoder.
+ * =====================================================================================
+ */
+    int
+benchmark( int k, int m, int frame_size, char* matrix_fname )
+{
+    LDGM_session_cpu_ref session;
+    session.set_params ( k, m, COLUMN_WEIGHT);
+    session.set_pcMatrix ( matrix_fname);
+
+    char *data = (char *) malloc(frame_size);
+    for ( int i = 0; i < frame_size; ++i)
+	data[i] = rand() % 256;
+
+    int buf_size;
+    char *output = session.encode_frame ( data, frame_size, &buf_size );
+    int ps = session.get_packet_size();
+    char *parity = output + k * ps;
+    char *reference = (char *) malloc((size_t) m * ps);
+    session.encode_naive ( output, reference );
+
+    enum { NAIVE, ORIGINAL, CURRENT };
+    struct {
+	const char *name;
+	LDGM_session_cpu::simd_level simd;
+	unsigned int threads;
+	int impl;
+    } configs[] = {
+	{ "naive", LDGM_session_cpu::SIMD_NONE, 1, NAIVE },
+	{ "original code (serial sse2)", LDGM_session_cpu::SIMD_SSE2, 1, ORIGINAL },
+	{ "sse2, 1 thread", LDGM_session_cpu::SIMD_SSE2, 1, CURRENT },
+	{ "best SIMD, 1 thread", LDGM_session_cpu::SIMD_AUTO, 1, CURRENT },
+	{ "best SIMD, all threads", LDGM_session_cpu::SIMD_AUTO, 0, CURRENT },
+    };
+
+    printf ( "K %d M %d frame %d B, packet %d B\n", k, m, frame_size, ps );
+    int ret = EXIT_SUCCESS;
+    for ( auto &c : configs ) {
+	session.set_simd_level(c.simd);
+	session.set_thread_count(c.threads);
+	Timer_util t;
+	t.start();
+	for ( int i = 0; i < BENCH_ITERATIONS; i++) {
+	    memset(parity, 0, (size_t) m * ps);
+	    if (c.impl == NAIVE)
+		session.encode_naive ( output, parity );
+	    else if (c.impl == ORIGINAL)
+		session.encode_original ( output, parity );
+	    else
+		session.encode ( output, parity );
+	}
+	t.end();
+	bool ok = memcmp(parity, reference, (size_t) m * ps) == 0;
+	if (!ok)
+	    ret = EXIT_FAILURE;
+	printf ( "encode %-28s %8.1f MB/s %s\n", c.name,
+		(double) frame_size * BENCH_ITERATIONS / t.elapsed_time() / 1000000.0,
+		ok ? "" : "PARITY MISMATCH" );
+    }
+
+    session.set_simd_level(LDGM_session_cpu::SIMD_AUTO);
+    session.set_thread_count(0);
+    // both decoders get the same losses
+    char *lossy = (char *) malloc(buf_size);
+    char *received = (char *) malloc(buf_size);
+    map<int, int> valid_data;
+    int good[2] = { 0, 0 };
+    double decode_time[2] = { 0.0, 0.0 };
+    for ( int i = 0; i < BENCH_ITERATIONS; i++) {
+	memcpy(lossy, output, buf_size);
+	valid_data.clear();
+	for ( int j = 0; j < buf_size ; j += BENCH_PACKET_SIZE) {
+	    int size = min(BENCH_PACKET_SIZE, buf_size - j);
+	    if(rand() % 100 > PACKET_LOSS * 100 ) {
+		valid_data.insert(pair<int,int>(j, size));
+	    } else {
+		memset(lossy + j, 0x0, size);
+	    }
+	}
+	for ( int d = 0; d < 2; d++) {
+	    memcpy(received, lossy, buf_size);
+	    Timer_util t;
+	    int f_size;
+	    t.start();
+	    char *decoded = d == 0
+		? session.decode_frame_original(received, buf_size, &f_size, valid_data)
+		: session.decode_frame(received, buf_size, &f_size, valid_data);
+	    t.end();
+	    decode_time[d] += t.elapsed_time();
+	    if (f_size == frame_size && memcmp(decoded, data, frame_size) == 0)
+		good[d]++;
+	}
+    }
+    for ( int d = 0; d < 2; d++) {
+	printf ( "decode %-28s %8.1f MB/s (%d/%d frames recovered at %.0f %% loss)\n",
+		d == 0 ? "original code (std::map)" : "flat arrays",
+		(double) frame_size * BENCH_ITERATIONS / decode_time[d] / 1000000.0,
+		good[d], BENCH_ITERATIONS, PACKET_LOSS * 100 );
+    }
+    if (good[1] < good[0])
+	ret = EXIT_FAILURE;
+
+    free(received);
+    free(lossy);
+    free(reference);
+    session.free_out_buf(output);
+    free(data);
+
+    return ret;
+}
+
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  printData
@@ -758,8 +758,9 @@ static void *audio_receiver_thread(void *arg)
                         if (ret) {
                                 last_not_timeout = curr_time;
                         }
+                        // only participants with data in playout buffer
                         pdb_iter_t it;
-                        cp = pdb_iter_init(s->audio_participants, &it);
+                        cp = pdb_iter_init_active(s->audio_participants, &it);
                 
                         while (cp != NULL) {
                                 if (cp->decoder_state == NULL &&
@@ -803,6 +804,9 @@ static void *audio_receiver_thread(void *arg)
                                 }
 
                                 pbuf_remove(cp->playout_buffer, curr_time);
+                                if (pbuf_is_empty(cp->playout_buffer)) {
+                                        pdb_set_active(s->audio_participants, cp, false);
+                                }
                                 cp = pdb_iter_next(&it);
 
                                 if (decoded && !playback_supports_multiple_streams)
@@ -48,15 +48,18 @@
 #include "audio/utils.h"
 #include "compat/misc.h"
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
+#include "utils/worker.h"
 
 #define MOD_NAME "[acodec] "
 
 using std::get;
 using std::hash;
 using std::max;
+using std::min;
 using std::stoi;
 using std::string;
 using std::tuple;
@@ -81,6 +84,13 @@ static const unordered_map<audio_codec_t, audio_codec_info_t, hash<int>>
 static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_cfg,
                 audio_codec_direction_t direction, bool try_init);
 
+struct channel_range_task {
+        struct audio_codec_state *s;
+        const audio_frame2 *frame; ///< NULL when flushing the encoder
+        int first;
+        int last;
+};
+
 struct audio_codec_state {
         void **state;
         int state_count;
@@ -88,6 +98,12 @@ struct audio_codec_state {
         audio_desc desc;
         audio_codec_direction_t direction;
         int bitrate;
+
+        int thread_count; ///< per-channel states are processed in up to thread_count tasks
+        // buffers reused across frames
+        vector<audio_channel> in;
+        vector<audio_channel *> out;
+        vector<channel_range_task> tasks;
 };
 
 static string
@@ -168,6 +184,8 @@ struct audio_codec_state *audio_codec_init_cfg(const char *audio_codec_cfg,
 }
 
 
+ADD_TO_PARAM("audio-codec-threads", "* audio-codec-threads=<n>|auto\n"
+                "  Encode/decode audio channels concurrently in up to <n> threads (default 1)\n");
 static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_cfg,
                 audio_codec_direction_t direction, bool silent) {
         const struct audio_codec_params params =
@@ -209,7 +227,7 @@ static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_c
                 return NULL;
         }
 
-        struct audio_codec_state *s = (struct audio_codec_state *) calloc(1, sizeof(struct audio_codec_state));
+        auto *s = new audio_codec_state();
 
         s->state = (void **) calloc(1, sizeof(void*));
         s->state[0] = state;
@@ -218,6 +236,10 @@ static struct audio_codec_state *audio_codec_init_real(const char *audio_codec_c
         s->desc.codec = params.codec;
         s->direction = direction;
         s->bitrate = params.bitrate;
+        s->thread_count = 1;
+        if (const char *threads = get_commandline_param("audio-codec-threads")) {
+                s->thread_count = strcmp(threads, "auto") == 0 ? get_cpu_core_count() : max(atoi(threads), 1);
+        }
 
         return s;
 }
@@ -232,6 +254,43 @@ struct audio_codec_state *audio_codec_reconfigure(struct audio_codec_state *old,
         return audio_codec_init(audio_codec, direction);
 }
 
+static void *process_channel_range(void *arg)
+{
+        auto *t = (channel_range_task *) arg;
+        struct audio_codec_state *s = t->s;
+        for (int i = t->first; i < t->last; ++i) {
+                audio_channel *in = nullptr;
+                if (t->frame != nullptr) {
+                        in = &s->in[i];
+                        audio_channel_demux(t->frame, i, in);
+                        in->timestamp = t->frame->get_timestamp();
+                }
+                if (s->direction == AUDIO_CODER) {
+                        s->out[i] = s->funcs->compress(s->state[i], in);
+                } else {
+                        s->out[i] = in->data_len == 0 ? nullptr : s->funcs->decompress(s->state[i], in);
+                }
+        }
+        return nullptr;
+}
+
+/**
+ * Runs compress/decompress for channels [0, ch_count) and stores results to
+ * s->out. Channel states are independent so that with "audio-codec-threads"
+ * they are processed concurrently, each channel always by a single task.
+ */
+static void process_channels(struct audio_codec_state *s, const audio_frame2 *frame, int ch_count)
+{
+        s->in.resize(ch_count);
+        s->out.resize(ch_count);
+        const int task_count = max(min(s->thread_count, ch_count), 1);
+        s->tasks.resize(task_count);
+        for (int i = 0; i < task_count; ++i) {
+                s->tasks[i] = { s, frame, i * ch_count / task_count, (i + 1) * ch_count / task_count };
+        }
+        task_run_parallel(process_channel_range, task_count, s->tasks.data(), sizeof s->tasks[0], nullptr);
+}
+
 /**
  * Audio_codec_compress compresses given audio frame.
  *
@@ -265,16 +324,10 @@ audio_frame2 audio_codec_compress(struct audio_codec_state *s, const audio_frame
                 res.set_timestamp(frame->get_timestamp());
         }
 
-        audio_channel channel;
-        channel.timestamp = frame == nullptr ? -1 : frame->get_timestamp();
+        process_channels(s, frame, s->desc.ch_count);
         int nonzero_channels = 0;
         for (int i = 0; i < s->desc.ch_count; ++i) {
-                audio_channel *encode_channel = NULL;
-                if(frame) {
-                        audio_channel_demux(frame, i, &channel);
-                        encode_channel = &channel;
-                }
-                audio_channel *out = s->funcs->compress(s->state[i], encode_channel);
+                audio_channel *out = s->out[i];
                 if (out == nullptr) {
                         continue;
                 }
@@ -319,15 +372,11 @@ audio_frame2 audio_codec_decompress(struct audio_codec_state *s, audio_frame2 *f
 #endif
 
         audio_frame2 ret;
-        audio_channel channel;
         int nonzero_channels = 0;
         bool out_frame_initialized = false;
+        process_channels(s, frame, frame->get_channel_count());
         for (int i = 0; i < frame->get_channel_count(); ++i) {
-                audio_channel_demux(frame, i, &channel);
-                if (channel.data_len == 0) {
-                        continue;
-                }
-                audio_channel *out = s->funcs->decompress(s->state[i], &channel);
+                audio_channel *out = s->out[i];
                 if (out) {
                         if (!out_frame_initialized) {
                                 ret.init(frame->get_channel_count(), AC_PCM, out->bps, out->sample_rate);
@@ -378,7 +427,7 @@ void audio_codec_done(struct audio_codec_state *s)
         }
         free(s->state);
 
-        free(s);
+        delete s;
 }
 
 static audio_codec_t
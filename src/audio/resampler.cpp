@@ -42,6 +42,9 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <cmath>
+
+#include "audio/resampler.h"
 #include "audio/resampler.hpp"
 #include "audio/types.h"
 #include "audio/utils.h"
@@ -249,11 +252,17 @@ private:
 };
 
 bool speex_resampler::check_reconfigure(unsigned original_sample_rate, unsigned new_sample_rate_num, unsigned new_sample_rate_den, unsigned nb_channels, unsigned bps) {
-        if (state != nullptr && original_sample_rate == prop.rate_from
-                                && new_sample_rate_num == prop.rate_to_num
-                                && new_sample_rate_den == prop.rate_to_den
-                                && nb_channels == prop.ch_count
-                                && bps == prop.bps) {
+        if (state != nullptr && nb_channels == prop.ch_count && bps == prop.bps) {
+                if (original_sample_rate != prop.rate_from
+                                || new_sample_rate_num != prop.rate_to_num
+                                || new_sample_rate_den != prop.rate_to_den) {
+                        // change the ratio without resetting the filter state (no glitch)
+                        speex_resampler_set_rate_frac(state, original_sample_rate * new_sample_rate_den,
+                                        new_sample_rate_num, original_sample_rate, new_sample_rate_num);
+                        prop.rate_from = original_sample_rate;
+                        prop.rate_to_num = new_sample_rate_num;
+                        prop.rate_to_den = new_sample_rate_den;
+                }
                 return true;
         }
         if (bps != 2 && bps != 4) {
@@ -417,7 +426,81 @@ int audio_frame2_resampler::align_bps(int orig) {
         return last;
 }
 
+audio_frame2_resampler::operator bool() const {
+        return m_impl != nullptr;
+}
+
 audio_frame2_resampler::~audio_frame2_resampler() = default;
 audio_frame2_resampler::audio_frame2_resampler(audio_frame2_resampler&&) = default;
 audio_frame2_resampler& audio_frame2_resampler::operator=(audio_frame2_resampler&&) = default;
 
+struct interleaved_resampler {
+        audio_frame2_resampler resampler;
+        audio_frame2 pending; ///< input not consumed by the previous call
+        vector<char> out;
+};
+
+struct interleaved_resampler *interleaved_resampler_init()
+{
+        try {
+                auto *r = new interleaved_resampler();
+                if (!r->resampler) {
+                        delete r;
+                        return nullptr;
+                }
+                return r;
+        } catch (ug_runtime_error &e) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << e.what() << "\n";
+                return nullptr;
+        }
+}
+
+void interleaved_resampler_done(struct interleaved_resampler *r)
+{
+        delete r;
+}
+
+const char *interleaved_resampler_process(struct interleaved_resampler *r,
+                                          const struct audio_desc *desc,
+                                          const char *in, int in_len,
+                                          double ratio, int *out_len)
+{
+        constexpr int den = 1000;
+        struct audio_frame f{};
+        f.bps = desc->bps;
+        f.sample_rate = desc->sample_rate;
+        f.ch_count = desc->ch_count;
+        f.data = const_cast<char *>(in);
+        f.data_len = in_len;
+        audio_frame2 frame(&f);
+        const int resampler_bps = r->resampler.align_bps(desc->bps);
+        if (resampler_bps <= 0) {
+                return nullptr;
+        }
+        if (resampler_bps != desc->bps) {
+                frame.change_bps(resampler_bps);
+        }
+        if (r->pending) {
+                r->pending.append(frame);
+                frame = std::move(r->pending);
+        }
+
+        auto [ret, remainder] = frame.resample_fake(r->resampler,
+                        (int) llround(desc->sample_rate * ratio * den), den);
+        if (!ret) {
+                r->pending = {};
+                return nullptr;
+        }
+        r->pending = std::move(remainder);
+        if (frame.get_bps() != desc->bps) {
+                frame.change_bps(desc->bps);
+        }
+
+        r->out.resize(frame.get_data_len(0) * desc->ch_count);
+        for (int i = 0; i < desc->ch_count; ++i) {
+                mux_channel(r->out.data(), frame.get_data(i), desc->bps,
+                            frame.get_data_len(i), desc->ch_count, i, 1.0);
+        }
+        *out_len = r->out.size();
+        return r->out.data();
+}
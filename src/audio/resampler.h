@@ -0,0 +1,70 @@
+/**
+ * @file   audio/resampler.h
+ * @brief  C interface to audio_frame2_resampler for interleaved streams
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AUDIO_RESAMPLER_H_
+#define AUDIO_RESAMPLER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct audio_desc;
+struct interleaved_resampler;
+
+/**
+ * @returns resampler state, NULL if neither SpeexDSP nor Soxr is compiled in
+ */
+struct interleaved_resampler *interleaved_resampler_init(void);
+void interleaved_resampler_done(struct interleaved_resampler *r);
+/**
+ * Resamples interleaved data by a (possibly varying) ratio of output to input
+ * sample count. Input samples the resampler didn't consume are kept for the
+ * next call.
+ *
+ * @param[out] out_len length of the returned data in bytes
+ * @returns resampled data valid until the next call, NULL on error
+ */
+const char *interleaved_resampler_process(struct interleaved_resampler *r,
+                                          const struct audio_desc *desc,
+                                          const char *in, int in_len,
+                                          double ratio, int *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUDIO_RESAMPLER_H_
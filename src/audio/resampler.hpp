@@ -54,6 +54,7 @@ public:
 
         std::tuple<bool, audio_frame2> resample(audio_frame2 &a, std::vector<audio_frame2::channel> &out, int new_sample_rate_num, int new_sample_rate_den);
         int align_bps(int orig);
+        explicit operator bool() const; ///< false if no resampler compiled in
         class impl;
 private:
         std::unique_ptr<impl> m_impl;
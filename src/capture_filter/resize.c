@@ -45,6 +45,13 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,6 +63,7 @@
 #include "utils/color_out.h"
 #include "utils/macros.h"
 #include "utils/parallel_conv.h"
+#include "utils/video_scale.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -75,6 +83,8 @@ struct state_resize {
     char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
     decoder_t decoder;
     struct video_frame *dec_frame;
+    bool opencv;                  ///< use OpenCV instead of the native scaler
+    struct video_scale *scaler;
 };
 
 static void usage() {
@@ -94,11 +104,37 @@ static void usage() {
         "\nOptions:\n"
         "\t" TBOLD(
             "algo") " - scaling algorithm to use (list with `algo:help`)\n");
+#ifdef HAVE_RESIZE_OPENCV
+    color_printf("\t" TBOLD("opencv") " - scale with OpenCV (converts to RGB) "
+                 "instead of the native scaler\n");
+#endif
+    color_printf("\nNative scaler processes %s directly, other pixel formats "
+                 "are converted first.\n", "UYVY, v210, I420 and RGBA");
     color_printf("\n");
 }
 
 static int
-parse_fmt(char *cfg, struct resize_param *param)
+resize_algo_from_string(const char *str)
+{
+    if (strcmp(str, "help") == 0) {
+        color_printf("Available resize algorithms:\n");
+        for (int i = 0; i < VIDEO_SCALE_ALGO_COUNT; ++i) {
+            color_printf("\t" TBOLD("%s") "%s\n", video_scale_algo_to_string(i),
+                         i == VIDEO_SCALE_ALGO_DEFAULT ? " (default)" : "");
+        }
+        return RESIZE_ALGO_HELP_SHOWN;
+    }
+    for (int i = 0; i < VIDEO_SCALE_ALGO_COUNT; ++i) {
+        if (strcmp(video_scale_algo_to_string(i), str) == 0) {
+            return i;
+        }
+    }
+    MSG(ERROR, "Unknown algorithm: %s\n", str);
+    return RESIZE_ALGO_UNKN;
+}
+
+static int
+parse_fmt(char *cfg, struct resize_param *param, bool *opencv)
 {
     char *save_ptr = NULL;
     char *item     = NULL;
@@ -111,6 +147,16 @@ parse_fmt(char *cfg, struct resize_param *param)
             }
             continue;
         }
+        if (strcmp(item, "opencv") == 0) {
+#ifdef HAVE_RESIZE_OPENCV
+            *opencv = true;
+            continue;
+#else
+            UNUSED(opencv);
+            MSG(ERROR, "Compiled without OpenCV support!\n");
+            return -1;
+#endif
+        }
         if (!isdigit(item[0]) && item[0] != '.') {
             log_msg(LOG_LEVEL_ERROR,
                     "[RESIZE ERROR] Unrecognized part of config "
@@ -155,14 +201,21 @@ static int init(struct module * parent, const char *cfg, void **state)
     }
 
     char *fmt = strdup(cfg);
-    const int rc = parse_fmt(fmt, &param);
+    bool opencv = false;
+    const int rc = parse_fmt(fmt, &param, &opencv);
     free(fmt);
     if (rc != 0) {
         return rc;
     }
+    if (param.algo == RESIZE_ALGO_DFL) {
+        param.algo = VIDEO_SCALE_ALGO_DEFAULT;
+        MSG(NOTICE, "using resize algorithm: %s\n",
+            video_scale_algo_to_string(param.algo));
+    }
 
     struct state_resize *s = calloc(1, sizeof(struct state_resize));
     s->param = param;
+    s->opencv = opencv;
 
     *state = s;
     return 0;
@@ -173,6 +226,8 @@ cleanup_common(struct state_resize *s)
 {
     vf_free(s->dec_frame);
     s->dec_frame = NULL;
+    video_scale_done(s->scaler);
+    s->scaler = NULL;
 }
 
 static void
@@ -190,8 +245,16 @@ reconfigure_if_needed(struct state_resize *s, const struct video_frame *in)
     }
     struct video_desc dec_desc         = video_desc_from_frame(in);
     s->out_desc                        = video_desc_from_frame(in);
-    const codec_t supp_in_codecs[] = { RESIZE_SUPPORTED_PIXFMT_INIT,
-                                           VIDEO_CODEC_NONE };
+    const codec_t native_in_codecs[] = { VIDEO_SCALE_SUPPORTED_PIXFMT_INIT,
+                                         VIDEO_CODEC_NONE };
+    const codec_t *supp_in_codecs = native_in_codecs;
+#ifdef HAVE_RESIZE_OPENCV
+    const codec_t opencv_in_codecs[] = { RESIZE_SUPPORTED_PIXFMT_INIT,
+                                         VIDEO_CODEC_NONE };
+    if (s->opencv) {
+        supp_in_codecs = opencv_in_codecs;
+    }
+#endif
     if (codec_is_in_set(in->color_spec, supp_in_codecs)) {
         dec_desc.color_spec = in->color_spec;
         s->decoder = vc_memcpy;
@@ -205,8 +268,12 @@ reconfigure_if_needed(struct state_resize *s, const struct video_frame *in)
             return false;
         }
     }
-    s->out_desc.color_spec =
-        get_bits_per_component(dec_desc.color_spec) == DEPTH8 ? RGB : RG48;
+    if (s->opencv) {
+        s->out_desc.color_spec =
+            get_bits_per_component(dec_desc.color_spec) == DEPTH8 ? RGB : RG48;
+    } else {
+        s->out_desc.color_spec = dec_desc.color_spec;
+    }
     MSG(INFO, "Decoding through %s to output pixfmt %s.\n",
         get_codec_name(dec_desc.color_spec),
         get_codec_name(s->out_desc.color_spec));
@@ -217,9 +284,22 @@ reconfigure_if_needed(struct state_resize *s, const struct video_frame *in)
     } else {
         s->out_desc.width = in->tiles[0].width * s->param.factor;
         s->out_desc.height = in->tiles[0].height * s->param.factor;
+        if (!s->opencv && s->out_desc.color_spec != RGBA) { // chroma subsampled
+            s->out_desc.width &= ~1U;
+        }
     }
-    s->saved_desc = video_desc_from_frame(in);
     cleanup_common(s);
+    if (!s->opencv) {
+        s->scaler = video_scale_init(
+            dec_desc.color_spec, (int) in->tiles[0].width,
+            (int) in->tiles[0].height, (int) s->out_desc.width,
+            (int) s->out_desc.height, s->param.mode == USE_DIMENSIONS,
+            s->param.algo, 0);
+        if (s->scaler == NULL) {
+            return false;
+        }
+    }
+    s->saved_desc = video_desc_from_frame(in);
     if (s->decoder != vc_memcpy) {
         s->dec_frame               = vf_alloc_desc_data(dec_desc);
     }
@@ -257,9 +337,17 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         struct video_frame *const in_frame =
             s->decoder == vc_memcpy ? in : s->dec_frame;
 
-        resize_frame(in_frame->tiles[i].data, in_frame->color_spec,
-                     out_frame->tiles[i].data, (int) in_frame->tiles[i].width,
-                     (int) in_frame->tiles[i].height, &s->param);
+        if (s->scaler) {
+            video_scale(s->scaler, in_frame->tiles[i].data,
+                        out_frame->tiles[i].data);
+        } else {
+#ifdef HAVE_RESIZE_OPENCV
+            resize_frame(in_frame->tiles[i].data, in_frame->color_spec,
+                         out_frame->tiles[i].data,
+                         (int) in_frame->tiles[i].width,
+                         (int) in_frame->tiles[i].height, &s->param);
+#endif
+        }
     }
 
     VIDEO_FRAME_DISPOSE(in);
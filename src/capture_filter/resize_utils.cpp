@@ -63,10 +63,9 @@
 
 #include "capture_filter/resize_utils.h"
 #include "debug.h"
-#include "utils/color_out.h"
+#include "utils/video_scale.h"
 #include "video.h"
 
-#define DEFAULT_ALGO INTER_LINEAR
 #define MOD_NAME "[resize] "
 
 using cv::INTER_AREA;
@@ -80,7 +79,22 @@ using cv::Mat;
 using cv::Rect;
 using cv::Size;
 
-static const char *resize_algo_to_string(int algo);
+static int
+to_cv_algo(int algo)
+{
+    switch (algo) {
+    case VIDEO_SCALE_NEAREST:
+        return INTER_NEAREST;
+    case VIDEO_SCALE_CUBIC:
+        return INTER_CUBIC;
+    case VIDEO_SCALE_AREA:
+        return INTER_AREA;
+    case VIDEO_SCALE_LANCZOS4:
+        return INTER_LANCZOS4;
+    default:
+        return INTER_LINEAR;
+    }
+}
 
 static Mat ug_to_rgb_mat(codec_t codec, int width, int height, char *indata) {
     Mat yuv;
@@ -177,26 +191,20 @@ resize_frame_dimensions(char *indata, codec_t in_color, char *outdata, int width
 
     Mat out((int) target_height, (int) target_width,
             get_out_cv_data_type(in_color), outdata);
-    resize(rgb, out(r), r.size(), 0, 0, algo);
+    resize(rgb, out(r), r.size(), 0, 0, to_cv_algo(algo));
 }
 
 void
 resize_frame(char *indata, codec_t in_color, char *outdata, int width,
              int height, struct resize_param *resize_spec)
 {
-    if (resize_spec->algo == RESIZE_ALGO_DFL) {
-        resize_spec->algo = DEFAULT_ALGO;
-        MSG(NOTICE, "using resize algorithm: %s\n",
-          resize_algo_to_string(DEFAULT_ALGO));
-    }
-
     DEBUG_TIMER_START(resize);
     if (resize_spec->mode == resize_param::USE_FRACTION) {
         const double factor = resize_spec->factor;
         Mat rgb = ug_to_rgb_mat(in_color, (int) width, (int) height, indata);
         Mat out((int) (height * factor), (int) (width * factor),
                 get_out_cv_data_type(in_color), outdata);
-        resize(rgb, out, Size(0, 0), factor, factor, resize_spec->algo);
+        resize(rgb, out, Size(0, 0), factor, factor, to_cv_algo(resize_spec->algo));
     } else if (resize_spec->mode == resize_param::USE_DIMENSIONS) {
         resize_frame_dimensions(indata, in_color, outdata, width, height,
                                 resize_spec->target_width,
@@ -207,47 +215,4 @@ resize_frame(char *indata, codec_t in_color, char *outdata, int width,
     DEBUG_TIMER_STOP(resize);
 }
 
-static const struct {
-    int         val;
-    const char *name;
-} interp_map[] = {
-        {INTER_NEAREST,        "nearest"      },
-        { INTER_LINEAR,        "linear"       },
-        { INTER_CUBIC,         "cubic"        },
-        { INTER_AREA,          "area"         },
-        { INTER_LANCZOS4,      "lanczos4"     },
-        // { INTER_LINEAR_EXACT,  "linear_exact" },
-        // { INTER_NEAREST_EXACT, "nearest_exact"},
-};
-
-int
-resize_algo_from_string(const char *str)
-{
-    if (strcmp(str, "help") == 0) {
-        color_printf("Available resize algorithms:\n");
-        for (auto const &i : interp_map) {
-            color_printf("\t" TBOLD("%s") "%s\n", i.name,
-                         i.val == DEFAULT_ALGO ? " (default)" : "");
-        }
-        return RESIZE_ALGO_HELP_SHOWN;
-    }
-    for (auto const &i : interp_map) {
-        if (strcmp(i.name, str) == 0) {
-            return i.val;
-        }
-    }
-    return RESIZE_ALGO_UNKN;
-}
-
-static const char *
-resize_algo_to_string(int algo)
-{
-    for (auto const &i : interp_map) {
-        if (i.val == algo) {
-            return i.name;
-        }
-    }
-    return "(unknown algo!)";
-}
-
 /* vim: set expandtab sw=4: */
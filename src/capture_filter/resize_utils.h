@@ -58,7 +58,6 @@ extern "C" {
 #define RESIZE_ALGO_DFL        (-1)
 #define RESIZE_ALGO_UNKN       (-2)
 #define RESIZE_ALGO_HELP_SHOWN (-3)
-int resize_algo_from_string(const char *str);
 
 struct resize_param {
         enum resize_mode {
@@ -73,7 +72,7 @@ struct resize_param {
                         int target_height;
                 };
         };
-        int algo;
+        int algo; ///< enum video_scale_algo
 };
 void resize_frame(char *indata, codec_t in_color, char *outdata, int width,
                   int height, struct resize_param *resize_spec);
@@ -0,0 +1,147 @@
+/**
+ * @file   capture_filter/unchanged.c
+ * @brief  Marks frames identical to the previous one with FRAME_UNCHANGED
+ *
+ * Useful for captures that don't know about that themselves (eg. screen
+ * capture without XDamage, HDMI grabber of a presentation). The flag is then
+ * honored by "--param skip-unchanged".
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_filter.h"
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "video.h"
+
+#define BLOCK_SIZE (64 * 1024) ///< granularity of comparison, only changed blocks are copied
+
+struct module;
+
+static int init(struct module *parent, const char *cfg, void **state);
+static void done(void *state);
+static struct video_frame *filter(void *state, struct video_frame *in);
+
+struct state_unchanged {
+        struct video_desc desc;
+        char *prev; ///< copy of the previous frame (all tiles consecutively)
+        size_t prev_len;
+};
+
+static int init(struct module *parent, const char *cfg, void **state)
+{
+        UNUSED(parent);
+        if (strlen(cfg) > 0) {
+                color_printf(TBOLD("unchanged") " marks frames identical to the previous one as unchanged so that they can be\n"
+                                "skipped with " TBOLD("--param skip-unchanged") ", takes no arguments\n");
+                return strcmp(cfg, "help") == 0 ? 1 : -1;
+        }
+        *state = calloc(1, sizeof(struct state_unchanged));
+        return 0;
+}
+
+static void done(void *state)
+{
+        struct state_unchanged *s = state;
+        free(s->prev);
+        free(s);
+}
+
+/**
+ * Compares in with stored copy and updates the changed blocks of the copy.
+ * memcmp() is vectorized by libc and stops at first difference of the block.
+ * @returns true if anything changed
+ */
+static bool update_copy(char *copy, const char *in, size_t len)
+{
+        bool changed = false;
+        for (size_t off = 0; off < len; off += BLOCK_SIZE) {
+                size_t block_len = MIN(BLOCK_SIZE, len - off);
+                if (memcmp(copy + off, in + off, block_len) != 0) {
+                        memcpy(copy + off, in + off, block_len);
+                        changed = true;
+                }
+        }
+        return changed;
+}
+
+static struct video_frame *filter(void *state, struct video_frame *in)
+{
+        struct state_unchanged *s = state;
+
+        size_t len = 0;
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                len += in->tiles[i].data_len;
+        }
+
+        bool changed = false;
+        if (!video_desc_eq(s->desc, video_desc_from_frame(in)) || len != s->prev_len) {
+                s->desc = video_desc_from_frame(in);
+                free(s->prev);
+                s->prev = calloc(1, len);
+                s->prev_len = len;
+                changed = true;
+        }
+
+        size_t off = 0;
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                changed = update_copy(s->prev + off, in->tiles[i].data, in->tiles[i].data_len) || changed;
+                off += in->tiles[i].data_len;
+        }
+
+        if (changed) {
+                in->flags &= ~FRAME_UNCHANGED;
+        } else {
+                in->flags |= FRAME_UNCHANGED;
+        }
+        return in;
+}
+
+static const struct capture_filter_info capture_filter_unchanged = {
+        .init = init,
+        .done = done,
+        .filter = filter,
+};
+
+REGISTER_MODULE(unchanged, &capture_filter_unchanged, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
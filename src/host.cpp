@@ -68,8 +68,10 @@
 #include "lib_common.h"
 #include "messaging.h"
 #include "module.h"
+#include "utils/bench_report.h"
 #include "utils/color_out.h"
 #include "utils/fs.h"
+#include "utils/metrics.h"
 #include "utils/misc.h" // ug_strerror
 #include "utils/random.h"
 #include "utils/string.h"
@@ -178,6 +180,9 @@ static bool validate_param(const char *param);
 
 void common_cleanup(struct init_data *init)
 {
+        bench_report_done();
+        metrics_done();
+
         if (init) {
 #if defined BUILD_LIBRARIES
                 for (auto a : init->opened_libs) {
@@ -94,7 +94,9 @@
 #include "rtsp/rtsp_utils.h"
 #include "tv.h"
 #include "ug_runtime_error.hpp"
+#include "utils/bench_report.h"
 #include "utils/color_out.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/nat.h"
 #include "utils/net.h"
@@ -336,7 +338,15 @@ static void *capture_thread(void *arg)
                 }
 
                 if (tx_frame != NULL) {
-                        print_fps(print_fps_prefix, &t0, &frames);
+                        if (!tx_frame->fragment || tx_frame->last_fragment) {
+                                print_fps(print_fps_prefix, &t0, &frames);
+                                metric_add(METRIC_VIDEO_FRAMES_CAPTURED, 1);
+                        }
+                        // slice mode - latency measured since the first slice
+                        if ((tx_frame->flags & TIMESTAMP_VALID) != 0 &&
+                            (!tx_frame->fragment || tx_frame->tiles[0].offset == 0)) {
+                                bench_frame_captured(get_local_mediatime_offset() + tx_frame->timestamp);
+                        }
                         //tx_frame = vf_get_copy(tx_frame);
                         bool wait_for_cur_uncompressed_frame;
                         shared_ptr<video_frame> frame;
@@ -1368,6 +1378,10 @@ int main(int argc, char *argv[])
                 EXIT(EXIT_FAIL_CONTROL_SOCK);
         }
 
+        if (!metrics_init() || !bench_report_init()) {
+                EXIT(EXIT_FAILURE);
+        }
+
         if(!opt.nat_traverse_config
                         || strncmp(opt.nat_traverse_config, "holepunch", strlen("holepunch")) != 0){
                 nat_traverse = start_nat_traverse(opt.nat_traverse_config, opt.requested_receiver, opt.video_rx_port, opt.audio.recv_port);
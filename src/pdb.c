@@ -69,62 +69,52 @@
 #include "tfrc.h"
 #include "pdb.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define PDB_MAGIC	0x10101010
-#define PDB_NODE_MAGIC	0x01010101
-
-typedef struct s_pdb_node {
-        uint32_t key;
-        void *data;
-        struct s_pdb_node *parent;
-        struct s_pdb_node *left;
-        struct s_pdb_node *right;
-        uint32_t magic;
-} pdb_node_t;
 
+enum {
+        PDB_MIN_SLOTS = 16,
+        PDB_EMPTY_SLOT = -1,
+};
+
+/*
+ * Participants are stored in a dense array (indexed by pdb_e::idx) for fast
+ * iteration, open-addressing (linear probing) hash table maps SSRC to the
+ * index. Bitset "active" marks participants with data in playout buffer.
+ */
 struct pdb {
-        pdb_node_t *root;
-        uint32_t magic;
+        struct pdb_e **entries;
         int count;
+        int alloc;
+        int *slots;             ///< indices to entries or PDB_EMPTY_SLOT
+        unsigned slot_mask;     ///< slot count - 1 (power of 2)
+        uint64_t *active;
+        uint32_t magic;
         volatile int *delay_ms;
+        bool nack;              ///< enable NACK tracking in playout buffers
 };
 
 /*****************************************************************************/
 /* Debugging functions...                                                    */
 /*****************************************************************************/
 
-#define BTREE_MAGIC      0x10101010
-#define BTREE_NODE_MAGIC 0x01010101
-
-#ifdef DEBUG
-static
-#ifndef HAVE_MACOSX
-__thread
-#endif
-int pdb_count;
-
-static void pdb_validate_node(pdb_node_t * node, pdb_node_t * parent)
-{
-        assert(node->magic == BTREE_NODE_MAGIC);
-        assert(node->parent == parent);
-        pdb_count++;
-        if (node->left != NULL) {
-                pdb_validate_node(node->left, node);
-        }
-        if (node->right != NULL) {
-                pdb_validate_node(node->right, node);
-        }
-}
-#endif
-
-static void pdb_validate(struct pdb *t)
+static void pdb_validate(struct pdb *db)
 {
-        assert(t->magic == BTREE_MAGIC);
+        assert(db->magic == PDB_MAGIC);
 #ifdef DEBUG
-        pdb_count = 0;
-        if (t->root != NULL) {
-                pdb_validate_node(t->root, NULL);
+        int used = 0;
+        for (unsigned i = 0; i <= db->slot_mask; ++i) {
+                if (db->slots[i] != PDB_EMPTY_SLOT) {
+                        assert(db->slots[i] < db->count);
+                        used++;
+                }
+        }
+        assert(used == db->count);
+        for (int i = 0; i < db->count; ++i) {
+                assert(db->entries[i]->idx == i);
         }
-        assert(pdb_count == t->count);
 #endif
 }
 
@@ -132,149 +122,107 @@ static void pdb_validate(struct pdb *t)
 /* Utility functions                                                         */
 /*****************************************************************************/
 
-static pdb_node_t *pdb_min(pdb_node_t * x)
+static unsigned pdb_hash(const struct pdb *db, uint32_t ssrc)
 {
-        if (x == NULL) {
-                return NULL;
-        }
-        while (x->left) {
-                x = x->left;
-        }
-        return x;
+        // SSRCs should be random but do not rely on that (Fibonacci hashing)
+        const uint32_t h = ssrc * 2654435769U;
+        return (h ^ h >> 16) & db->slot_mask;
 }
 
-static pdb_node_t *pdb_successor(pdb_node_t * x)
+/// @returns slot containing ssrc or the empty slot where it would be inserted
+static unsigned pdb_find_slot(const struct pdb *db, uint32_t ssrc)
 {
-        pdb_node_t *y;
-
-        if (x->right != NULL) {
-                return pdb_min(x->right);
-        }
-
-        y = x->parent;
-        while (y != NULL && x == y->right) {
-                x = y;
-                y = y->parent;
+        unsigned i = pdb_hash(db, ssrc);
+        while (db->slots[i] != PDB_EMPTY_SLOT && db->entries[db->slots[i]]->ssrc != ssrc) {
+                i = (i + 1) & db->slot_mask;
         }
-
-        return y;
+        return i;
 }
 
-static pdb_node_t *pdb_search(pdb_node_t * x, uint32_t key)
+static void pdb_rehash(struct pdb *db, unsigned slot_count)
 {
-        while (x != NULL && key != x->key) {
-                if (key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
-                }
+        free(db->slots);
+        db->slots = malloc(slot_count * sizeof db->slots[0]);
+        db->slot_mask = slot_count - 1;
+        for (unsigned i = 0; i < slot_count; ++i) {
+                db->slots[i] = PDB_EMPTY_SLOT;
+        }
+        for (int i = 0; i < db->count; ++i) {
+                db->slots[pdb_find_slot(db, db->entries[i]->ssrc)] = i;
         }
-        return x;
 }
 
-static void pdb_insert_node(struct pdb *tree, pdb_node_t * z)
+/// removes slot content keeping the probe sequences of other entries intact
+static void pdb_delete_slot(struct pdb *db, unsigned hole)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        y = NULL;
-        x = tree->root;
-        while (x != NULL) {
-                y = x;
-                assert(z->key != x->key);
-                if (z->key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
+        unsigned i = hole;
+        while (1) {
+                i = (i + 1) & db->slot_mask;
+                if (db->slots[i] == PDB_EMPTY_SLOT) {
+                        break;
+                }
+                unsigned home = pdb_hash(db, db->entries[db->slots[i]]->ssrc);
+                // move the entry back if its home is not cyclically in (hole, i]
+                if (((i - home) & db->slot_mask) >= ((i - hole) & db->slot_mask)) {
+                        db->slots[hole] = db->slots[i];
+                        hole = i;
                 }
         }
-
-        z->parent = y;
-        if (y == NULL) {
-                tree->root = z;
-        } else if (z->key < y->key) {
-                y->left = z;
-        } else {
-                y->right = z;
-        }
-        tree->count++;
-        pdb_validate(tree);
+        db->slots[hole] = PDB_EMPTY_SLOT;
 }
 
-static pdb_node_t *pdb_delete_node(struct pdb *tree, pdb_node_t * z)
+static bool pdb_is_active(const struct pdb *db, int idx)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        if (z->left == NULL || z->right == NULL) {
-                y = z;
-        } else {
-                y = pdb_successor(z);
-        }
-
-        if (y->left != NULL) {
-                x = y->left;
-        } else {
-                x = y->right;
-        }
-
-        if (x != NULL) {
-                x->parent = y->parent;
-        }
+        return (db->active[idx / 64] & (1ULL << (idx % 64))) != 0;
+}
 
-        if (y->parent == NULL) {
-                tree->root = x;
-        } else if (y == y->parent->left) {
-                y->parent->left = x;
+static void pdb_set_active_idx(struct pdb *db, int idx, bool active)
+{
+        if (active) {
+                db->active[idx / 64] |= 1ULL << (idx % 64);
         } else {
-                y->parent->right = x;
+                db->active[idx / 64] &= ~(1ULL << (idx % 64));
         }
-
-        z->key = y->key;
-        z->data = y->data;
-
-        tree->count--;
-
-        pdb_validate(tree);
-        return y;
 }
 
 /*****************************************************************************/
 
 struct pdb *pdb_init(volatile int *delay_ms)
 {
-        struct pdb *db = malloc(sizeof(struct pdb));
+        struct pdb *db = calloc(1, sizeof(struct pdb));
         if (db != NULL) {
                 db->magic = PDB_MAGIC;
-                db->count = 0;
-                db->root = NULL;
                 db->delay_ms = delay_ms;
+                pdb_rehash(db, PDB_MIN_SLOTS);
         }
         return db;
 }
 
+void pdb_enable_nack(struct pdb *db)
+{
+        pdb_validate(db);
+        db->nack = true;
+}
+
 void pdb_destroy(struct pdb **db_p)
 {
         struct pdb *db = *db_p;
 
         pdb_validate(db);
-        if (db->root != NULL) {
-                pdb_iter_t it;
-                struct pdb_e *cp = pdb_iter_init(db, &it);
-                while (cp != NULL) {
-                        struct pdb_e *item = NULL;
-                        pdb_remove(db, cp->ssrc, &item);
-                        cp = pdb_iter_next(&it);
-                        pdb_destroy_item(item);
-                }
-                pdb_iter_done(&it);
+        while (db->count > 0) {
+                struct pdb_e *item = NULL;
+                pdb_remove(db, db->entries[db->count - 1]->ssrc, &item);
+                pdb_destroy_item(item);
         }
 
+        free(db->entries);
+        free(db->slots);
+        free(db->active);
         free(db);
         *db_p = NULL;
 }
 
-static struct pdb_e *pdb_create_item(uint32_t ssrc, volatile int *delay_ms)
+static struct pdb_e *pdb_create_item(uint32_t ssrc, volatile int *delay_ms, bool nack)
 {
         struct pdb_e *p = malloc(sizeof(struct pdb_e));
         if (p != NULL) {
@@ -291,7 +239,12 @@ static struct pdb_e *pdb_create_item(uint32_t ssrc, volatile int *delay_ms)
                 p->decoder_state_deleter = NULL;
                 p->pt = 255;
                 p->playout_buffer = pbuf_init(delay_ms);
+                if (nack && p->playout_buffer != NULL) {
+                        pbuf_enable_nack(p->playout_buffer);
+                }
                 p->tfrc_state = tfrc_init(p->creation_time);
+                memset(&p->cc, 0, sizeof p->cc);
+                p->idx = -1;
         }
         return p;
 }
@@ -301,30 +254,37 @@ int pdb_add(struct pdb *db, uint32_t ssrc)
         /* Add an item to the participant database, indexed by ssrc. */
         /* Returns 0 on success, 1 if the participant is already in  */
         /* the database, 2 for other failures.                       */
-        pdb_node_t *x;
         struct pdb_e *i;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
+        if (db->slots[pdb_find_slot(db, ssrc)] != PDB_EMPTY_SLOT) {
                 debug_msg("Item already exists - ssrc %x\n", ssrc);
                 return 1;
         }
 
-        i = pdb_create_item(ssrc, db->delay_ms);
+        i = pdb_create_item(ssrc, db->delay_ms, db->nack);
         if (i == NULL) {
                 debug_msg("Unable to create database entry - ssrc %x\n", ssrc);
                 return 2;
         }
 
-        x = (pdb_node_t *) malloc(sizeof(pdb_node_t));
-        x->key = ssrc;
-        x->data = i;
-        x->parent = NULL;
-        x->left = NULL;
-        x->right = NULL;
-        x->magic = BTREE_NODE_MAGIC;
-        pdb_insert_node(db, x);
+        if (db->count == db->alloc) {
+                const int old_words = (db->alloc + 63) / 64;
+                db->alloc = db->alloc == 0 ? 8 : 2 * db->alloc;
+                const int new_words = (db->alloc + 63) / 64;
+                db->entries = realloc(db->entries, db->alloc * sizeof db->entries[0]);
+                db->active = realloc(db->active, new_words * sizeof db->active[0]);
+                memset(db->active + old_words, 0, (new_words - old_words) * sizeof db->active[0]);
+        }
+        i->idx = db->count++;
+        db->entries[i->idx] = i;
+        // keep load factor <= 1/2
+        if ((unsigned) db->count * 2 > db->slot_mask + 1) {
+                pdb_rehash(db, 2 * (db->slot_mask + 1));
+        } else {
+                db->slots[pdb_find_slot(db, ssrc)] = i->idx;
+        }
+        pdb_validate(db);
         debug_msg("Added participant %x\n", ssrc);
         return 0;
 }
@@ -333,37 +293,37 @@ struct pdb_e *pdb_get(struct pdb *db, uint32_t ssrc)
 {
         /* Return a pointer to the item indexed by ssrc, or NULL if   */
         /* the item is not present in the database.                   */
-        pdb_node_t *x;
-
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
-                return x->data;
-        }
-        return NULL;
+        const int idx = db->slots[pdb_find_slot(db, ssrc)];
+        return idx == PDB_EMPTY_SLOT ? NULL : db->entries[idx];
 }
 
 int pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item)
 {
         /* Remove the item indexed by ssrc. Return zero on success.   */
-        pdb_node_t *x;
-
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x == NULL) {
-                debug_msg("Item not on tree - ssrc %ul\n", ssrc);
+        const unsigned slot = pdb_find_slot(db, ssrc);
+        if (db->slots[slot] == PDB_EMPTY_SLOT) {
+                debug_msg("Item not in database - ssrc %ul\n", ssrc);
                 *item = NULL;
                 return 1;
         }
 
-        /* Note value that gets freed is not necessarily the the same as node
-         * that gets removed from tree since there is an optimization to avoid
-         * pointer updates in tree which means sometimes we just copy key and
-         * data from one node to another.  
-         */
-        *item = x->data;
-        x = pdb_delete_node(db, x);
-        free(x);
+        const int idx = db->slots[slot];
+        *item = db->entries[idx];
+        pdb_delete_slot(db, slot);
+        // move the last entry to the freed place
+        const int last = --db->count;
+        pdb_set_active_idx(db, idx, pdb_is_active(db, last));
+        pdb_set_active_idx(db, last, false);
+        if (idx != last) {
+                struct pdb_e *moved = db->entries[last];
+                db->entries[idx] = moved;
+                moved->idx = idx;
+                db->slots[pdb_find_slot(db, moved->ssrc)] = idx;
+        }
+        (*item)->idx = -1;
+        pdb_validate(db);
         return 0;
 }
 
@@ -386,31 +346,53 @@ void pdb_destroy_item(struct pdb_e *item)
         }
 }
 
+void pdb_set_active(struct pdb *db, struct pdb_e *item, bool active)
+{
+        assert(item->idx >= 0 && item->idx < db->count);
+        pdb_set_active_idx(db, item->idx, active);
+}
+
 /* 
  * Iterator functions 
  */
 
-struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
+static struct pdb_e *pdb_iter_find(pdb_iter_t *it)
 {
-        if (db->root == NULL) {
-                return NULL;    /* The database is empty */
+        struct pdb *db = it->db;
+        if (!it->active_only) {
+                return it->idx < db->count ? db->entries[it->idx] : NULL;
         }
-        *it = (pdb_node_t *) pdb_min(db->root);
-        return ((pdb_node_t *) *it)->data;
+        while (it->idx < db->count) {
+                const uint64_t word = db->active[it->idx / 64] >> (it->idx % 64);
+                if (word != 0) {
+                        it->idx += __builtin_ctzll(word);
+                        return db->entries[it->idx];
+                }
+                it->idx = (it->idx / 64 + 1) * 64; // next word
+        }
+        return NULL;
+}
+
+struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
+{
+        *it = (pdb_iter_t){ .db = db, .idx = 0, .active_only = false };
+        return pdb_iter_find(it);
+}
+
+struct pdb_e *pdb_iter_init_active(struct pdb *db, pdb_iter_t *it)
+{
+        *it = (pdb_iter_t){ .db = db, .idx = 0, .active_only = true };
+        return pdb_iter_find(it);
 }
 
 struct pdb_e *pdb_iter_next(pdb_iter_t *it)
 {
-        assert(*it != NULL);
-        *it = (pdb_node_t *)pdb_successor((pdb_node_t *)*it);
-        if (*it == NULL) {
-                return NULL;
-        }
-        return ((pdb_node_t *) *it)->data;
+        assert(it->db != NULL);
+        it->idx += 1;
+        return pdb_iter_find(it);
 }
 
 void pdb_iter_done(pdb_iter_t *it)
 {
-        *it = NULL;
+        it->db = NULL;
 }
-
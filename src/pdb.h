@@ -54,6 +54,10 @@
 
 #include "tv.h"
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -69,6 +73,24 @@ extern "C" {
  */
 typedef void (*decoder_state_deleter_t)(void *);
 
+/**
+ * Congestion-control statistics of a participant (see rtp/rate_control.h)
+ */
+struct pdb_cc {
+        /* receiver side - current measurement interval */
+        time_ns_t       interval_start;
+        uint64_t        rx_bytes;
+        uint32_t        rx_packets;
+        uint32_t        ext_max_seq;    ///< highest extended seq number seen
+        uint32_t        interval_base;  ///< ext_max_seq at interval start
+        int             seq_valid;
+        /* sender side - last feedback from this receiver */
+        unsigned        fb_count;       ///< incremented with each feedback
+        uint32_t        fb_rx_rate;     ///< [kbps]
+        double          fb_loss;        ///< lost packets fraction
+        uint32_t        rtt_us;         ///< from RTCP RR, 0 if unknown
+};
+
 struct pdb_e {
 	uint32_t		 ssrc;
 	char			*sdes_cname;
@@ -84,6 +106,8 @@ struct pdb_e {
 	struct pbuf		*playout_buffer;
 	struct tfrc		*tfrc_state;
 	time_ns_t		 creation_time;	/* Time this entry was created */
+	struct pdb_cc		 cc;
+	int			 idx;	///< index in the database (internal)
 };
 
 struct pdb;	/* The participant database */
@@ -94,6 +118,8 @@ struct pdb;	/* The participant database */
  */
 struct pdb          *pdb_init(volatile int *delay_ms);
 void                 pdb_destroy(struct pdb **db);
+/// playout buffers of participants added afterwards track packets to be NACKed
+void                 pdb_enable_nack(struct pdb *db);
 int                  pdb_add(struct pdb *db, uint32_t ssrc);
 struct pdb_e        *pdb_get(struct pdb *db, uint32_t ssrc);
 
@@ -103,11 +129,24 @@ struct pdb_e        *pdb_get(struct pdb *db, uint32_t ssrc);
 int                  pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item);
 void                 pdb_destroy_item(struct pdb_e *item);
 
-typedef void *pdb_iter_t;
+/**
+ * Marks participant as having data in the playout buffer (set after
+ * pbuf_insert(), cleared when the buffer becomes empty) so that the
+ * receiver needs to visit only those in pdb_iter_init_active().
+ */
+void                 pdb_set_active(struct pdb *db, struct pdb_e *item, bool active);
+
+typedef struct {
+        struct pdb *db;
+        int idx;
+        bool active_only;
+} pdb_iter_t;
 /*
- * Iterator for the database.
+ * Iterator for the database. Items must not be added or removed while iterating.
  */ 
 struct pdb_e        *pdb_iter_init(struct pdb *db, pdb_iter_t *it);
+/// iterates only over participants marked with pdb_set_active()
+struct pdb_e        *pdb_iter_init_active(struct pdb *db, pdb_iter_t *it);
 struct pdb_e        *pdb_iter_next(pdb_iter_t *it);
 void                 pdb_iter_done(pdb_iter_t *it);
 
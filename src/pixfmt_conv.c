@@ -59,11 +59,14 @@
 #include "config_win32.h"
 
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "color.h"
 #include "compat/qsort_s.h"
 #include "debug.h"
 #include "pixfmt_conv.h"
+#include "tv.h"
 #include "utils/macros.h" // to_fourcc, OPTIMEZED_FOR, CLAMP
 #include "video_codec.h"
 
@@ -2849,4 +2852,278 @@ decoder_t get_best_decoder_from(codec_t in, const codec_t *out_candidates, codec
         return get_decoder_from_to(in, *out);
 }
 
+/*
+ * Multi-step conversion planning
+ *
+ * The decoders[] table is considered a graph with pixel formats as nodes.
+ * Edge costs (ns per pixel) are measured by a micro-benchmark when the first
+ * plan is requested. A chain is admissible only if no intermediate format
+ * reduces bit depth or chroma resolution below both the input and the
+ * output and if it doesn't contain RGB<->YCbCr conversions beyond the one
+ * needed. Chains are executed chunk by chunk so that the intermediate data
+ * stays in L1 cache.
+ */
+enum {
+        PLAN_MAX_STEPS = 3,
+        PLAN_CHUNK_PX = 768, ///< multiple of the usual block sizes (2, 3, 6, 8, 16 px)
+        PLAN_BENCH_REPS = 8,
+};
+#define DECODERS_COUNT (sizeof decoders / sizeof decoders[0])
+
+struct pixfmt_conv_plan {
+        int steps;
+        decoder_t step[PLAN_MAX_STEPS];
+        codec_t codec[PLAN_MAX_STEPS + 1]; ///< codec[0] input, codec[steps] output
+        double cost; ///< ns per pixel
+};
+
+static struct {
+        pthread_mutex_t lock;
+        bool benchmarked;
+        double edge_cost[DECODERS_COUNT];
+        struct pixfmt_conv_plan *plans[VIDEO_CODEC_COUNT][VIDEO_CODEC_COUNT];
+        bool planned[VIDEO_CODEC_COUNT][VIDEO_CODEC_COUNT];
+} plan_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void benchmark_edges(void)
+{
+        unsigned char *src = malloc(vc_get_linesize(PLAN_CHUNK_PX, RG48) * 2 + MAX_PADDING);
+        unsigned char *dst = malloc(vc_get_linesize(PLAN_CHUNK_PX, RG48) * 2 + MAX_PADDING);
+        for (int i = 0; i < vc_get_linesize(PLAN_CHUNK_PX, RG48) * 2 + MAX_PADDING; ++i) {
+                src[i] = i * 37;
+        }
+        for (unsigned i = 0; i < DECODERS_COUNT; ++i) {
+                const int dst_len = vc_get_linesize(PLAN_CHUNK_PX, decoders[i].out);
+                time_ns_t best = INT64_MAX;
+                for (int rep = 0; rep < PLAN_BENCH_REPS; ++rep) {
+                        const time_ns_t t0 = get_time_in_ns();
+                        decoders[i].decoder(dst, src, dst_len, DEFAULT_R_SHIFT,
+                                            DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                        best = MIN(best, get_time_in_ns() - t0);
+                }
+                plan_cache.edge_cost[i] = (double) best / PLAN_CHUNK_PX;
+        }
+        free(src);
+        free(dst);
+}
+
+struct plan_search {
+        struct pixfmt_desc in, out;
+        int max_rgb_changes;
+        struct pixfmt_conv_plan cur;
+        struct pixfmt_conv_plan best;
+};
+
+static bool plan_node_admissible(const struct plan_search *ps, codec_t c, codec_t out)
+{
+        if (c == out) {
+                return true;
+        }
+        if (PLAN_CHUNK_PX % get_pf_block_pixels(c) != 0 ||
+            vc_get_linesize(PLAN_CHUNK_PX, c) > PLAN_CHUNK_PX * 16) {
+                return false;
+        }
+        const struct pixfmt_desc d = get_pixfmt_desc(c);
+        return d.depth >= MIN(ps->in.depth, ps->out.depth) &&
+               d.subsampling >= MIN(ps->in.subsampling, ps->out.subsampling);
+}
+
+static void plan_search_from(struct plan_search *ps, codec_t out, int rgb_changes)
+{
+        const codec_t node = ps->cur.codec[ps->cur.steps];
+        if (node == out) {
+                if (ps->cur.steps > 1 && (PLAN_CHUNK_PX % get_pf_block_pixels(ps->cur.codec[0]) != 0 ||
+                                          PLAN_CHUNK_PX % get_pf_block_pixels(out) != 0)) {
+                        return; // multi-step plans are executed in chunks
+                }
+                if (ps->best.steps == 0 || ps->cur.cost < ps->best.cost) {
+                        ps->best = ps->cur;
+                }
+                return;
+        }
+        if (ps->cur.steps == PLAN_MAX_STEPS) {
+                return;
+        }
+        for (unsigned i = 0; i < DECODERS_COUNT; ++i) {
+                if (decoders[i].in != node || decoders[i].out == node) {
+                        continue;
+                }
+                const codec_t next = decoders[i].out;
+                bool visited = false;
+                for (int j = 0; j <= ps->cur.steps; ++j) {
+                        visited = visited || ps->cur.codec[j] == next;
+                }
+                const int changes = rgb_changes + (codec_is_a_rgb(node) != codec_is_a_rgb(next));
+                if (visited || changes > ps->max_rgb_changes ||
+                    !plan_node_admissible(ps, next, out)) {
+                        continue;
+                }
+                ps->cur.step[ps->cur.steps] = decoders[i].decoder;
+                ps->cur.codec[++ps->cur.steps] = next;
+                ps->cur.cost += plan_cache.edge_cost[i];
+                plan_search_from(ps, out, changes);
+                ps->cur.cost -= plan_cache.edge_cost[i];
+                ps->cur.steps -= 1;
+        }
+}
+
+/**
+ * Returns the cheapest admissible conversion chain from in to out.
+ *
+ * Plans are cached for the lifetime of the process, the returned pointer
+ * must not be freed.
+ *
+ * @returns plan or NULL if there is none
+ */
+const struct pixfmt_conv_plan *get_pixfmt_conv_plan(codec_t in, codec_t out)
+{
+        if (in == out || get_pixfmt_desc(in).depth == 0 || get_pixfmt_desc(out).depth == 0) {
+                return NULL;
+        }
+        pthread_mutex_lock(&plan_cache.lock);
+        if (!plan_cache.planned[in][out]) {
+                if (!plan_cache.benchmarked) {
+                        benchmark_edges();
+                        plan_cache.benchmarked = true;
+                }
+                struct plan_search ps = { .in = get_pixfmt_desc(in), .out = get_pixfmt_desc(out) };
+                ps.max_rgb_changes = ps.in.rgb != ps.out.rgb;
+                ps.cur.codec[0] = in;
+                plan_search_from(&ps, out, 0);
+                if (ps.best.steps > 0) {
+                        plan_cache.plans[in][out] = malloc(sizeof ps.best);
+                        memcpy(plan_cache.plans[in][out], &ps.best, sizeof ps.best);
+                        if (ps.best.steps > 1) {
+                                char chain[STR_LEN] = "";
+                                for (int i = 0; i <= ps.best.steps; ++i) {
+                                        snprintf(chain + strlen(chain), sizeof chain - strlen(chain),
+                                                 "%s%s", i > 0 ? "->" : "", get_codec_name(ps.best.codec[i]));
+                                }
+                                log_msg(LOG_LEVEL_VERBOSE, "[pixfmt_conv] Conversion plan %s (%.2f ns/px)\n", chain, ps.best.cost);
+                        }
+                }
+                plan_cache.planned[in][out] = true;
+        }
+        const struct pixfmt_conv_plan *ret = plan_cache.plans[in][out];
+        pthread_mutex_unlock(&plan_cache.lock);
+        return ret;
+}
+
+/**
+ * @param candidates  ordered by quality (best_decoder_cmp())
+ * @param cost        conversion cost of each candidate, INFINITY if unknown
+ * @returns index of the cheapest candidate of the same quality as the first one
+ */
+size_t pixfmt_conv_select_cheapest(const codec_t *candidates, size_t count, const double *cost,
+                                   const struct pixfmt_desc *src_desc)
+{
+        size_t best = 0;
+        const struct pixfmt_desc desc_0 = get_pixfmt_desc(candidates[0]);
+        // best_decoder_cmp() orders also equal quality by codec, compare only the quality here
+        for (size_t i = 1; i < count; ++i) {
+                const struct pixfmt_desc desc_i = get_pixfmt_desc(candidates[i]);
+                if (compare_pixdesc(&desc_0, &desc_i, src_desc) != 0) {
+                        break;
+                }
+                if (cost[i] < cost[best]) {
+                        best = i;
+                }
+        }
+        return best;
+}
+
+/**
+ * Multi-step counterpart of get_best_decoder_from().
+ *
+ * Candidates are ordered by quality as in get_best_decoder_from(), from
+ * the equally good ones the one with the cheapest plan is chosen.
+ *
+ * @param[out] out  selected codec
+ * @param[out] plan selected plan if the conversion needs more than one step,
+ *                  NULL otherwise
+ * @returns decoder for a single-step conversion, NULL if multi-step plan was
+ * selected or there is no conversion at all (then *plan is NULL as well)
+ */
+decoder_t get_best_conv_plan_from(codec_t in, const codec_t *out_candidates, codec_t *out,
+                                  const struct pixfmt_conv_plan **plan)
+{
+        *plan = NULL;
+        if (codec_is_in_set(in, out_candidates) && (in != RGBA && in != RGB)) {
+                *out = in;
+                return vc_memcpy;
+        }
+
+        codec_t candidates[VIDEO_CODEC_END];
+        const codec_t *it = out_candidates;
+        size_t count = 0;
+        for ( ; *it != VIDEO_CODEC_NONE; it++) {
+                if (get_decoder_from_to(in, *it) || get_pixfmt_conv_plan(in, *it)) {
+                        assert(count < VIDEO_CODEC_END && "Too much codecs, some used multiple times!");
+                        candidates[count++] = *it;
+                }
+        }
+        if (count == 0) {
+                return NULL;
+        }
+        struct pixfmt_desc src_desc = get_pixfmt_desc(in);
+        qsort_s(candidates, count, sizeof(codec_t), best_decoder_cmp, &src_desc);
+
+        double cost[VIDEO_CODEC_END];
+        for (size_t i = 0; i < count; ++i) {
+                const struct pixfmt_conv_plan *p = get_pixfmt_conv_plan(in, candidates[i]);
+                cost[i] = p != NULL ? p->cost : INFINITY;
+        }
+        const size_t best = pixfmt_conv_select_cheapest(candidates, count, cost, &src_desc);
+        const struct pixfmt_conv_plan *best_plan = get_pixfmt_conv_plan(in, candidates[best]);
+        *out = candidates[best];
+        if (best_plan == NULL || best_plan->steps == 1) {
+                return get_decoder_from_to(in, *out);
+        }
+        *plan = best_plan;
+        return NULL;
+}
+
+/**
+ * Converts a line (or its part, as determined by dst_len) according to plan.
+ *
+ * Shifts are applied only in the last step, intermediate formats use the
+ * default ones.
+ */
+void pixfmt_conv_plan_run(const struct pixfmt_conv_plan *plan, unsigned char *dst,
+                          const unsigned char *src, int dst_len, int rshift,
+                          int gshift, int bshift)
+{
+        if (plan->steps == 1) {
+                plan->step[0](dst, src, dst_len, rshift, gshift, bshift);
+                return;
+        }
+        // + MAX_PADDING - decoders may overwrite up to a block past dst_len
+        unsigned char buf[2][PLAN_CHUNK_PX * 16 + MAX_PADDING];
+        const codec_t out = plan->codec[plan->steps];
+        const int out_block_bytes = get_pf_block_bytes(out);
+        const int out_block_px = get_pf_block_pixels(out);
+        const int px_total = (dst_len + out_block_bytes - 1) / out_block_bytes * out_block_px;
+        const int src_chunk_len = vc_get_linesize(PLAN_CHUNK_PX, plan->codec[0]);
+        const int dst_chunk_len = vc_get_linesize(PLAN_CHUNK_PX, out);
+
+        for (int px = 0; px < px_total; px += PLAN_CHUNK_PX) {
+                const int chunk_px = MIN(PLAN_CHUNK_PX, px_total - px);
+                const unsigned char *in = src;
+                for (int i = 0; i < plan->steps; ++i) {
+                        const bool last = i == plan->steps - 1;
+                        unsigned char *step_dst = last ? dst : buf[i % 2];
+                        const int len = last ? MIN(dst_chunk_len, dst_len)
+                                             : vc_get_linesize(chunk_px, plan->codec[i + 1]);
+                        plan->step[i](step_dst, in, len,
+                                      last ? rshift : DEFAULT_R_SHIFT,
+                                      last ? gshift : DEFAULT_G_SHIFT,
+                                      last ? bshift : DEFAULT_B_SHIFT);
+                        in = step_dst;
+                }
+                src += src_chunk_len;
+                dst += dst_chunk_len;
+                dst_len -= dst_chunk_len;
+        }
+}
+
 /* vim: set expandtab sw=8: */
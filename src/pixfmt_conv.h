@@ -57,6 +57,7 @@
 
 #ifndef __cplusplus
 #include <stdbool.h>
+#include <stddef.h>
 #endif // !defined __cplusplus
 
 #ifdef _MSC_VER
@@ -98,6 +99,17 @@ typedef decoder_func_t *decoder_t;
 decoder_t        get_decoder_from_to(codec_t in, codec_t out) __attribute__((const));
 decoder_t        get_best_decoder_from(codec_t in, const codec_t *out_candidates, codec_t *out);
 
+/// chain of decoders converting in several steps (see get_best_conv_plan_from())
+struct pixfmt_conv_plan;
+const struct pixfmt_conv_plan *get_pixfmt_conv_plan(codec_t in, codec_t out);
+size_t           pixfmt_conv_select_cheapest(const codec_t *candidates, size_t count, const double *cost,
+                                             const struct pixfmt_desc *src_desc);
+decoder_t        get_best_conv_plan_from(codec_t in, const codec_t *out_candidates, codec_t *out,
+                                         const struct pixfmt_conv_plan **plan);
+void             pixfmt_conv_plan_run(const struct pixfmt_conv_plan *plan, unsigned char *dst,
+                                      const unsigned char *src, int dst_len, int rshift,
+                                      int gshift, int bshift);
+
 decoder_func_t vc_copylineRGBA;
 decoder_func_t vc_copylineToRGBA_inplace;
 decoder_func_t vc_copylineABGRtoRGB;
@@ -50,6 +50,9 @@
 
 #include <pthread.h>
 #include <stdalign.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
 #include "debug.h"
 #include "host.h"
@@ -58,8 +61,10 @@
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
 #include "rtp.h"
+#include "udp_impair.h"
 #include "utils/list.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/net.h"
 #include "utils/thread.h"
@@ -159,6 +164,8 @@ struct socket_udp_local {
 
         bool should_exit;
         fd_t should_exit_fd[2];
+
+        struct udp_impair *impair; ///< testing impairment of sent packets, usually NULL
 };
 
 /*
@@ -898,6 +905,13 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 pthread_create(&s->local->thread_id, NULL, udp_reader, s);
         }
 
+        if (get_commandline_param("udp-impair") != NULL) {
+                s->local->impair = udp_impair_init(get_commandline_param("udp-impair"));
+                if (s->local->impair == NULL) {
+                        goto error;
+                }
+        }
+
         return s;
 
 error:
@@ -992,6 +1006,7 @@ void udp_exit(socket_udp * s)
                         }
                         platform_pipe_close(s->local->should_exit_fd[1]);
                 }
+                udp_impair_done(s->local->impair); // before closing tx_fd
                 CLOSESOCKET(s->local->rx_fd);
                 if (s->local->tx_fd != s->local->rx_fd) {
                         CLOSESOCKET(s->local->tx_fd);
@@ -1024,12 +1039,20 @@ int udp_send(socket_udp * s, char *buffer, int buflen)
         assert(buffer != NULL);
         assert(buflen > 0);
 
+        if (s->local->impair != NULL) {
+                return udp_impair_sendto(s->local->impair, s->local->tx_fd, buffer, buflen,
+                                         (struct sockaddr *) &s->sock, s->sock_len);
+        }
         return sendto(s->local->tx_fd, buffer, buflen, 0, (struct sockaddr *)&s->sock,
                       s->sock_len);
 }
 
 int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen)
 {
+        if (s->local->impair != NULL) {
+                return udp_impair_sendto(s->local->impair, s->local->tx_fd, buffer, buflen,
+                                         dst_addr, addrlen);
+        }
         return sendto(s->local->tx_fd, buffer, buflen, 0, dst_addr, addrlen);
 }
 
@@ -1063,6 +1086,19 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 
         assert(s != NULL);
 
+        if (s->local->impair != NULL) {
+                char buf[RTP_MAX_PACKET_LEN];
+                int len = 0;
+                for (int i = 0; i < count; ++i) {
+                        assert(len + vector[i].iov_len <= sizeof buf);
+                        memcpy(buf + len, vector[i].iov_base, vector[i].iov_len);
+                        len += vector[i].iov_len;
+                }
+                free(d);
+                return udp_impair_sendto(s->local->impair, s->local->tx_fd, buf, len,
+                                         (struct sockaddr *) &s->sock, s->sock_len);
+        }
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -1121,6 +1157,9 @@ static void *udp_reader(void *arg)
                 }
 
                 pthread_mutex_lock(&s->local->lock);
+                if (simple_linked_list_size(s->local->packets) >= (int) s->local->max_packets) {
+                        metric_add(METRIC_UDP_RX_QUEUE_FULL, 1);
+                }
                 while (simple_linked_list_size(s->local->packets) >= (int) s->local->max_packets && !s->local->should_exit) {
                         pthread_cond_wait(&s->local->reader_cv, &s->local->lock);
                 }
@@ -1133,6 +1172,7 @@ static void *udp_reader(void *arg)
                 struct item *i = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
                 *i = (struct item){packet, size, src_addr, addrlen};
                 simple_linked_list_append(s->local->packets, i);
+                metric_set(METRIC_UDP_RX_QUEUE_DEPTH, simple_linked_list_size(s->local->packets));
 
                 pthread_mutex_unlock(&s->local->lock);
                 pthread_cond_signal(&s->local->boss_cv);
@@ -1487,6 +1527,36 @@ udp_set_send_buf(socket_udp *s, int size)
         return udp_set_buf(s, SO_SNDBUF, size);
 }
 
+/**
+ * Steers datagrams among sockets of the SO_REUSEPORT group of socket s by
+ * 32-bit big-endian word at ssrc_offset of UDP payload modulo shard count
+ * (socket index in the group is given by the order the sockets were bound).
+ *
+ * @retval false if not supported on the platform or failed
+ */
+bool
+udp_set_reuseport_steering(socket_udp *s, unsigned int shards, unsigned int ssrc_offset)
+{
+#if defined SO_ATTACH_REUSEPORT_CBPF
+        struct sock_filter code[] = {
+                { BPF_LD | BPF_W | BPF_ABS, 0, 0, ssrc_offset },
+                { BPF_ALU | BPF_MOD | BPF_K, 0, 0, shards },
+                { BPF_RET | BPF_A, 0, 0, 0 },
+        };
+        struct sock_fprog prog = { .len = sizeof code / sizeof code[0], .filter = code };
+        if (SETSOCKOPT(s->local->rx_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                       (sockopt_t) &prog, sizeof prog) != 0) {
+                socket_error("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+                return false;
+        }
+        return true;
+#else
+        UNUSED(s), UNUSED(shards), UNUSED(ssrc_offset);
+        log_msg(LOG_LEVEL_ERROR, "SO_REUSEPORT steering not supported on this platform!\n");
+        return false;
+#endif
+}
+
 /*
  * TODO: This should be definitely removed. We need to solve audio burst avoidance first.
  */
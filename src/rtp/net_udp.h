@@ -95,6 +95,7 @@ int         udp_fd_isset(socket_udp *s);
 int         udp_get_recv_buf(socket_udp *s);
 bool        udp_set_recv_buf(socket_udp *s, int size);
 bool        udp_set_send_buf(socket_udp *s, int size);
+bool        udp_set_reuseport_steering(socket_udp *s, unsigned int shards, unsigned int ssrc_offset);
 void        udp_flush_recv_buf(socket_udp *s);
 
 struct udp_fd_r {
@@ -58,8 +58,10 @@
 #include "config_win32.h"
 
 #include <inttypes.h>
+#include <math.h>
 
 #include "debug.h"
+#include "host.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/ptime.h"
@@ -67,6 +69,7 @@
 #include "tv.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
 
 #define PBUF_MAGIC	0xcafebabe
 
@@ -79,6 +82,22 @@ static_assert(DEFAULT_STATS_INTERVAL % STAT_INT_MIN_DIVISOR == 0,
                 "STATS_INTERVAL must be divisible by (sizeof(ull) * CHAR_BIT)");
 #define MOD_NAME "[Pbuf] "
 
+#define ADAPT_DEFAULT_MIN_MS 2
+#define ADAPT_DEFAULT_MAX_MS 200
+enum {
+        ADAPT_SMOOTHING      = 16, ///< RFC 3550-like gain (1/16) for jitter estimates
+        ADAPT_RELEASE        = 64, ///< slower gain used when the delay is decreasing
+        ADAPT_JITTER_MULT    = 4,  ///< safety margin in multiples of measured jitter
+};
+
+enum {
+        NACK_MAX_PENDING = 1024,       ///< max tracked missing packets
+        NACK_MAX_GAP     = 512,        ///< larger gaps are not requested (source restart, long outage)
+        NACK_MAX_RETRIES = 3,
+        NACK_REORDER_NS  = 2 * NS_IN_MS, ///< time to wait for a reordered packet before requesting it
+        NACK_MIN_RETRY_NS = 5 * NS_IN_MS,
+};
+
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
@@ -91,6 +110,38 @@ struct pbuf_node {
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+        time_ns_t last_pkt_time;   /* Arrival time of last packet in frame  */
+        bool late;                 /* Data arrived after frame was decoded  */
+};
+
+/// state of adaptive playout delay (enabled with "pbuf-adaptive" param)
+struct pbuf_adaptive {
+        bool enabled;
+        long long min_ns;
+        long long max_ns;
+        long long delay_ns;        ///< currently used playout delay
+        time_ns_t last_arrival;    ///< arrival of the first packet of previous frame
+        double mean_ifi_ns;        ///< smoothed inter-frame arrival interval
+        double jitter_ns;          ///< smoothed deviation from mean_ifi_ns
+        double completion_ns;      ///< smoothed time between first and last packet of a frame
+        long long late_frames;     ///< frames that received data after being decoded
+        long long late_pkts;
+};
+
+struct pbuf_nack_entry {
+        uint16_t seq;
+        int sent;                  ///< number of NACKs sent for the packet
+        time_ns_t detected;
+        time_ns_t last_sent;
+};
+
+/// missing packets to be requested by RTCP NACK (see pbuf_enable_nack())
+struct pbuf_nack {
+        bool enabled;
+        bool initialized;
+        uint16_t max_seq;          ///< highest sequence number seen
+        int count;
+        struct pbuf_nack_entry entries[NACK_MAX_PENDING]; ///< in ascending seq order
 };
 
 struct pbuf {
@@ -111,6 +162,9 @@ struct pbuf {
         int out_of_order_pkts;
         int max_out_of_order_dist;
         int dups; // duplicite packets
+
+        struct pbuf_adaptive adapt;
+        struct pbuf_nack *nack;
 };
 
 static void free_cdata(struct coded_data *head);
@@ -171,6 +225,83 @@ static void pbuf_validate(struct pbuf *playout_buf)
 #endif
 }
 
+ADD_TO_PARAM("pbuf-adaptive", "* pbuf-adaptive[=<min_ms>:<max_ms>]\n"
+                "  Adapt playout delay to measured arrival jitter and frame completion time,\n"
+                "  bounded by <min_ms> and <max_ms> (default " TOSTRING(ADAPT_DEFAULT_MIN_MS) ":" TOSTRING(ADAPT_DEFAULT_MAX_MS) ").\n");
+static void pbuf_adaptive_init(struct pbuf_adaptive *adapt, long long playout_delay_us)
+{
+        const char *cfg = get_commandline_param("pbuf-adaptive");
+        if (cfg == NULL) {
+                return;
+        }
+        long long min_ms = ADAPT_DEFAULT_MIN_MS;
+        long long max_ms = ADAPT_DEFAULT_MAX_MS;
+        if (strlen(cfg) > 0) {
+                char *endptr = NULL;
+                min_ms = strtoll(cfg, &endptr, 10);
+                if (*endptr == ':') {
+                        max_ms = strtoll(endptr + 1, &endptr, 10);
+                }
+                if (*endptr != '\0' || min_ms < 0 || max_ms < min_ms) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong pbuf-adaptive value \"%s\", using defaults!\n", cfg);
+                        min_ms = ADAPT_DEFAULT_MIN_MS;
+                        max_ms = ADAPT_DEFAULT_MAX_MS;
+                }
+        }
+        adapt->enabled = true;
+        adapt->min_ns = min_ms * NS_IN_MS;
+        adapt->max_ns = max_ms * NS_IN_MS;
+        adapt->delay_ns = MIN(MAX(playout_delay_us * US_IN_NS, adapt->min_ns), adapt->max_ns);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Adaptive playout delay enabled (%lld-%lld ms)\n", min_ms, max_ms);
+}
+
+/**
+ * Updates the adaptive playout delay with a new frame arrival and returns
+ * the delay (in ns) that should be used for the frame.
+ *
+ * The target is the smoothed frame completion time plus a multiple of the
+ * inter-frame arrival jitter. The delay grows immediately to the target but
+ * decays slowly to avoid oscillation.
+ */
+static long long pbuf_adaptive_new_frame(struct pbuf_adaptive *adapt, time_ns_t arrival)
+{
+        if (adapt->last_arrival != 0) {
+                double ifi = arrival - adapt->last_arrival;
+                if (adapt->mean_ifi_ns == 0.0) {
+                        adapt->mean_ifi_ns = ifi;
+                }
+                adapt->jitter_ns += (fabs(ifi - adapt->mean_ifi_ns) - adapt->jitter_ns) / ADAPT_SMOOTHING;
+                adapt->mean_ifi_ns += (ifi - adapt->mean_ifi_ns) / ADAPT_SMOOTHING;
+        }
+        adapt->last_arrival = arrival;
+
+        long long target = adapt->completion_ns + ADAPT_JITTER_MULT * adapt->jitter_ns;
+        if (target > adapt->delay_ns) {
+                adapt->delay_ns = target;
+        } else {
+                adapt->delay_ns -= (adapt->delay_ns - target) / ADAPT_RELEASE;
+        }
+        adapt->delay_ns = MIN(MAX(adapt->delay_ns, adapt->min_ns), adapt->max_ns);
+        return adapt->delay_ns;
+}
+
+/**
+ * Called when data for an already decoded frame arrive - the frame was
+ * played out too early so the delay is increased to cover it at once.
+ */
+static void pbuf_adaptive_late_pkt(struct pbuf_adaptive *adapt, struct pbuf_node *node, time_ns_t now)
+{
+        adapt->late_pkts += 1;
+        if (node->late) {
+                return;
+        }
+        node->late = true;
+        adapt->late_frames += 1;
+        if (adapt->enabled) {
+                adapt->delay_ns = MIN(MAX(adapt->delay_ns, now - node->arrival_time), adapt->max_ns);
+        }
+}
+
 struct pbuf *pbuf_init(volatile int *delay_ms)
 {
         struct pbuf *playout_buf = NULL;
@@ -186,6 +317,7 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_report_seq = -1;
                 playout_buf->stats_interval = DEFAULT_STATS_INTERVAL;
+                pbuf_adaptive_init(&playout_buf->adapt, playout_buf->playout_delay_us);
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
@@ -224,6 +356,7 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                         free(curr);
                         curr = temp;
                 }
+                free(playout_buf->nack);
                 free(playout_buf);
         }
 }
@@ -248,6 +381,7 @@ static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
         tmp->seqno = pkt->seq;
         tmp->data = pkt;
         node->mbit |= pkt->m;
+        node->last_pkt_time = get_time_in_ns();
         if((int16_t)(tmp->seqno - node->cdata->seqno) > 0){
                 tmp->prv = NULL;
                 tmp->nxt = node->cdata;
@@ -277,7 +411,7 @@ static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
         }
 }
 
-static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
+static struct pbuf_node *create_new_pnode(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         struct pbuf_node *tmp = calloc(1, sizeof(struct pbuf_node));
         if (tmp != NULL) {
@@ -285,9 +419,14 @@ static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_de
                 tmp->rtp_timestamp = pkt->ts;
                 tmp->mbit = pkt->m;
                 tmp->playout_time =
+                        tmp->last_pkt_time =
                         tmp->arrival_time = get_time_in_ns();
-                tmp->playout_time += playout_delay_us * 1000;
-                tmp->deletion_time = tmp->playout_time + playout_delay_us * 1000;
+                long long playout_delay_ns = playout_buf->adapt.enabled
+                        ? pbuf_adaptive_new_frame(&playout_buf->adapt, tmp->arrival_time)
+                        : playout_buf->playout_delay_us * US_IN_NS;
+                long long offset_ns = playout_buf->offset_ms ? *playout_buf->offset_ms * NS_IN_MS : 0;
+                tmp->playout_time += playout_delay_ns + offset_ns;
+                tmp->deletion_time = tmp->playout_time + playout_delay_ns + offset_ns;
 
                 tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
                 if (tmp->cdata != NULL) {
@@ -369,6 +508,7 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         if (dist >= playout_buf->stats_interval * 2 && dist < 1U<<15U) {
                 uint16_t report_seq_until = (uint16_t) ((pkt->seq / playout_buf->stats_interval * playout_buf->stats_interval) - playout_buf->stats_interval); // sum up only up to current-playout_buf->stats_interval to be able to catch out-of-order packets
                 int accumulated_loss = 0;
+                const int lost_before = playout_buf->expected_pkts - playout_buf->received_pkts;
                 for (uint16_t i = playout_buf->last_report_seq;
                                 i != report_seq_until; i += NUMBER_WORD_BITS) {
                         playout_buf->expected_pkts += NUMBER_WORD_BITS;
@@ -377,6 +517,7 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                         playout_buf->packets[i / NUMBER_WORD_BITS] = 0;
                 }
 
+                metric_add(METRIC_RTP_LOST_PACKETS, playout_buf->expected_pkts - playout_buf->received_pkts - lost_before);
                 playout_buf->received_pkts_cum += playout_buf->received_pkts;
                 playout_buf->expected_pkts_cum += playout_buf->expected_pkts;
 
@@ -397,6 +538,10 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 if (playout_buf->dups > 0) {
                         snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", %d dups", playout_buf->dups);
                 }
+                if (playout_buf->adapt.enabled) {
+                        snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", playout delay %.2f ms (%lld late frames)",
+                                        playout_buf->adapt.delay_ns / NS_IN_MS_DBL, playout_buf->adapt.late_frames);
+                }
                 log_msg(LOG_LEVEL_INFO, "SSRC 0x%08" PRIx32 ": %d/%d packets received (%s%.4f%%" TERM_FG_RESET "), %d lost, max loss %d%s\n",
                                 pkt->ssrc, playout_buf->received_pkts, playout_buf->expected_pkts, (loss_pct < 100.0 ? TERM_FG_RED : ""), loss_pct,
                                 playout_buf->expected_pkts - playout_buf->received_pkts, playout_buf->longest_gap, oo_dups_str);
@@ -417,16 +562,62 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         }
 }
 
+static void pbuf_nack_remove(struct pbuf_nack *nack, int idx)
+{
+        memmove(&nack->entries[idx], &nack->entries[idx + 1],
+                        (nack->count - idx - 1) * sizeof nack->entries[0]);
+        nack->count -= 1;
+}
+
+/**
+ * Tracks sequence number gaps. Packets skipped by an arriving packet are
+ * recorded as missing, a late (reordered or retransmitted) packet removes
+ * its record.
+ */
+static void pbuf_nack_update(struct pbuf_nack *nack, uint16_t seq)
+{
+        if (!nack->initialized) {
+                nack->initialized = true;
+                nack->max_seq = seq;
+                return;
+        }
+        int16_t dist = (int16_t) (seq - nack->max_seq);
+        if (dist <= 0) {
+                for (int i = nack->count - 1; i >= 0; --i) {
+                        if (nack->entries[i].seq == seq) {
+                                pbuf_nack_remove(nack, i);
+                                break;
+                        }
+                }
+                return;
+        }
+        if (dist - 1 > NACK_MAX_GAP) {
+                nack->count = 0;
+        } else {
+                time_ns_t now = get_time_in_ns();
+                for (uint16_t missing = nack->max_seq + 1; missing != seq; ++missing) {
+                        if (nack->count == NACK_MAX_PENDING) { // drop the oldest
+                                pbuf_nack_remove(nack, 0);
+                        }
+                        nack->entries[nack->count++] = (struct pbuf_nack_entry) { .seq = missing, .detected = now };
+                }
+        }
+        nack->max_seq = seq;
+}
+
 void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         struct pbuf_node *tmp;
 
         pbuf_validate(playout_buf);
         pbuf_process_stats(playout_buf, pkt);
+        if (playout_buf->nack) {
+                pbuf_nack_update(playout_buf->nack, pkt->seq);
+        }
 
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                playout_buf->frst = create_new_pnode(playout_buf, pkt);
                 playout_buf->last = playout_buf->frst;
                 return;
         }
@@ -434,6 +625,7 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
         if (playout_buf->last->rtp_timestamp == pkt->ts) {
                 if (playout_buf->last->decoded) {
                         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Late data for already decoded frame!\n");
+                        pbuf_adaptive_late_pkt(&playout_buf->adapt, playout_buf->last, get_time_in_ns());
                 }
                 /* Packet belongs to last frame in playout_buf this is the */
                 /* most likely scenario - although...                      */
@@ -443,7 +635,7 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                     playout_buf->last->rtp_timestamp - pkt->ts >
                         UINT32_MAX - WRAPAROUND_THRESHOLD) {
                         /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        tmp = create_new_pnode(playout_buf, pkt);
                         playout_buf->last->nxt = tmp;
                         playout_buf->last->completed = true;
                         tmp->prv = playout_buf->last;
@@ -465,6 +657,9 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                 }
                                 if (curr->rtp_timestamp == pkt->ts) {
                                         /* Packet belongs to a previous existing frame... */
+                                        if (curr->decoded) {
+                                                pbuf_adaptive_late_pkt(&playout_buf->adapt, curr, get_time_in_ns());
+                                        }
                                         add_coded_unit(curr, pkt);
                                 } else {
                                         /* Packet belongs to a frame that is not present */
@@ -575,8 +770,10 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                                 && curr_time > curr->playout_time
                    ) {
                         if (frame_complete(curr)) {
-                                struct pbuf_stats stats = { playout_buf->received_pkts_cum,
-                                        playout_buf->expected_pkts_cum };
+                                struct pbuf_adaptive *adapt = &playout_buf->adapt;
+                                adapt->completion_ns += (curr->last_pkt_time - curr->arrival_time - adapt->completion_ns) / ADAPT_SMOOTHING;
+                                struct pbuf_stats stats;
+                                pbuf_get_stats(playout_buf, &stats);
                                 int ret = decode_func(curr->cdata, data, &stats);
                                 curr->decoded = 1;
                                 return ret;
@@ -594,8 +791,79 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         return 0;
 }
 
+/**
+ * Sets the playout delay. If adaptive playout is enabled, the value is used
+ * just as a new starting point for the adaptation.
+ */
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
+        if (playout_buf->adapt.enabled) {
+                playout_buf->adapt.delay_ns = MIN(MAX(playout_buf->playout_delay_us * US_IN_NS,
+                                        playout_buf->adapt.min_ns), playout_buf->adapt.max_ns);
+        }
+}
+
+/**
+ * Starts tracking missing packets for pbuf_get_nacks(). Intended for video
+ * only - audio is not retransmitted.
+ */
+void pbuf_enable_nack(struct pbuf *playout_buf)
+{
+        if (playout_buf->nack == NULL) {
+                playout_buf->nack = calloc(1, sizeof *playout_buf->nack);
+        }
+}
+
+/**
+ * Returns missing packets that should be requested by NACK now.
+ *
+ * A packet is requested after it hasn't arrived for NACK_REORDER_NS, the request
+ * is repeated up to NACK_MAX_RETRIES times while the retransmission could still
+ * make it before the playout deadline (estimated from the time of detection).
+ *
+ * @param[out] seqs sequence numbers in ascending order
+ * @returns         number of sequence numbers stored in seqs (at most max)
+ */
+int pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time, uint16_t *seqs, int max)
+{
+        struct pbuf_nack *nack = playout_buf->nack;
+        if (nack == NULL) {
+                return 0;
+        }
+        long long delay_ns = (playout_buf->adapt.enabled
+                        ? playout_buf->adapt.delay_ns
+                        : playout_buf->playout_delay_us * US_IN_NS)
+                + (playout_buf->offset_ms ? *playout_buf->offset_ms * NS_IN_MS : 0);
+        long long retry_ns = MAX(delay_ns / (NACK_MAX_RETRIES + 1), NACK_MIN_RETRY_NS);
+
+        int ret = 0;
+        for (int i = 0; i < nack->count; ) {
+                struct pbuf_nack_entry *e = &nack->entries[i];
+                if (e->sent >= NACK_MAX_RETRIES || curr_time > e->detected + delay_ns) {
+                        pbuf_nack_remove(nack, i);
+                        continue;
+                }
+                if (ret < max && curr_time - e->detected >= NACK_REORDER_NS &&
+                                (e->sent == 0 || curr_time - e->last_sent >= retry_ns)) {
+                        e->sent += 1;
+                        e->last_sent = curr_time;
+                        seqs[ret++] = e->seq;
+                }
+                i += 1;
+        }
+        return ret;
+}
+
+void pbuf_get_stats(struct pbuf *playout_buf, struct pbuf_stats *stats)
+{
+        stats->received_pkts_cum = playout_buf->received_pkts_cum;
+        stats->expected_pkts_cum = playout_buf->expected_pkts_cum;
+        stats->playout_delay_us = playout_buf->adapt.enabled
+                ? playout_buf->adapt.delay_ns / US_IN_NS
+                : playout_buf->playout_delay_us;
+        stats->jitter_us = playout_buf->adapt.jitter_ns / US_IN_NS;
+        stats->late_frames = playout_buf->adapt.late_frames;
+        stats->late_pkts = playout_buf->adapt.late_pkts;
 }
 
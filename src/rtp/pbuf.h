@@ -78,6 +78,10 @@ struct coded_data {
 struct pbuf_stats {
         long long int received_pkts_cum;
         long long int expected_pkts_cum;
+        long long int playout_delay_us; ///< current (possibly adaptive) playout delay
+        long long int jitter_us;        ///< measured inter-frame arrival jitter
+        long long int late_frames;      ///< frames that received data after being decoded
+        long long int late_pkts;
 };
 
 /* The playout buffer */
@@ -121,6 +125,10 @@ int 	 	 pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
 void		 pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
+void		 pbuf_get_stats(struct pbuf *playout_buf, struct pbuf_stats *stats);
+void		 pbuf_enable_nack(struct pbuf *playout_buf);
+int		 pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time,
+                                uint16_t *seqs, int max);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,268 @@
+/**
+ * @file   rtp/rate_control.c
+ * @brief  Sender rate control driven by receiver feedback
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "host.h"
+#include "pdb.h"
+#include "rtp/rate_control.h"
+#include "utils/macros.h"
+#include "utils/misc.h" // unit_evaluate
+
+#define MOD_NAME "[rate_ctl] "
+
+enum {
+        FEEDBACK_INTERVAL_NS = 200 * NS_IN_MS,
+        FEEDBACK_WORDS = 3, ///< rx rate [kbps], lost, expected
+};
+
+#define LOSS_DECREASE 0.10      ///< loss above which rate is decreased
+#define LOSS_INCREASE 0.02      ///< loss below which rate may be increased
+#define RATE_INCREASE 1.05      ///< per feedback interval
+#define RTT_QUEUE_DECREASE 0.85 ///< decrease on growing RTT (queue build-up)
+#define RTT_QUEUE_MIN_US 50000
+#define APPLY_THRESHOLD 0.05    ///< relative change needed to retarget
+
+/// last feedback summary of one participant database (RX shard)
+struct rate_ctl_source {
+        const struct pdb *participants;
+        unsigned fb_seen;       ///< sum of pdb_cc.fb_count processed
+        double loss;
+        uint32_t rtt_us;
+        uint32_t rx_rate;
+};
+
+struct rate_ctl {
+        double min_rate;
+        double max_rate;
+        double rate;            ///< current target [bps]
+        double applied;         ///< last rate returned to caller
+        uint32_t min_rtt_us;
+        struct rate_ctl_source *sources;
+        int source_count;
+};
+
+void rate_ctl_rx_packet(struct pdb_e *e, uint16_t seq, unsigned len)
+{
+        struct pdb_cc *cc = &e->cc;
+        if (!cc->seq_valid) {
+                cc->ext_max_seq = seq;
+                cc->interval_base = seq - 1U;
+                cc->seq_valid = 1;
+        } else {
+                const int16_t diff = (int16_t) (seq - (uint16_t) cc->ext_max_seq);
+                if (diff > 0) {
+                        cc->ext_max_seq += diff;
+                }
+        }
+        cc->rx_packets += 1;
+        cc->rx_bytes += len;
+}
+
+void rate_ctl_send_feedback(struct rtp *session, struct pdb_e *e, time_ns_t curr_time)
+{
+        struct pdb_cc *cc = &e->cc;
+        if (cc->interval_start == 0) {
+                cc->interval_start = curr_time;
+                return;
+        }
+        const time_ns_t elapsed = curr_time - cc->interval_start;
+        if (elapsed < FEEDBACK_INTERVAL_NS) {
+                return;
+        }
+        const uint32_t expected = cc->ext_max_seq - cc->interval_base;
+        if (cc->seq_valid && expected > 0) {
+                const uint32_t lost = expected > cc->rx_packets ? expected - cc->rx_packets : 0;
+                uint32_t data[FEEDBACK_WORDS] = {
+                        htonl((uint32_t) (cc->rx_bytes * 8 * US_IN_SEC / elapsed)),
+                        htonl(lost),
+                        htonl(expected),
+                };
+                rtp_send_app(session, RATE_CTL_APP_NAME, data, sizeof data);
+        }
+        cc->interval_base = cc->ext_max_seq;
+        cc->rx_packets = 0;
+        cc->rx_bytes = 0;
+        cc->interval_start = curr_time;
+}
+
+void rate_ctl_process_app(struct pdb_e *e, const rtcp_app *app)
+{
+        if (app->length != 2 + FEEDBACK_WORDS) {
+                debug_msg(MOD_NAME "Wrong feedback length %d\n", app->length);
+                return;
+        }
+        uint32_t data[FEEDBACK_WORDS];
+        memcpy(data, app->data, sizeof data);
+        const uint32_t lost = ntohl(data[1]);
+        const uint32_t expected = ntohl(data[2]);
+        e->cc.fb_rx_rate = ntohl(data[0]);
+        e->cc.fb_loss = expected > 0 ? (double) lost / expected : 0.0;
+        e->cc.fb_count += 1;
+}
+
+ADD_TO_PARAM("rate-control", "* rate-control=<min>:<max>[:<start>]\n"
+                "  Adapt video compression bitrate and pacing to receiver-reported loss\n"
+                "  and RTT within <min>..<max> bps (start at <start>, default <max>).\n");
+struct rate_ctl *rate_ctl_init(void)
+{
+        const char *cfg = get_commandline_param("rate-control");
+        if (cfg == NULL) {
+                return NULL;
+        }
+        const char *endptr = NULL;
+        const long long min_rate = unit_evaluate(cfg, &endptr);
+        long long max_rate = 0;
+        long long start_rate = 0;
+        if (*endptr == ':') {
+                max_rate = unit_evaluate(endptr + 1, &endptr);
+        }
+        if (*endptr == ':') {
+                start_rate = unit_evaluate(endptr + 1, &endptr);
+        }
+        if (min_rate <= 0 || max_rate < min_rate || *endptr != '\0') {
+                MSG(ERROR, "Wrong rate-control config: %s\n", cfg);
+                return NULL;
+        }
+        struct rate_ctl *s = calloc(1, sizeof *s);
+        s->min_rate = (double) min_rate;
+        s->max_rate = (double) max_rate;
+        s->rate = start_rate > 0 ? CLAMP((double) start_rate, s->min_rate, s->max_rate)
+                                 : s->max_rate;
+        MSG(NOTICE, "Rate control enabled (%lld-%lld bps)\n", min_rate, max_rate);
+        return s;
+}
+
+void rate_ctl_done(struct rate_ctl *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        free(s->sources);
+        free(s);
+}
+
+static struct rate_ctl_source *get_source(struct rate_ctl *s, const struct pdb *participants)
+{
+        for (int i = 0; i < s->source_count; ++i) {
+                if (s->sources[i].participants == participants) {
+                        return &s->sources[i];
+                }
+        }
+        s->sources = realloc(s->sources, (s->source_count + 1) * sizeof s->sources[0]);
+        struct rate_ctl_source *src = &s->sources[s->source_count++];
+        *src = (struct rate_ctl_source){ .participants = participants };
+        return src;
+}
+
+bool rate_ctl_update(struct rate_ctl *s, struct pdb *participants,
+                     struct rate_ctl_stats *stats)
+{
+        unsigned fb_count = 0;
+        double loss = 0;
+        uint32_t rtt_us = 0;
+        uint32_t rx_rate = UINT32_MAX;
+
+        pdb_iter_t it;
+        for (struct pdb_e *e = pdb_iter_init(participants, &it); e != NULL;
+             e = pdb_iter_next(&it)) {
+                if (e->cc.fb_count == 0) {
+                        continue;
+                }
+                fb_count += e->cc.fb_count;
+                loss = MAX(loss, e->cc.fb_loss);
+                rtt_us = MAX(rtt_us, e->cc.rtt_us);
+                rx_rate = MIN(rx_rate, e->cc.fb_rx_rate);
+        }
+        pdb_iter_done(&it);
+
+        struct rate_ctl_source *src = get_source(s, participants);
+        if (fb_count == src->fb_seen) { // no new feedback
+                return false;
+        }
+        src->fb_seen = fb_count;
+        src->loss = loss;
+        src->rtt_us = rtt_us;
+        src->rx_rate = rx_rate;
+
+        // the worst receiver of any source decides
+        for (int i = 0; i < s->source_count; ++i) {
+                if (s->sources[i].fb_seen == 0) {
+                        continue;
+                }
+                loss = MAX(loss, s->sources[i].loss);
+                rtt_us = MAX(rtt_us, s->sources[i].rtt_us);
+                rx_rate = MIN(rx_rate, s->sources[i].rx_rate);
+        }
+
+        if (rtt_us > 0 && (s->min_rtt_us == 0 || rtt_us < s->min_rtt_us)) {
+                s->min_rtt_us = rtt_us;
+        }
+        const bool queue_building = rtt_us > 2 * s->min_rtt_us &&
+                                    rtt_us - s->min_rtt_us > RTT_QUEUE_MIN_US;
+        const double rx_bps = (double) rx_rate * 1000;
+
+        if (loss > LOSS_DECREASE) {
+                s->rate *= 1 - 0.5 * loss;
+        } else if (queue_building) {
+                s->rate *= RTT_QUEUE_DECREASE;
+        } else if (loss < LOSS_INCREASE && s->rate < 2 * rx_bps) {
+                // do not probe further when the sender does not use the rate
+                s->rate *= RATE_INCREASE;
+        }
+        s->rate = CLAMP(s->rate, s->min_rate, s->max_rate);
+
+        if (s->applied != 0 &&
+            fabs(s->rate - s->applied) < APPLY_THRESHOLD * s->applied) {
+                return false;
+        }
+        s->applied = s->rate;
+        stats->bitrate = (long long) s->rate;
+        stats->loss = loss;
+        stats->rtt_us = rtt_us;
+        stats->rx_rate_kbps = rx_rate;
+        return true;
+}
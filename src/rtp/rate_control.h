@@ -0,0 +1,93 @@
+/**
+ * @file   rtp/rate_control.h
+ * @brief  Sender rate control driven by receiver feedback
+ *
+ * Receivers measure the receive rate and packet loss of each sender over
+ * short intervals and report them in an RTCP APP packet ("UGCC"). The
+ * sender combines it with the RTT from regular RTCP RRs and runs a
+ * loss-based controller (similar to GCC) whose output retargets the
+ * compression bitrate and the packet pacer.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_RATE_CONTROL_H_
+#define RTP_RATE_CONTROL_H_
+
+#include "rtp/rtp.h"
+#include "tv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pdb;
+struct pdb_e;
+
+#define RATE_CTL_APP_NAME "UGCC"
+
+/// receiver side - accounts received RTP packet
+void rate_ctl_rx_packet(struct pdb_e *e, uint16_t seq, unsigned len);
+/// receiver side - sends feedback to the sender e if the interval elapsed
+void rate_ctl_send_feedback(struct rtp *session, struct pdb_e *e, time_ns_t curr_time);
+/// sender side - stores feedback received from receiver e
+void rate_ctl_process_app(struct pdb_e *e, const rtcp_app *app);
+
+struct rate_ctl_stats {
+        long long bitrate;      ///< new target [bps]
+        double loss;            ///< worst reported loss fraction
+        uint32_t rtt_us;        ///< worst RTT, 0 if unknown
+        uint32_t rx_rate_kbps;  ///< lowest reported receive rate
+};
+
+struct rate_ctl;
+/**
+ * @returns controller state if requested by "rate-control" param, NULL otherwise
+ */
+struct rate_ctl *rate_ctl_init(void);
+void rate_ctl_done(struct rate_ctl *s);
+/**
+ * Processes feedback received from participants since the last call. With
+ * multiple participant databases (RX shards), each is passed by the thread
+ * owning it and the decision takes the last feedback of all of them into
+ * account. Calls must be serialized by the caller.
+ * @retval true  target bitrate has changed significantly, it is in stats
+ */
+bool rate_ctl_update(struct rate_ctl *s, struct pdb *participants,
+                     struct rate_ctl_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_RATE_CONTROL_H_
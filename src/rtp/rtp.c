@@ -77,6 +77,7 @@
 #endif // defined HAVE_CONFIG_H
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdatomic.h>
 
 #include "memory.h"
@@ -88,6 +89,7 @@
 #include "crypto/md5.h"
 #include "ntp.h"
 #include "rtp.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/net.h"
 #include "utils/random.h"
@@ -140,6 +142,9 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define RTCP_BYE  203
 #define RTCP_APP  204
 #define RTCP_RX   205
+#define RTCP_RTPFB 205 /* RFC 4585 transport layer feedback, shares PT with RX (TFRC sessions only) */
+
+#define RTCP_RTPFB_FMT_NACK 1 /* RFC 4585 generic NACK */
 
 typedef struct {
 #ifdef WORDS_BIGENDIAN
@@ -185,6 +190,14 @@ typedef struct {
                         uint8_t name[4];
                         uint8_t data[1];
                 } app;
+                struct {
+                        uint32_t ssrc;          /* sender of the feedback */
+                        uint32_t media_ssrc;    /* source the feedback is about */
+                        struct {
+                                uint16_t pid;   /* first lost packet */
+                                uint16_t blp;   /* bitmask of following lost packets */
+                        } fci[1];               /* variable-length list */
+                } nack;
         } r;
 } rtcp_t;
 
@@ -258,6 +271,30 @@ typedef struct {
         int send_back;
 } options;
 
+/*
+ * Retransmission buffer - copies of recently sent RTP packets indexed by
+ * sequence number, used to answer generic NACKs (RTP_OPT_NACK).
+ *
+ * Slots are preallocated. Packets are stored by the sender and resent by the
+ * thread receiving RTCP, each slot is guarded by a sequence lock so that the
+ * sender never blocks - the reader copies the slot and retries if the version
+ * changed meanwhile.
+ */
+struct rtx_slot {
+        atomic_uint version;    /* odd while being written */
+        atomic_int len;         /* 0 - empty */
+        atomic_ushort seq;
+};
+
+struct rtx_ring {
+        int size;
+        int slot_len;           /* max stored packet length */
+        struct rtx_slot *slots;
+        uint8_t *data;          /* size * slot_len */
+        uint8_t *scratch;       /* slot_len, used by the (single) resending thread */
+        atomic_uint_least64_t retransmitted;
+};
+
 /*
  * Encryption function types
  */
@@ -331,6 +368,8 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        struct rtx_ring *rtx;   /* retransmission buffer, NULL if NACK is disabled */
+        int rtx_packet_len;     /* slot length of rtx (RTP_OPT_NACK_PACKET_LEN) */
         uint32_t magic;         /* For debugging...  */
 };
 
@@ -975,6 +1014,7 @@ static void init_opt(struct rtp *session)
         rtp_set_option(session, RTP_OPT_REUSE_PACKET_BUFS, FALSE);
         rtp_set_option(session, RTP_OPT_RECORD_SOURCE, FALSE);
         rtp_set_option(session, RTP_OPT_SEND_BACK, FALSE);
+        rtp_set_option(session, RTP_OPT_NACK_PACKET_LEN, RTP_MAX_PACKET_LEN);
 }
 
 /* See rtp_init_if(); calling rtp_init() is just like calling
@@ -1295,6 +1335,94 @@ bool rtp_set_my_ssrc(struct rtp *session, uint32_t ssrc)
         return true;
 }
 
+static void rtx_ring_destroy(struct rtx_ring *ring)
+{
+        if (ring == NULL) {
+                return;
+        }
+        free(ring->slots);
+        free(ring->data);
+        free(ring->scratch);
+        free(ring);
+}
+
+static struct rtx_ring *rtx_ring_create(int size, int slot_len)
+{
+        struct rtx_ring *ring = calloc(1, sizeof *ring);
+        ring->slots = calloc(size, sizeof ring->slots[0]);
+        ring->data = malloc((size_t) size * slot_len);
+        ring->scratch = malloc(slot_len);
+        if (ring->slots == NULL || ring->data == NULL || ring->scratch == NULL) {
+                log_msg(LOG_LEVEL_ERROR, "Cannot allocate NACK buffer of %d packets!\n", size);
+                rtx_ring_destroy(ring);
+                return NULL;
+        }
+        ring->size = size;
+        ring->slot_len = slot_len;
+        return ring;
+}
+
+#ifdef WIN32
+#define IOV_BASE(v) ((v).buf)
+#define IOV_LEN(v) ((v).len)
+typedef WSABUF rtx_iov_t;
+#else
+#define IOV_BASE(v) ((v).iov_base)
+#define IOV_LEN(v) ((v).iov_len)
+typedef struct iovec rtx_iov_t;
+#endif
+
+/* Stores a copy of an outgoing packet for possible later retransmission. */
+static void rtx_ring_store(struct rtx_ring *ring, uint16_t seq, const rtx_iov_t *vector, int count)
+{
+        int len = 0;
+        for (int i = 0; i < count; ++i) {
+                len += IOV_LEN(vector[i]);
+        }
+
+        struct rtx_slot *slot = &ring->slots[seq % ring->size];
+        const unsigned version = atomic_load_explicit(&slot->version, memory_order_relaxed);
+        atomic_store_explicit(&slot->version, version + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        if (len > ring->slot_len) { // larger than announced MTU, cannot be resent
+                atomic_store_explicit(&slot->len, 0, memory_order_relaxed);
+        } else {
+                uint8_t *ptr = ring->data + (size_t) (seq % ring->size) * ring->slot_len;
+                for (int i = 0; i < count; ++i) {
+                        memcpy(ptr, IOV_BASE(vector[i]), IOV_LEN(vector[i]));
+                        ptr += IOV_LEN(vector[i]);
+                }
+                atomic_store_explicit(&slot->len, len, memory_order_relaxed);
+                atomic_store_explicit(&slot->seq, seq, memory_order_relaxed);
+        }
+        atomic_store_explicit(&slot->version, version + 2, memory_order_release);
+}
+
+/* Resends packet with sequence number seq if still present in the buffer. */
+static bool rtx_ring_resend(struct rtp *session, uint16_t seq)
+{
+        struct rtx_ring *ring = session->rtx;
+        struct rtx_slot *slot = &ring->slots[seq % ring->size];
+        const unsigned version = atomic_load_explicit(&slot->version, memory_order_acquire);
+        const int len = atomic_load_explicit(&slot->len, memory_order_relaxed);
+        if ((version & 1U) != 0 || len == 0 ||
+            atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+                return false;
+        }
+        memcpy(ring->scratch, ring->data + (size_t) (seq % ring->size) * ring->slot_len, len);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->version, memory_order_relaxed) != version) {
+                return false; // overwritten meanwhile - packet is too old anyways
+        }
+        if (udp_send(session->rtp_socket, (char *) ring->scratch, len) == -1) {
+                log_msg(LOG_LEVEL_WARNING, "retransmitting RTP packet: %s", ug_strerror(errno));
+                return false;
+        }
+        atomic_fetch_add_explicit(&ring->retransmitted, 1, memory_order_relaxed);
+        metric_add(METRIC_RTP_RETRANSMITTED_PACKETS, 1);
+        return true;
+}
+
 /**
  * rtp_set_option:
  * @session: The RTP session.
@@ -1328,6 +1456,17 @@ bool rtp_set_option(struct rtp *session, rtp_option optname, int optval)
                         session->opt->record_source = TRUE;
                 }
                 break;
+        case RTP_OPT_NACK:
+                rtx_ring_destroy(session->rtx);
+                session->rtx = optval > 0 ? rtx_ring_create(optval, session->rtx_packet_len) : NULL;
+                break;
+        case RTP_OPT_NACK_PACKET_LEN:
+                session->rtx_packet_len = optval;
+                break;
+        case RTP_OPT_SSRC_STEERING:
+                // SSRC offset in RTP header and in RTCP SR/RR header
+                return udp_set_reuseport_steering(session->rtp_socket, optval, 8) &&
+                       udp_set_reuseport_steering(session->rtcp_socket, optval, 4);
         default:
                 debug_msg
                     ("Ignoring unknown option (%d) in call to rtp_set_option().\n",
@@ -1363,6 +1502,9 @@ bool rtp_get_option(struct rtp *session, rtp_option optname, int *optval)
         case RTP_OPT_REUSE_PACKET_BUFS:
                 *optval = session->opt->reuse_bufs;
                 break;
+        case RTP_OPT_NACK:
+                *optval = session->rtx ? session->rtx->size : 0;
+                break;
         default:
                 *optval = 0;
                 debug_msg
@@ -1551,6 +1693,8 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
         }
 
         if (buflen > 0) {
+                metric_add(METRIC_RTP_RX_PACKETS, 1);
+                metric_add(METRIC_RTP_RX_BYTES, buflen);
                 rtp_process_data(session, curr_rtp_ts, buffer, packet, buflen);
         }
 
@@ -2119,6 +2263,32 @@ static void process_rtcp_app(struct rtp *session, rtcp_t * packet)
         }
 }
 
+/* Answers a generic NACK (RFC 4585 section 6.2.1) from the retransmission buffer. */
+static void process_rtcp_nack(struct rtp *session, rtcp_t * packet)
+{
+        if (session->rtx == NULL ||
+            ntohl(packet->r.nack.media_ssrc) != session->my_ssrc) {
+                return;
+        }
+        int fci_count = ntohs(packet->common.length) - 2;
+        int requested = 0;
+        int resent = 0;
+        for (int i = 0; i < fci_count; ++i) {
+                uint16_t pid = ntohs(packet->r.nack.fci[i].pid);
+                uint16_t blp = ntohs(packet->r.nack.fci[i].blp);
+                requested += 1;
+                resent += rtx_ring_resend(session, pid);
+                for (int j = 0; j < 16; ++j) {
+                        if (blp & (1U << j)) {
+                                requested += 1;
+                                resent += rtx_ring_resend(session, pid + j + 1);
+                        }
+                }
+        }
+        debug_msg("NACK from 0x%08" PRIx32 ": %d packets requested, %d retransmitted\n",
+                  ntohl(packet->r.nack.ssrc), requested, resent);
+}
+
 static
 uint32_t compute_rtt(struct rtp *session, rtcp_rx * rrx)
 {
@@ -2179,7 +2349,13 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         }
                                         process_rtcp_rr(session, packet);
                                         break;
-                                case RTCP_RX:
+                                case RTCP_RX: /* == RTCP_RTPFB */
+                                        if (!session->tfrc_on) {
+                                                if (packet->common.count == RTCP_RTPFB_FMT_NACK) {
+                                                        process_rtcp_nack(session, packet);
+                                                }
+                                                break;
+                                        }
                                         /* am not sending up a RX_RTCP_START... */
                                         process_rtcp_rx(session, packet);
                                         if (session->tfrc_on) {
@@ -2919,9 +3095,16 @@ rtp_send_data_hdr(struct rtp *session,
                                          buffer_len, initVec);
         }
 
+        if (session->rtx != NULL) {
+                rtx_ring_store(session->rtx, ntohs(packet->seq), send_vector, send_vector_len);
+        }
+
         rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
         if (rc == -1) {
                 log_msg(LOG_LEVEL_WARNING, "sending RTP packet: %s", ug_strerror(errno));
+        } else {
+                metric_add(METRIC_RTP_TX_PACKETS, 1);
+                metric_add(METRIC_RTP_TX_BYTES, buffer_len + data_len);
         }
 
         /* Update the RTCP statistics... */
@@ -3259,6 +3442,38 @@ static uint8_t *format_rtcp_app(uint8_t * buffer, int buflen, uint32_t ssrc,
         return buffer + pkt_octets;
 }
 
+static uint8_t *format_rtcp_nack(uint8_t * buffer, int buflen, uint32_t ssrc,
+                                 uint32_t media_ssrc, const uint16_t *seqs, int count, int *consumed)
+{
+        /* Write an RTCP generic NACK, each FCI covers a PID and 16 following packets. */
+        rtcp_t *packet = (rtcp_t *)(void *) buffer;
+        int fci_count = 0;
+        int i = 0;
+
+        assert(buflen >= 16);
+
+        packet->common.version = 2;
+        packet->common.p = 0;
+        packet->common.count = RTCP_RTPFB_FMT_NACK;
+        packet->common.pt = RTCP_RTPFB;
+        packet->r.nack.ssrc = htonl(ssrc);
+        packet->r.nack.media_ssrc = htonl(media_ssrc);
+        while (i < count && 12 + (fci_count + 1) * 4 <= buflen) {
+                uint16_t pid = seqs[i++];
+                uint16_t blp = 0;
+                while (i < count && (uint16_t) (seqs[i] - pid - 1) < 16) {
+                        blp |= 1U << (uint16_t) (seqs[i] - pid - 1);
+                        i++;
+                }
+                packet->r.nack.fci[fci_count].pid = htons(pid);
+                packet->r.nack.fci[fci_count].blp = htons(blp);
+                fci_count++;
+        }
+        packet->common.length = htons(2 + fci_count);
+        *consumed = i;
+        return buffer + 12 + fci_count * 4;
+}
+
 /**
  * Sends the RTCP packet over UDP to either a configured host (if specified on
  * the command-line) or to the destination from which we are receiving RTCP.
@@ -3393,6 +3608,91 @@ static void send_rtcp(struct rtp *session, uint32_t rtp_ts,
         check_database(session);
 }
 
+/**
+ * Requests retransmission of packets using RTCP generic NACK (RFC 4585).
+ *
+ * The NACK is sent immediately (regardless the RTCP timer) in a minimal
+ * compound packet consisting of an empty RR followed by the feedback.
+ *
+ * @param media_ssrc SSRC of the source whose packets are missing
+ * @param seqs       missing sequence numbers in ascending order
+ * @retval false     if the NACK cannot be sent (RTCP encryption is not supported)
+ */
+bool rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count)
+{
+        if (session->encryption_enabled) {
+                debug_msg("NACK cannot be sent with RTCP encryption enabled\n");
+                return false;
+        }
+
+        while (count > 0) {
+                uint8_t buffer[RTP_MAX_PACKET_LEN];
+                rtcp_t *rr = (rtcp_t *)(void *) buffer;
+                rr->common.version = 2;
+                rr->common.p = 0;
+                rr->common.count = 0;
+                rr->common.pt = RTCP_RR;
+                rr->common.length = htons(1);
+                rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+                int consumed = 0;
+                uint8_t *ptr = format_rtcp_nack(buffer + 8, sizeof buffer - 8,
+                                session->my_ssrc, media_ssrc, seqs, count, &consumed);
+                rtcp_udp_send(session, ptr - buffer, (char *) buffer);
+                seqs += consumed;
+                count -= consumed;
+        }
+        return true;
+}
+
+/**
+ * Sends an RTCP APP packet immediately, outside of the regular RTCP schedule.
+ *
+ * @param name  4-character APP name
+ * @param len   length of data, must be a multiple of 4
+ */
+bool rtp_send_app(struct rtp *session, const char *name, const void *data, int len)
+{
+        if (session->encryption_enabled) {
+                debug_msg("APP cannot be sent with RTCP encryption enabled\n");
+                return false;
+        }
+        assert(len % 4 == 0 && len <= RTP_MAX_PACKET_LEN - 64);
+
+        uint8_t app_buf[RTP_MAX_PACKET_LEN];
+        rtcp_app *app = (rtcp_app *)(void *) app_buf;
+        app->p = 0;
+        app->subtype = 0;
+        app->length = (12 + len) / 4 - 1;
+        memcpy(app->name, name, 4);
+        memcpy(app->data, data, len);
+
+        uint8_t buffer[RTP_MAX_PACKET_LEN];
+        rtcp_t *rr = (rtcp_t *)(void *) buffer;
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        uint8_t *ptr = format_rtcp_app(buffer + 8, sizeof buffer - 8,
+                        session->my_ssrc, app);
+        rtcp_udp_send(session, ptr - buffer, (char *) buffer);
+        return true;
+}
+
+/**
+ * Returns the number of packets retransmitted as a response to NACKs.
+ */
+uint64_t rtp_get_retransmitted(struct rtp *session)
+{
+        if (session->rtx == NULL) {
+                return 0;
+        }
+        return atomic_load_explicit(&session->rtx->retransmitted, memory_order_relaxed);
+}
+
 /**
  * rtp_send_ctrl:
  * @session: the session pointer (returned by rtp_init())
@@ -3704,6 +4004,7 @@ void rtp_done(struct rtp *session)
 
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
+        rtx_ring_destroy(session->rtx);
         free(session->opt);
         free(session);
 }
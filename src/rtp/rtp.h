@@ -235,6 +235,12 @@ typedef enum {
                                         /* end of the packet                                 */
 	RTP_OPT_SEND_BACK         = 7,  // Send to a receiver that is sending to us. Sets also
                                         // RTP_POT_RECORD_SOURCE
+	RTP_OPT_NACK              = 8,  // Keep last <optval> sent packets to answer RTCP
+                                        // generic NACKs (RFC 4585), 0 disables
+	RTP_OPT_SSRC_STEERING     = 9,  // Distribute incoming packets among <optval> sessions
+                                        // bound to the same port (SO_REUSEPORT) by SSRC
+	RTP_OPT_NACK_PACKET_LEN   = 10, // Max length of packets kept for NACK (default
+                                        // RTP_MAX_PACKET_LEN), must precede RTP_OPT_NACK
 } rtp_option;
 
 struct socket_udp_local;
@@ -286,6 +292,11 @@ int 		 rtp_send_data_hdr(struct rtp *session,
 void 		 rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts, 
 			       rtcp_app_callback appcallback, time_ns_t curr_time);
 void 		 rtp_update(struct rtp *session, time_ns_t curr_time);
+bool             rtp_send_nack(struct rtp *session, uint32_t media_ssrc,
+                               const uint16_t *seqs, int count);
+bool             rtp_send_app(struct rtp *session, const char *name,
+                              const void *data, int len);
+uint64_t         rtp_get_retransmitted(struct rtp *session);
 
 uint32_t	 rtp_my_ssrc(struct rtp *session);
 bool             rtp_add_csrc(struct rtp *session, uint32_t csrc);
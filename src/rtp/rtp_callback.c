@@ -72,6 +72,7 @@
 #include "rtp/rtp.h"
 #include "rtp/pbuf.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rate_control.h"
 #include "tfrc.h"
 
 extern char *frame;
@@ -119,6 +120,11 @@ static void process_rr(struct rtp *session, rtp_event * e)
                         } else {
                                 tmp = ((float)(now - r->lsr - r->dlsr)) / 65536.0;      /* RTT in seconds */
                                 RTT = tmp * 1000000;    /* RTT in usec */
+                                struct pdb_e *reporter = pdb_get(
+                                    (struct pdb *) rtp_get_userdata(session), e->ssrc);
+                                if (reporter != NULL) {
+                                        reporter->cc.rtt_us = RTT;
+                                }
                         }
                         //debug_msg("  RTT=%d usec\n", RTT);
                 }
@@ -219,8 +225,10 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
         case RX_RTP:
                 tfrc_recv_data(state->tfrc_state, get_time_in_ns(), pckt_rtp->seq,
                                pckt_rtp->data_len + 40);
+                rate_ctl_rx_packet(state, pckt_rtp->seq, pckt_rtp->data_len);
                 if (pckt_rtp->data_len > 0) {   /* Only process packets that contain data... */
                         pbuf_insert(state->playout_buffer, pckt_rtp);
+                        pdb_set_active(participants, state, true);
                 }
                 break;
         case RX_TFRC_RX:
@@ -246,7 +254,10 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                         assert(pckt_app->length == 3);
                         assert(pckt_app->subtype == 0);
 //                      tfrc_recv_rtt(state->tfrc_state, get_time_in_ns(), ntohl(*((int *) pckt_app->data)));
+                } else if (strncmp(pckt_app->name, RATE_CTL_APP_NAME, 4) == 0 && state != NULL) {
+                        rate_ctl_process_app(state, pckt_app);
                 }
+                free(pckt_app);
                 break;
         case RX_BYE:
                 break;
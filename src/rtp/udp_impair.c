@@ -0,0 +1,374 @@
+/**
+ * @file   rtp/udp_impair.c
+ * @brief  In-process network impairment (loss, delay, reorder, rate) of sent UDP packets
+ *
+ * Allows reproducible testing of FEC, packet reordering and playout under
+ * packet loss without netem. Losses follow the Gilbert-Elliott model, the
+ * random generator is seeded so that runs are repeatable.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/net_udp.h" // socket_error
+#include "rtp/udp_impair.h"
+#include "tv.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[udp_impair] "
+
+enum {
+        RATE_QUEUE_LIMIT_MS = 100, ///< tail-drop if the rate-limited queue is longer
+        REORDER_DELAY_MS = 1,      ///< reordered packet is held back by this
+};
+
+struct impair_pkt {
+        time_ns_t release;
+        uint64_t seq; ///< keeps heap order stable for equal release times
+        fd_t fd;
+        int len;
+        socklen_t addrlen;
+        struct sockaddr_storage addr;
+        char data[];
+};
+
+struct udp_impair {
+        // Gilbert-Elliott loss model
+        double ge_p;            ///< good->bad transition probability
+        double ge_r;            ///< bad->good transition probability
+        double loss_bad;
+        double loss_good;
+        bool bad_state;
+
+        double dup;
+        double reorder;
+        time_ns_t delay;
+        time_ns_t jitter;
+        long long rate;         ///< bps, 0 - unlimited
+
+        uint64_t rng;
+        time_ns_t last_release; ///< keeps FIFO order of not reordered packets
+        time_ns_t link_free;    ///< when the rate-limited link finishes sending
+        uint64_t seq;
+        unsigned long long stat_sent, stat_lost, stat_dup, stat_reordered, stat_rate_drop;
+
+        bool queued;            ///< packets are sent from thread (delay/rate/reorder set)
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t cv;
+        bool should_exit;
+        struct impair_pkt **heap; ///< min-heap by (release, seq)
+        int heap_len;
+        int heap_size;
+};
+
+/// xorshift64* - own generator so that the sequence is reproducible per socket
+static double impair_rand(struct udp_impair *s)
+{
+        s->rng ^= s->rng >> 12;
+        s->rng ^= s->rng << 25;
+        s->rng ^= s->rng >> 27;
+        return (double) ((s->rng * 0x2545F4914F6CDD1DULL) >> 11) / (double) (1ULL << 53);
+}
+
+static bool pkt_less(const struct impair_pkt *a, const struct impair_pkt *b)
+{
+        return a->release < b->release || (a->release == b->release && a->seq < b->seq);
+}
+
+static void heap_push(struct udp_impair *s, struct impair_pkt *p)
+{
+        if (s->heap_len == s->heap_size) {
+                s->heap_size = MAX(2 * s->heap_size, 64);
+                s->heap = realloc(s->heap, s->heap_size * sizeof s->heap[0]);
+        }
+        int i = s->heap_len++;
+        while (i > 0 && pkt_less(p, s->heap[(i - 1) / 2])) {
+                s->heap[i] = s->heap[(i - 1) / 2];
+                i = (i - 1) / 2;
+        }
+        s->heap[i] = p;
+}
+
+static struct impair_pkt *heap_pop(struct udp_impair *s)
+{
+        struct impair_pkt *ret = s->heap[0];
+        struct impair_pkt *last = s->heap[--s->heap_len];
+        int i = 0;
+        while (2 * i + 1 < s->heap_len) {
+                int child = 2 * i + 1;
+                if (child + 1 < s->heap_len && pkt_less(s->heap[child + 1], s->heap[child])) {
+                        child += 1;
+                }
+                if (!pkt_less(s->heap[child], last)) {
+                        break;
+                }
+                s->heap[i] = s->heap[child];
+                i = child;
+        }
+        s->heap[i] = last;
+        return ret;
+}
+
+static void *impair_thread(void *arg)
+{
+        set_thread_name(__func__);
+        struct udp_impair *s = arg;
+        pthread_mutex_lock(&s->lock);
+        while (!s->should_exit) {
+                if (s->heap_len == 0) {
+                        pthread_cond_wait(&s->cv, &s->lock);
+                        continue;
+                }
+                const time_ns_t release = s->heap[0]->release;
+                if (release > get_time_in_ns()) {
+                        struct timespec ts = { release / NS_IN_SEC, release % NS_IN_SEC };
+                        pthread_cond_timedwait(&s->cv, &s->lock, &ts);
+                        continue;
+                }
+                struct impair_pkt *p = heap_pop(s);
+                pthread_mutex_unlock(&s->lock);
+                if (sendto(p->fd, p->data, p->len, 0, (struct sockaddr *) &p->addr, p->addrlen) < 0) {
+                        socket_error(MOD_NAME "sendto");
+                }
+                free(p);
+                pthread_mutex_lock(&s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+        return NULL;
+}
+
+static bool parse_percent(const char *val, double *out)
+{
+        char *endptr = NULL;
+        *out = strtod(val, &endptr) / 100.0;
+        return *endptr == '\0' && *out >= 0.0 && *out <= 1.0;
+}
+
+static bool parse_ms(const char *val, time_ns_t *out)
+{
+        char *endptr = NULL;
+        double ms = strtod(val, &endptr);
+        *out = (time_ns_t) (ms * MS_IN_NS_DBL);
+        return *endptr == '\0' && ms >= 0.0;
+}
+
+static bool parse_cfg(struct udp_impair *s, const char *cfg, unsigned long long *seed)
+{
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *it = tmp;
+        double loss = 0.0;
+        double burst = 1.0;
+        bool ret = true;
+        while (ret && (item = strtok_r(it, ":", &save_ptr)) != NULL) {
+                it = NULL;
+                char *val = strchr(item, '=');
+                if (val == NULL) {
+                        MSG(ERROR, "Missing value for %s!\n", item);
+                        ret = false;
+                        break;
+                }
+                *val++ = '\0';
+                if (strcmp(item, "loss") == 0) {
+                        ret = parse_percent(val, &loss) && loss < 1.0;
+                } else if (strcmp(item, "burst") == 0) {
+                        burst = atof(val);
+                        ret = burst >= 1.0;
+                } else if (strcmp(item, "ge") == 0) {
+                        double v[4] = { 0, 0, 100, 0 };
+                        int n = sscanf(val, "%lf/%lf/%lf/%lf", &v[0], &v[1], &v[2], &v[3]);
+                        ret = n >= 2;
+                        s->ge_p = v[0] / 100.0;
+                        s->ge_r = v[1] / 100.0;
+                        s->loss_bad = v[2] / 100.0;
+                        s->loss_good = v[3] / 100.0;
+                } else if (strcmp(item, "delay") == 0) {
+                        ret = parse_ms(val, &s->delay);
+                } else if (strcmp(item, "jitter") == 0) {
+                        ret = parse_ms(val, &s->jitter);
+                } else if (strcmp(item, "reorder") == 0) {
+                        ret = parse_percent(val, &s->reorder);
+                } else if (strcmp(item, "dup") == 0) {
+                        ret = parse_percent(val, &s->dup);
+                } else if (strcmp(item, "rate") == 0) {
+                        s->rate = unit_evaluate(val, NULL);
+                        ret = s->rate > 0;
+                } else if (strcmp(item, "seed") == 0) {
+                        *seed = strtoull(val, NULL, 0);
+                } else {
+                        MSG(ERROR, "Unknown option: %s\n", item);
+                        ret = false;
+                        break;
+                }
+                if (!ret) {
+                        MSG(ERROR, "Wrong value for %s: %s\n", item, val);
+                }
+        }
+        free(tmp);
+        if (loss > 0.0) { // simple Gilbert model from mean loss and mean burst length
+                s->ge_r = 1.0 / burst;
+                s->ge_p = s->ge_r * loss / (1.0 - loss);
+                s->loss_bad = 1.0;
+                s->loss_good = 0.0;
+        }
+        return ret;
+}
+
+ADD_TO_PARAM("udp-impair", "* udp-impair=<opt>=<val>[:<opt>=<val>...]\n"
+                "  Impair sent UDP packets (for testing only), options:\n"
+                "    loss=<%>[:burst=<n>] - mean loss and mean loss burst length (Gilbert model)\n"
+                "    ge=<p%>/<r%>[/<bad_loss%>[/<good_loss%>]] - Gilbert-Elliott transition and loss probabilities\n"
+                "    delay=<ms>, jitter=<ms> - fixed and uniformly distributed random delay\n"
+                "    reorder=<%> - hold back packets by " TOSTRING(REORDER_DELAY_MS) " ms, dup=<%> - duplicate packets\n"
+                "    rate=<bps> - bandwidth cap (tail drop above " TOSTRING(RATE_QUEUE_LIMIT_MS) " ms queue)\n"
+                "    seed=<n> - random seed (default 1), combined with socket order\n");
+struct udp_impair *udp_impair_init(const char *cfg)
+{
+        static atomic_uint instance_count;
+        struct udp_impair *s = calloc(1, sizeof *s);
+        unsigned long long seed = 1;
+        if (!parse_cfg(s, cfg, &seed)) {
+                free(s);
+                return NULL;
+        }
+        // xorshift state must not be 0
+        s->rng = (seed + atomic_fetch_add(&instance_count, 1)) * 0x9E3779B97F4A7C15ULL | 1U;
+        s->queued = s->delay > 0 || s->jitter > 0 || s->reorder > 0 || s->rate > 0;
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->cv, NULL);
+        if (s->queued) {
+                pthread_create(&s->thread, NULL, impair_thread, s);
+        }
+        MSG(VERBOSE, "Gilbert-Elliott p=%f r=%f loss bad/good %f/%f, delay %lld+%lld ns, "
+                     "reorder %f, dup %f, rate %lld bps\n", s->ge_p, s->ge_r, s->loss_bad,
+                     s->loss_good, (long long) s->delay, (long long) s->jitter, s->reorder,
+                     s->dup, s->rate);
+        return s;
+}
+
+void udp_impair_done(struct udp_impair *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        if (s->queued) {
+                pthread_mutex_lock(&s->lock);
+                s->should_exit = true;
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_signal(&s->cv);
+                pthread_join(s->thread, NULL);
+        }
+        while (s->heap_len > 0) {
+                free(heap_pop(s));
+        }
+        if (s->stat_sent > 0) {
+                MSG(INFO, "Packets sent %llu, lost %llu, duplicated %llu, reordered %llu, "
+                          "dropped by rate limit %llu\n", s->stat_sent, s->stat_lost,
+                          s->stat_dup, s->stat_reordered, s->stat_rate_drop);
+        }
+        free(s->heap);
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cv);
+        free(s);
+}
+
+int udp_impair_sendto(struct udp_impair *s, fd_t fd, const char *data, int len,
+                      const struct sockaddr *addr, socklen_t addrlen)
+{
+        pthread_mutex_lock(&s->lock);
+        s->stat_sent += 1;
+        if (s->bad_state ? impair_rand(s) < s->ge_r : impair_rand(s) < s->ge_p) {
+                s->bad_state = !s->bad_state;
+        }
+        if (impair_rand(s) < (s->bad_state ? s->loss_bad : s->loss_good)) {
+                s->stat_lost += 1;
+                pthread_mutex_unlock(&s->lock);
+                return len;
+        }
+        const int copies = impair_rand(s) < s->dup ? 2 : 1;
+        s->stat_dup += copies - 1;
+        int ret = len;
+        for (int i = 0; i < copies; ++i) {
+                if (!s->queued) {
+                        if (sendto(fd, data, len, 0, addr, addrlen) < 0) {
+                                ret = -1;
+                        }
+                        continue;
+                }
+                const time_ns_t now = get_time_in_ns();
+                time_ns_t release = now + s->delay + (time_ns_t) (impair_rand(s) * s->jitter);
+                if (impair_rand(s) < s->reorder) {
+                        release += REORDER_DELAY_MS * MS_IN_NS;
+                        s->stat_reordered += 1;
+                } else {
+                        release = MAX(release, s->last_release);
+                        s->last_release = release;
+                }
+                if (s->rate > 0) {
+                        const time_ns_t start = MAX(release, s->link_free);
+                        if (start - release > RATE_QUEUE_LIMIT_MS * MS_IN_NS) {
+                                s->stat_rate_drop += 1;
+                                continue;
+                        }
+                        s->link_free = start + (time_ns_t) len * 8 * NS_IN_SEC / s->rate;
+                        release = s->link_free;
+                }
+                struct impair_pkt *p = malloc(sizeof *p + len);
+                *p = (struct impair_pkt){ .release = release, .seq = s->seq++, .fd = fd,
+                                          .len = len, .addrlen = addrlen };
+                memcpy(&p->addr, addr, addrlen);
+                memcpy(p->data, data, len);
+                heap_push(s, p);
+                pthread_cond_signal(&s->cv);
+        }
+        pthread_mutex_unlock(&s->lock);
+        return ret;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file   rtp/udp_impair.h
+ * @brief  In-process network impairment (loss, delay, reorder, rate) of sent UDP packets
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_UDP_IMPAIR_H_
+#define RTP_UDP_IMPAIR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sockaddr;
+struct udp_impair;
+
+/**
+ * @param cfg  value of the "udp-impair" param
+ * @returns impairment state, NULL on wrong config
+ */
+struct udp_impair *udp_impair_init(const char *cfg);
+void udp_impair_done(struct udp_impair *s);
+/**
+ * Sends packet through the impairment - it may be dropped, duplicated or
+ * sent later from a separate thread.
+ *
+ * @returns len (as if the packet was sent), -1 on immediate send error
+ */
+int udp_impair_sendto(struct udp_impair *s, fd_t fd, const char *data, int len,
+                      const struct sockaddr *addr, socklen_t addrlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_UDP_IMPAIR_H_
@@ -56,6 +56,9 @@
  *
  * ### Compressed video ###
  * Data is saved to decompress buffer. The decompression itself is done by decompress_thread().
+ * With "decoder-frame-parallel=<n>" and an intra-only codec, decompress_thread()
+ * keeps up to <n> frames in flight, each decompressed by its own decompressor
+ * instance to a private buffer, and displays them in the order of arrival.
  *
  * ### video with FEC ###
  * Data is saved to FEC buffer. Decoded with fec_thread().
@@ -112,8 +115,10 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
+#include "utils/bench_report.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
@@ -202,11 +207,24 @@ struct line_decoder {
         long                 conv_den;     ///< in->out bpp conv denominator
         int                  shifts[3];    ///< requested red,green and blue shift (in bits)
         decoder_t            decode_line;  ///< actual decoding function
+        const struct pixfmt_conv_plan *conv_plan; ///< used instead of decode_line if multi-step conversion needed
         unsigned int         dst_linesize; ///< destination linesize
         unsigned int         dst_pitch;    ///< framebuffer pitch - it can be larger if SDL resolution is larger than data
         unsigned int         src_linesize; ///< source linesize
 };
 
+static void line_decoder_decode(const struct line_decoder *ld, unsigned char *dst,
+                                const unsigned char *src, int dst_len)
+{
+        if (ld->conv_plan != nullptr) {
+                pixfmt_conv_plan_run(ld->conv_plan, dst, src, dst_len, ld->shifts[0],
+                                     ld->shifts[1], ld->shifts[2]);
+        } else {
+                ld->decode_line(dst, src, dst_len, ld->shifts[0], ld->shifts[1],
+                                ld->shifts[2]);
+        }
+}
+
 struct reported_statistics_cumul {
         ~reported_statistics_cumul() {
                 print();
@@ -270,17 +288,21 @@ struct frame_msg {
                         if (recv_frame->fec_params.type != FEC_NONE) {
                                 if (is_corrupted) {
                                         stats.fec_nok += 1;
+                                        metric_add(METRIC_FEC_FAILED_FRAMES, 1);
                                 } else {
                                         if (received_bytes == expected_bytes) {
                                                 stats.fec_ok += 1;
                                         } else {
                                                 stats.fec_corrected += 1;
+                                                metric_add(METRIC_FEC_CORRECTED_FRAMES, 1);
                                         }
                                 }
                         }
                         stats.corrupted += is_corrupted;
                         stats.displayed += is_displayed;
                         stats.dropped += !is_displayed;
+                        metric_add(METRIC_VIDEO_FRAMES_CORRUPTED, is_corrupted);
+                        metric_add(is_displayed ? METRIC_VIDEO_FRAMES_DISPLAYED : METRIC_VIDEO_FRAMES_DROPPED, 1);
                 }
                 vf_free(recv_frame);
                 vf_free(nofec_frame);
@@ -356,7 +378,12 @@ struct state_video_decoder
         enum decoder_type_t decoder_type = {};  ///< how will the video data be decoded
         struct line_decoder *line_decoder = NULL; ///< if the video is uncompressed and only pixelformat change
                                            ///< is neeeded, use this structure
-        vector<struct state_decompress *> decompress_state; ///< state of the decompress (for every substream)
+        const struct pixfmt_conv_plan *conv_plan = nullptr; ///< multi-step line conversion (owned by pixfmt_conv)
+        vector<struct state_decompress *> decompress_state; ///< state of the decompress (for every substream and instance)
+        int frame_parallel = 1;           ///< requested count of frames decompressed concurrently
+        int decompress_instances = 1;     ///< decompressor sets in decompress_state (frame_parallel or 1)
+        atomic<int> frame_parallel_active{0};   ///< frame-parallel decompressions currently running
+        atomic<int> frame_parallel_max_active{0}; ///< peak of frame_parallel_active (reported at exit)
         bool accepts_corrupted_frame = false;     ///< whether we should pass corrupted frame to decompress
         bool buffer_swapped = true; /**< variable indicating that display buffer
                               * has been processed and we can write to a new one */
@@ -512,10 +539,9 @@ static void *fec_thread(void *args) {
                                         char *src = fec_out_buffer;
                                         char *dst = tile->data + line_decoder->base_offset;
                                         while(data_pos < (int) fec_out_len) {
-                                                line_decoder->decode_line((unsigned char*)dst, (unsigned char *) src, line_decoder->dst_linesize,
-                                                                line_decoder->shifts[0],
-                                                                line_decoder->shifts[1],
-                                                                line_decoder->shifts[2]);
+                                                line_decoder_decode(line_decoder, (unsigned char *) dst,
+                                                                (unsigned char *) src,
+                                                                line_decoder->dst_linesize);
                                                 src += line_decoder->src_linesize;
                                                 dst += vc_get_linesize(tile->width ,frame->color_spec);
                                                 data_pos += line_decoder->src_linesize;
@@ -568,11 +594,15 @@ static bool blacklist_current_out_codec(struct state_video_decoder *decoder){
 struct decompress_data {
         struct state_video_decoder *decoder;
         int pos;
+        int instance; ///< decompressor set for frame-parallel decoding
         struct video_frame *compressed;
         int buffer_num;
         decompress_status ret = DECODER_NO_FRAME;
         unsigned char *out;
+        struct video_frame_callbacks *callbacks;
         struct pixfmt_desc internal_prop; // set only if probing (ret == DECODER_GOT_CODEC)
+        long long duration_ns = 0;
+        atomic<int> *pending = nullptr; ///< frame-parallel slot tiles not yet decompressed
 };
 static void *decompress_worker(void *data)
 {
@@ -581,20 +611,185 @@ static void *decompress_worker(void *data)
 
         if (!d->compressed->tiles[d->pos].data)
                 return NULL;
-        d->ret = decompress_frame(decoder->decompress_state.at(d->pos),
+        auto t0 = high_resolution_clock::now();
+        d->ret = decompress_frame(decoder->decompress_state.at(d->instance * decoder->max_substreams + d->pos),
                         (unsigned char *) d->out,
                         (unsigned char *) d->compressed->tiles[d->pos].data,
                         d->compressed->tiles[d->pos].data_len,
                         d->buffer_num,
-                        &decoder->frame->callbacks,
+                        d->callbacks,
                         &d->internal_prop);
+        d->duration_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count();
+        return d;
+}
+
+/**
+ * @param tile_data  base of output tiles - decoder->frame tiles or frame-parallel buffers
+ * @returns          where to decompress tile pos to
+ */
+static unsigned char *get_decompress_out(struct state_video_decoder *decoder, char *const *tile_data, int pos)
+{
+        if (!decoder->merged_fb) {
+                return (unsigned char *) tile_data[pos];
+        }
+        // TODO: OK when rendering directly to display FB, otherwise, do not reflect pitch (we use PP)
+        const int tile_width = decoder->received_vid_desc.width;
+        const int tile_height = decoder->received_vid_desc.height;
+        int x = pos % get_video_mode_tiles_x(decoder->video_mode),
+            y = pos / get_video_mode_tiles_x(decoder->video_mode);
+        return (unsigned char *) tile_data[0] + y * decoder->pitch * tile_height +
+                vc_get_linesize(tile_width, decoder->out_codec) * x;
+}
+
+/// @retval false if the frame should not be displayed
+static bool check_decompress_results(struct state_video_decoder *decoder, vector<decompress_data> const &data)
+{
+        for (auto const &d : data) {
+                if (d.ret == DECODER_GOT_CODEC) {
+                        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Detected compression properties: " << get_pixdesc_desc(d.internal_prop) << "\n";
+                        decoder->msg_queue.push(new main_msg_reconfigure(decoder->received_vid_desc, nullptr, false, d.internal_prop));
+                        return false;
+                }
+                if (d.ret != DECODER_GOT_FRAME){
+                        if (d.ret == DECODER_UNSUPP_PIXFMT) {
+                                if(blacklist_current_out_codec(decoder))
+                                        decoder->msg_queue.push(new main_msg_reconfigure(decoder->received_vid_desc, nullptr, true));
+                        }
+                        return false;
+                }
+        }
+        return true;
+}
+
+/// passes decoder->frame to display and gets a new one
+static void put_decoded_frame(struct state_video_decoder *decoder, frame_msg *msg, long long putf_timeout)
+{
+        if(decoder->change_il) {
+                for(unsigned int i = 0; i < decoder->frame->tile_count; ++i) {
+                        struct tile *tile = vf_get_tile(decoder->frame, i);
+                        decoder->change_il(tile->data, tile->data, vc_get_linesize(tile->width,
+                                                decoder->out_codec), tile->height, &decoder->change_il_state[i]);
+                }
+        }
+
+        decoder->frame->ssrc = msg->nofec_frame->ssrc;
+        decoder->frame->timestamp = msg->nofec_frame->timestamp;
+        bench_frame_displayed(decoder->frame->timestamp);
+        const bool ret = display_put_frame(
+            decoder->display, decoder->frame, putf_timeout);
+        msg->is_displayed = ret;
+        decoder->frame = display_get_frame(decoder->display);
+        assert(decoder->frame != nullptr);
+}
+
+static void signal_buffer_swapped(struct state_video_decoder *decoder)
+{
+        unique_lock<mutex> lk(decoder->lock);
+        // we have put the video frame and requested another one which is
+        // writable so on
+        decoder->buffer_swapped = true;
+        lk.unlock();
+        decoder->buffer_swapped_cv.notify_one();
+}
+
+/**
+ * One in-flight frame of frame-parallel decoding. Frames are decompressed to
+ * own buffers by separate decompressor instances and copied to the display
+ * frame in the order of arrival.
+ */
+struct frame_parallel_slot {
+        unique_ptr<frame_msg> msg;
+        vector<unique_ptr<char[]>> buf; ///< per decoder->frame tile
+        vector<unsigned> buf_len;
+        vector<decompress_data> data;
+        vector<task_result_handle_t> handle;
+        struct video_frame_callbacks callbacks;
+        atomic<int> pending{0}; ///< tiles still being decompressed, 0 - can be finished without waiting
+};
+
+static void *frame_parallel_worker(void *arg)
+{
+        auto *d = (struct decompress_data *) arg;
+        struct state_video_decoder *decoder = d->decoder;
+        const int active = ++decoder->frame_parallel_active;
+        int max_active = decoder->frame_parallel_max_active.load(memory_order_relaxed);
+        while (active > max_active && !decoder->frame_parallel_max_active.compare_exchange_weak(max_active, active)) {
+        }
+        decompress_worker(d);
+        --decoder->frame_parallel_active;
+        d->pending->fetch_sub(1, memory_order_release);
         return d;
 }
 
+static void frame_parallel_submit(struct state_video_decoder *decoder, struct frame_parallel_slot *slot,
+                int instance, unique_ptr<frame_msg> &&msg)
+{
+        const int tile_count = decoder->max_substreams;
+        slot->msg = std::move(msg);
+        slot->buf.resize(decoder->frame->tile_count);
+        slot->buf_len.resize(decoder->frame->tile_count);
+        vector<char *> tile_data(decoder->frame->tile_count);
+        for (unsigned i = 0; i < decoder->frame->tile_count; ++i) {
+                if (slot->buf_len[i] != decoder->frame->tiles[i].data_len) {
+                        slot->buf_len[i] = decoder->frame->tiles[i].data_len;
+                        slot->buf[i] = unique_ptr<char[]>(new char[slot->buf_len[i]]);
+                }
+                tile_data[i] = slot->buf[i].get();
+        }
+        slot->callbacks = {};
+        slot->data.assign(tile_count, {});
+        slot->handle.resize(tile_count);
+        slot->pending = tile_count;
+        for (int pos = 0; pos < tile_count; ++pos) {
+                auto &d = slot->data[pos];
+                d.decoder = decoder;
+                d.pos = pos;
+                d.instance = instance;
+                d.compressed = slot->msg->nofec_frame;
+                d.buffer_num = slot->msg->buffer_num[pos];
+                d.out = get_decompress_out(decoder, tile_data.data(), pos);
+                d.callbacks = &slot->callbacks;
+                d.pending = &slot->pending;
+                slot->handle[pos] = task_run_async(frame_parallel_worker, &d);
+        }
+}
+
+static void frame_parallel_finish(struct state_video_decoder *decoder, struct frame_parallel_slot *slot,
+                long long putf_timeout)
+{
+        long long duration_ns = 0;
+        for (auto &h : slot->handle) {
+                wait_task(h);
+        }
+        for (auto const &d : slot->data) {
+                duration_ns = max(duration_ns, d.duration_ns);
+        }
+        metric_observe_ns(METRIC_VIDEO_DECOMPRESS_TIME, duration_ns);
+
+        if (check_decompress_results(decoder, slot->data)) {
+                for (unsigned i = 0; i < decoder->frame->tile_count && i < slot->buf.size(); ++i) {
+                        memcpy(decoder->frame->tiles[i].data, slot->buf[i].get(),
+                                        min(slot->buf_len[i], decoder->frame->tiles[i].data_len));
+                }
+                // the sequential path lets decompressors set these directly in the displayed frame
+                if (slot->callbacks.recycle != nullptr) {
+                        decoder->frame->callbacks.recycle = slot->callbacks.recycle;
+                }
+                if (slot->callbacks.copy != nullptr) {
+                        decoder->frame->callbacks.copy = slot->callbacks.copy;
+                }
+                put_decoded_frame(decoder, slot->msg.get(), putf_timeout);
+        }
+        slot->msg = nullptr;
+        signal_buffer_swapped(decoder);
+}
+
 ADD_TO_PARAM("decoder-drop-policy",
                 "* decoder-drop-policy=blocking|nonblock|<sec>\n"
                 "  Force specified blocking policy (default nonblock).\n"
                 "  <sec> - specifies frame timeout in seconds (can have suffixes, eg. \"20ms\")\n");
+/// how long decompress_thread() waits for a new frame while the oldest in-flight one is being decompressed
+constexpr auto FRAME_PARALLEL_POLL = std::chrono::milliseconds(1);
 static void *decompress_thread(void *args) {
         set_thread_name(__func__);
         struct state_video_decoder *decoder =
@@ -618,14 +813,51 @@ static void *decompress_thread(void *args) {
                                       nullptr) *
                     NS_IN_SEC);
         }();
+        long long putf_timeout = force_putf_timeout != -1 ? force_putf_timeout : PUTF_NONBLOCK; // originally was BLOCKING when !is_codec_interframe(decoder->received_vid_desc.color_spec)
+
+        // frame-parallel reorder ring, frames are finished from the oldest
+        vector<frame_parallel_slot> slots(decoder->frame_parallel);
+        int slot_first = 0;
+        int slot_count = 0;
+        auto finish_oldest = [&]() {
+                frame_parallel_finish(decoder, &slots[slot_first], putf_timeout);
+                slot_first = (slot_first + 1) % slots.size();
+                slot_count -= 1;
+        };
 
         while(1) {
-                unique_ptr<frame_msg> msg = decoder->decompress_queue.pop();
+                unique_ptr<frame_msg> msg;
+                if (slot_count == 0) {
+                        msg = decoder->decompress_queue.pop();
+                } else if (slots[slot_first].pending.load(memory_order_acquire) == 0
+                                || slot_count == (int) slots.size()) {
+                        // display the oldest frame once done, wait for it only if the ring is full
+                        finish_oldest();
+                        continue;
+                } else if (!decoder->decompress_queue.timed_pop(msg, FRAME_PARALLEL_POLL)) {
+                        continue;
+                }
 
                 if(!msg->recv_frame) { // poisoned
+                        while (slot_count > 0) {
+                                finish_oldest();
+                        }
                         break;
                 }
 
+                if (decoder->decompress_instances > 1 && decoder->decoder_type == EXTERNAL_DECODER &&
+                                decoder->out_codec != VIDEO_CODEC_END &&
+                                !codec_is_hw_accelerated(decoder->out_codec)) {
+                        assert(slot_count < (int) slots.size());
+                        const int idx = (slot_first + slot_count) % slots.size();
+                        frame_parallel_submit(decoder, &slots[idx], idx, std::move(msg));
+                        slot_count += 1;
+                        continue;
+                }
+                while (slot_count > 0) {
+                        finish_oldest();
+                }
+
                 auto t0 = std::chrono::high_resolution_clock::now();
                 unique_ptr<char[]> tmp;
 
@@ -638,21 +870,21 @@ static void *decompress_thread(void *args) {
                                         get_video_mode_tiles_y(decoder->video_mode);
                         vector<task_result_handle_t> handle(tile_count);
                         vector<decompress_data> data(tile_count);
+                        vector<char *> tile_data(decoder->frame->tile_count);
+                        for (unsigned i = 0; i < decoder->frame->tile_count; ++i) {
+                                tile_data[i] = decoder->frame->tiles[i].data;
+                        }
                         for (int pos = 0; pos < tile_count; ++pos) {
                                 data[pos].decoder = decoder;
                                 data[pos].pos = pos;
+                                data[pos].instance = 0;
                                 data[pos].compressed = msg->nofec_frame;
                                 data[pos].buffer_num = msg->buffer_num[pos];
+                                data[pos].callbacks = &decoder->frame->callbacks;
                                 if (tmp.get()) {
                                         data[pos].out = (unsigned char *) tmp.get();
-                                } else if (decoder->merged_fb) {
-                                        // TODO: OK when rendering directly to display FB, otherwise, do not reflect pitch (we use PP)
-                                        int x = pos % get_video_mode_tiles_x(decoder->video_mode),
-                                            y = pos / get_video_mode_tiles_x(decoder->video_mode);
-                                        data[pos].out = (unsigned char *) vf_get_tile(decoder->frame, 0)->data + y * decoder->pitch * tile_height +
-                                                vc_get_linesize(tile_width, decoder->out_codec) * x;
                                 } else {
-                                        data[pos].out = (unsigned char *) vf_get_tile(decoder->frame, pos)->data;
+                                        data[pos].out = get_decompress_out(decoder, tile_data.data(), pos);
                                 }
                                 if (tile_count > 1) {
                                         handle[pos] = task_run_async(decompress_worker, &data[pos]);
@@ -665,19 +897,9 @@ static void *decompress_thread(void *args) {
                                         wait_task(handle[pos]);
                                 }
                         }
-                        for (int pos = 0; pos < tile_count; ++pos) {
-                                if (data[pos].ret == DECODER_GOT_CODEC) {
-                                        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Detected compression properties: " << get_pixdesc_desc(data[pos].internal_prop) << "\n";
-                                        decoder->msg_queue.push(new main_msg_reconfigure(decoder->received_vid_desc, nullptr, false, data[pos].internal_prop));
-                                        goto skip_frame;
-                                }
-                                if (data[pos].ret != DECODER_GOT_FRAME){
-                                        if (data[pos].ret == DECODER_UNSUPP_PIXFMT) {
-                                                if(blacklist_current_out_codec(decoder))
-                                                        decoder->msg_queue.push(new main_msg_reconfigure(decoder->received_vid_desc, nullptr, true));
-                                        }
-                                        goto skip_frame;
-                                }
+                        if (!check_decompress_results(decoder, data)) {
+                                signal_buffer_swapped(decoder);
+                                continue;
                         }
                 } else {
                         if (decoder->frame->decoder_overrides_data_len == TRUE) {
@@ -689,36 +911,16 @@ static void *decompress_thread(void *args) {
 
                 LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "Decompress duration: " <<
                         duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count() / 1000000.0 << " ms\n";
+                metric_observe_ns(METRIC_VIDEO_DECOMPRESS_TIME,
+                                  duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count());
 
-                if(decoder->change_il) {
-                        for(unsigned int i = 0; i < decoder->frame->tile_count; ++i) {
-                                struct tile *tile = vf_get_tile(decoder->frame, i);
-                                decoder->change_il(tile->data, tile->data, vc_get_linesize(tile->width,
-                                                        decoder->out_codec), tile->height, &decoder->change_il_state[i]);
-                        }
-                }
-
-                {
-                        long long putf_timeout = force_putf_timeout != -1 ? force_putf_timeout : PUTF_NONBLOCK; // originally was BLOCKING when !is_codec_interframe(decoder->received_vid_desc.color_spec)
-
-                        decoder->frame->ssrc = msg->nofec_frame->ssrc;
-                        decoder->frame->timestamp = msg->nofec_frame->timestamp;
-                        const bool ret = display_put_frame(
-                            decoder->display, decoder->frame, putf_timeout);
-                        msg->is_displayed = ret;
-                        decoder->frame = display_get_frame(decoder->display);
-                        assert(decoder->frame != nullptr);
-                }
+                put_decoded_frame(decoder, msg.get(), putf_timeout);
+                signal_buffer_swapped(decoder);
+        }
 
-skip_frame:
-                {
-                        unique_lock<mutex> lk(decoder->lock);
-                        // we have put the video frame and requested another one which is
-                        // writable so on
-                        decoder->buffer_swapped = true;
-                        lk.unlock();
-                        decoder->buffer_swapped_cv.notify_one();
-                }
+        if (decoder->frame_parallel_max_active > 0) {
+                MSG(VERBOSE, "Frame-parallel decoding: at most %d decompressions ran concurrently.\n",
+                                decoder->frame_parallel_max_active.load());
         }
 
         return NULL;
@@ -731,6 +933,10 @@ static void decoder_set_video_mode(struct state_video_decoder *decoder, enum vid
                         * get_video_mode_tiles_y(decoder->video_mode);
 }
 
+ADD_TO_PARAM("decoder-frame-parallel",
+                "* decoder-frame-parallel=<n>\n"
+                "  Decompress up to <n> successive frames concurrently (intra-only codecs), increases\n"
+                "  throughput at the cost of up to <n> - 1 frames of additional latency\n");
 /**
  * @brief Initializes video decompress state.
  * @param video_mode  video_mode expected to be received from network
@@ -765,6 +971,15 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
                 }
         }
 
+        if (const char *fp = get_commandline_param("decoder-frame-parallel")) {
+                s->frame_parallel = atoi(fp);
+                if (s->frame_parallel < 1) {
+                        MSG(ERROR, "Wrong frame-parallel count: %s\n", fp);
+                        delete s;
+                        return NULL;
+                }
+        }
+
         decoder_set_video_mode(s, video_mode);
 
         if(!video_decoder_register_display(s, display)) {
@@ -922,6 +1137,7 @@ void video_decoder_remove_display(struct state_video_decoder *decoder)
 static void cleanup(struct state_video_decoder *decoder)
 {
         decoder->decoder_type = UNSET;
+        decoder->conv_plan = nullptr;
         for (auto &d : decoder->decompress_state) {
                 decompress_done(d);
         }
@@ -1036,6 +1252,8 @@ static vector<pair<struct pixfmt_desc, codec_t>> video_decoder_order_output_code
  * @param[in]  desc        incoming video description
  * @param[out] decode_line If chosen decoder is a linedecoder, this variable contains the
  *                         decoding function.
+ *                         If the conversion needs more steps, it is NULL and
+ *                         decoder->conv_plan is set instead.
  * @return                 Output codec, if no decoding function found, -1 is returned.
  */
 static codec_t choose_codec_and_decoder(struct state_video_decoder *decoder, struct video_desc desc,
@@ -1067,8 +1285,9 @@ static codec_t choose_codec_and_decoder(struct state_video_decoder *decoder, str
         {
                 vector<codec_t> native_codecs_copy = decoder->native_codecs;
                 native_codecs_copy.push_back(VIDEO_CODEC_NONE); // this needs to be NULL-terminated
-                *decode_line = get_best_decoder_from(desc.color_spec, native_codecs_copy.data(), &out_codec);
-                if (*decode_line) {
+                *decode_line = get_best_conv_plan_from(desc.color_spec, native_codecs_copy.data(),
+                                                       &out_codec, &decoder->conv_plan);
+                if (*decode_line || decoder->conv_plan) {
                         decoder->decoder_type = LINE_DECODER;
                         goto after_linedecoder_lookup;
                 }
@@ -1077,8 +1296,18 @@ static codec_t choose_codec_and_decoder(struct state_video_decoder *decoder, str
 after_linedecoder_lookup:
 
         /* we didn't find line decoder. So try now regular (aka DXT) decoder */
-        if(*decode_line == NULL) {
-                decoder->decompress_state.resize(decoder->max_substreams);
+        if (*decode_line == NULL && decoder->conv_plan == nullptr) {
+                decoder->decompress_instances = 1;
+                if (decoder->frame_parallel > 1) {
+                        if (is_codec_interframe(desc.color_spec)) {
+                                MSG(WARNING, "Frame-parallel decoding ignored for "
+                                    "interframe codec %s.\n",
+                                    get_codec_name(desc.color_spec));
+                        } else {
+                                decoder->decompress_instances = decoder->frame_parallel;
+                        }
+                }
+                decoder->decompress_state.resize(decoder->max_substreams * decoder->decompress_instances);
 
                 // try to probe video format
                 if (comp_int_prop.depth == 0 && decoder->out_codec != VIDEO_CODEC_END) {
@@ -1278,6 +1507,7 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                         memcpy(out->shifts, display_requested_rgb_shift, 3 * sizeof(int));
 
                         out->decode_line = decode_line;
+                        out->conv_plan = decoder->conv_plan;
                         out->dst_pitch = decoder->pitch;
                         out->src_linesize = vc_get_linesize(desc.width, desc.color_spec);
                         out->dst_linesize = vc_get_linesize(desc.width, out_codec);
@@ -1299,6 +1529,7 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                                                         3 * sizeof(int));
 
                                         out->decode_line = decode_line;
+                                        out->conv_plan = decoder->conv_plan;
 
                                         out->dst_pitch = decoder->pitch;
                                         out->src_linesize =
@@ -1321,6 +1552,7 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                                                         3 * sizeof(int));
 
                                         out->decode_line = decode_line;
+                                        out->conv_plan = decoder->conv_plan;
                                         out->src_linesize =
                                                 vc_get_linesize(desc.width, desc.color_spec);
                                         out->dst_pitch =
@@ -1707,9 +1939,9 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                                          * we have offset for destination
                                          * we update source contiguously
                                          * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
+                                        line_decoder_decode(line_decoder,
+                                                        (unsigned char *) tile->data + line_decoder->base_offset + offset,
+                                                        source, l);
                                         /* we decoded one line (or a part of one line) to the end of the line
                                          * so decrease *source* len by 1 line (or that part of the line */
                                         len -= line_decoder->src_linesize - s_x;
@@ -58,8 +58,12 @@
 
 #include <algorithm>
 #include <array>
+#include <cerrno>
+#include <chrono>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #include "audio/codec.h"
@@ -78,6 +82,7 @@
 #include "transmit.h"
 #include "tv.h"
 #include "utils/jpeg_reader.h"
+#include "utils/macros.h"
 #include "utils/misc.h" // unit_evaluate
 #include "utils/random.h"
 #include "video.h"
@@ -89,6 +94,8 @@
 #define FEC_MAX_MULT 10
 
 #define CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_NS NS_IN_SEC
+#define DEFAULT_PACING_BURST 16
+#define PACING_REPORT_INTERVAL_NS (5 * NS_IN_SEC)
 
 #ifdef __APPLE__
 #define GET_STARTTIME gettimeofday(&start, NULL)
@@ -108,6 +115,9 @@
 
 using std::array;
 using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
 
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream);
 static void tx_done(struct module *tx);
@@ -162,6 +172,133 @@ struct tx {
         char tmp_packet[RTP_MAX_MTU];
 };
 
+ADD_TO_PARAM("tx-pacing-burst", "* tx-pacing-burst=<packets>\n"
+                "  Burst size of the token-bucket packet pacer (default " TOSTRING(DEFAULT_PACING_BURST) "),\n"
+                "  0 - legacy per-packet busy-wait pacing\n");
+/**
+ * Token-bucket pacer shared by all TX instances of the process (video
+ * substreams and audio) to keep the total egress smooth. Video sets the
+ * refill rate per tile and waits for the tokens, audio packets are only
+ * accounted against the bucket. Bucket capacity (burst) caps the overshoot
+ * after the sending thread has been preempted.
+ */
+static struct tx_pacer {
+        std::mutex lock;
+        int burst_pkts = -1;    ///< -1 until initialized from param
+        double rate = 0;        ///< refill rate [B/ns], 0 - inactive
+        double tokens = 0;      ///< [B], may drop below 0 due to audio
+        double capacity = 0;    ///< [B]
+        long long last_refill = 0;
+
+        long long stat_start = 0;
+        long long stat_bytes = 0;
+        long long stat_send_ns = 0;
+        double stat_target_ns = 0;
+        long long stat_sleeps = 0;
+} pacer;
+
+static long long pacer_now()
+{
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void pacer_sleep_until(long long deadline_ns)
+{
+#ifdef __linux__ // steady_clock is CLOCK_MONOTONIC
+        struct timespec ts = { (time_t) (deadline_ns / NS_IN_SEC), (long) (deadline_ns % NS_IN_SEC) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+#else
+        std::this_thread::sleep_until(steady_clock::time_point(nanoseconds(deadline_ns)));
+#endif
+}
+
+static int pacer_get_burst()
+{
+        std::lock_guard<std::mutex> lk(pacer.lock);
+        if (pacer.burst_pkts == -1) {
+                const char *burst = get_commandline_param("tx-pacing-burst");
+                pacer.burst_pkts = burst != nullptr ? std::max(atoi(burst), 0) : DEFAULT_PACING_BURST;
+        }
+        return pacer.burst_pkts;
+}
+
+/// must be called with pacer.lock held
+static void pacer_refill(long long now)
+{
+        pacer.tokens = std::min(pacer.capacity, pacer.tokens + (double) (now - pacer.last_refill) * pacer.rate);
+        pacer.last_refill = now;
+}
+
+/// @param rate  [B/ns]
+static void pacer_set_rate(double rate, unsigned mtu)
+{
+        std::lock_guard<std::mutex> lk(pacer.lock);
+        const long long now = pacer_now();
+        pacer.capacity = (double) pacer.burst_pkts * mtu;
+        if (pacer.rate > 0) {
+                pacer_refill(now);
+        } else {
+                pacer.tokens = pacer.capacity;
+        }
+        pacer.rate = rate;
+        pacer.last_refill = now;
+}
+
+/**
+ * Waits until the bucket has tokens for the packet and consumes them. If
+ * sleeping, waits for a whole burst (or rest of the tile) to be sent at once.
+ */
+static void pacer_wait(long bytes, long remaining)
+{
+        std::unique_lock<std::mutex> lk(pacer.lock);
+        const long long now = pacer_now();
+        pacer_refill(now);
+        if (pacer.tokens < bytes) {
+                const double want = std::max<double>(bytes, std::min<double>(pacer.capacity, remaining));
+                const long long deadline = now + (long long) ((want - pacer.tokens) / pacer.rate);
+                pacer.stat_sleeps += 1;
+                lk.unlock();
+                pacer_sleep_until(deadline);
+                lk.lock();
+                pacer_refill(pacer_now());
+        }
+        pacer.tokens -= bytes;
+}
+
+/// accounts packets sent outside the pacer (audio)
+static void pacer_account(long bytes)
+{
+        std::lock_guard<std::mutex> lk(pacer.lock);
+        if (pacer.rate == 0) {
+                return;
+        }
+        pacer_refill(pacer_now());
+        pacer.tokens -= bytes;
+}
+
+static void pacer_report(long bytes, long long send_ns, double target_ns)
+{
+        std::lock_guard<std::mutex> lk(pacer.lock);
+        pacer.stat_bytes += bytes;
+        pacer.stat_send_ns += send_ns;
+        pacer.stat_target_ns += target_ns;
+        const long long now = pacer_now();
+        if (pacer.stat_start == 0) {
+                pacer.stat_start = now;
+        }
+        if (now - pacer.stat_start < PACING_REPORT_INTERVAL_NS || pacer.stat_send_ns == 0) {
+                return;
+        }
+        MSG(VERBOSE, "Pacing: achieved %.2f Mbps, target %.2f Mbps, %.1f sleeps/s\n",
+                        (double) pacer.stat_bytes * 8 * 1000 / (double) pacer.stat_send_ns,
+                        (double) pacer.stat_bytes * 8 * 1000 / pacer.stat_target_ns,
+                        (double) pacer.stat_sleeps * NS_IN_SEC / (double) (now - pacer.stat_start));
+        pacer.stat_start = now;
+        pacer.stat_bytes = pacer.stat_send_ns = pacer.stat_sleeps = 0;
+        pacer.stat_target_ns = 0;
+}
+
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
 {
         if(!frame) {
@@ -383,7 +520,8 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
 {
         unsigned int i;
 
-        assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
+        // packet multiplication works per slice, other FEC is rejected by the sender (needs whole frames)
+        assert(!frame->fragment || tx->fec_scheme == FEC_NONE || tx->fec_scheme == FEC_MULT);
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
 
@@ -414,7 +552,10 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
                 tx_send_base(tx, frame, rtp_session, ts, last,
                                 i, fragment_offset);
         }
-        tx->buffer++;
+        // slices of one frame share the buffer ID, receiver places them by offset
+        if (!frame->fragment || frame->last_fragment) {
+                tx->buffer++;
+        }
 }
 
 void format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx, uint32_t *video_hdr)
@@ -423,7 +564,11 @@ void format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx
 
         video_hdr[3] = htonl(frame->tiles[tile_idx].width << 16 | frame->tiles[tile_idx].height);
         video_hdr[4] = get_fourcc(frame->color_spec);
-        video_hdr[2] = htonl(frame->tiles[tile_idx].data_len);
+        // fragment (slice) carries only a part of the (uncompressed) tile
+        video_hdr[2] = htonl(frame->fragment ? vc_get_datalen(frame->tiles[tile_idx].width,
+                                                              frame->tiles[tile_idx].height,
+                                                              frame->color_spec)
+                                             : frame->tiles[tile_idx].data_len);
         tmp = tile_idx << 22;
         tmp |= 0x3fffff & buffer_idx;
         video_hdr[0] = htonl(tmp);
@@ -578,6 +723,12 @@ report_stats(struct tx *tx, struct rtp *rtp_session, long data_sent)
             << " " << media << " " << tx->sent_since_report;
 
         control_report_stats(tx->control, oss.str());
+        if (const uint64_t retransmitted = rtp_get_retransmitted(rtp_session)) {
+                oss.str("");
+                oss << "tx_retransmit " << std::hex << rtp_my_ssrc(rtp_session)
+                    << std::dec << " " << media << " " << retransmitted;
+                control_report_stats(tx->control, oss.str());
+        }
         tx->last_stat_report  = current_time_ns;
         tx->sent_since_report = 0;
 }
@@ -592,6 +743,12 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
                 return 0;
         }
         double time_for_frame = 1.0 / frame->fps / frame->tile_count;
+        if (frame->fragment) { // slice gets its share of the frame time
+                time_for_frame = time_for_frame * frame->tiles[substream].data_len /
+                                 vc_get_datalen(frame->tiles[substream].width,
+                                                frame->tiles[substream].height,
+                                                frame->color_spec);
+        }
         double interval_between_pkts = time_for_frame / tx->mult_count / packet_count;
         // use only 75% of the time - we less likely overshot the frame time and
         // can minimize risk of swapping packets between 2 frames (out-of-order ones)
@@ -636,7 +793,6 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 unsigned int substream,
                 int fragment_offset)
 {
-        assert(fragment_offset == 0); // no longer supported
         if (!rtp_has_receiver(rtp_session)) {
                 return;
         }
@@ -699,12 +855,21 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 unsigned pos = 0;
                 for (unsigned i = 0; i < packet_sizes.size(); ++i) {
                         memcpy(rtp_hdr_packet, rtp_hdr, rtp_hdr_len);
-                        rtp_hdr_packet[1] = htonl(pos);
+                        rtp_hdr_packet[1] = htonl(fragment_offset + pos);
                         rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
                         pos += packet_sizes.at(i);
                 }
         }
 
+        const long total_len =
+            (long) tile->data_len * tx->mult_count + rtp_hdr_len * mult_pkt_cnt;
+        const bool bucket_pacing = packet_rate > 0 && pacer_get_burst() > 0;
+        if (bucket_pacing) {
+                pacer_set_rate((double) total_len / ((double) packet_rate * mult_pkt_cnt), tx->mtu);
+        }
+        long remaining = total_len;
+        const long long send_start = pacer_now();
+
         if (!tx->encryption) {
                 rtp_async_start(rtp_session, mult_pkt_cnt);
         }
@@ -713,7 +878,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         for (long i = 0; i < mult_pkt_cnt; ++i) {
                 GET_STARTTIME;
                 const int m        = i == mult_pkt_cnt - 1 ? send_m : 0;
-                char     *data     = tile->data + ntohl(rtp_hdr_packet[1]);
+                char     *data     = tile->data + ntohl(rtp_hdr_packet[1]) - fragment_offset;
                 int       data_len = packet_sizes.at(i % packet_sizes.size());
 
                 char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
@@ -728,13 +893,17 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         data = encrypted_data;
                 }
 
+                if (bucket_pacing) {
+                        pacer_wait(data_len + rtp_hdr_len, remaining);
+                        remaining -= data_len + rtp_hdr_len;
+                }
                 rtp_send_data_hdr(rtp_session, ts, pt, m, 0, nullptr,
                                   (char *) rtp_hdr_packet, rtp_hdr_len, data,
                                   data_len, nullptr, 0, 0);
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
 
-                // TRAFFIC SHAPER
-                if (m != 1) { // wait for all but last packet
+                // TRAFFIC SHAPER (legacy busy-wait)
+                if (!bucket_pacing && m != 1) { // wait for all but last packet
                         do {
                                 GET_STOPTIME;
                                 GET_DELTA;
@@ -746,6 +915,10 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
 
         const long data_sent = tile->data_len + rtp_hdr_len * mult_pkt_cnt;
         report_stats(tx, rtp_session, data_sent);
+        if (bucket_pacing && log_level >= LOG_LEVEL_VERBOSE) {
+                pacer_report(total_len, pacer_now() - send_start,
+                             (double) packet_rate * mult_pkt_cnt);
+        }
 
         if (!tx->encryption) {
                 rtp_async_wait(rtp_session);
@@ -862,6 +1035,7 @@ audio_tx_send_chan(struct tx *tx, struct rtp *rtp_session, uint32_t timestamp,
                 }
 
                 data_sent += data_len + rtp_hdr_len;
+                pacer_account(data_len + rtp_hdr_len);
 
                 rtp_send_data_hdr(rtp_session, timestamp, pt, m,
                                   0, /* contributing sources */
@@ -980,6 +1154,7 @@ void audio_tx_send_standard(struct tx* tx, struct rtp *rtp_session,
                 rtp_send_data(rtp_session, ts, pt, 0, 0, /* contributing sources 		*/
                                 0, 												/* contributing sources length 	*/
                                 tx->tmp_packet, pkt_len, 0, 0, 0);
+                pacer_account(pkt_len);
                 pos += pkt_len;
 	} while (pos < data_len);
 }
@@ -221,6 +221,7 @@ struct fec_desc {
 /// flags common for both audio and video frame
 enum frame_flags_common {
         TIMESTAMP_VALID = 1 << 0, ///< timestamp set by source (in 90 kHz clock)
+        FRAME_UNCHANGED = 1 << 1, ///< (video) content is identical to the previous frame of the source
 };
 
 struct video_frame;
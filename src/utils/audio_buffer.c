@@ -41,12 +41,20 @@
 #include "config_win32.h"
 #endif
 
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio/resampler.h"
 #include "audio/types.h"
 #include "debug.h"
 #include "host.h"
 #include "utils/audio_buffer.h"
+#include "utils/macros.h"
 #include "utils/ring_buffer.h"
 
+#define MOD_NAME "[audio_buffer] "
 #define WINDOW 50
 
 #undef max
@@ -60,6 +68,12 @@
 #define AGGRESSIVITY_MAX 4
 #define AGGRESSIVITY_STEP 100
 
+#define DRIFT_TARGET_MS_DEFAULT 15
+#define DRIFT_RATIO_MAX 0.005   ///< max deviation of the resampling ratio from 1
+#define DRIFT_KP 0.2            ///< ratio change per second of occupancy error
+#define DRIFT_KI 0.01           ///< ratio change per second of integrated error (per s)
+#define DRIFT_SMOOTH_S 0.5      ///< time constant of occupancy averaging
+
 static const int occupacy_windows[] = { 50, 200 };
 
 struct audio_buffer {
@@ -75,8 +89,19 @@ struct audio_buffer {
         int last_overrun; // last overrun n output frames ago
         int aggressivity;
         int last_aggressivity_change;
+
+        // drift compensation, see update_drift_ratio()
+        struct interleaved_resampler *resampler; ///< NULL if not used (drop samples instead)
+        int drift_target_ms;
+        double occupancy_s;     ///< smoothed occupancy (reader)
+        double integral;        ///< PI controller integrated error (reader)
+        atomic_int ratio_ppb;   ///< (resampling ratio - 1) * 10^9, set by reader for writer
 };
 
+ADD_TO_PARAM("audio-buffer-resample", "* audio-buffer-resample[=<ms>]\n"
+                "  Compensate sender/receiver clock drift in the playback buffer by resampling\n"
+                "  instead of dropping samples, keep <ms> buffered (default " TOSTRING(DRIFT_TARGET_MS_DEFAULT) ")\n");
+
 struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, int suggested_latency_ms)
 {
         struct audio_buffer *buf = calloc(1, sizeof(struct audio_buffer));
@@ -93,6 +118,19 @@ struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, i
         buf->aggressivity = 1;
         buf->last_aggressivity_change = AGGRESSIVITY_STEP;
 
+        const char *drift_cfg = get_commandline_param("audio-buffer-resample");
+        if (drift_cfg != NULL) {
+                buf->drift_target_ms = strlen(drift_cfg) > 0 ? atoi(drift_cfg) : DRIFT_TARGET_MS_DEFAULT;
+                buf->resampler = interleaved_resampler_init();
+                if (buf->resampler == NULL) {
+                        MSG(WARNING, "Resampler not available, latency will be "
+                                     "controlled by dropping samples.\n");
+                } else {
+                        MSG(INFO, "Compensating clock drift by resampling, "
+                                  "target latency %d ms.\n", buf->drift_target_ms);
+                }
+        }
+
         return buf;
 }
 
@@ -102,9 +140,28 @@ void audio_buffer_destroy(struct audio_buffer *buf)
                 return;
         }
         ring_buffer_destroy(buf->ring);
+        interleaved_resampler_done(buf->resampler);
         free(buf);
 }
 
+/**
+ * Estimates the sender/receiver clock ratio from buffer occupancy with
+ * a PI controller. Writer resamples incoming data by the resulting ratio
+ * so that the occupancy stays at the requested latency without drops.
+ */
+static void update_drift_ratio(struct audio_buffer *buf, int ring_size, int read_len,
+                               int requested_latency_bytes)
+{
+        const double bytes_per_s = (double) buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate;
+        const double dt = read_len / bytes_per_s;
+        buf->occupancy_s += (ring_size / bytes_per_s - buf->occupancy_s) * min(dt / DRIFT_SMOOTH_S, 1.0);
+        const double error = buf->occupancy_s - requested_latency_bytes / bytes_per_s;
+        buf->integral = CLAMP(buf->integral + error * dt, -DRIFT_RATIO_MAX / DRIFT_KI, DRIFT_RATIO_MAX / DRIFT_KI);
+        const double ratio = CLAMP(1.0 - (DRIFT_KP * error + DRIFT_KI * buf->integral),
+                                   1.0 - DRIFT_RATIO_MAX, 1.0 + DRIFT_RATIO_MAX);
+        atomic_store_explicit(&buf->ratio_ppb, (int) lround((ratio - 1.0) * 1E9), memory_order_relaxed);
+}
+
 int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
 {
         if (buf->out_pkt_size > 0) {
@@ -134,6 +191,13 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
 
         int suggested_latency_bytes = buf->suggested_latency_ms * buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate / 1000;
         int requested_latency_bytes = max(suggested_latency_bytes, 2*max(buf->in_pkt_size, buf->out_pkt_size));
+        if (buf->resampler != NULL) {
+                // controller keeps average occupancy, drop only on gross overrun
+                int target_bytes = max(buf->drift_target_ms * buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate / 1000,
+                                buf->in_pkt_size + buf->out_pkt_size);
+                update_drift_ratio(buf, ring_size, max_len, target_bytes);
+                requested_latency_bytes = 2 * target_bytes + buf->in_pkt_size;
+        }
 
         int ret = ring_buffer_read(buf->ring, out, max_len);
 
@@ -163,7 +227,7 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
                 buf->last_overrun += 1;
         }
 
-        log_msg(LOG_LEVEL_DEBUG, "buf - in a. %d, out a. %d, occ. a. [%d,%d] last under/overrun %d, %d aggressivity %d\n", buf->in_pkt_size, buf->out_pkt_size, buf->avg_occupancy[0],buf->avg_occupancy[1], buf->last_underrun, buf->last_overrun, buf->aggressivity);
+        log_msg(LOG_LEVEL_DEBUG, "buf - in a. %d, out a. %d, occ. a. [%d,%d] last under/overrun %d, %d aggressivity %d ratio %+d ppb\n", buf->in_pkt_size, buf->out_pkt_size, buf->avg_occupancy[0],buf->avg_occupancy[1], buf->last_underrun, buf->last_overrun, buf->aggressivity, atomic_load_explicit(&buf->ratio_ppb, memory_order_relaxed));
 
         return ret;
 }
@@ -175,6 +239,15 @@ void audio_buffer_write(struct audio_buffer *buf, const char *in, int len)
         } else {
                 buf->in_pkt_size = len;
         }
+        if (buf->resampler != NULL) {
+                const double ratio = 1.0 + atomic_load_explicit(&buf->ratio_ppb, memory_order_relaxed) / 1E9;
+                int out_len = 0;
+                const char *out = interleaved_resampler_process(buf->resampler, &buf->desc, in, len, ratio, &out_len);
+                if (out != NULL) {
+                        ring_buffer_write(buf->ring, out, out_len);
+                        return;
+                }
+        }
         ring_buffer_write(buf->ring, in, len);
 }
 
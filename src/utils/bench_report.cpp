@@ -0,0 +1,257 @@
+/**
+ * @file   utils/bench_report.cpp
+ * @brief  Per-run pipeline benchmark report (fps, drops, CPU, latency)
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "tv.h"
+#include "utils/bench_report.h"
+#include "utils/metrics.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[bench] "
+
+using std::map;
+using std::mutex;
+using std::ostringstream;
+using std::string;
+using std::unique_lock;
+using std::vector;
+
+enum {
+        CAPTURED_RING = 256,            ///< frames in flight that can be matched on display
+        LATENCY_SAMPLES_MAX = 1 << 20,
+        CPU_SAMPLE_MS = 500,
+};
+
+bool bench_active = false;
+
+static struct {
+        const char *file = nullptr;
+        time_ns_t start = 0;
+        clock_t cpu_start = 0;
+
+        mutex lock;
+        struct {
+                uint32_t rtp_ts;
+                time_ns_t time;
+        } captured[CAPTURED_RING] = {};
+        unsigned captured_idx = 0;
+        vector<time_ns_t> latency;
+
+        // per thread CPU time, sampled periodically since threads exit before the report
+        map<int, std::pair<string, double>> thread_cpu; ///< tid -> (name, seconds)
+        std::thread sampler;
+        std::condition_variable cv;
+        bool should_exit = false;
+} bench;
+
+void bench_frame_captured_slow(uint32_t rtp_ts)
+{
+        unique_lock<mutex> lk(bench.lock);
+        bench.captured[bench.captured_idx] = { rtp_ts, get_time_in_ns() };
+        bench.captured_idx = (bench.captured_idx + 1) % CAPTURED_RING;
+}
+
+void bench_frame_displayed_slow(uint32_t rtp_ts)
+{
+        const time_ns_t now = get_time_in_ns();
+        unique_lock<mutex> lk(bench.lock);
+        for (auto &c : bench.captured) {
+                if (c.time != 0 && c.rtp_ts == rtp_ts) {
+                        if (bench.latency.size() < LATENCY_SAMPLES_MAX) {
+                                bench.latency.push_back(now - c.time);
+                        }
+                        metric_observe_ns(METRIC_VIDEO_LATENCY, now - c.time);
+                        c.time = 0; // count every frame once (tiles share TS)
+                        return;
+                }
+        }
+}
+
+static void sample_thread_cpu()
+{
+#ifdef __linux__
+        static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+        DIR *dir = opendir("/proc/self/task");
+        if (dir == nullptr) {
+                return;
+        }
+        struct dirent *ent = nullptr;
+        while ((ent = readdir(dir)) != nullptr) {
+                if (ent->d_name[0] == '.') {
+                        continue;
+                }
+                string task = string("/proc/self/task/") + ent->d_name;
+                string name;
+                std::getline(std::ifstream(task + "/comm"), name);
+                string stat;
+                std::getline(std::ifstream(task + "/stat"), stat);
+                // fields after the parenthesized comm, utime and stime are 14th and 15th
+                size_t pos = stat.rfind(')');
+                if (pos == string::npos) {
+                        continue;
+                }
+                std::istringstream iss(stat.substr(pos + 2));
+                string field;
+                for (int i = 3; i < 14; ++i) {
+                        iss >> field;
+                }
+                unsigned long long utime = 0;
+                unsigned long long stime = 0;
+                iss >> utime >> stime;
+                unique_lock<mutex> lk(bench.lock);
+                bench.thread_cpu[atoi(ent->d_name)] = { name, (double) (utime + stime) / ticks_per_sec };
+        }
+        closedir(dir);
+#endif
+}
+
+static void sampler_loop()
+{
+        set_thread_name("bench");
+        unique_lock<mutex> lk(bench.lock);
+        while (!bench.should_exit) {
+                lk.unlock();
+                sample_thread_cpu();
+                lk.lock();
+                bench.cv.wait_for(lk, std::chrono::milliseconds(CPU_SAMPLE_MS),
+                                  [] { return bench.should_exit; });
+        }
+}
+
+ADD_TO_PARAM("bench-report", "* bench-report=<file>\n"
+                "  Write a JSON report with achieved fps, dropped frames, CPU time per thread\n"
+                "  and capture-to-display latency (if sender is in the same process) at exit.\n");
+bool bench_report_init()
+{
+        bench.file = get_commandline_param("bench-report");
+        if (bench.file == nullptr) {
+                return true;
+        }
+        bench.start = get_time_in_ns();
+        bench.cpu_start = clock();
+        metrics_active = true;
+        bench_active = true;
+        bench.sampler = std::thread(sampler_loop);
+        return true;
+}
+
+static double percentile_ms(vector<time_ns_t> &v, double p)
+{
+        if (v.empty()) {
+                return 0.0;
+        }
+        size_t idx = std::min(v.size() - 1, (size_t) (p * v.size()));
+        std::nth_element(v.begin(), v.begin() + idx, v.end());
+        return v[idx] / MS_IN_NS_DBL;
+}
+
+void bench_report_done()
+{
+        if (!bench_active) {
+                return;
+        }
+        {
+                unique_lock<mutex> lk(bench.lock);
+                bench.should_exit = true;
+        }
+        bench.cv.notify_one();
+        bench.sampler.join();
+        sample_thread_cpu();
+        bench_active = false;
+
+        const double duration = (get_time_in_ns() - bench.start) / NS_IN_SEC_DBL;
+        map<string, double> cpu_by_name;
+        for (auto &t : bench.thread_cpu) {
+                cpu_by_name[t.second.first] += t.second.second;
+        }
+
+        ostringstream oss;
+        oss << "{\n"
+            << "  \"duration_s\": " << duration << ",\n"
+            << "  \"fps_captured\": " << metric_get_count(METRIC_VIDEO_FRAMES_CAPTURED) / duration << ",\n"
+            << "  \"fps_displayed\": " << metric_get_count(METRIC_VIDEO_FRAMES_DISPLAYED) / duration << ",\n"
+            << "  \"frames_dropped\": " << metric_get_count(METRIC_VIDEO_FRAMES_DROPPED) << ",\n"
+            << "  \"frames_corrupted\": " << metric_get_count(METRIC_VIDEO_FRAMES_CORRUPTED) << ",\n"
+            << "  \"packets_lost\": " << metric_get_count(METRIC_RTP_LOST_PACKETS) << ",\n"
+            << "  \"latency_ms\": { \"samples\": " << bench.latency.size()
+            << ", \"p50\": " << percentile_ms(bench.latency, 0.5)
+            << ", \"p99\": " << percentile_ms(bench.latency, 0.99) << " },\n"
+            << "  \"stage_time_s\": { \"compress\": " << metric_get_sum_ns(METRIC_VIDEO_COMPRESS_TIME) / NS_IN_SEC_DBL
+            << ", \"decompress\": " << metric_get_sum_ns(METRIC_VIDEO_DECOMPRESS_TIME) / NS_IN_SEC_DBL << " },\n"
+            << "  \"cpu_total_s\": " << (double) (clock() - bench.cpu_start) / CLOCKS_PER_SEC << ",\n"
+            << "  \"cpu_s\": {";
+        const char *sep = "";
+        for (auto &c : cpu_by_name) {
+                oss << sep << "\n    \"" << c.first << "\": " << c.second;
+                sep = ",";
+        }
+        oss << "\n  }\n}\n";
+
+        FILE *f = fopen(bench.file, "w");
+        if (f == nullptr) {
+                perror(MOD_NAME "fopen");
+                return;
+        }
+        fputs(oss.str().c_str(), f);
+        fclose(f);
+        MSG(INFO, "Report written to %s\n", bench.file);
+}
@@ -0,0 +1,84 @@
+/**
+ * @file   utils/bench_report.h
+ * @brief  Per-run pipeline benchmark report (fps, drops, CPU, latency)
+ *
+ * Enabled with "--param bench-report=<file>", the report is written as JSON
+ * at exit. Used by tools/pipeline_bench.sh.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_BENCH_REPORT_H_
+#define UTILS_BENCH_REPORT_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern bool bench_active;
+
+void bench_frame_captured_slow(uint32_t rtp_ts);
+void bench_frame_displayed_slow(uint32_t rtp_ts);
+
+/**
+ * Records capture time of a frame, rtp_ts is the RTP timestamp that the
+ * frame will be sent with.
+ */
+static inline void bench_frame_captured(uint32_t rtp_ts) {
+        if (bench_active) {
+                bench_frame_captured_slow(rtp_ts);
+        }
+}
+
+/// computes capture-to-display latency of a frame captured in this process
+static inline void bench_frame_displayed(uint32_t rtp_ts) {
+        if (bench_active) {
+                bench_frame_displayed_slow(rtp_ts);
+        }
+}
+
+bool bench_report_init(void);
+void bench_report_done(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_BENCH_REPORT_H_
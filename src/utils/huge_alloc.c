@@ -0,0 +1,235 @@
+/**
+ * @file   utils/huge_alloc.c
+ * @brief  Large buffer allocation backed by huge pages, optionally NUMA-local
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef MAP_HUGE_1GB // linux/mman.h
+#define MAP_HUGE_1GB (30 << 26)
+#endif
+#endif
+
+#include "debug.h"
+#include "utils/huge_alloc.h"
+
+#define MOD_NAME "[huge_alloc] "
+#define HUGE_ALLOC_MAGIC 0x48554745U
+
+enum {
+        HDR_LEN = 64, ///< keeps the returned pointer cache-line aligned
+        HUGE_2M = 2 * 1024 * 1024,
+        HUGE_1G = 1024 * 1024 * 1024,
+};
+
+/// stored in front of the returned buffer
+struct huge_alloc_hdr {
+        uint32_t magic;
+        enum huge_alloc_mode mode; ///< actually used mode
+        bool     numa_bound;       ///< bound to the node of the allocating thread
+        size_t   map_len;          ///< mmap length, 0 if allocated by malloc
+};
+_Static_assert(sizeof(struct huge_alloc_hdr) <= HDR_LEN, "header too long");
+
+static const char *const mode_names[] = {
+        [HUGE_ALLOC_MALLOC] = "malloc",
+        [HUGE_ALLOC_THP] = "thp",
+        [HUGE_ALLOC_HUGETLB] = "hugetlb",
+        [HUGE_ALLOC_HUGETLB_1G] = "hugetlb1g",
+};
+
+const char *huge_alloc_mode_to_str(enum huge_alloc_mode mode)
+{
+        return mode_names[mode];
+}
+
+bool huge_alloc_parse(const char *cfg, struct huge_alloc_cfg *out)
+{
+        *out = (struct huge_alloc_cfg){ HUGE_ALLOC_MALLOC, false };
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *it = tmp;
+        bool ret = true;
+        while (ret && (item = strtok_r(it, ":", &save_ptr)) != NULL) {
+                it = NULL;
+                if (strcmp(item, "numa") == 0) {
+                        out->numa_local = true;
+                        continue;
+                }
+                ret = false;
+                for (unsigned i = 0; i < sizeof mode_names / sizeof mode_names[0]; ++i) {
+                        if (strcmp(item, mode_names[i]) == 0) {
+                                out->mode = (enum huge_alloc_mode) i;
+                                ret = true;
+                        }
+                }
+                if (!ret) {
+                        MSG(ERROR, "Unknown allocation mode: %s\n", item);
+                }
+        }
+        free(tmp);
+        return ret;
+}
+
+#ifdef __linux__
+/// sets preferred node of the range to the node the calling thread runs on
+static bool bind_local_node(void *addr, size_t len)
+{
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (getcpu(&cpu, &node) != 0) {
+                return false;
+        }
+        unsigned long nodemask[16] = { 0 }; // up to 1024 nodes
+        if (node >= sizeof nodemask * 8) {
+                return false;
+        }
+        nodemask[node / (sizeof nodemask[0] * 8)] |= 1UL << (node % (sizeof nodemask[0] * 8));
+        if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, nodemask, sizeof nodemask * 8, 0) != 0) {
+                log_msg_once(LOG_LEVEL_WARNING, HUGE_ALLOC_MAGIC, MOD_NAME "mbind: %s\n",
+                             strerror(errno));
+                return false;
+        }
+        return true;
+}
+
+/**
+ * @param mode  HUGE_ALLOC_MALLOC maps regular pages (so that they can be bound
+ *              to a node)
+ */
+static void *map(size_t *len, enum huge_alloc_mode mode, bool numa_local, bool *numa_bound)
+{
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        size_t page = mode == HUGE_ALLOC_MALLOC ? (size_t) sysconf(_SC_PAGESIZE) : HUGE_2M;
+        if (mode == HUGE_ALLOC_HUGETLB || mode == HUGE_ALLOC_HUGETLB_1G) {
+                flags |= MAP_HUGETLB;
+        }
+        if (mode == HUGE_ALLOC_HUGETLB_1G) {
+                flags |= MAP_HUGE_1GB;
+                page = HUGE_1G;
+        }
+        *len = (*len + page - 1) / page * page;
+        void *ret = mmap(NULL, *len, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (ret == MAP_FAILED) {
+                return NULL;
+        }
+        if (mode == HUGE_ALLOC_THP && madvise(ret, *len, MADV_HUGEPAGE) != 0) {
+                log_msg_once(LOG_LEVEL_WARNING, HUGE_ALLOC_MAGIC + 1, MOD_NAME "madvise: %s\n",
+                             strerror(errno));
+        }
+        if (numa_local) { // before the pages are touched
+                *numa_bound = bind_local_node(ret, *len);
+        }
+        return ret;
+}
+#endif
+
+void *huge_alloc(size_t size, const struct huge_alloc_cfg *cfg)
+{
+        struct huge_alloc_hdr hdr = { HUGE_ALLOC_MAGIC, cfg->mode, false, 0 };
+        char *base = NULL;
+#ifdef __linux__
+        while (hdr.mode != HUGE_ALLOC_MALLOC || cfg->numa_local) {
+                hdr.map_len = size + HDR_LEN;
+                if ((base = map(&hdr.map_len, hdr.mode, cfg->numa_local, &hdr.numa_bound)) != NULL) {
+                        break;
+                }
+                hdr.map_len = 0;
+                if (hdr.mode == HUGE_ALLOC_MALLOC) { // NUMA-local regular pages, use unbound malloc
+                        break;
+                }
+                log_msg_once(LOG_LEVEL_WARNING, HUGE_ALLOC_MAGIC + 2 + hdr.mode,
+                             MOD_NAME "Cannot allocate %s pages (%s), falling back to %s.\n",
+                             mode_names[hdr.mode], strerror(errno), mode_names[hdr.mode - 1]);
+                hdr.mode -= 1;
+        }
+#else
+        if (hdr.mode != HUGE_ALLOC_MALLOC || cfg->numa_local) {
+                log_msg_once(LOG_LEVEL_WARNING, HUGE_ALLOC_MAGIC,
+                             MOD_NAME "Huge pages and NUMA binding supported only in Linux.\n");
+                hdr.mode = HUGE_ALLOC_MALLOC;
+        }
+#endif
+        if (base == NULL) {
+                if ((base = aligned_alloc(HDR_LEN, (size + 2 * HDR_LEN - 1) / HDR_LEN * HDR_LEN)) == NULL) {
+                        return NULL;
+                }
+        }
+        memcpy(base, &hdr, sizeof hdr);
+        return base + HDR_LEN;
+}
+
+void huge_free(void *ptr)
+{
+        if (ptr == NULL) {
+                return;
+        }
+        char *base = (char *) ptr - HDR_LEN;
+        struct huge_alloc_hdr hdr;
+        memcpy(&hdr, base, sizeof hdr);
+        assert(hdr.magic == HUGE_ALLOC_MAGIC);
+        if (hdr.map_len == 0) {
+                free(base);
+                return;
+        }
+#ifdef __linux__
+        munmap(base, hdr.map_len);
+#endif
+}
+
+struct huge_alloc_cfg huge_alloc_get_cfg(const void *ptr)
+{
+        struct huge_alloc_hdr hdr;
+        memcpy(&hdr, (const char *) ptr - HDR_LEN, sizeof hdr);
+        assert(hdr.magic == HUGE_ALLOC_MAGIC);
+        return (struct huge_alloc_cfg){ hdr.mode, hdr.numa_bound };
+}
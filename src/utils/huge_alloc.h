@@ -0,0 +1,88 @@
+/**
+ * @file   utils/huge_alloc.h
+ * @brief  Large buffer allocation backed by huge pages, optionally NUMA-local
+ *
+ * Intended for video frame buffers (see utils/video_frame_pool.h) where
+ * conversions over large frames suffer from TLB misses with 4 KiB pages.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_HUGE_ALLOC_H_
+#define UTILS_HUGE_ALLOC_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#else
+#include <cstddef>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum huge_alloc_mode {
+        HUGE_ALLOC_MALLOC,      ///< plain malloc()
+        HUGE_ALLOC_THP,         ///< mmap + madvise(MADV_HUGEPAGE) (transparent huge pages)
+        HUGE_ALLOC_HUGETLB,     ///< mmap(MAP_HUGETLB) 2 MiB pages (needs reserved pages)
+        HUGE_ALLOC_HUGETLB_1G,  ///< mmap(MAP_HUGETLB) 1 GiB pages (needs reserved pages)
+};
+
+struct huge_alloc_cfg {
+        enum huge_alloc_mode mode;
+        bool numa_local; ///< prefer NUMA node of the thread calling huge_alloc() (not of the one using the buffer)
+};
+
+/**
+ * Parses "<mode>[:numa]" or "numa", mode is one of malloc, thp, hugetlb, hugetlb1g.
+ * @retval false on wrong config
+ */
+bool huge_alloc_parse(const char *cfg, struct huge_alloc_cfg *out);
+const char *huge_alloc_mode_to_str(enum huge_alloc_mode mode);
+
+/**
+ * If huge pages cannot be obtained (eg. none reserved for HUGETLB), falls
+ * back to the nearest weaker mode. NUMA-local malloc mode maps regular pages.
+ * @returns 64 B aligned buffer to be freed with huge_free(), NULL on error
+ */
+void *huge_alloc(size_t size, const struct huge_alloc_cfg *cfg);
+void huge_free(void *ptr);
+/// @returns mode actually used for ptr returned by huge_alloc(), numa_local if binding succeeded
+struct huge_alloc_cfg huge_alloc_get_cfg(const void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_HUGE_ALLOC_H_
@@ -0,0 +1,335 @@
+/**
+ * @file   utils/metrics.cpp
+ * @brief  Sharded hot-path counters with OpenMetrics HTTP exporter
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/net_udp.h" // socket_error
+#include "utils/metrics.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[metrics] "
+
+#ifdef WIN32
+typedef const char *sso_val_type;
+#else
+typedef void *sso_val_type;
+#endif                          /* WIN32 */
+
+using std::atomic;
+using std::memory_order_relaxed;
+using std::ostringstream;
+using std::string;
+
+enum {
+        METRICS_SHARDS = 16, ///< threads are spread over shards to avoid cache-line bouncing
+        ACCEPT_TIMEOUT_MS = 200,
+};
+
+enum metric_type {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM,
+};
+
+static const struct {
+        const char *name;
+        enum metric_type type;
+        const char *help;
+} metric_desc[] = { // in enum ug_metric order
+        { "ug_rtp_rx_packets", COUNTER, "Received RTP packets" },
+        { "ug_rtp_rx_bytes", COUNTER, "Received RTP bytes including RTP headers" },
+        { "ug_rtp_tx_packets", COUNTER, "Successfully sent RTP packets" },
+        { "ug_rtp_tx_bytes", COUNTER, "Successfully sent RTP bytes including RTP headers" },
+        { "ug_rtp_lost_packets", COUNTER, "RTP packets missing in sequence" },
+        { "ug_rtp_retransmitted_packets", COUNTER, "RTP packets resent on NACK" },
+        { "ug_udp_rx_queue_full", COUNTER, "UDP reader stalls on full queue" },
+        { "ug_video_frames_captured", COUNTER, "Video frames grabbed from capture" },
+        { "ug_video_frames_displayed", COUNTER, "Video frames passed to display" },
+        { "ug_video_frames_dropped", COUNTER, "Video frames dropped by decoder" },
+        { "ug_video_frames_corrupted", COUNTER, "Incomplete received video frames" },
+        { "ug_fec_corrected_frames", COUNTER, "Frames repaired by FEC" },
+        { "ug_fec_failed_frames", COUNTER, "Frames FEC failed to repair" },
+        { "ug_udp_rx_queue_depth", GAUGE, "Packets waiting in UDP reader queue" },
+        { "ug_video_compress_seconds", HISTOGRAM, "Video frame compression duration" },
+        { "ug_video_decompress_seconds", HISTOGRAM, "Video frame decompression duration" },
+        { "ug_video_latency_seconds", HISTOGRAM, "Capture-to-display latency (sender in the same process)" },
+};
+
+static_assert(sizeof metric_desc / sizeof metric_desc[0] == METRIC_COUNT, "metric_desc incomplete");
+
+/// upper bounds of histogram buckets in ns, last (+Inf) bucket is implicit
+static const long long hist_bounds_ns[] = {
+        100'000, 250'000, 500'000, 1'000'000, 2'500'000, 5'000'000,
+        10'000'000, 25'000'000, 50'000'000, 100'000'000, 250'000'000,
+        1'000'000'000,
+};
+#define HIST_BUCKETS (sizeof hist_bounds_ns / sizeof hist_bounds_ns[0] + 1)
+
+struct alignas(64) metrics_shard {
+        atomic<uint64_t> counter[METRIC_COUNT];
+        atomic<uint64_t> hist[METRIC_COUNT][HIST_BUCKETS];
+        atomic<uint64_t> hist_sum_ns[METRIC_COUNT];
+};
+
+bool metrics_active = false;
+static metrics_shard shards[METRICS_SHARDS];
+static atomic<int64_t> gauges[METRIC_COUNT];
+static atomic<unsigned> next_shard;
+
+static struct {
+        fd_t fd = INVALID_SOCKET;
+        std::thread thread;
+        atomic<bool> should_exit{false};
+} server;
+
+static metrics_shard &get_shard()
+{
+        thread_local metrics_shard &shard =
+            shards[next_shard.fetch_add(1, memory_order_relaxed) % METRICS_SHARDS];
+        return shard;
+}
+
+void metric_add_slow(enum ug_metric m, uint64_t val)
+{
+        get_shard().counter[m].fetch_add(val, memory_order_relaxed);
+}
+
+void metric_set_slow(enum ug_metric m, int64_t val)
+{
+        gauges[m].store(val, memory_order_relaxed);
+}
+
+void metric_observe_ns_slow(enum ug_metric m, long long ns)
+{
+        unsigned bucket = 0;
+        while (bucket < HIST_BUCKETS - 1 && ns > hist_bounds_ns[bucket]) {
+                bucket++;
+        }
+        metrics_shard &shard = get_shard();
+        shard.hist[m][bucket].fetch_add(1, memory_order_relaxed);
+        shard.hist_sum_ns[m].fetch_add(ns, memory_order_relaxed);
+}
+
+uint64_t metric_get_count(enum ug_metric m)
+{
+        uint64_t sum = 0;
+        for (auto &s : shards) {
+                if (metric_desc[m].type == HISTOGRAM) {
+                        for (auto &b : s.hist[m]) {
+                                sum += b.load(memory_order_relaxed);
+                        }
+                } else {
+                        sum += s.counter[m].load(memory_order_relaxed);
+                }
+        }
+        return sum;
+}
+
+uint64_t metric_get_sum_ns(enum ug_metric m)
+{
+        uint64_t sum = 0;
+        for (auto &s : shards) {
+                sum += s.hist_sum_ns[m].load(memory_order_relaxed);
+        }
+        return sum;
+}
+
+static string metrics_format()
+{
+        ostringstream oss;
+        for (int i = 0; i < METRIC_COUNT; ++i) {
+                const auto &d = metric_desc[i];
+                oss << "# TYPE " << d.name << (d.type == COUNTER ? " counter\n" : d.type == GAUGE ? " gauge\n" : " histogram\n");
+                oss << "# HELP " << d.name << " " << d.help << "\n";
+                switch (d.type) {
+                case COUNTER: {
+                        uint64_t sum = 0;
+                        for (auto &s : shards) {
+                                sum += s.counter[i].load(memory_order_relaxed);
+                        }
+                        oss << d.name << "_total " << sum << "\n";
+                        break;
+                }
+                case GAUGE:
+                        oss << d.name << " " << gauges[i].load(memory_order_relaxed) << "\n";
+                        break;
+                case HISTOGRAM: {
+                        uint64_t count = 0;
+                        uint64_t sum_ns = 0;
+                        for (unsigned b = 0; b < HIST_BUCKETS; ++b) {
+                                for (auto &s : shards) {
+                                        count += s.hist[i][b].load(memory_order_relaxed);
+                                }
+                                oss << d.name << "_bucket{le=\"";
+                                if (b < HIST_BUCKETS - 1) {
+                                        oss << hist_bounds_ns[b] / 1E9;
+                                } else {
+                                        oss << "+Inf";
+                                }
+                                oss << "\"} " << count << "\n";
+                        }
+                        for (auto &s : shards) {
+                                sum_ns += s.hist_sum_ns[i].load(memory_order_relaxed);
+                        }
+                        oss << d.name << "_count " << count << "\n";
+                        oss << d.name << "_sum " << sum_ns / 1E9 << "\n";
+                        break;
+                }
+                }
+        }
+        oss << "# EOF\n";
+        return oss.str();
+}
+
+static void send_all(fd_t fd, const string &data)
+{
+        size_t sent = 0;
+        while (sent < data.size()) {
+                ssize_t ret = send(fd, data.data() + sent, data.size() - sent, 0);
+                if (ret <= 0) {
+                        return;
+                }
+                sent += ret;
+        }
+}
+
+static void serve_client(fd_t fd)
+{
+        // the request is not interpreted, every path returns the metrics
+        char buf[2048];
+        if (recv(fd, buf, sizeof buf, 0) <= 0) {
+                return;
+        }
+        string body = metrics_format();
+        ostringstream hdr;
+        hdr << "HTTP/1.0 200 OK\r\n"
+            << "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Connection: close\r\n\r\n";
+        send_all(fd, hdr.str() + body);
+}
+
+static void server_loop()
+{
+        set_thread_name("metrics");
+        while (!server.should_exit) {
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(server.fd, &fds);
+                struct timeval timeout = { 0, ACCEPT_TIMEOUT_MS * 1000 };
+                if (select(server.fd + 1, &fds, nullptr, nullptr, &timeout) <= 0) {
+                        continue;
+                }
+                fd_t fd = accept(server.fd, nullptr, nullptr);
+                if (fd == INVALID_SOCKET) {
+                        socket_error(MOD_NAME "accept");
+                        continue;
+                }
+#ifdef WIN32
+                DWORD rcv_timeout = 1000;
+#else
+                struct timeval rcv_timeout = { 1, 0 };
+#endif
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (sso_val_type) &rcv_timeout, sizeof rcv_timeout);
+                serve_client(fd);
+                CLOSESOCKET(fd);
+        }
+}
+
+ADD_TO_PARAM("metrics-port", "* metrics-port=<port>\n"
+                "  Serve counters and latency histograms in OpenMetrics (Prometheus) format over HTTP\n"
+                "  on localhost:<port>.\n");
+bool metrics_init()
+{
+        const char *port_str = get_commandline_param("metrics-port");
+        if (port_str == nullptr) {
+                return true;
+        }
+        const int port = atoi(port_str);
+        if (port <= 0 || port > 65535) {
+                MSG(ERROR, "Wrong port: %s\n", port_str);
+                return false;
+        }
+
+        server.fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (server.fd == INVALID_SOCKET) {
+                socket_error(MOD_NAME "socket");
+                return false;
+        }
+        int val = 1;
+        setsockopt(server.fd, SOL_SOCKET, SO_REUSEADDR, (sso_val_type) &val, sizeof val);
+        struct sockaddr_in sin{};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sin.sin_port = htons(port);
+        if (::bind(server.fd, (struct sockaddr *) &sin, sizeof sin) != 0 || listen(server.fd, 4) != 0) {
+                socket_error(MOD_NAME "bind");
+                CLOSESOCKET(server.fd);
+                server.fd = INVALID_SOCKET;
+                return false;
+        }
+
+        metrics_active = true;
+        server.thread = std::thread(server_loop);
+        MSG(INFO, "Serving metrics on http://localhost:%d/metrics\n", port);
+        return true;
+}
+
+void metrics_done()
+{
+        if (server.fd == INVALID_SOCKET) {
+                return;
+        }
+        server.should_exit = true;
+        server.thread.join();
+        CLOSESOCKET(server.fd);
+        server.fd = INVALID_SOCKET;
+        metrics_active = false;
+}
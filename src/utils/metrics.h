@@ -0,0 +1,124 @@
+/**
+ * @file   utils/metrics.h
+ * @brief  Process-wide hot-path counters exported in OpenMetrics format
+ *
+ * Metrics are identified by a fixed enum so that updating them is a single
+ * relaxed atomic operation on a per-thread shard without any lookup or lock.
+ * Updates are skipped altogether unless the exporter was started with
+ * "--param metrics-port=<port>".
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_METRICS_H_
+#define UTILS_METRICS_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ug_metric {
+        // counters
+        METRIC_RTP_RX_PACKETS,
+        METRIC_RTP_RX_BYTES,
+        METRIC_RTP_TX_PACKETS,
+        METRIC_RTP_TX_BYTES,
+        METRIC_RTP_LOST_PACKETS,
+        METRIC_RTP_RETRANSMITTED_PACKETS,
+        METRIC_UDP_RX_QUEUE_FULL,
+        METRIC_VIDEO_FRAMES_CAPTURED,
+        METRIC_VIDEO_FRAMES_DISPLAYED,
+        METRIC_VIDEO_FRAMES_DROPPED,
+        METRIC_VIDEO_FRAMES_CORRUPTED,
+        METRIC_FEC_CORRECTED_FRAMES,
+        METRIC_FEC_FAILED_FRAMES,
+        // gauges
+        METRIC_UDP_RX_QUEUE_DEPTH,
+        // histograms (values in nanoseconds, exported in seconds)
+        METRIC_VIDEO_COMPRESS_TIME,
+        METRIC_VIDEO_DECOMPRESS_TIME,
+        METRIC_VIDEO_LATENCY,
+        METRIC_COUNT
+};
+
+extern bool metrics_active;
+
+void metric_add_slow(enum ug_metric m, uint64_t val);
+void metric_set_slow(enum ug_metric m, int64_t val);
+void metric_observe_ns_slow(enum ug_metric m, long long ns);
+
+/// increments counter
+static inline void metric_add(enum ug_metric m, uint64_t val) {
+        if (metrics_active) {
+                metric_add_slow(m, val);
+        }
+}
+
+/// sets gauge value
+static inline void metric_set(enum ug_metric m, int64_t val) {
+        if (metrics_active) {
+                metric_set_slow(m, val);
+        }
+}
+
+/// records duration to histogram
+static inline void metric_observe_ns(enum ug_metric m, long long ns) {
+        if (metrics_active) {
+                metric_observe_ns_slow(m, ns);
+        }
+}
+
+/// @returns counter value or count of histogram observations
+uint64_t metric_get_count(enum ug_metric m);
+/// @returns sum of histogram observations in ns
+uint64_t metric_get_sum_ns(enum ug_metric m);
+
+/**
+ * Starts HTTP exporter if requested by "metrics-port" param.
+ * @retval false if requested but failed
+ */
+bool metrics_init(void);
+void metrics_done(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_METRICS_H_
@@ -37,85 +37,123 @@
 
 #include "config_msvc.h"
 
+#include <algorithm>
 #include <cassert>
-#include <functional>
-#include <iostream>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <utility>
 
+#include "utils/thread.h"
 #include "video_frame_pool.h"
 
+#define MOD_NAME "[video_frame_pool] "
+
+default_data_allocator::default_data_allocator() : m_cfg{HUGE_ALLOC_MALLOC, false} {
+        const char *cfg = get_commandline_param("frame-pool-alloc");
+        if (cfg != nullptr && !huge_alloc_parse(cfg, &m_cfg)) {
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('V', 'F', 'P', 'A'),
+                             MOD_NAME "Wrong frame-pool-alloc, using malloc.\n");
+                m_cfg = { HUGE_ALLOC_MALLOC, false };
+        }
+}
 void *default_data_allocator::allocate(size_t size) {
-        return malloc(size);
+        return huge_alloc(size, &m_cfg);
 }
 void default_data_allocator::deallocate(void *ptr) {
-        free(ptr);
+        huge_free(ptr);
 }
 struct video_frame_pool_allocator *default_data_allocator::clone() const {
         return new default_data_allocator(*this);
 }
 
-video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames) {
+namespace {
+constexpr unsigned DEFAULT_PREALLOC = 2;
+std::atomic<uint64_t> pool_uid_counter{0};
+/// magazine used by this thread in the most recently used pool
+thread_local uint64_t tl_pool_uid;
+thread_local void *tl_magazine;
+} // end of anonymous namespace
+
+video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_uid(++pool_uid_counter), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames), m_prealloc_count(DEFAULT_PREALLOC), m_prealloc_async(false) {
+        for (auto &mag : m_magazines) {
+                mag.owner.store(std::thread::id());
+                mag.frames = nullptr;
+        }
+        const char *cfg = get_commandline_param("frame-pool-prealloc");
+        if (cfg != nullptr) {
+                char *endptr = nullptr;
+                const long count = strtol(cfg, &endptr, 10);
+                if (endptr == cfg || count < 0 || (*endptr != '\0' && strcmp(endptr, ":async") != 0)) {
+                        log_msg_once(LOG_LEVEL_ERROR, to_fourcc('V', 'F', 'P', 'P'),
+                                     MOD_NAME "Wrong frame-pool-prealloc: %s, using default.\n", cfg);
+                } else {
+                        m_prealloc_count = count;
+                        m_prealloc_async = *endptr != '\0';
+                }
+        }
 }
 
 video_frame_pool::~video_frame_pool() {
-        std::unique_lock<std::mutex> lk(m_lock);
-        remove_free_frames();
+        join_prealloc();
         // wait also for all frames we gave out to return us
-        m_frame_returned.wait(lk, [this] {return m_unreturned_frames == 0;});
+        {
+                std::unique_lock<std::mutex> lk(m_lock);
+                m_waiters++;
+                m_frame_returned.wait(lk, [this] { return m_unreturned_frames == 0; });
+                m_waiters--;
+        }
+        // the last returners may still be between their decrement and the end of return_frame()
+        while (m_returning.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+        }
+        deallocate_list(m_free_frames.exchange(nullptr));
+        for (auto &mag : m_magazines) {
+                deallocate_list(mag.frames);
+        }
 }
 
 void video_frame_pool::reconfigure(struct video_desc new_desc, size_t new_size) {
-        std::unique_lock<std::mutex> lk(m_lock);
+        join_prealloc();
         m_desc = new_desc;
         m_max_data_len = new_size != SIZE_MAX ? new_size : new_desc.height * vc_get_linesize(new_desc.width, new_desc.color_spec);
-        remove_free_frames();
-        m_generation++;
+        // frames in flight are recognized by generation and freed when popped
+        int generation = m_generation.load(std::memory_order_relaxed) + 1;
+        m_generation.store(generation, std::memory_order_release);
+        deallocate_list(m_free_frames.exchange(nullptr, std::memory_order_acquire));
+        for (auto &mag : m_magazines) {
+                deallocate_list(mag.frames);
+                mag.frames = nullptr;
+        }
+
+        unsigned count = m_max_used_frames > 0 ? std::min(m_prealloc_count, m_max_used_frames) : m_prealloc_count;
+        if (count == 0) {
+                return;
+        }
+        if (m_prealloc_async) {
+                m_prealloc_thread = std::thread([this, new_desc, generation, count, len = m_max_data_len] {
+                        set_thread_name("frame_pool_alloc");
+                        prealloc(new_desc, len, generation, count);
+                });
+        } else {
+                prealloc(new_desc, m_max_data_len, generation, count);
+        }
 }
 
 std::shared_ptr<video_frame> video_frame_pool::get_frame() {
         assert(m_generation != 0);
-        struct video_frame *ret = NULL;
-        std::unique_lock<std::mutex> lk(m_lock);
-        if (!m_free_frames.empty()) {
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else if (m_max_used_frames > 0 && m_max_used_frames == m_unreturned_frames) {
-                m_frame_returned.wait(lk, [this] {return m_unreturned_frames < m_max_used_frames;});
-                assert(!m_free_frames.empty());
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else {
-                try {
-                        ret = vf_alloc_desc(m_desc);
-                        for (unsigned int i = 0; i < m_desc.tile_count; ++i) {
-                                ret->tiles[i].data = (char *)
-                                        m_allocator->allocate(m_max_data_len);
-                                if (ret->tiles[i].data == NULL) {
-                                        throw std::runtime_error("Cannot allocate data");
-                                }
-                                ret->tiles[i].data_len = m_max_data_len;
-                        }
-                } catch (std::exception &e) {
-                        std::cerr << e.what() << std::endl;
-                        deallocate_frame(ret);
-                        throw e;
+        reserve_frame();
+        struct pool_frame *ret = pop_free();
+        if (ret == nullptr) {
+                ret = alloc_frame(m_desc, m_max_data_len, m_generation.load(std::memory_order_relaxed));
+                if (ret == nullptr) {
+                        unreserve_frame();
+                        throw std::runtime_error("Cannot allocate data");
                 }
         }
-        m_unreturned_frames += 1;
-        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation) {
-                                std::unique_lock<std::mutex> lk(m_lock);
-
-                                assert(m_unreturned_frames > 0);
-                                m_unreturned_frames -= 1;
-                                m_frame_returned.notify_one();
-
-                                if (this->m_generation != generation) {
-                                this->deallocate_frame(frame);
-                                } else {
-                                m_free_frames.push(frame);
-                                }
-                                }, std::placeholders::_1, m_generation));
+        return std::shared_ptr<video_frame>(ret->frame, [this, ret](struct video_frame *) {
+                        return_frame(ret);
+                        });
 }
 
 struct video_frame *video_frame_pool::get_disposable_frame() {
@@ -145,21 +183,169 @@ video_frame_pool_allocator const & video_frame_pool::get_allocator() {
         return *m_allocator;
 }
 
-void video_frame_pool::remove_free_frames() {
-        while (!m_free_frames.empty()) {
-                struct video_frame *frame = m_free_frames.front();
-                m_free_frames.pop();
-                deallocate_frame(frame);
+/// @returns nullptr if allocation fails
+struct video_frame_pool::pool_frame *video_frame_pool::alloc_frame(struct video_desc desc, size_t data_len, int generation) {
+        auto *ret = new pool_frame{vf_alloc_desc(desc), nullptr, generation};
+        for (unsigned int i = 0; i < desc.tile_count; ++i) {
+                ret->frame->tiles[i].data = (char *) m_allocator->allocate(data_len);
+                if (ret->frame->tiles[i].data == NULL) {
+                        deallocate_frame(ret);
+                        return nullptr;
+                }
+                ret->frame->tiles[i].data_len = data_len;
+        }
+        return ret;
+}
+
+void video_frame_pool::deallocate_frame(struct pool_frame *frame) {
+        for (unsigned int i = 0; i < frame->frame->tile_count; ++i) {
+                if (frame->frame->tiles[i].data != NULL) {
+                        m_allocator->deallocate(frame->frame->tiles[i].data);
+                }
+        }
+        vf_free(frame->frame);
+        delete frame;
+}
+
+void video_frame_pool::deallocate_list(struct pool_frame *list) {
+        while (list != nullptr) {
+                struct pool_frame *next = list->next;
+                deallocate_frame(list);
+                list = next;
+        }
+}
+
+/// pushes list first..last to the shared free stack (push only is ABA-safe)
+void video_frame_pool::push_free(struct pool_frame *first, struct pool_frame *last) {
+        struct pool_frame *head = m_free_frames.load(std::memory_order_relaxed);
+        do {
+                last->next = head;
+        } while (!m_free_frames.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/**
+ * Takes frame from thread's magazine, refilling it with the whole shared
+ * stack if empty (taking all with exchange avoids ABA of single-item pop).
+ * Frames of older generations are freed here, in the getter thread, so that
+ * the allocator is not called from the threads returning the frames.
+ */
+struct video_frame_pool::pool_frame *video_frame_pool::pop_free() {
+        const int generation = m_generation.load(std::memory_order_relaxed);
+        struct magazine *mag = get_magazine();
+        struct pool_frame *list = mag != nullptr ? mag->frames : nullptr;
+        if (list == nullptr) {
+                list = m_free_frames.exchange(nullptr, std::memory_order_acquire);
+        }
+        struct pool_frame *ret = nullptr;
+        struct pool_frame *rest = nullptr;
+        struct pool_frame *rest_last = nullptr;
+        while (list != nullptr) {
+                struct pool_frame *next = list->next;
+                if (list->generation != generation) {
+                        deallocate_frame(list);
+                } else if (ret == nullptr) {
+                        ret = list;
+                } else {
+                        list->next = rest;
+                        rest = list;
+                        rest_last = rest_last == nullptr ? list : rest_last;
+                }
+                list = next;
         }
+        if (mag != nullptr) {
+                mag->frames = rest;
+        } else if (rest != nullptr) { // no magazine left for this thread - give back
+                push_free(rest, rest_last);
+        }
+        return ret;
 }
 
-void video_frame_pool::deallocate_frame(struct video_frame *frame) {
-        if (frame == NULL)
+struct video_frame_pool::magazine *video_frame_pool::get_magazine() {
+        if (tl_pool_uid == m_uid) {
+                return static_cast<magazine *>(tl_magazine);
+        }
+        const std::thread::id me = std::this_thread::get_id();
+        struct magazine *ret = nullptr;
+        for (auto &mag : m_magazines) {
+                if (mag.owner.load(std::memory_order_relaxed) == me) {
+                        ret = &mag;
+                        break;
+                }
+        }
+        for (int i = 0; ret == nullptr && i < MAGAZINES; ++i) {
+                std::thread::id unowned;
+                if (m_magazines[i].owner.compare_exchange_strong(unowned, me)) {
+                        ret = &m_magazines[i];
+                }
+        }
+        tl_pool_uid = m_uid;
+        tl_magazine = ret;
+        return ret;
+}
+
+/// accounts frame to m_max_used_frames, waits if exhausted
+void video_frame_pool::reserve_frame() {
+        if (m_max_used_frames == 0) {
+                m_unreturned_frames += 1;
                 return;
-        for (unsigned int i = 0; i < frame->tile_count; ++i) {
-                m_allocator->deallocate(frame->tiles[i].data);
         }
-        vf_free(frame);
+        unsigned int cur = m_unreturned_frames.load();
+        while (true) {
+                while (cur < m_max_used_frames) {
+                        if (m_unreturned_frames.compare_exchange_weak(cur, cur + 1)) {
+                                return;
+                        }
+                }
+                std::unique_lock<std::mutex> lk(m_lock);
+                m_waiters++;
+                m_frame_returned.wait(lk, [this] { return m_unreturned_frames < m_max_used_frames; });
+                m_waiters--;
+                cur = m_unreturned_frames.load();
+        }
+}
+
+/**
+ * Both the decrement here and the m_waiters increment of a waiter are
+ * sequentially consistent, so either this sees the waiter and notifies it
+ * under the lock, or the waiter's predicate (evaluated under the lock after
+ * registering) already sees the decrement - no wake-up is lost.
+ */
+void video_frame_pool::unreserve_frame() {
+        assert(m_unreturned_frames > 0);
+        m_unreturned_frames.fetch_sub(1);
+        if (m_waiters.load() > 0) {
+                std::lock_guard<std::mutex> lk(m_lock);
+                m_frame_returned.notify_all();
+        }
+}
+
+/**
+ * The frame is pushed before the decrement so that the waiter finds it.
+ * m_returning keeps the destructor from finishing while this runs (its
+ * decrement is the last access to the pool).
+ */
+void video_frame_pool::return_frame(struct pool_frame *frame) {
+        m_returning.fetch_add(1);
+        push_free(frame, frame);
+        unreserve_frame();
+        m_returning.fetch_sub(1, std::memory_order_release);
+}
+
+void video_frame_pool::prealloc(struct video_desc desc, size_t data_len, int generation, unsigned count) {
+        for (unsigned i = 0; i < count; ++i) {
+                struct pool_frame *frame = alloc_frame(desc, data_len, generation);
+                if (frame == nullptr) {
+                        MSG(WARNING, "Cannot pre-allocate frame %u/%u!\n", i + 1, count);
+                        return;
+                }
+                push_free(frame, frame);
+        }
+}
+
+void video_frame_pool::join_prealloc() {
+        if (m_prealloc_thread.joinable()) {
+                m_prealloc_thread.join();
+        }
 }
 
 void *video_frame_pool_init(struct video_desc desc, int len) {
@@ -178,3 +364,12 @@ void video_frame_pool_destroy(void *state) {
         delete s;
 }
 
+
+ADD_TO_PARAM("frame-pool-alloc", "* frame-pool-alloc=malloc|thp|hugetlb|hugetlb1g[:numa]\n"
+                "  Backing of frame pool buffers: malloc (default), transparent huge\n"
+                "  pages, reserved 2 MiB/1 GiB huge pages; \"numa\" prefers the NUMA node of the\n"
+                "  thread allocating the frame (pool user on reconfiguration or the async\n"
+                "  prealloc thread), not of the thread that consumes it\n");
+ADD_TO_PARAM("frame-pool-prealloc", "* frame-pool-prealloc=<n>[:async]\n"
+                "  Frames allocated by frame pools on reconfiguration (default 2), async from\n"
+                "  a background thread\n");
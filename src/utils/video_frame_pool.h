@@ -40,16 +40,18 @@
 
 #include "debug.h"
 #include "host.h"
+#include "utils/huge_alloc.h"
 #include "utils/macros.h"
 #include "video.h"
 
 #ifdef __cplusplus
 
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <mutex>
 #include <memory>
-#include <queue>
+#include <thread>
 
 struct video_frame_pool_allocator {
         virtual void *allocate(size_t size) = 0;
@@ -58,12 +60,34 @@ struct video_frame_pool_allocator {
         virtual ~video_frame_pool_allocator() {}
 };
 
+/**
+ * Allocates with huge_alloc(), backing is selected by
+ * "--param frame-pool-alloc=<mode>[:numa]" (default malloc).
+ */
 struct default_data_allocator : public video_frame_pool_allocator {
+        default_data_allocator();
         void *allocate(size_t size) override;
         void deallocate(void *ptr) override;
         struct video_frame_pool_allocator *clone() const override;
+private:
+        struct huge_alloc_cfg m_cfg;
 };
 
+/**
+ * Pool of equally sized video frames.
+ *
+ * Frames are returned (by releasing the shared_ptr) to a lock-free stack and
+ * get_frame() takes them in batches to a per-thread magazine, so neither
+ * path takes a lock unless the pool is bounded and exhausted.
+ *
+ * reconfigure() pre-allocates "--param frame-pool-prealloc=<n>[:async]"
+ * frames (by default 2, at most max_used_frames) - with async from a
+ * background thread, which requires the allocator to be thread-safe. Frames
+ * of the previous generation that are still in flight are freed on return.
+ *
+ * reconfigure() must not be called concurrently with get_frame(), frames can
+ * be returned from any thread.
+ */
 struct video_frame_pool {
         public:
                 /**
@@ -97,18 +121,47 @@ struct video_frame_pool {
                 video_frame_pool_allocator const & get_allocator();
 
         private:
-                void remove_free_frames();
-                void deallocate_frame(struct video_frame *frame);
+                struct pool_frame {
+                        struct video_frame *frame;
+                        struct pool_frame *next;
+                        int generation;
+                };
+                struct magazine {
+                        std::atomic<std::thread::id> owner;
+                        struct pool_frame *frames; ///< accessed only by owner
+                };
+                static constexpr int MAGAZINES = 4;
+
+                struct pool_frame *alloc_frame(struct video_desc desc, size_t data_len, int generation);
+                void deallocate_frame(struct pool_frame *frame);
+                void deallocate_list(struct pool_frame *list);
+                void push_free(struct pool_frame *first, struct pool_frame *last);
+                struct pool_frame *pop_free();
+                struct magazine *get_magazine();
+                void reserve_frame();
+                void unreserve_frame();
+                void return_frame(struct pool_frame *frame);
+                void prealloc(struct video_desc desc, size_t data_len, int generation, unsigned count);
+                void join_prealloc();
 
                 std::unique_ptr<video_frame_pool_allocator> m_allocator;
-                std::queue<struct video_frame *> m_free_frames;
-                std::mutex        m_lock;
-                std::condition_variable m_frame_returned;
-                int               m_generation;
+                const uint64_t    m_uid; ///< identifies the pool in thread-local cache
+                std::atomic<struct pool_frame *> m_free_frames{nullptr};
+                struct magazine   m_magazines[MAGAZINES];
+                std::atomic<int>  m_generation;
                 struct video_desc m_desc;
                 size_t            m_max_data_len;
-                unsigned int      m_unreturned_frames;
+                std::atomic<unsigned int> m_unreturned_frames;
                 unsigned int      m_max_used_frames;
+                unsigned int      m_prealloc_count;
+                bool              m_prealloc_async;
+                std::thread       m_prealloc_thread;
+
+                /// slow path - only when bounded pool is exhausted or being destroyed
+                std::mutex        m_lock;
+                std::condition_variable m_frame_returned;
+                std::atomic<int>  m_waiters{0};
+                std::atomic<int>  m_returning{0}; ///< return_frame() calls in progress
 };
 #endif //  __cplusplus
 
@@ -0,0 +1,676 @@
+/**
+ * @file   utils/video_scale.c
+ * @brief  Separable polyphase scaler working directly on UYVY, v210, I420 and RGBA
+ *
+ * Every component is scaled in its own resolution (chroma of 4:2:2 and 4:2:0
+ * is not upsampled). Input lines needed by a stripe are filtered horizontally
+ * to 16-bit intermediate lines which are then combined vertically to the
+ * output. Coefficients are 14-bit fixed point, the intermediate keeps
+ * 14 bits of precision for both 8- and 10-bit input so that negative lobes
+ * of cubic and Lanczos filters are not clipped before the vertical pass.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/video_scale.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[video_scale] "
+#define COEF_BITS 14
+#define MID_BITS 14 ///< intermediate precision
+#define MAX_CHANNELS 4
+
+struct scale_filter {
+        int taps;
+        int *pos;       ///< first input sample (line) for every output one
+        int16_t *coef;  ///< taps coefficients for every output sample (line), sum is 1 << COEF_BITS
+};
+
+/// interleaved components of a plane sharing one horizontal filter (eg. U and V of UYVY)
+struct scale_channel {
+        int in_off, in_step;   ///< first sample and pixel distance on input line
+        int out_off, out_step; ///< the same for intermediate/output line
+        int comps, comp_stride;
+        int out_count;
+        struct scale_filter h;
+};
+
+struct scale_plane {
+        size_t in_off, out_off;     ///< plane offset in frame
+        int in_linesize, out_linesize;
+        int in_samples, out_samples; ///< samples per line (v210 unpacked)
+        int out_h;
+        int out_y, scaled_h;        ///< lines covered by the picture, rest is black
+        bool margins;               ///< intermediate line contains samples not written by horizontal pass
+        int chan_count;
+        struct scale_channel chan[MAX_CHANNELS];
+        struct scale_filter v;
+        int16_t *black_mid;         ///< intermediate line with black margins
+        char *black_line;
+        int stripe_lines;           ///< output lines per stripe
+        int max_band;               ///< max input lines needed by a stripe
+};
+
+typedef void (*vscale_t)(const int16_t *const *rows, const int16_t *coef, int taps, int n, void *out);
+
+struct video_scale {
+        codec_t codec;
+        int depth;
+        int threads;
+        int plane_count;
+        struct scale_plane plane[3];
+        size_t mid_len;   ///< per stripe intermediate buffer length
+        int16_t *mid;
+        uint16_t *line16; ///< per stripe v210 input and output lines
+        size_t line16_len;
+        vscale_t vscale;
+};
+
+struct scale_stripe {
+        const struct video_scale *s;
+        const struct scale_plane *p;
+        const char *in;
+        char *out;
+        int out_pitch;
+        int y_start, y_end;
+        int16_t *mid;
+        uint16_t *line_in, *line_out;
+};
+
+static const char *const algo_names[] = {
+        [VIDEO_SCALE_NEAREST] = "nearest",
+        [VIDEO_SCALE_LINEAR] = "linear",
+        [VIDEO_SCALE_CUBIC] = "cubic",
+        [VIDEO_SCALE_AREA] = "area",
+        [VIDEO_SCALE_LANCZOS4] = "lanczos4",
+};
+
+const char *video_scale_algo_to_string(enum video_scale_algo algo)
+{
+        if (algo < 0 || algo >= VIDEO_SCALE_ALGO_COUNT) {
+                return "(unknown algo!)";
+        }
+        return algo_names[algo];
+}
+
+static double sinc(double x)
+{
+        if (x == 0.0) {
+                return 1.0;
+        }
+        return sin(M_PI * x) / (M_PI * x);
+}
+
+/// @param t  distance from the center in (possibly stretched) input samples
+static double kernel(enum video_scale_algo algo, double t)
+{
+        t = fabs(t);
+        switch (algo) {
+        case VIDEO_SCALE_CUBIC: { // a = -0.75 as OpenCV uses
+                const double a = -0.75;
+                if (t < 1.0) {
+                        return ((a + 2) * t - (a + 3)) * t * t + 1;
+                }
+                if (t < 2.0) {
+                        return ((a * t - 5 * a) * t + 8 * a) * t - 4 * a;
+                }
+                return 0.0;
+        }
+        case VIDEO_SCALE_LANCZOS4:
+                return t < 4.0 ? sinc(t) * sinc(t / 4.0) : 0.0;
+        default:
+                return MAX(0.0, 1.0 - t);
+        }
+}
+
+static double kernel_support(enum video_scale_algo algo)
+{
+        switch (algo) {
+        case VIDEO_SCALE_CUBIC:
+                return 2.0;
+        case VIDEO_SCALE_LANCZOS4:
+                return 4.0;
+        default:
+                return 1.0;
+        }
+}
+
+/**
+ * Computes positions and fixed-point coefficients mapping in samples to out.
+ * Taps reaching over the edges are folded to the edge sample so that all
+ * reads stay inside [0, in).
+ */
+static void filter_init(struct scale_filter *f, int in, int out, enum video_scale_algo algo)
+{
+        const double scale = (double) in / out;
+        const bool area_down = algo == VIDEO_SCALE_AREA && scale > 1.0;
+        const double stretch = algo == VIDEO_SCALE_NEAREST ? 1.0 : MAX(1.0, scale);
+        double support = algo == VIDEO_SCALE_NEAREST ? 0.5 : kernel_support(algo) * stretch;
+        if (area_down) {
+                support = scale / 2 + 0.5;
+        }
+        const int taps = algo == VIDEO_SCALE_NEAREST ? 1 : ceil(2 * support);
+        const int taps_stored = MIN(taps, in);
+
+        f->taps = taps_stored;
+        f->pos = malloc(out * sizeof f->pos[0]);
+        f->coef = malloc((size_t) out * taps_stored * sizeof f->coef[0]);
+        double w[taps];
+        double folded[taps];
+
+        for (int x = 0; x < out; ++x) {
+                const double center = (x + 0.5) * scale - 0.5;
+                int start = (int) (floor(center - support) + 1);
+                double sum = 0.0;
+                if (algo == VIDEO_SCALE_NEAREST) {
+                        start = MIN((int) ((x + 0.5) * scale), in - 1);
+                        w[0] = 1.0;
+                }
+                for (int k = 0; k < taps && algo != VIDEO_SCALE_NEAREST; ++k) {
+                        const int i = start + k;
+                        if (area_down) { // overlap of the output sample box with input sample
+                                const double lo = center + 0.5 - scale / 2;
+                                const double hi = center + 0.5 + scale / 2;
+                                w[k] = MAX(0.0, MIN(i + 1.0, hi) - MAX((double) i, lo));
+                        } else {
+                                w[k] = kernel(algo, (i - center) / stretch);
+                        }
+                }
+                const int new_start = CLAMP(start, 0, MAX(in - taps, 0));
+                memset(folded, 0, sizeof folded);
+                for (int k = 0; k < taps; ++k) {
+                        folded[CLAMP(start + k, 0, in - 1) - new_start] += w[k];
+                        sum += w[k];
+                }
+                f->pos[x] = new_start;
+
+                int16_t *c = f->coef + (size_t) x * taps_stored;
+                int total = 0;
+                int biggest = 0;
+                for (int k = 0; k < taps_stored; ++k) {
+                        c[k] = (int16_t) lrint(folded[k] / sum * (1 << COEF_BITS));
+                        total += c[k];
+                        if (c[k] > c[biggest]) {
+                                biggest = k;
+                        }
+                }
+                c[biggest] += (1 << COEF_BITS) - total;
+        }
+}
+
+static void filter_done(struct scale_filter *f)
+{
+        free(f->pos);
+        free(f->coef);
+}
+
+/* C doesn't have a vector ternary operator, comparison results are used as masks
+ * instead - operands must not have side effects */
+#define VSEL(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+#define VMIN(a, b) VSEL((a) < (b), a, b)
+#define VMAX(a, b) VSEL((a) > (b), a, b)
+
+typedef int16_t v4s16 __attribute__((vector_size(8)));
+typedef int32_t v4s32 __attribute__((vector_size(16)));
+typedef uint8_t v4u8 __attribute__((vector_size(4)));
+typedef uint16_t v4u16 __attribute__((vector_size(8)));
+typedef int16_t v8s16 __attribute__((vector_size(16)));
+typedef int32_t v8s32 __attribute__((vector_size(32)));
+typedef uint8_t v8u8 __attribute__((vector_size(8)));
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+
+/**
+ * Defines vertical pass - weighted sum of taps intermediate lines. The
+ * intermediate line layout is the same as the output one so that 8-bit
+ * output is written directly to the frame.
+ *
+ * @param VS  intermediate vector
+ * @param VA  accumulator vector with the same lane count
+ * @param VO  output vector
+ */
+#define DEFINE_VSCALE(name, T, DEPTH, VS, VA, VO, attr) \
+attr static void name(const int16_t *const *rows, const int16_t *coef, int taps, int n, void *out) \
+{ \
+        enum { N = sizeof(VS) / sizeof(int16_t), SHIFT = COEF_BITS + MID_BITS - DEPTH }; \
+        T *dst = out; \
+        int x = 0; \
+        for ( ; x + N <= n; x += N) { \
+                VA acc = { 0 }; \
+                acc += 1 << (SHIFT - 1); \
+                for (int k = 0; k < taps; ++k) { \
+                        VS v; \
+                        memcpy(&v, rows[k] + x, sizeof v); \
+                        acc += __builtin_convertvector(v, VA) * coef[k]; \
+                } \
+                acc >>= SHIFT; \
+                const VA lo = { 0 }; \
+                const VA hi = lo + ((1 << DEPTH) - 1); \
+                acc = VMAX(acc, lo); \
+                acc = VMIN(acc, hi); \
+                VO o = __builtin_convertvector(acc, VO); \
+                memcpy(dst + x, &o, sizeof o); \
+        } \
+        for ( ; x < n; ++x) { \
+                int acc = 1 << (SHIFT - 1); \
+                for (int k = 0; k < taps; ++k) { \
+                        acc += rows[k][x] * coef[k]; \
+                } \
+                dst[x] = CLAMP(acc >> SHIFT, 0, (1 << DEPTH) - 1); \
+        } \
+}
+
+DEFINE_VSCALE(vscale8, uint8_t, 8, v4s16, v4s32, v4u8, )
+DEFINE_VSCALE(vscale10, uint16_t, 10, v4s16, v4s32, v4u16, )
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define HAVE_AVX2_DISPATCH 1
+DEFINE_VSCALE(vscale8_avx2, uint8_t, 8, v8s16, v8s32, v8u8, __attribute__((target("avx2"))))
+DEFINE_VSCALE(vscale10_avx2, uint16_t, 10, v8s16, v8s32, v8u16, __attribute__((target("avx2"))))
+#endif
+
+/// horizontal pass of one channel, common filter lengths are unrolled
+#define DEFINE_HSCALE(name, T, DEPTH) \
+static inline void name##_taps(const struct scale_channel *c, const T *in, int16_t *out, const int taps, \
+                const int comps) \
+{ \
+        enum { SHIFT = COEF_BITS - (MID_BITS - DEPTH) }; \
+        const int16_t *coef = c->h.coef; \
+        const int step = c->in_step; \
+        const int cs = c->comp_stride; \
+        in += c->in_off; \
+        out += c->out_off; \
+        for (int x = 0; x < c->out_count; ++x) { \
+                const T *src = in + c->h.pos[x] * step; \
+                int acc[MAX_CHANNELS]; \
+                for (int j = 0; j < comps; ++j) { \
+                        acc[j] = 1 << (SHIFT - 1); \
+                } \
+                for (int k = 0; k < taps; ++k) { \
+                        for (int j = 0; j < comps; ++j) { \
+                                acc[j] += coef[k] * src[k * step + j * cs]; \
+                        } \
+                } \
+                for (int j = 0; j < comps; ++j) { \
+                        out[j * cs] = CLAMP(acc[j] >> SHIFT, INT16_MIN, INT16_MAX); \
+                } \
+                out += c->out_step; \
+                coef += taps; \
+        } \
+} \
+static inline void name##_comps(const struct scale_channel *c, const T *in, int16_t *out, const int comps) \
+{ \
+        switch (c->h.taps) { \
+        case 1: name##_taps(c, in, out, 1, comps); break; \
+        case 2: name##_taps(c, in, out, 2, comps); break; \
+        case 3: name##_taps(c, in, out, 3, comps); break; \
+        case 4: name##_taps(c, in, out, 4, comps); break; \
+        case 6: name##_taps(c, in, out, 6, comps); break; \
+        case 8: name##_taps(c, in, out, 8, comps); break; \
+        default: name##_taps(c, in, out, c->h.taps, comps); \
+        } \
+} \
+static void name(const struct scale_channel *c, const T *in, int16_t *out) \
+{ \
+        switch (c->comps) { \
+        case 1: name##_comps(c, in, out, 1); break; \
+        case 2: name##_comps(c, in, out, 2); break; \
+        default: name##_comps(c, in, out, 4); break; \
+        } \
+}
+
+DEFINE_HSCALE(hscale8, uint8_t, 8)
+DEFINE_HSCALE(hscale10, uint16_t, 10)
+
+static void v210_unpack_line(const uint32_t *in, uint16_t *out, int samples)
+{
+        for (int x = 0; x < samples; x += 3) {
+                uint32_t w = *in++;
+                *out++ = w & 0x3ff;
+                *out++ = w >> 10 & 0x3ff;
+                *out++ = w >> 20 & 0x3ff;
+        }
+}
+
+static void v210_pack_line(const uint16_t *in, uint32_t *out, int samples)
+{
+        for (int x = 0; x < samples; x += 3) {
+                *out++ = in[0] | in[1] << 10 | (uint32_t) in[2] << 20;
+                in += 3;
+        }
+}
+
+static void *scale_stripe(void *arg)
+{
+        const struct scale_stripe *st = arg;
+        const struct video_scale *s = st->s;
+        const struct scale_plane *p = st->p;
+        const int first = MAX(st->y_start, p->out_y);
+        const int last = MIN(st->y_end, p->out_y + p->scaled_h); // exclusive
+
+        for (int y = st->y_start; y < st->y_end; ++y) {
+                if (y < first || y >= last) {
+                        memcpy(st->out + p->out_off + (size_t) y * st->out_pitch, p->black_line, p->out_linesize);
+                }
+        }
+        if (first >= last) {
+                return NULL;
+        }
+
+        const int taps = p->v.taps;
+        const int in_first = p->v.pos[first - p->out_y];
+        const int in_last = p->v.pos[last - 1 - p->out_y] + taps; // exclusive
+        assert(in_last - in_first <= p->max_band);
+        for (int y = in_first; y < in_last; ++y) {
+                int16_t *mid = st->mid + (size_t) (y - in_first) * p->out_samples;
+                const char *src = st->in + p->in_off + (size_t) y * p->in_linesize;
+                if (p->margins) {
+                        memcpy(mid, p->black_mid, p->out_samples * sizeof *mid);
+                }
+                if (s->depth == 8) {
+                        for (int c = 0; c < p->chan_count; ++c) {
+                                hscale8(&p->chan[c], (const uint8_t *) src, mid);
+                        }
+                } else {
+                        v210_unpack_line((const uint32_t *)(const void *) src, st->line_in, p->in_samples);
+                        for (int c = 0; c < p->chan_count; ++c) {
+                                hscale10(&p->chan[c], st->line_in, mid);
+                        }
+                }
+        }
+
+        const int16_t *rows[taps];
+        for (int y = first; y < last; ++y) {
+                const int ys = y - p->out_y;
+                for (int k = 0; k < taps; ++k) {
+                        rows[k] = st->mid + (size_t) (p->v.pos[ys] + k - in_first) * p->out_samples;
+                }
+                char *dst = st->out + p->out_off + (size_t) y * st->out_pitch;
+                if (s->depth == 8) {
+                        s->vscale(rows, p->v.coef + (size_t) ys * taps, taps, p->out_samples, dst);
+                } else {
+                        s->vscale(rows, p->v.coef + (size_t) ys * taps, taps, p->out_samples, st->line_out);
+                        v210_pack_line(st->line_out, (uint32_t *)(void *) dst, p->out_samples);
+                }
+        }
+        return NULL;
+}
+
+void video_scale(struct video_scale *s, const char *in, char *out)
+{
+        video_scale_pitch(s, in, out, 0);
+}
+
+void video_scale_pitch(struct video_scale *s, const char *in, char *out, int out_pitch)
+{
+        assert(out_pitch == 0 || s->plane_count == 1);
+        struct scale_stripe stripes[s->threads];
+        for (int i = 0; i < s->plane_count; ++i) {
+                const struct scale_plane *p = &s->plane[i];
+                for (int j = 0; j < s->threads; ++j) {
+                        stripes[j] = (struct scale_stripe) {
+                                .s = s,
+                                .p = p,
+                                .in = in,
+                                .out = out,
+                                .out_pitch = out_pitch > 0 ? out_pitch : p->out_linesize,
+                                .y_start = MIN(j * p->stripe_lines, p->out_h),
+                                .y_end = MIN((j + 1) * p->stripe_lines, p->out_h),
+                                .mid = s->mid + j * s->mid_len,
+                                .line_in = s->line16 ? s->line16 + j * s->line16_len : NULL,
+                                .line_out = s->line16 ? s->line16 + j * s->line16_len + s->line16_len / 2 : NULL,
+                        };
+                }
+                task_run_parallel(scale_stripe, s->threads, stripes, sizeof stripes[0], NULL);
+        }
+}
+
+struct plane_geometry {
+        size_t in_off, out_off;
+        int in_w, in_h, out_w, out_h;    ///< plane dimensions in pixels
+        int x, y, w, h;                  ///< rectangle covered by the picture
+        int in_linesize, out_linesize;
+        int in_samples, out_samples;
+        int px_samples;                  ///< samples per pixel (of the luma or only channel)
+};
+
+struct channel_desc {
+        int off, step, div; ///< first sample, pixel distance, horizontal subsampling
+        int comps, comp_stride;
+        int black[MAX_CHANNELS];
+};
+
+static void plane_init(struct video_scale *s, struct scale_plane *p, const struct plane_geometry *g,
+                int chan_count, const struct channel_desc *desc, enum video_scale_algo algo)
+{
+        p->in_off = g->in_off;
+        p->out_off = g->out_off;
+        p->in_linesize = g->in_linesize;
+        p->out_linesize = g->out_linesize;
+        p->in_samples = g->in_samples;
+        p->out_samples = g->out_samples;
+        p->out_h = g->out_h;
+        p->out_y = g->y;
+        p->scaled_h = g->h;
+        p->chan_count = chan_count;
+        p->black_mid = calloc(p->out_samples, sizeof p->black_mid[0]);
+        for (int c = 0; c < chan_count; ++c) {
+                const struct channel_desc *d = &desc[c];
+                struct scale_channel *ch = &p->chan[c];
+                assert(d->comps == 1 || d->comps == 2 || d->comps == 4);
+                ch->in_off = d->off;
+                ch->in_step = d->step;
+                ch->out_off = g->x * g->px_samples + d->off;
+                ch->out_step = d->step;
+                ch->comps = d->comps;
+                ch->comp_stride = d->comp_stride;
+                ch->out_count = g->w / d->div;
+                filter_init(&ch->h, g->in_w / d->div, ch->out_count, algo);
+                for (int i = d->off; i + (d->comps - 1) * d->comp_stride < p->out_samples; i += d->step) {
+                        for (int j = 0; j < d->comps; ++j) {
+                                p->black_mid[i + j * d->comp_stride] = d->black[j] << (MID_BITS - s->depth);
+                        }
+                }
+        }
+        p->margins = g->w != g->out_w || g->out_samples > g->out_w * g->px_samples;
+
+        p->black_line = malloc(p->out_linesize);
+        if (s->depth == 8) {
+                for (int i = 0; i < p->out_linesize; ++i) {
+                        p->black_line[i] = (char) (p->black_mid[i] >> (MID_BITS - s->depth));
+                }
+        } else {
+                uint16_t line[p->out_samples];
+                for (int i = 0; i < p->out_samples; ++i) {
+                        line[i] = p->black_mid[i] >> (MID_BITS - s->depth);
+                }
+                v210_pack_line(line, (uint32_t *)(void *) p->black_line, p->out_samples);
+        }
+
+        filter_init(&p->v, g->in_h, g->h, algo);
+        p->stripe_lines = (g->out_h + s->threads - 1) / s->threads;
+        p->max_band = 0;
+        for (int j = 0; j < s->threads; ++j) {
+                const int first = MAX(j * p->stripe_lines, g->y);
+                const int last = MIN((j + 1) * p->stripe_lines, g->y + g->h);
+                if (first < last) {
+                        p->max_band = MAX(p->max_band, p->v.pos[last - 1 - g->y] + p->v.taps - p->v.pos[first - g->y]);
+                }
+        }
+}
+
+struct video_scale *video_scale_init(codec_t codec, int in_width, int in_height, int out_width,
+                int out_height, bool keep_aspect, enum video_scale_algo algo, int threads)
+{
+        const codec_t supported[] = { VIDEO_SCALE_SUPPORTED_PIXFMT_INIT, VIDEO_CODEC_NONE };
+        if (!codec_is_in_set(codec, supported)) {
+                MSG(ERROR, "Unsupported pixel format %s!\n", get_codec_name(codec));
+                return NULL;
+        }
+        const int align = codec == v210 ? 6 : codec == RGBA ? 1 : 2; // pixels, horizontal
+        const int valign = codec == I420 ? 2 : 1;
+        int x = 0;
+        int y = 0;
+        int w = out_width;
+        int h = out_height;
+        if (keep_aspect) {
+                const double in_aspect = (double) in_width / in_height;
+                if (in_aspect > (double) out_width / out_height) {
+                        h = (int) (out_width / in_aspect) / valign * valign;
+                        y = (out_height - h) / 2 / valign * valign;
+                } else {
+                        w = (int) (out_height * in_aspect) / align * align;
+                        x = (out_width - w) / 2 / align * align;
+                }
+        }
+        if (w < align || h < valign || in_width < 2 || in_height < valign) {
+                MSG(ERROR, "Cannot scale %dx%d to %dx%d!\n", in_width, in_height, out_width, out_height);
+                return NULL;
+        }
+
+        struct video_scale *s = calloc(1, sizeof *s);
+        s->codec = codec;
+        s->depth = codec == v210 ? 10 : 8;
+        s->threads = threads > 0 ? threads : get_cpu_core_count();
+        s->vscale = s->depth == 8 ? vscale8 : vscale10;
+#ifdef HAVE_AVX2_DISPATCH
+        if (__builtin_cpu_supports("avx2")) {
+                s->vscale = s->depth == 8 ? vscale8_avx2 : vscale10_avx2;
+        }
+#endif
+
+        const int in_linesize = vc_get_linesize(in_width, codec);
+        const int out_linesize = vc_get_linesize(out_width, codec);
+        struct plane_geometry g = {
+                .in_w = in_width, .in_h = in_height, .out_w = out_width, .out_h = out_height,
+                .x = x, .y = y, .w = w, .h = h,
+                .in_linesize = in_linesize, .out_linesize = out_linesize,
+        };
+        switch (codec) {
+        case UYVY:
+        case v210: {
+                const int lo = codec == v210 ? 64 : 16;
+                const int mid = codec == v210 ? 512 : 128;
+                const struct channel_desc desc[] = {
+                        { .off = 1, .step = 2, .div = 1, .comps = 1, .black = { lo } },
+                        { .off = 0, .step = 4, .div = 2, .comps = 2, .comp_stride = 2, .black = { mid, mid } },
+                };
+                g.in_samples = codec == v210 ? in_linesize / 16 * 12 : in_linesize;
+                g.out_samples = codec == v210 ? out_linesize / 16 * 12 : out_linesize;
+                g.px_samples = 2;
+                s->plane_count = 1;
+                plane_init(s, &s->plane[0], &g, 2, desc, algo);
+                break;
+        }
+        case RGBA: {
+                const struct channel_desc desc = { .off = 0, .step = 4, .div = 1, .comps = 4, .comp_stride = 1,
+                        .black = { 0, 0, 0, 255 } };
+                g.in_samples = in_linesize;
+                g.out_samples = out_linesize;
+                g.px_samples = 4;
+                s->plane_count = 1;
+                plane_init(s, &s->plane[0], &g, 1, &desc, algo);
+                break;
+        }
+        case I420: {
+                g.in_samples = g.in_linesize = in_width;
+                g.out_samples = g.out_linesize = out_width;
+                g.px_samples = 1;
+                s->plane_count = 3;
+                plane_init(s, &s->plane[0], &g, 1,
+                                &(struct channel_desc) { .off = 0, .step = 1, .div = 1, .comps = 1, .black = { 16 } }, algo);
+                struct plane_geometry c = {
+                        .in_w = (in_width + 1) / 2, .in_h = (in_height + 1) / 2,
+                        .out_w = (out_width + 1) / 2, .out_h = (out_height + 1) / 2,
+                        .x = x / 2, .y = y / 2, .w = w / 2, .h = h / 2,
+                        .px_samples = 1,
+                };
+                c.in_samples = c.in_linesize = c.in_w;
+                c.out_samples = c.out_linesize = c.out_w;
+                for (int i = 1; i < 3; ++i) {
+                        c.in_off = (size_t) in_width * in_height + (size_t) (i - 1) * c.in_w * c.in_h;
+                        c.out_off = (size_t) out_width * out_height + (size_t) (i - 1) * c.out_w * c.out_h;
+                        plane_init(s, &s->plane[i], &c, 1,
+                                        &(struct channel_desc) { .off = 0, .step = 1, .div = 1, .comps = 1, .black = { 128 } }, algo);
+                }
+                break;
+        }
+        default:
+                abort();
+        }
+
+        for (int i = 0; i < s->plane_count; ++i) {
+                s->mid_len = MAX(s->mid_len, (size_t) s->plane[i].max_band * s->plane[i].out_samples);
+        }
+        s->mid = malloc(s->threads * s->mid_len * sizeof s->mid[0]);
+        if (codec == v210) {
+                s->line16_len = 2 * MAX(s->plane[0].in_samples, s->plane[0].out_samples);
+                s->line16 = malloc(s->threads * s->line16_len * sizeof s->line16[0]);
+        }
+        MSG(VERBOSE, "%s %dx%d -> %dx%d (picture %dx%d+%d+%d), %d threads\n", get_codec_name(codec),
+                        in_width, in_height, out_width, out_height, w, h, x, y, s->threads);
+        return s;
+}
+
+void video_scale_done(struct video_scale *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        for (int i = 0; i < s->plane_count; ++i) {
+                struct scale_plane *p = &s->plane[i];
+                for (int c = 0; c < p->chan_count; ++c) {
+                        filter_done(&p->chan[c].h);
+                }
+                filter_done(&p->v);
+                free(p->black_mid);
+                free(p->black_line);
+        }
+        free(s->mid);
+        free(s->line16);
+        free(s);
+}
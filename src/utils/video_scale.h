@@ -0,0 +1,91 @@
+/**
+ * @file   utils/video_scale.h
+ * @brief  Separable polyphase scaler working directly on UYVY, v210, I420 and RGBA
+ *
+ * Filter tables are computed once by video_scale_init(), frames are then
+ * scaled in horizontal stripes on the worker pool without any conversion.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_VIDEO_SCALE_H_
+#define UTILS_VIDEO_SCALE_H_
+
+#include "types.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIDEO_SCALE_SUPPORTED_PIXFMT_INIT UYVY, v210, I420, RGBA
+
+enum video_scale_algo {
+        VIDEO_SCALE_NEAREST,
+        VIDEO_SCALE_LINEAR,
+        VIDEO_SCALE_CUBIC,
+        VIDEO_SCALE_AREA,
+        VIDEO_SCALE_LANCZOS4,
+        VIDEO_SCALE_ALGO_COUNT,
+};
+#define VIDEO_SCALE_ALGO_DEFAULT VIDEO_SCALE_LINEAR
+
+const char *video_scale_algo_to_string(enum video_scale_algo algo);
+
+struct video_scale;
+
+/**
+ * @param keep_aspect  fit the picture to out_width x out_height and fill the
+ *                     rest with black, otherwise the picture is stretched
+ * @param threads      number of stripes, 0 to use all cores
+ * @returns NULL if codec is not supported
+ */
+struct video_scale *video_scale_init(codec_t codec, int in_width, int in_height, int out_width,
+                int out_height, bool keep_aspect, enum video_scale_algo algo, int threads);
+/// in and out are whole frames with vc_get_linesize() lines
+void video_scale(struct video_scale *s, const char *in, char *out);
+/**
+ * Writes output lines out_pitch bytes apart, eg. to a rectangle of a bigger
+ * frame. Packed pixel formats only, 0 means vc_get_linesize().
+ */
+void video_scale_pitch(struct video_scale *s, const char *in, char *out, int out_pitch);
+void video_scale_done(struct video_scale *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_VIDEO_SCALE_H_
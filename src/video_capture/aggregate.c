@@ -5,7 +5,7 @@
  * @brief Aggregate video capture driver
  */
 /*
- * Copyright (c) 2012-2023 CESNET z.s.p.o.
+ * Copyright (c) 2012-2026 CESNET z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -49,32 +49,89 @@
 #include "tv.h"
 
 #include "audio/types.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/thread.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#define MOD_NAME "[aggregate] "
+
+enum {
+        AGG_QUEUE_LEN = 4,           ///< max frames queued per device
+        AGG_DEFAULT_TIMEOUT_MS = 100, ///< used until FPS is known
+        AGG_IDLE_MIN_NS = 500 * 1000,        ///< first back-off after an immediate empty grab
+        AGG_IDLE_MAX_NS = 4 * 1000 * 1000,   ///< back-off limit, well below a frame time
+};
+
+enum agg_policy {
+        AGG_WAIT,   ///< wait until all tiles arrive (default, previous behavior)
+        AGG_DROP,   ///< drop the frame if a tile is missing after timeout
+        AGG_REPEAT, ///< use the previous tile of the late device after timeout
+};
+
 /* prototypes of functions defined in this module */
 static void show_help(void);
 
 static void show_help()
 {
-        printf("Aggregate capture\n");
-        printf("Usage\n");
-        printf("\t-t aggregate -t <dev1_config> -t <dev2_config> ....]\n");
-        printf("\t\twhere devn_config is a complete configuration string of device involved in an aggregate device\n");
-
+        color_printf("Aggregate capture\n");
+        color_printf("Usage\n");
+        color_printf("\t" TBOLD("-t aggregate[:policy=wait|drop|repeat][:tolerance=<ms>][:timeout=<ms>] -t <dev1_config> -t <dev2_config> ....") "\n");
+        color_printf("\t\twhere devn_config is a complete configuration string of device involved in an aggregate device\n");
+        color_printf("\n");
+        color_printf("Each device is grabbed in a separate thread, tiles are matched by capture time.\n");
+        color_printf("\t" TBOLD("policy") "    - what to do if a tile is not captured until timeout:\n");
+        color_printf("\t\t" TBOLD("wait") " (default) - keep waiting, " TBOLD("drop") " - drop the frame, "
+                        TBOLD("repeat") " - reuse previous tile\n");
+        color_printf("\t" TBOLD("tolerance") " - max capture time difference of tiles (default half of frame time)\n");
+        color_printf("\t" TBOLD("timeout") "   - time to wait for a missing tile (default frame time)\n");
 }
 
+struct queued_frame {
+        struct video_frame *frame;
+        time_ns_t           ts; ///< capture time (arrival from device)
+};
+
+struct aggregate_device {
+        struct vidcap_aggregate_state *parent;
+        int                 idx;
+        struct vidcap      *device;
+        pthread_t           thread_id;
+        bool                thread_started;
+
+        struct queued_frame queue[AGG_QUEUE_LEN];
+        int                 queue_len;
+        /// frames without dispose callback are valid only until next grab,
+        /// so only one may be outstanding (queued or in output frame)
+        bool                disposable;
+        int                 outstanding;
+        struct video_frame *current; ///< tile used in the last output frame
+};
+
 struct vidcap_aggregate_state {
-        struct vidcap     **devices;
+        struct aggregate_device *devices;
         int                 devices_cnt;
 
-        struct video_frame      **captured_frames;
-        struct video_frame       *frame; 
+        pthread_mutex_t     lock;
+        pthread_cond_t      boss_cv;   ///< new frame queued
+        pthread_cond_t      worker_cv; ///< frame released
+        bool                should_exit;
+
+        enum agg_policy     policy;
+        time_ns_t           tolerance; ///< 0 - derive from FPS
+        time_ns_t           timeout;   ///< 0 - derive from FPS
+
+        struct video_frame *frame;
         int frames;
+        int dropped_tiles;
         struct       timeval t, t0;
 
         int          audio_source_index;
+        struct audio_frame audio_in;  ///< accumulated from the audio source device
+        struct audio_frame audio_out; ///< returned from grab
 };
 
 
@@ -85,6 +142,125 @@ static void vidcap_aggregate_probe(struct device_info **cards, int *count, void
         *deleter = free;
 }
 
+/// @note called with lock held
+static void release_frame(struct aggregate_device *d, struct video_frame *f)
+{
+        VIDEO_FRAME_DISPOSE(f);
+        d->outstanding -= 1;
+        pthread_cond_broadcast(&d->parent->worker_cv);
+}
+
+/// @note called with lock held
+static void append_audio(struct vidcap_aggregate_state *s, const struct audio_frame *a)
+{
+        struct audio_frame *acc = &s->audio_in;
+        if (acc->bps != a->bps || acc->ch_count != a->ch_count || acc->sample_rate != a->sample_rate) {
+                acc->bps = a->bps;
+                acc->ch_count = a->ch_count;
+                acc->sample_rate = a->sample_rate;
+                acc->data_len = 0;
+        }
+        if (acc->data_len + a->data_len > acc->max_size) {
+                acc->max_size = acc->data_len + a->data_len;
+                acc->data = realloc(acc->data, acc->max_size);
+        }
+        memcpy(acc->data + acc->data_len, a->data, a->data_len);
+        acc->data_len += a->data_len;
+}
+
+static void *grab_worker(void *arg)
+{
+        struct aggregate_device *d = arg;
+        struct vidcap_aggregate_state *s = d->parent;
+        char name[16];
+        snprintf(name, sizeof name, "aggregate%d", d->idx);
+        set_thread_name(name);
+
+        time_ns_t idle_ns = 0; // back-off for devices whose grab returns immediately without a frame
+        pthread_mutex_lock(&s->lock);
+        while (!s->should_exit) {
+                if (!d->disposable && d->outstanding > 0) {
+                        pthread_cond_wait(&s->worker_cv, &s->lock);
+                        continue;
+                }
+                pthread_mutex_unlock(&s->lock);
+                struct audio_frame *audio = NULL;
+                const time_ns_t grab_start = get_time_in_ns();
+                struct video_frame *frame = vidcap_grab(d->device, &audio);
+                const time_ns_t ts = get_time_in_ns();
+                pthread_mutex_lock(&s->lock);
+
+                if (frame == NULL && audio == NULL && ts - grab_start < AGG_IDLE_MIN_NS) {
+                        idle_ns = idle_ns == 0 ? AGG_IDLE_MIN_NS : MIN(2 * idle_ns, AGG_IDLE_MAX_NS);
+                        const time_ns_t until = ts + idle_ns;
+                        struct timespec abs = { until / NS_IN_SEC, until % NS_IN_SEC };
+                        pthread_cond_timedwait(&s->worker_cv, &s->lock, &abs); // woken on exit
+                        continue;
+                }
+                idle_ns = 0;
+
+                if (audio != NULL) {
+                        if (s->audio_source_index == -1) {
+                                MSG(NOTICE, "Locking device #%d as an audio source.\n", d->idx);
+                                s->audio_source_index = d->idx;
+                        }
+                        if (s->audio_source_index == d->idx) {
+                                append_audio(s, audio);
+                        }
+                        AUDIO_FRAME_DISPOSE(audio);
+                }
+                if (frame == NULL) {
+                        continue;
+                }
+                d->disposable = frame->callbacks.dispose != NULL;
+                if (d->queue_len == AGG_QUEUE_LEN) { // drop oldest
+                        release_frame(d, d->queue[0].frame);
+                        memmove(&d->queue[0], &d->queue[1], (AGG_QUEUE_LEN - 1) * sizeof d->queue[0]);
+                        d->queue_len -= 1;
+                        s->dropped_tiles += 1;
+                }
+                d->queue[d->queue_len++] = (struct queued_frame){ frame, ts };
+                d->outstanding += 1;
+                pthread_cond_signal(&s->boss_cv);
+        }
+        pthread_mutex_unlock(&s->lock);
+        return NULL;
+}
+
+static bool parse_fmt(struct vidcap_aggregate_state *s, const char *fmt)
+{
+        char *tmp = strdup(fmt);
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *it = tmp;
+        bool ret = true;
+        while ((item = strtok_r(it, ":", &save_ptr)) != NULL) {
+                it = NULL;
+                if (strcmp(item, "policy=wait") == 0) {
+                        s->policy = AGG_WAIT;
+                } else if (strcmp(item, "policy=drop") == 0) {
+                        s->policy = AGG_DROP;
+                } else if (strcmp(item, "policy=repeat") == 0) {
+                        s->policy = AGG_REPEAT;
+                } else if (strstr(item, "tolerance=") == item) {
+                        s->tolerance = (time_ns_t) (atof(strchr(item, '=') + 1) * MS_IN_NS_DBL);
+                } else if (strstr(item, "timeout=") == item) {
+                        s->timeout = (time_ns_t) (atof(strchr(item, '=') + 1) * MS_IN_NS_DBL);
+                } else {
+                        if (strcmp(item, "help") != 0) {
+                                MSG(ERROR, "Unknown option: %s\n", item);
+                        }
+                        ret = false;
+                        break;
+                }
+        }
+        free(tmp);
+        return ret;
+}
+
+static void
+vidcap_aggregate_done(void *state);
+
 static int
 vidcap_aggregate_init(struct vidcap_params *params, void **state)
 {
@@ -103,10 +279,10 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
         s->frames = 0;
         gettimeofday(&s->t0, NULL);
 
-        if(vidcap_params_get_fmt(params) && strcmp(vidcap_params_get_fmt(params), "") != 0) {
+        if (vidcap_params_get_fmt(params) && !parse_fmt(s, vidcap_params_get_fmt(params))) {
                 show_help();
                 free(s);
-                return VIDCAP_INIT_NOERR;
+                return strcmp(vidcap_params_get_fmt(params), "help") == 0 ? VIDCAP_INIT_NOERR : VIDCAP_INIT_FAIL;
         }
 
 
@@ -119,7 +295,10 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                         break;
         }
 
-        s->devices = calloc(s->devices_cnt, sizeof(struct vidcap *));
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->boss_cv, NULL);
+        pthread_cond_init(&s->worker_cv, NULL);
+        s->devices = calloc(s->devices_cnt, sizeof s->devices[0]);
         tmp = params;
         for (int i = 0; i < s->devices_cnt; ++i) {
                 tmp = vidcap_params_get_next(tmp);
@@ -128,33 +307,27 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                         vidcap_params_set_flags(tmp, vidcap_params_get_flags(params));
                 }
 
-                int ret = initialize_video_capture(vidcap_params_get_parent(params), (struct vidcap_params *) tmp, &s->devices[i]);
+                s->devices[i].parent = s;
+                s->devices[i].idx = i;
+                int ret = initialize_video_capture(vidcap_params_get_parent(params), (struct vidcap_params *) tmp, &s->devices[i].device);
                 if(ret != 0) {
                         fprintf(stderr, "[aggregate] Unable to initialize device %d (%s:%s).\n",
                                         i, vidcap_params_get_driver(tmp),
                                         vidcap_params_get_fmt(tmp));
-                        goto error;
+                        vidcap_aggregate_done(s);
+                        return VIDCAP_INIT_FAIL;
                 }
         }
 
-        s->captured_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                pthread_create(&s->devices[i].thread_id, NULL, grab_worker, &s->devices[i]);
+                s->devices[i].thread_started = true;
+        }
 
         s->frame = vf_alloc(s->devices_cnt);
         
         *state = s;
 	return VIDCAP_INIT_OK;
-
-error:
-        if(s->devices) {
-                int i;
-                for (i = 0u; i < s->devices_cnt; ++i) {
-                        if(s->devices[i]) {
-                                 vidcap_done(s->devices[i]);
-                        }
-                }
-        }
-        free(s);
-        return VIDCAP_INIT_FAIL;
 }
 
 static void
@@ -164,48 +337,169 @@ vidcap_aggregate_done(void *state)
 
 	assert(s != NULL);
 
-	if (s != NULL) {
-                int i;
-		for (i = 0; i < s->devices_cnt; ++i) {
-                         vidcap_done(s->devices[i]);
-		}
-	}
-        
+        pthread_mutex_lock(&s->lock);
+        s->should_exit = true;
+        pthread_cond_broadcast(&s->worker_cv);
+        pthread_mutex_unlock(&s->lock);
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                if (s->devices[i].thread_started) {
+                        pthread_join(s->devices[i].thread_id, NULL);
+                }
+        }
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_device *d = &s->devices[i];
+                for (int j = 0; j < d->queue_len; ++j) {
+                        release_frame(d, d->queue[j].frame);
+                }
+                if (d->current != NULL) {
+                        release_frame(d, d->current);
+                }
+                if (d->device != NULL) {
+                        vidcap_done(d->device);
+                }
+        }
+
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->boss_cv);
+        pthread_cond_destroy(&s->worker_cv);
+        free(s->audio_in.data);
+        free(s->audio_out.data);
+        free(s->devices);
         vf_free(s->frame);
         free(s);
 }
 
+/// @returns frame duration or default if FPS is not yet known
+static time_ns_t frame_time(const struct vidcap_aggregate_state *s)
+{
+        return s->frame->fps > 0 ? (time_ns_t) (NS_IN_SEC_DBL / s->frame->fps)
+                                 : AGG_DEFAULT_TIMEOUT_MS * MS_IN_NS;
+}
+
+/**
+ * Discards queued tiles captured before the others' frame period.
+ * @returns true if all devices have a head tile within tolerance
+ * @note called with lock held
+ */
+static bool align_queues(struct vidcap_aggregate_state *s)
+{
+        const time_ns_t tolerance = s->tolerance > 0 ? s->tolerance : frame_time(s) / 2;
+        time_ns_t target = 0;
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                if (s->devices[i].queue_len > 0) {
+                        target = MAX(target, s->devices[i].queue[0].ts);
+                }
+        }
+        bool complete = true;
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_device *d = &s->devices[i];
+                while (d->queue_len > 0 && d->queue[0].ts < target - tolerance) {
+                        release_frame(d, d->queue[0].frame);
+                        memmove(&d->queue[0], &d->queue[1], (d->queue_len - 1) * sizeof d->queue[0]);
+                        d->queue_len -= 1;
+                        s->dropped_tiles += 1;
+                }
+                complete = complete && d->queue_len > 0;
+        }
+        return complete;
+}
+
+/**
+ * Takes head tiles to the output frame, missing tiles are replaced by the
+ * previous ones (if there are any and
+ * are still valid).
+ * @returns false if some tile is missing completely
+ * @note called with lock held
+ */
+static bool take_tiles(struct vidcap_aggregate_state *s)
+{
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                if (s->devices[i].queue_len == 0 && s->devices[i].current == NULL) {
+                        return false;
+                }
+        }
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_device *d = &s->devices[i];
+                if (d->queue_len == 0) {
+                        continue; // repeat
+                }
+                if (d->current != NULL) {
+                        release_frame(d, d->current);
+                }
+                d->current = d->queue[0].frame;
+                memmove(&d->queue[0], &d->queue[1], (d->queue_len - 1) * sizeof d->queue[0]);
+                d->queue_len -= 1;
+        }
+        return true;
+}
+
+/// @note called with lock held
+static void drop_queued(struct vidcap_aggregate_state *s)
+{
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_device *d = &s->devices[i];
+                for (int j = 0; j < d->queue_len; ++j) {
+                        release_frame(d, d->queue[j].frame);
+                        s->dropped_tiles += 1;
+                }
+                d->queue_len = 0;
+        }
+}
+
 static struct video_frame *
 vidcap_aggregate_grab(void *state, struct audio_frame **audio)
 {
 	struct vidcap_aggregate_state *s = (struct vidcap_aggregate_state *) state;
-        struct audio_frame *audio_frame = NULL;
-        struct video_frame *frame = NULL;
 
+        *audio = NULL;
+
+        pthread_mutex_lock(&s->lock);
+        // previous output frame was already processed (it has no dispose
+        // callback) so tiles valid only until next grab can be returned
         for (int i = 0; i < s->devices_cnt; ++i) {
-                VIDEO_FRAME_DISPOSE(s->captured_frames[i]);
+                struct aggregate_device *d = &s->devices[i];
+                if (d->current != NULL && !d->disposable) {
+                        release_frame(d, d->current);
+                        d->current = NULL;
+                }
+        }
+        const time_ns_t deadline = get_time_in_ns() + (s->timeout > 0 ? s->timeout : frame_time(s));
+        bool have_frame = false;
+        while (!(have_frame = align_queues(s))) {
+                if (get_time_in_ns() >= deadline) {
+                        break;
+                }
+                struct timespec ts = { deadline / NS_IN_SEC, deadline % NS_IN_SEC };
+                pthread_cond_timedwait(&s->boss_cv, &s->lock, &ts);
+        }
+        if (have_frame) {
+                take_tiles(s);
+        } else if (s->policy == AGG_DROP) {
+                drop_queued(s);
+        } else if (s->policy == AGG_REPEAT) {
+                have_frame = take_tiles(s);
         }
 
-        *audio = NULL;
+        if (s->audio_in.data_len > 0) {
+                struct audio_frame tmp = s->audio_out;
+                s->audio_out = s->audio_in;
+                s->audio_in = tmp;
+                s->audio_in.data_len = 0;
+                *audio = &s->audio_out;
+        }
+
+        if (!have_frame) {
+                pthread_mutex_unlock(&s->lock);
+                return NULL;
+        }
 
         for (int i = 0; i < s->devices_cnt; ++i) {
-                frame = NULL;
-                while(!frame) {
-                        frame = vidcap_grab(s->devices[i], &audio_frame);
-                }
+                struct video_frame *frame = s->devices[i].current;
                 if (i == 0) {
                         s->frame->color_spec = frame->color_spec;
                         s->frame->interlacing = frame->interlacing;
                         s->frame->fps = frame->fps;
                 }
-                if (s->audio_source_index == -1 && audio_frame != NULL) {
-                        fprintf(stderr, "[aggregate] Locking device #%d as an audio source.\n",
-                                        i);
-                        s->audio_source_index = i;
-                }
-                if (s->audio_source_index == i) {
-                        *audio = audio_frame;
-                }
                 if (frame->color_spec != s->frame->color_spec ||
                                 frame->fps != s->frame->fps ||
                                 frame->interlacing != s->frame->interlacing) {
@@ -217,21 +511,25 @@ vidcap_aggregate_grab(void *state, struct audio_frame **audio)
                         if(frame->fps != s->frame->fps)
                                 fprintf(stderr, "FPS (%.2f and %.2f)", frame->fps, s->frame->fps);
                         fprintf(stderr, "\n");
-                        
+
+                        pthread_mutex_unlock(&s->lock);
                         return NULL;
                 }
                 vf_get_tile(s->frame, i)->width = vf_get_tile(frame, 0)->width;
                 vf_get_tile(s->frame, i)->height = vf_get_tile(frame, 0)->height;
                 vf_get_tile(s->frame, i)->data_len = vf_get_tile(frame, 0)->data_len;
                 vf_get_tile(s->frame, i)->data = vf_get_tile(frame, 0)->data;
-                s->captured_frames[i] = frame;
         }
+        const int dropped_tiles = s->dropped_tiles;
+        s->dropped_tiles = 0;
+        pthread_mutex_unlock(&s->lock);
+
         s->frames++;
         gettimeofday(&s->t, NULL);
         double seconds = tv_diff(s->t, s->t0);    
         if (seconds >= 5) {
             float fps  = s->frames / seconds;
-            log_msg(LOG_LEVEL_INFO, "[aggregate cap.] %d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
+            log_msg(LOG_LEVEL_INFO, "[aggregate cap.] %d frames in %g seconds = %g FPS, %d tiles dropped\n", s->frames, seconds, fps, dropped_tiles);
             s->t0 = s->t;
             s->frames = 0;
         }  
@@ -248,4 +546,3 @@ static const struct video_capture_info vidcap_aggregate_info = {
 };
 
 REGISTER_MODULE(aggregate, &vidcap_aggregate_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
-
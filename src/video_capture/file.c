@@ -113,6 +113,8 @@ struct vidcap_state_lavf_decoder {
         bool paused;
         bool ended;
         int seek_sec;
+        int video_frames_since_rewind;
+        bool still_loop; ///< looping a single picture, frames are marked FRAME_UNCHANGED
 
         int video_stream_idx, audio_stream_idx;
         int64_t last_vid_pts; ///< last played PTS, if PTS == PTS_NO_VALUE, DTS is stored instead
@@ -500,6 +502,8 @@ static void *vidcap_file_worker(void *state) {
                                 CHECK_FF(avio_seek(s->fmt_ctx->pb, s->video_stream_idx, SEEK_SET), {}); // handle single JPEG loop, inspired by libavformat's seek_frame_generic because img_read_seek (AVInputFormat::read_seek) doesn't do the job - seeking is inmplemeted just in img2dec if VideoDemuxData::loop == 1
                                 CHECK_FF(avformat_seek_file(s->fmt_ctx, -1, INT64_MIN, s->fmt_ctx->start_time, INT64_MAX, 0), FAIL_WORKER);
                                 flush_captured_data(s);
+                                s->still_loop = s->video_frames_since_rewind == 1;
+                                s->video_frames_since_rewind = 0;
                                 log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Rewinding the file.\n");
                                 continue;
                         } else {
@@ -523,6 +527,10 @@ static void *vidcap_file_worker(void *state) {
                         if (!out) {
                                 continue;
                         }
+                        s->video_frames_since_rewind += 1;
+                        if (s->still_loop) {
+                                out->flags |= FRAME_UNCHANGED;
+                        }
                         if (s->audio_stream_idx != -1 && out->seq != UINT32_MAX) {
                                 if (!have_audio_for_video(s, out->seq, out->duration)) {
                                         simple_linked_list_append(s->vid_frm_noaud,
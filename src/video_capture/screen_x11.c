@@ -35,8 +35,14 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 /**
- * @todo
- * The XGetImage() is a bit slow, consider using XShm as OBS does.
+ * @file
+ * If MIT-SHM is available (local X server), the screen is read by the server
+ * directly to a persistent shared-memory image. With XDamage, only the rows
+ * of the damaged area (and of the moved cursor) are read and converted and
+ * frames without any change are marked with FRAME_UNCHANGED.
+ *
+ * Otherwise a worker thread grabs the whole screen with XGetImage(), which
+ * is considerably slower.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -66,6 +72,14 @@
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif // HAVE_XSHM
 #include <X11/Xutil.h>
 
 #define MOD_NAME "[screen capture] "
@@ -79,10 +93,11 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH]\n");
+        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH][:noshm]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
         printf("\t\tdisplay - display to capture (including the colon!)\n");
         printf("\t\tgeomoetry | size - viewport to use (both option mean the same - size is just a convenient name)\n");
+        printf("\t\tnoshm - do not use MIT-SHM and XDamage even if available (slower)\n");
 }
 
 struct grabbed_data;
@@ -119,8 +134,118 @@ struct vidcap_screen_x11_state {
         bool initialized;
         int cpu_count;
         char *req_display;
+        bool noshm;
+
+        XImage *shm_image; ///< persistent capture buffer if MIT-SHM is used
+#ifdef HAVE_XSHM
+        XShmSegmentInfo shminfo;
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+        Damage damage;
+        XserverRegion damage_region;
+#endif // HAVE_XDAMAGE
+        bool use_damage;
+        bool shm_valid; ///< shm_image and frame contain the whole screen
+        int cursor_x, cursor_y, cursor_w, cursor_h; ///< cursor blended into shm_image
+        unsigned long cursor_serial;
 };
 
+#ifdef HAVE_XSHM
+static volatile bool x_error_occurred;
+static int x_error_handler(Display *dpy, XErrorEvent *ev) {
+        UNUSED(dpy), UNUSED(ev);
+        x_error_occurred = true;
+        return 0;
+}
+
+static bool init_shm(struct vidcap_screen_x11_state *s) {
+        if (!XShmQueryExtension(s->dpy)) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "MIT-SHM not available.\n");
+                return false;
+        }
+        int screen = DefaultScreen(s->dpy);
+        s->shm_image = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, screen), DefaultDepth(s->dpy, screen),
+                        ZPixmap, NULL, &s->shminfo, s->tile->width, s->tile->height);
+        if (s->shm_image == NULL) {
+                return false;
+        }
+        if (s->shm_image->bits_per_pixel != 32) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unsupported depth %d bpp for MIT-SHM.\n", s->shm_image->bits_per_pixel);
+                XDestroyImage(s->shm_image);
+                s->shm_image = NULL;
+                return false;
+        }
+        s->shminfo.shmid = shmget(IPC_PRIVATE, (size_t) s->shm_image->bytes_per_line * s->shm_image->height, IPC_CREAT | 0600);
+        if (s->shminfo.shmid == -1) {
+                perror(MOD_NAME "shmget");
+                XDestroyImage(s->shm_image);
+                s->shm_image = NULL;
+                return false;
+        }
+        s->shminfo.shmaddr = s->shm_image->data = shmat(s->shminfo.shmid, NULL, 0);
+        // mark for removal now, the segment exists until the last detach
+        shmctl(s->shminfo.shmid, IPC_RMID, NULL);
+        if (s->shminfo.shmaddr == (char *) -1) {
+                perror(MOD_NAME "shmat");
+                s->shm_image->data = NULL;
+                XDestroyImage(s->shm_image);
+                s->shm_image = NULL;
+                return false;
+        }
+        s->shminfo.readOnly = False;
+
+        // attach fails asynchronously for remote X servers
+        x_error_occurred = false;
+        int (*old_handler)(Display *, XErrorEvent *) = XSetErrorHandler(x_error_handler);
+        Status attached = XShmAttach(s->dpy, &s->shminfo);
+        XSync(s->dpy, False);
+        XSetErrorHandler(old_handler);
+        if (!attached || x_error_occurred) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot attach MIT-SHM segment (remote display?), using XGetImage.\n");
+                shmdt(s->shminfo.shmaddr);
+                s->shm_image->data = NULL;
+                XDestroyImage(s->shm_image);
+                s->shm_image = NULL;
+                return false;
+        }
+
+#ifdef HAVE_XDAMAGE
+        int event_base = 0;
+        int error_base = 0;
+        if (XDamageQueryExtension(s->dpy, &event_base, &error_base)) {
+                int major = 2;
+                int minor = 0;
+                XFixesQueryVersion(s->dpy, &major, &minor);
+                s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+                s->damage_region = XFixesCreateRegion(s->dpy, NULL, 0);
+                s->use_damage = true;
+        } else {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "XDamage not available, reading whole screen.\n");
+        }
+#endif // HAVE_XDAMAGE
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using MIT-SHM%s.\n", s->use_damage ? " with XDamage" : "");
+        return true;
+}
+
+static void done_shm(struct vidcap_screen_x11_state *s) {
+        if (s->shm_image == NULL) {
+                return;
+        }
+#ifdef HAVE_XDAMAGE
+        if (s->use_damage) {
+                XDamageDestroy(s->dpy, s->damage);
+                XFixesDestroyRegion(s->dpy, s->damage_region);
+        }
+#endif // HAVE_XDAMAGE
+        XShmDetach(s->dpy, &s->shminfo);
+        XSync(s->dpy, False);
+        shmdt(s->shminfo.shmaddr);
+        s->shm_image->data = NULL; // not owned by XImage
+        XDestroyImage(s->shm_image);
+        s->shm_image = NULL;
+}
+#endif // HAVE_XSHM
+
 static bool initialize(struct vidcap_screen_x11_state *s) {
         s->frame = vf_alloc(1);
         s->tile = vf_get_tile(s->frame, 0);
@@ -168,11 +293,152 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 
         s->tile->data = (char *) malloc(s->tile->data_len);
 
+#ifdef HAVE_XSHM
+        if (!s->noshm && init_shm(s)) {
+                return true; // no worker needed, see grab_shm()
+        }
+#endif // HAVE_XSHM
         pthread_create(&s->worker_id, NULL, grab_thread, s);
 
         return true;
 }
 
+#ifdef HAVE_XFIXES
+/**
+ * Blends cursor to 32-bit image (cursor position is given relative to image)
+ */
+static void blend_cursor(uint32_t *image_data, int width, int height, int stride_px,
+                const XFixesCursorImage *cursor, int cursor_x, int cursor_y)
+{
+        for(int x = 0; x < cursor->width; ++x) {
+                for(int y = 0; y < cursor->height; ++y) {
+                        if (cursor_x + x < 0 || cursor_x + x >= width ||
+                                        cursor_y + y < 0 || cursor_y + y >= height)
+                                continue;
+                        uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
+                        int alpha = cursor_pix >> 24 & 0xff;
+                        int r1 = cursor_pix >> 16 & 0xff,
+                            g1 = cursor_pix >> 8 & 0xff,
+                            b1 = cursor_pix >> 0 & 0xff;
+                        uint32_t *image_pix_ptr = &image_data[cursor_x + x + (cursor_y + y) * stride_px];
+                        uint_fast32_t image_pix = *image_pix_ptr;
+                        int r2 = image_pix >> 16 & 0xff,
+                            g2 = image_pix >> 8 & 0xff,
+                            b2 = image_pix >> 0 & 0xff;
+                        float scale_image = (float) (255 - alpha)/ 255;
+                        float scale_cursor = (float) alpha / 255;
+
+                        *image_pix_ptr =
+                                ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
+                                ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
+                                ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
+                }
+        }
+}
+#endif // HAVE_XFIXES
+
+#ifdef HAVE_XSHM
+static void extend_rows(int *y0, int *y1, int top, int bottom, int height) {
+        top = MAX(top, 0);
+        bottom = MIN(bottom, height);
+        if (top >= bottom) {
+                return;
+        }
+        *y0 = MIN(*y0, top);
+        *y1 = MAX(*y1, bottom);
+}
+
+/**
+ * Reads the changed rows to the persistent SHM image and converts them to
+ * the output frame. Rows are always read over the whole width so that the
+ * band is contiguous in the shared memory.
+ */
+static void grab_shm(struct vidcap_screen_x11_state *s)
+{
+        const int height = s->tile->height;
+        int y0 = s->shm_valid ? height : 0;
+        int y1 = s->shm_valid ? 0 : height;
+
+#ifdef HAVE_XDAMAGE
+        if (s->use_damage) {
+                while (XPending(s->dpy) > 0) { // damage notifications, the damage itself is accumulated in s->damage
+                        XEvent ev;
+                        XNextEvent(s->dpy, &ev);
+                }
+                XDamageSubtract(s->dpy, s->damage, None, s->damage_region);
+                int nrects = 0;
+                XRectangle *rects = XFixesFetchRegion(s->dpy, s->damage_region, &nrects);
+                for (int i = 0; i < nrects; ++i) {
+                        if (rects[i].x + rects[i].width <= s->x || rects[i].x >= s->x + (int) s->tile->width) {
+                                continue;
+                        }
+                        extend_rows(&y0, &y1, rects[i].y - s->y, rects[i].y + rects[i].height - s->y, height);
+                }
+                if (rects != NULL) {
+                        XFree(rects);
+                }
+        } else {
+                y0 = 0;
+                y1 = height;
+        }
+#else
+        y0 = 0;
+        y1 = height;
+#endif // HAVE_XDAMAGE
+
+#ifdef HAVE_XFIXES
+        XFixesCursorImage *cursor = XFixesGetCursorImage(s->dpy);
+        if (cursor != NULL) {
+                const int cursor_x = cursor->x - cursor->xhot - s->x;
+                const int cursor_y = cursor->y - cursor->yhot - s->y;
+                if (cursor_x != s->cursor_x || cursor_y != s->cursor_y || cursor->cursor_serial != s->cursor_serial) {
+                        extend_rows(&y0, &y1, s->cursor_y, s->cursor_y + s->cursor_h, height);
+                        extend_rows(&y0, &y1, cursor_y, cursor_y + cursor->height, height);
+                }
+                if (y0 < y1) { // the cursor rows must be re-read to avoid blending it twice
+                        extend_rows(&y0, &y1, cursor_y, cursor_y + cursor->height, height);
+                }
+                s->cursor_x = cursor_x;
+                s->cursor_y = cursor_y;
+                s->cursor_w = cursor->width;
+                s->cursor_h = cursor->height;
+                s->cursor_serial = cursor->cursor_serial;
+        }
+#endif // HAVE_XFIXES
+
+        if (y0 >= y1) {
+                s->frame->flags |= FRAME_UNCHANGED;
+#ifdef HAVE_XFIXES
+                if (cursor != NULL) {
+                        XFree(cursor);
+                }
+#endif // HAVE_XFIXES
+                return;
+        }
+        s->frame->flags &= ~FRAME_UNCHANGED;
+
+        XImage band = *s->shm_image;
+        band.height = y1 - y0;
+        band.data = s->shm_image->data + (size_t) y0 * s->shm_image->bytes_per_line;
+        if (!XShmGetImage(s->dpy, s->root, &band, s->x, s->y + y0, AllPlanes)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "XShmGetImage failed!\n");
+        }
+        s->shm_valid = true;
+
+#ifdef HAVE_XFIXES
+        if (cursor != NULL) {
+                blend_cursor((uint32_t *)(void *) s->shm_image->data, s->tile->width, height,
+                                s->shm_image->bytes_per_line / 4, cursor, s->cursor_x, s->cursor_y);
+                XFree(cursor);
+        }
+#endif // HAVE_XFIXES
+
+        const int dst_linesize = vc_get_linesize(s->tile->width, RGB);
+        parallel_pix_conv(y1 - y0, s->tile->data + (size_t) y0 * dst_linesize, dst_linesize,
+                        band.data, s->shm_image->bytes_per_line, vc_copylineABGRtoRGB, s->cpu_count);
+}
+#endif // HAVE_XSHM
+
 
 static void *grab_thread(void *args)
 {
@@ -190,33 +456,9 @@ static void *grab_thread(void *args)
 
 #ifdef HAVE_XFIXES
                 if (cursor) {
-                        uint32_t *image_data = (uint32_t *)(void *) new_item->data->data;
-                        for(int x = 0; x < cursor->width; ++x) {
-                                for(int y = 0; y < cursor->height; ++y) {
-                                        if(cursor->x + x >= (int) s->tile->width ||
-                                                        cursor->y + y >= (int) s->tile->height)
-                                                continue;
-                                        //image_data[x + y * s->tile->width] = cursor->pixels[x + y * cursor->width];
-                                        uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
-                                        ///fprintf(stderr, "%d %d\n", cursor->x + x, cursor->y + y);
-                                        int alpha = cursor_pix >> 24 & 0xff;
-                                        int r1 = cursor_pix >> 16 & 0xff,
-                                            g1 = cursor_pix >> 8 & 0xff,
-                                            b1 = cursor_pix >> 0 & 0xff;
-                                        uint_fast32_t image_pix = image_data[cursor->x + x + (cursor->y + y) * s->tile->width];
-                                        int r2 = image_pix >> 16 & 0xff,
-                                            g2 = image_pix >> 8 & 0xff,
-                                            b2 = image_pix >> 0 & 0xff;
-                                        float scale_image = (float) (255 - alpha)/ 255;
-                                        float scale_cursor = (float) alpha / 255;
-
-                                        image_data[cursor->x + x + (cursor->y + y) * s->tile->width] =
-                                                ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
-                                                ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
-                                                ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
-                                }
-                        }
-
+                        blend_cursor((uint32_t *)(void *) new_item->data->data, s->tile->width, s->tile->height,
+                                        new_item->data->bytes_per_line / 4, cursor,
+                                        cursor->x - cursor->xhot - s->x, cursor->y - cursor->yhot - s->y);
                         XFree(cursor);
                 }
 #endif // HAVE_XFIXES
@@ -312,6 +554,8 @@ static _Bool parse_fmt(struct vidcap_screen_x11_state *s, char *fmt) {
                                 val = strchr(val, '+') + 1;
                                 s->y = atoi(val);
                         }
+                } else if (strcmp(tok, "noshm") == 0) {
+                        s->noshm = true;
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option \"%s\"!\n", tok);
                         return 0;
@@ -399,6 +643,9 @@ static void vidcap_screen_x11_done(void *state)
         }
         pthread_mutex_unlock(&s->lock);
 
+#ifdef HAVE_XSHM
+        done_shm(s);
+#endif // HAVE_XSHM
         if(s->tile)
                 free(s->tile->data);
 
@@ -407,21 +654,9 @@ static void vidcap_screen_x11_done(void *state)
         free(s);
 }
 
-static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_frame **audio)
+/// takes a screenshot grabbed by grab_thread()
+static void grab_queued(struct vidcap_screen_x11_state *s)
 {
-        struct vidcap_screen_x11_state *s = (struct vidcap_screen_x11_state *) state;
-
-        if (!s->initialized) {
-                s->initialized = initialize(s);
-                if (!s->initialized) {
-                        fprintf(stderr, "Cannot capture screen - unable to initialize!\n");
-                        exit_uv(1);
-                        return NULL;
-                }
-        }
-
-        *audio = NULL;
-
         struct grabbed_data *item = NULL;
 
         pthread_mutex_lock(&s->lock);
@@ -452,6 +687,31 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
 
         XDestroyImage(item->data);
         free(item);
+}
+
+static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_frame **audio)
+{
+        struct vidcap_screen_x11_state *s = (struct vidcap_screen_x11_state *) state;
+
+        if (!s->initialized) {
+                s->initialized = initialize(s);
+                if (!s->initialized) {
+                        fprintf(stderr, "Cannot capture screen - unable to initialize!\n");
+                        exit_uv(1);
+                        return NULL;
+                }
+        }
+
+        *audio = NULL;
+
+#ifdef HAVE_XSHM
+        if (s->shm_image != NULL) {
+                grab_shm(s);
+        } else
+#endif // HAVE_XSHM
+        {
+                grab_queued(s);
+        }
 
         if(s->fps > 0.0) {
                 struct timeval cur_time;
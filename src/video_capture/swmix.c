@@ -36,13 +36,20 @@
  *
  * @brief SW video mix is a virtual video mixer.
  *
- * @todo
- * Reenable configuration file position matching.
+ * Slaves are composited either with OpenGL or on CPU. With the CPU backend,
+ * each slave thread scales its frames into its own cell as soon as they are
+ * captured and the master thread only copies the latest cells to the output.
  *
  * @todo
- * Refactor to use also different scalers than OpenGL (eg. libswscale)
+ * Reenable configuration file position matching.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
 #include <assert.h>
 #include <math.h>
 #include <pthread.h>
@@ -52,24 +59,39 @@
 
 #include "audio/types.h"
 #include "debug.h"
+#ifdef HAVE_SWMIX_GL
 #include "gl_context.h"
+#endif
 #include "host.h"
 #include "lib_common.h"
+#include "pixfmt_conv.h"
 #include "tv.h"
 #include "utils/config_file.h"
 #include "utils/fs.h"
 #include "utils/list.h"
 #include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/video_scale.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_capture.h"
 
 #define MAX_AUDIO_LEN (1024*1024)
+#define MOD_NAME "[swmix] "
 
 typedef enum {
         BICUBIC,
         BILINEAR
 } interpolation_t;
 
+enum swmix_backend {
+        BACKEND_AUTO, ///< GL if a context can be created, CPU otherwise
+        BACKEND_GL,
+        BACKEND_CPU,
+};
+
+#ifdef HAVE_SWMIX_GL
+
 /*
  * Bicubic interpolation taken from:
  * http://www.codeproject.com/Articles/236394/Bi-Cubic-and-Bi-Linear-Interpolation-with-GLSL
@@ -161,6 +183,7 @@ void main()
     }
     gl_FragColor = nSum / nDenom;
 });
+#endif // defined HAVE_SWMIX_GL
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -190,7 +213,7 @@ static void show_help()
 {
         printf("SW Mix capture\n");
         printf("Usage\n");
-        printf("\t-t swmix:<width>:<height>:<fps>[:<codec>[:interpolation=<i_type>[,<algo>]][:layout=<X>x<Y>]] "
+        printf("\t-t swmix:<width>:<height>:<fps>[:<codec>[:interpolation=<i_type>[,<algo>]][:layout=<X>x<Y>][:backend=<b>]] "
                         "-t <dev1_config> -t <dev2_config>\n");
         printf("\tor\n");
         printf("\t-t swmix:file[=<file_path>] -t <dev1_config> -t <dev2_config> ...\n");
@@ -203,12 +226,35 @@ static void show_help()
                         "RGB or UYVY (optional, default RGBA)\n");
         printf("\t\t<i_type> can be one of 'bilinear' or 'bicubic' (default)\n");
         printf("\t\t\t<algo> bicubic interpolation algorithm: CatMullRom, BSpline (default) or Triangular\n");
+        printf("\t\t<b> compositing backend - 'gl' or 'cpu', default is GL if available\n"
+                        "\t\t\t(CPU supports RGBA and UYVY output, inputs should not overlap)\n");
         printf("\n");
         printf("\t\tIn first variant, individual inputs are arranged automatically.\n");
         printf("\t\tWith the second variant, you provide overall layout and layout for \n"
                         "\t\tindividual inputs in SW mix config file (%s).\n", get_config_name());
 }
 
+/**
+ * Area of the output frame owned by one slave with the CPU backend. The slave
+ * thread renders the back buffer, the front one is read by the master.
+ */
+struct cpu_cell {
+        int                 x, y, width, height; ///< in output frame pixels
+        codec_t             out_codec;
+        enum video_scale_algo algo;
+        int                 threads;
+
+        struct video_desc   saved_desc;
+        bool                supported;
+        decoder_t           decoder; ///< slave codec to out_codec, NULL if same
+        char               *conv_buf;
+        struct video_scale *scaler;  ///< NULL if the slave matches the cell size
+
+        char               *back;
+        char               *front;   ///< guarded by state_slave::lock
+        bool                valid;   ///< front contains a frame
+};
+
 struct state_slave {
         pthread_t           thread_id;
         bool                should_exit;
@@ -220,17 +266,22 @@ struct state_slave {
 
         struct audio_frame  audio_frame;
         bool                audio_captured;
+
+        struct cpu_cell    *cell; ///< CPU backend only
 };
 
 struct vidcap_swmix_state {
         struct state_slave *slaves;
         int                 devices_cnt;
+        enum swmix_backend  backend;
+#ifdef HAVE_SWMIX_GL
         struct gl_context   gl_context;
 
         GLuint              tex_output;
         GLuint              tex_output_uyvy;
         GLuint              fbo;
         GLuint              fbo_uyvy;
+#endif
 
         struct video_frame *frame;
         char               *network_buffer;
@@ -258,9 +309,14 @@ struct vidcap_swmix_state {
         bool                use_config_file;
 
         char               *bicubic_algo;
+#ifdef HAVE_SWMIX_GL
         GLuint              bicubic_program;
+#endif
         interpolation_t     interpolation;
         int                 grid_x, grid_y;
+
+        struct cpu_cell    *cells;
+        bool                cells_cover_frame;
 };
 
 
@@ -276,8 +332,10 @@ struct slave_data {
         struct video_desc   saved_desc;
         float               posX[4];
         float               posY[4];
+#ifdef HAVE_SWMIX_GL
         GLuint              texture[2]; // RGB(A), (UYVY)
         GLuint              fbo; // RGB(A)
+#endif
         double              x, y, width, height; // in 1x1 unit space
         double              fb_aspect;
 
@@ -303,16 +361,20 @@ static struct slave_data *init_slave_data(struct vidcap_swmix_state *s, FILE *co
         }
 
         for(int i = 0; i < s->devices_cnt; ++i) {
-                glGenTextures(2, slaves_data[i].texture);
-                for(int j = 0; j < 2; ++j) {
-                        glBindTexture(GL_TEXTURE_2D, slaves_data[i].texture[j]);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                }
+#ifdef HAVE_SWMIX_GL
+                if (s->backend == BACKEND_GL) {
+                        glGenTextures(2, slaves_data[i].texture);
+                        for(int j = 0; j < 2; ++j) {
+                                glBindTexture(GL_TEXTURE_2D, slaves_data[i].texture[j]);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                        }
 
-                glGenFramebuffers(1, &slaves_data[i].fbo);
+                        glGenFramebuffers(1, &slaves_data[i].fbo);
+                }
+#endif
 
                 slaves_data[i].fb_aspect = (double) s->frame->tiles[0].width /
                         s->frame->tiles[0].height;
@@ -346,17 +408,22 @@ static struct slave_data *init_slave_data(struct vidcap_swmix_state *s, FILE *co
         return slaves_data;
 }
 
-static void destroy_slave_data(struct slave_data *data, int count) {
+static void destroy_slave_data(struct slave_data *data, int count, bool gl) {
         if (!data) {
                 return;
         }
-        for(int i = 0; i < count; ++i) {
+#ifdef HAVE_SWMIX_GL
+        for(int i = 0; gl && i < count; ++i) {
                 glDeleteTextures(2, data[i].texture);
                 glDeleteFramebuffers(1, &data[i].fbo);
         }
+#else
+        UNUSED(count), UNUSED(gl);
+#endif
         free(data);
 }
 
+#ifdef HAVE_SWMIX_GL
 static void reconfigure_slave_rendering(struct slave_data *s, struct video_desc desc)
 {
         glBindTexture(GL_TEXTURE_2D, s->texture[0]);
@@ -598,29 +665,320 @@ static void render_slave(struct slave_data *s, interpolation_t interpolation, GL
         glEnd();
 }
 
+/// moves newly captured slave frames to slaves_data and reconfigures textures on format change
+static void gl_grab_slave_frames(struct vidcap_swmix_state *s)
+{
+        for(int i = 0; i < s->devices_cnt; ++i) {
+                pthread_mutex_lock(&s->slaves[i].lock);
+                VIDEO_FRAME_DISPOSE(s->slaves[i].done_frame);
+                s->slaves[i].done_frame = s->slaves_data[i].current_frame;
+                s->slaves_data[i].current_frame = NULL;
+                if(s->slaves[i].captured_frame) {
+                        s->slaves_data[i].current_frame =
+                                s->slaves[i].captured_frame;
+                        s->slaves[i].captured_frame = NULL;
+                } else if(s->slaves[i].done_frame) {
+                        s->slaves_data[i].current_frame =
+                                s->slaves[i].done_frame;
+                        s->slaves[i].done_frame = NULL;
+                }
+                pthread_mutex_unlock(&s->slaves[i].lock);
+        }
+
+        // check for mode change
+        for(int i = 0; i < s->devices_cnt; ++i) {
+                if(s->slaves_data[i].current_frame) {
+                        check_for_slave_format_change(&s->slaves_data[i]);
+                }
+        }
+}
+
+static void gl_composite(struct vidcap_swmix_state *s, GLuint from_uyvy, GLuint to_uyvy, char *read_buf)
+{
+        // load data
+        for(int i = 0; i < s->devices_cnt; ++i) {
+                if(s->slaves_data[i].current_frame) {
+                        load_texture(&s->slaves_data[i], from_uyvy);
+                }
+        }
+
+        // draw
+        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
+                        GL_TEXTURE_2D, s->tex_output, 0);
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glViewport(0, 0, s->frame->tiles[0].width, s->frame->tiles[0].height);
+
+        if(s->interpolation == BICUBIC) {
+                glUseProgram(s->bicubic_program);
+                glUniform1i(glGetUniformLocation(s->bicubic_program, "image"), 0);
+        }
+
+        for(int i = 0; i < s->devices_cnt; ++i) {
+                if(s->slaves_data[i].current_frame) {
+                        render_slave(&s->slaves_data[i], s->interpolation, s->bicubic_program);
+                }
+        }
+        glUseProgram(0);
+
+        // read back
+        glBindTexture(GL_TEXTURE_2D, s->tex_output);
+        int width = s->frame->tiles[0].width;
+        GLenum format = GL_RGBA;
+        if(s->frame->color_spec == UYVY) {
+                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo_uyvy);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
+                                GL_TEXTURE_2D, s->tex_output_uyvy, 0);
+                glViewport(0, 0, s->frame->tiles[0].width / 2, s->frame->tiles[0].height);
+                glUseProgram(to_uyvy);
+                glBegin(GL_QUADS);
+                glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
+                glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
+                glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
+                glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
+                glEnd();
+                glUseProgram(0);
+                width /= 2;
+                glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
+        } else if (s->frame->color_spec == RGB) {
+                format = GL_RGB;
+        }
+
+        glReadPixels(0, 0, width,
+                        s->frame->tiles[0].height,
+                        format, GL_UNSIGNED_BYTE,
+                        read_buf);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
+#endif // defined HAVE_SWMIX_GL
+
+static void fill_black(char *data, int width, int height, codec_t codec)
+{
+        const unsigned char uyvy[] = { 128, 16, 128, 16 };
+        const unsigned char rgba[] = { 0, 0, 0, 255 };
+        const unsigned char *pattern = codec == UYVY ? uyvy : rgba;
+        const size_t len = (size_t) vc_get_linesize(width, codec) * height;
+        for (size_t i = 0; i < len; ++i) {
+                data[i] = (char) pattern[i % 4];
+        }
+}
+
+static bool cpu_cell_reconfigure(struct cpu_cell *c, struct video_desc desc)
+{
+        video_scale_done(c->scaler);
+        c->scaler = NULL;
+        free(c->conv_buf);
+        c->conv_buf = NULL;
+        c->decoder = NULL;
+
+        if (desc.color_spec != c->out_codec) {
+                c->decoder = get_decoder_from_to(desc.color_spec, c->out_codec);
+                if (c->decoder == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot convert %s to %s!\n",
+                                        get_codec_name(desc.color_spec), get_codec_name(c->out_codec));
+                        return false;
+                }
+        }
+        if (desc.width != (unsigned) c->width || desc.height != (unsigned) c->height) {
+                c->scaler = video_scale_init(c->out_codec, desc.width, desc.height, c->width, c->height,
+                                true, c->algo, c->threads);
+                if (c->scaler == NULL) {
+                        return false;
+                }
+                if (c->decoder) {
+                        c->conv_buf = malloc((size_t) vc_get_linesize(desc.width, c->out_codec) * desc.height);
+                }
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cell %dx%d+%d+%d: %s %ux%u%s\n", c->width, c->height, c->x, c->y,
+                        get_codec_name(desc.color_spec), desc.width, desc.height,
+                        c->scaler ? " scaled" : "");
+        return true;
+}
+
+/// called by slave thread for every captured frame
+static void cpu_cell_render(struct state_slave *s, const struct video_frame *frame)
+{
+        struct cpu_cell *c = s->cell;
+        struct video_desc desc = video_desc_from_frame(frame);
+        if (!video_desc_eq(desc, c->saved_desc)) {
+                c->supported = cpu_cell_reconfigure(c, desc);
+                c->saved_desc = desc;
+        }
+        if (!c->supported) {
+                return;
+        }
+
+        const char *src = frame->tiles[0].data;
+        if (c->decoder) {
+                char *dst = c->scaler ? c->conv_buf : c->back;
+                const int src_linesize = vc_get_linesize(desc.width, desc.color_spec);
+                const int dst_linesize = vc_get_linesize(desc.width, c->out_codec);
+                for (unsigned i = 0; i < desc.height; ++i) {
+                        c->decoder((unsigned char *) dst + (size_t) i * dst_linesize,
+                                        (const unsigned char *) src + (size_t) i * src_linesize,
+                                        dst_linesize, 0, 8, 16);
+                }
+                src = dst;
+        }
+        if (c->scaler) {
+                video_scale(c->scaler, src, c->back);
+        } else if (src != c->back) {
+                memcpy(c->back, src, (size_t) vc_get_linesize(c->width, c->out_codec) * c->height);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        char *tmp = c->front;
+        c->front = c->back;
+        c->back = tmp;
+        c->valid = true;
+        pthread_mutex_unlock(&s->lock);
+}
+
+struct cpu_blit_data {
+        struct state_slave *slave;
+        char               *out;
+        int                 out_linesize;
+};
+
+static void *cpu_blit_cell(void *arg)
+{
+        struct cpu_blit_data *d = arg;
+        struct cpu_cell *c = d->slave->cell;
+        const int cell_linesize = vc_get_linesize(c->width, c->out_codec);
+        char *out = d->out + (size_t) c->y * d->out_linesize + vc_get_linesize(c->x, c->out_codec);
+
+        pthread_mutex_lock(&d->slave->lock);
+        if (c->valid) {
+                for (int y = 0; y < c->height; ++y) {
+                        memcpy(out + (size_t) y * d->out_linesize, c->front + (size_t) y * cell_linesize,
+                                        cell_linesize);
+                }
+        } else {
+                for (int y = 0; y < c->height; ++y) {
+                        fill_black(out + (size_t) y * d->out_linesize, c->width, 1, c->out_codec);
+                }
+        }
+        pthread_mutex_unlock(&d->slave->lock);
+        return NULL;
+}
+
+static void cpu_composite(struct vidcap_swmix_state *s, char *out)
+{
+        if (!s->cells_cover_frame) {
+                fill_black(out, s->frame->tiles[0].width, s->frame->tiles[0].height, s->frame->color_spec);
+        }
+        struct cpu_blit_data data[s->devices_cnt];
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                data[i].slave = &s->slaves[i];
+                data[i].out = out;
+                data[i].out_linesize = vc_get_linesize(s->frame->tiles[0].width, s->frame->color_spec);
+        }
+        task_run_parallel(cpu_blit_cell, s->devices_cnt, data, sizeof data[0], NULL);
+}
+
+static int to_pixels(double pos, int size)
+{
+        return CLAMP((int) (pos * size + 0.5), 0, size);
+}
+
+/**
+ * Places slaves to cells in output pixel coordinates according to layout in
+ * slaves_data. Scaler stripes are split among slaves since they run concurrently.
+ */
+static bool init_cpu_cells(struct vidcap_swmix_state *s)
+{
+        const codec_t out_codec = s->frame->color_spec;
+        if (out_codec != UYVY && out_codec != RGBA) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "CPU backend supports only UYVY and RGBA output!\n");
+                return false;
+        }
+        const int out_w = s->frame->tiles[0].width;
+        const int out_h = s->frame->tiles[0].height;
+        s->cells = calloc(s->devices_cnt, sizeof s->cells[0]);
+        long long covered = 0;
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct cpu_cell *c = &s->cells[i];
+                const struct slave_data *sd = &s->slaves_data[i];
+                c->x = to_pixels(sd->x, out_w) & ~1;
+                c->y = to_pixels(sd->y, out_h);
+                c->width = (to_pixels(sd->x + sd->width, out_w) - c->x) & ~1;
+                c->height = to_pixels(sd->y + sd->height, out_h) - c->y;
+                if (c->width == 0 || c->height == 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Empty area for input #%d!\n", i);
+                        return false;
+                }
+                covered += (long long) c->width * c->height;
+                c->out_codec = out_codec;
+                c->algo = s->interpolation == BILINEAR ? VIDEO_SCALE_LINEAR : VIDEO_SCALE_CUBIC;
+                c->threads = MAX(get_cpu_core_count() / s->devices_cnt, 1);
+                c->front = malloc((size_t) vc_get_linesize(c->width, out_codec) * c->height);
+                c->back = malloc((size_t) vc_get_linesize(c->width, out_codec) * c->height);
+                s->slaves[i].cell = c;
+        }
+        s->cells_cover_frame = covered >= (long long) out_w * out_h;
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Compositing on CPU with %s scaling.\n",
+                        video_scale_algo_to_string(s->cells[0].algo));
+        return true;
+}
+
+static void destroy_cpu_cells(struct vidcap_swmix_state *s)
+{
+        if (s->cells == NULL) {
+                return;
+        }
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                video_scale_done(s->cells[i].scaler);
+                free(s->cells[i].conv_buf);
+                free(s->cells[i].front);
+                free(s->cells[i].back);
+        }
+        free(s->cells);
+}
+
+static bool slave_has_frame(struct vidcap_swmix_state *s, int i)
+{
+        if (s->backend != BACKEND_CPU) {
+                return s->slaves_data[i].current_frame != NULL;
+        }
+        pthread_mutex_lock(&s->slaves[i].lock);
+        const bool ret = s->cells[i].valid;
+        pthread_mutex_unlock(&s->slaves[i].lock);
+        return ret;
+}
+
 static void *master_worker(void *arg)
 {
         struct vidcap_swmix_state *s = (struct vidcap_swmix_state *) arg;
         struct timeval t0;
-        GLuint from_uyvy, to_uyvy;
 
         gettimeofday(&t0, NULL);
 
-        gl_context_make_current(&s->gl_context);
-        glEnable(GL_TEXTURE_2D);
-        from_uyvy = glsl_compile_link(vprogram, fprogram_from_uyvy);
-        to_uyvy = glsl_compile_link(vprogram, fprogram_to_uyvy);
-        assert(from_uyvy != 0);
-        assert(to_uyvy != 0);
-
-        glUseProgram(to_uyvy);
-        glUniform1i(glGetUniformLocation(to_uyvy, "image"), 0);
-        glUniform1f(glGetUniformLocation(to_uyvy, "imageWidth"),
-                        (GLfloat) s->frame->tiles[0].width);
-        glUseProgram(0);
+#ifdef HAVE_SWMIX_GL
+        GLuint from_uyvy = 0, to_uyvy = 0;
+        if (s->backend == BACKEND_GL) {
+                gl_context_make_current(&s->gl_context);
+                glEnable(GL_TEXTURE_2D);
+                from_uyvy = glsl_compile_link(vprogram, fprogram_from_uyvy);
+                to_uyvy = glsl_compile_link(vprogram, fprogram_to_uyvy);
+                assert(from_uyvy != 0);
+                assert(to_uyvy != 0);
+
+                glUseProgram(to_uyvy);
+                glUniform1i(glGetUniformLocation(to_uyvy, "image"), 0);
+                glUniform1f(glGetUniformLocation(to_uyvy, "imageWidth"),
+                                (GLfloat) s->frame->tiles[0].width);
+                glUseProgram(0);
+        }
+#endif
 
         int field = 0;
         char *tmp_buffer = (char *) malloc(s->frame->tiles[0].data_len);
+        if (s->backend == BACKEND_CPU) {
+                fill_black(tmp_buffer, s->frame->tiles[0].width, s->frame->tiles[0].height, s->frame->color_spec);
+        }
 
         char *current_buffer = NULL;
 
@@ -642,104 +1000,39 @@ static void *master_worker(void *arg)
                         pthread_mutex_unlock(&s->lock);
                 }
 
-                // "capture" frames
-                for(int i = 0; i < s->devices_cnt; ++i) {
-                        pthread_mutex_lock(&s->slaves[i].lock);
-                        VIDEO_FRAME_DISPOSE(s->slaves[i].done_frame);
-                        s->slaves[i].done_frame = s->slaves_data[i].current_frame;
-                        s->slaves_data[i].current_frame = NULL;
-                        if(s->slaves[i].captured_frame) {
-                                s->slaves_data[i].current_frame =
-                                        s->slaves[i].captured_frame;
-                                s->slaves[i].captured_frame = NULL;
-                        } else if(s->slaves[i].done_frame) {
-                                s->slaves_data[i].current_frame =
-                                        s->slaves[i].done_frame;
-                                s->slaves[i].done_frame = NULL;
-                        }
-                        pthread_mutex_unlock(&s->slaves[i].lock);
-                }
-
-                // check for mode change
-                for(int i = 0; i < s->devices_cnt; ++i) {
-                        if(s->slaves_data[i].current_frame) {
-                                check_for_slave_format_change(&s->slaves_data[i]);
-                        }
+#ifdef HAVE_SWMIX_GL
+                if (s->backend == BACKEND_GL) {
+                        // "capture" frames
+                        gl_grab_slave_frames(s);
                 }
+#endif
 
                 char *audio_data = NULL;
                 int audio_len = 0;
 
-                // load data
                 for(int i = 0; i < s->devices_cnt; ++i) {
-                        if(s->slaves_data[i].current_frame) {
-                                if(s->slaves[i].audio_captured && s->audio_device_index == -1) {
-                                        fprintf(stderr, "[swmix] Locking device #%d as an audio source.\n",
-                                                        i);
-                                        s->audio_device_index = i;
-                                }
-
-                                if ((s->frame->interlacing != INTERLACED_MERGED || field == 1)
-							&& s->audio_device_index == i) {
-                                        s->audio.bps = s->slaves[i].audio_frame.bps;
-                                        s->audio.ch_count = s->slaves[i].audio_frame.ch_count;
-                                        s->audio.sample_rate = s->slaves[i].audio_frame.sample_rate;
-                                        if(s->slaves[i].audio_frame.data_len) {
-                                                audio_data = (char *) malloc(s->slaves[i].audio_frame.data_len);
-                                                audio_len = s->slaves[i].audio_frame.data_len;
-                                                memcpy(audio_data, s->slaves[i].audio_frame.data,
-                                                                audio_len);
-                                                s->slaves[i].audio_frame.data_len = 0;
-                                        }
-                                }
-
-                                load_texture(&s->slaves_data[i], from_uyvy);
-
+                        if (!slave_has_frame(s, i)) {
+                                continue;
                         }
-                }
-
-                // draw
-                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
-                                GL_TEXTURE_2D, s->tex_output, 0);
-                glClearColor(0, 0, 0, 1);
-                glClear(GL_COLOR_BUFFER_BIT);
-
-                glViewport(0, 0, s->frame->tiles[0].width, s->frame->tiles[0].height);
-
-                if(s->interpolation == BICUBIC) {
-                        glUseProgram(s->bicubic_program);
-                        glUniform1i(glGetUniformLocation(s->bicubic_program, "image"), 0);
-                }
-
-                for(int i = 0; i < s->devices_cnt; ++i) {
-                        if(s->slaves_data[i].current_frame) {
-                                render_slave(&s->slaves_data[i], s->interpolation, s->bicubic_program);
+                        if(s->slaves[i].audio_captured && s->audio_device_index == -1) {
+                                fprintf(stderr, "[swmix] Locking device #%d as an audio source.\n",
+                                                i);
+                                s->audio_device_index = i;
                         }
-                }
-                glUseProgram(0);
 
-                // read back
-                glBindTexture(GL_TEXTURE_2D, s->tex_output);
-                int width = s->frame->tiles[0].width;
-                GLenum format = GL_RGBA;
-                if(s->frame->color_spec == UYVY) {
-                        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo_uyvy);
-                        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
-                                        GL_TEXTURE_2D, s->tex_output_uyvy, 0);
-                        glViewport(0, 0, s->frame->tiles[0].width / 2, s->frame->tiles[0].height);
-                        glUseProgram(to_uyvy);
-                        glBegin(GL_QUADS);
-                        glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
-                        glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
-                        glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
-                        glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
-                        glEnd();
-                        glUseProgram(0);
-                        width /= 2;
-                        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
-                } else if (s->frame->color_spec == RGB) {
-                        format = GL_RGB;
+                        if ((s->frame->interlacing != INTERLACED_MERGED || field == 1)
+                                        && s->audio_device_index == i) {
+                                s->audio.bps = s->slaves[i].audio_frame.bps;
+                                s->audio.ch_count = s->slaves[i].audio_frame.ch_count;
+                                s->audio.sample_rate = s->slaves[i].audio_frame.sample_rate;
+                                if(s->slaves[i].audio_frame.data_len) {
+                                        audio_data = (char *) malloc(s->slaves[i].audio_frame.data_len);
+                                        audio_len = s->slaves[i].audio_frame.data_len;
+                                        memcpy(audio_data, s->slaves[i].audio_frame.data,
+                                                        audio_len);
+                                        s->slaves[i].audio_frame.data_len = 0;
+                                }
+                        }
                 }
 
                 char *read_buf;
@@ -748,12 +1041,14 @@ static void *master_worker(void *arg)
                 } else {
                         read_buf = tmp_buffer;
                 }
-                glReadPixels(0, 0, width,
-                                s->frame->tiles[0].height,
-                                format, GL_UNSIGNED_BYTE,
-                                read_buf);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glBindTexture(GL_TEXTURE_2D, 0);
+#ifdef HAVE_SWMIX_GL
+                if (s->backend == BACKEND_GL) {
+                        gl_composite(s, from_uyvy, to_uyvy, read_buf);
+                } else
+#endif
+                {
+                        cpu_composite(s, read_buf);
+                }
 
                 if(s->frame->interlacing == INTERLACED_MERGED) {
                         int linesize =
@@ -769,10 +1064,12 @@ static void *master_worker(void *arg)
                         // wait until next frame time is due
                         double sec;
                         struct timeval t;
-                        do {
-                                gettimeofday(&t, NULL);
-                                sec = tv_diff(t, t0);
-                        } while(sec < 1.0 / s->frame->fps);
+                        while (gettimeofday(&t, NULL), (sec = tv_diff(t, t0)) < 1.0 / s->frame->fps) {
+                                const double remaining = 1.0 / s->frame->fps - sec;
+                                if (remaining > 0.002) { // sleep when far, spin for precision
+                                        usleep((remaining - 0.001) * 1000000);
+                                }
+                        }
                         t0 = t;
 
                         pthread_mutex_lock(&s->lock);
@@ -792,14 +1089,19 @@ static void *master_worker(void *arg)
 
         free(tmp_buffer);
 
-        glDeleteProgram(from_uyvy);
-        glDeleteProgram(to_uyvy);
-        glDisable(GL_TEXTURE_2D);
-        gl_context_make_current(NULL);
+#ifdef HAVE_SWMIX_GL
+        if (s->backend == BACKEND_GL) {
+                glDeleteProgram(from_uyvy);
+                glDeleteProgram(to_uyvy);
+                glDisable(GL_TEXTURE_2D);
+                gl_context_make_current(NULL);
+        }
+#endif
 
         return NULL;
 }
 
+
 static void *slave_worker(void *arg)
 {
         struct state_slave *s = (struct state_slave *) arg;
@@ -821,6 +1123,13 @@ static void *slave_worker(void *arg)
                 struct audio_frame *audio;
 
                 frame = vidcap_grab(device, &audio);
+                const bool got_frame = frame != NULL;
+                if (frame && s->cell && frame->interlacing != INTERLACED_MERGED) {
+                        // render directly, no need to keep the frame
+                        cpu_cell_render(s, frame);
+                        VIDEO_FRAME_DISPOSE(frame);
+                        frame = NULL;
+                }
                 if (frame) {
                         struct video_frame *frame_local;
                         if (frame->callbacks.dispose) {
@@ -835,24 +1144,31 @@ static void *slave_worker(void *arg)
                                                 vc_get_linesize(frame_local->tiles[0].width, frame_local->color_spec),
                                                 frame_local->tiles[0].height);
                         }
+                        if (s->cell) {
+                                cpu_cell_render(s, frame_local);
+                                VIDEO_FRAME_DISPOSE(frame_local);
+                        } else {
+                                pthread_mutex_lock(&s->lock);
+                                // video frame was not processed, simply replace it
+                                VIDEO_FRAME_DISPOSE(s->captured_frame);
+                                s->captured_frame = frame_local;
+                                pthread_mutex_unlock(&s->lock);
+                        }
+                }
+                if (got_frame && audio) {
                         pthread_mutex_lock(&s->lock);
-                        // video frame was not processed, simply replace it
-                        VIDEO_FRAME_DISPOSE(s->captured_frame);
-                        s->captured_frame = frame_local;
-                        if(audio) {
-                                s->audio_captured = true;
-                                int len = audio->data_len;
-                                if(len + s->audio_frame.data_len > (int) s->audio_frame.max_size) {
-                                        len = s->audio_frame.max_size - s->audio_frame.data_len;
-                                        fprintf(stderr, "[SW Mix] Audio buffer overflow!\n");
-                                }
-                                memcpy(s->audio_frame.data + s->audio_frame.data_len, audio->data,
-                                                len);
-                                s->audio_frame.data_len += len;
-                                s->audio_frame.ch_count = audio->ch_count;
-                                s->audio_frame.bps = audio->bps;
-                                s->audio_frame.sample_rate = audio->sample_rate;
+                        s->audio_captured = true;
+                        int len = audio->data_len;
+                        if(len + s->audio_frame.data_len > (int) s->audio_frame.max_size) {
+                                len = s->audio_frame.max_size - s->audio_frame.data_len;
+                                fprintf(stderr, "[SW Mix] Audio buffer overflow!\n");
                         }
+                        memcpy(s->audio_frame.data + s->audio_frame.data_len, audio->data,
+                                        len);
+                        s->audio_frame.data_len += len;
+                        s->audio_frame.ch_count = audio->ch_count;
+                        s->audio_frame.bps = audio->bps;
+                        s->audio_frame.sample_rate = audio->sample_rate;
                         pthread_mutex_unlock(&s->lock);
                 }
         }
@@ -913,7 +1229,8 @@ static bool get_device_config_from_file(FILE* config_file, char *slave_name,
 #define PARSE_FILE 2
 static int parse_config_string(const char *fmt, unsigned int *width,
                 unsigned int *height, double *fps,
-        codec_t *color_spec, interpolation_t *interpolation, char **bicubic_algo, enum interlacing_t *interl, int *grid_x, int *grid_y, char **filepath)
+        codec_t *color_spec, interpolation_t *interpolation, char **bicubic_algo, enum interlacing_t *interl, int *grid_x, int *grid_y,
+        enum swmix_backend *backend, char **filepath)
 {
         char *save_ptr = NULL;
         char *item;
@@ -981,6 +1298,16 @@ static int parse_config_string(const char *fmt, unsigned int *width,
                                                 log_msg(LOG_LEVEL_ERROR, "Error parsing layout!\n");
                                                 return PARSE_ERROR;
                                         }
+                                } else if (strncasecmp(item, "backend=", strlen("backend=")) == 0) {
+                                        const char *b = item + strlen("backend=");
+                                        if (strcasecmp(b, "gl") == 0) {
+                                                *backend = BACKEND_GL;
+                                        } else if (strcasecmp(b, "cpu") == 0) {
+                                                *backend = BACKEND_CPU;
+                                        } else {
+                                                log_msg(LOG_LEVEL_ERROR, "Unknown backend: %s\n", b);
+                                                return PARSE_ERROR;
+                                        }
                                 } else {
                                         log_msg(LOG_LEVEL_ERROR, "Unknown option: %s\n", item);
                                         return PARSE_ERROR;
@@ -1005,7 +1332,7 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
         int ret;
 
         ret = parse_config_string(fmt, &desc->width, &desc->height, &desc->fps, &desc->color_spec,
-                        interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y, &config_path);
+                        interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y, &s->backend, &config_path);
         if(ret == PARSE_ERROR) {
                 show_help();
                 return false;
@@ -1032,7 +1359,7 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
                 }
                 for(int i = strlen(line); i > 0 && isspace(line[i - 1]); i--) line[i - 1] = '\0'; // trim trailing spaces
                 ret = parse_config_string(line, &desc->width, &desc->height, &desc->fps, &desc->color_spec,
-                                interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y, NULL);
+                                interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y, &s->backend, NULL);
                 if(ret != PARSE_OK) {
                         fprintf(stderr, "Malformed input file! First line should contain config "
                                         "string same as for cmdline use (between first ':' and '#' "
@@ -1085,8 +1412,6 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
 static int
 vidcap_swmix_init(struct vidcap_params *params, void **state)
 {
-        GLenum format;
-
 	printf("vidcap_swmix_init\n");
 
         if(!vidcap_params_get_fmt(params) ||
@@ -1133,19 +1458,26 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
 
         s->frame = vf_alloc_desc(desc);
 
-        if(!init_gl_context(&s->gl_context, GL_CONTEXT_LEGACY)) {
-                fprintf(stderr, "[swmix] Unable to initialize OpenGL context.\n");
-                goto error;
-        }
-
-        if (s->gl_context.gl_major < 2) {
-                fprintf(stderr, "[swmix] Unsufficient OpenGL version to run SWMix.\n");
-                goto error;
+#ifdef HAVE_SWMIX_GL
+        if (s->backend != BACKEND_CPU) {
+                if (!init_gl_context(&s->gl_context, GL_CONTEXT_LEGACY)) {
+                        if (s->backend == BACKEND_GL) {
+                                fprintf(stderr, "[swmix] Unable to initialize OpenGL context.\n");
+                                goto error;
+                        }
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unable to initialize OpenGL context, compositing on CPU.\n");
+                        s->backend = BACKEND_CPU;
+                } else if (s->gl_context.gl_major < 2) {
+                        fprintf(stderr, "[swmix] Unsufficient OpenGL version to run SWMix.\n");
+                        goto error;
+                } else {
+                        s->backend = BACKEND_GL;
+                }
         }
 
-        gl_context_make_current(&s->gl_context);
+        if (s->backend == BACKEND_GL) {
+                gl_context_make_current(&s->gl_context);
 
-        {
                 char *bicubic = strdup(bicubic_template);
                 char *algo_pos;
                 while((algo_pos = strstr(bicubic, "INTERP_ALGORITHM_PLACEHOLDER"))) {
@@ -1156,6 +1488,13 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
                 s->bicubic_program = glsl_compile_link(vprogram, bicubic);
                 free(bicubic);
         }
+#else
+        if (s->backend == BACKEND_GL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Compiled without OpenGL support!\n");
+                goto error;
+        }
+        s->backend = BACKEND_CPU;
+#endif
 
         s->slaves_data = init_slave_data(s, config_file);
         if(!s->slaves_data) {
@@ -1164,39 +1503,51 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
 
         if (config_file) {
                 fclose(config_file);
+                config_file = NULL;
         }
 
-        format = GL_RGBA;
-        if(desc.color_spec == RGB) {
-                format = GL_RGB;
+#ifdef HAVE_SWMIX_GL
+        if (s->backend == BACKEND_GL) {
+                GLenum format = GL_RGBA;
+                if(desc.color_spec == RGB) {
+                        format = GL_RGB;
+                }
+                glGenTextures(1, &s->tex_output);
+                glBindTexture(GL_TEXTURE_2D, s->tex_output);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexImage2D(GL_TEXTURE_2D, 0, format, desc.width, desc.height,
+                                0, format, GL_UNSIGNED_BYTE, NULL);
+
+                glGenTextures(1, &s->tex_output_uyvy);
+                glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height,
+                                0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+                glGenFramebuffers(1, &s->fbo);
+                glGenFramebuffers(1, &s->fbo_uyvy);
+
+                gl_context_make_current(NULL);
+        }
+#endif
+
+        if (s->backend == BACKEND_CPU && !init_cpu_cells(s)) {
+                goto error;
         }
-        glGenTextures(1, &s->tex_output);
-        glBindTexture(GL_TEXTURE_2D, s->tex_output);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, desc.width, desc.height,
-                        0, format, GL_UNSIGNED_BYTE, NULL);
-
-        glGenTextures(1, &s->tex_output_uyvy);
-        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height,
-                        0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-        glGenFramebuffers(1, &s->fbo);
-        glGenFramebuffers(1, &s->fbo_uyvy);
-
-        gl_context_make_current(NULL);
 
         s->frame->tiles[0].data_len = vc_get_linesize(s->frame->tiles[0].width,
                                 s->frame->color_spec) * s->frame->tiles[0].height;
         for(int i = 0; i < 3; ++i) {
                 char *buffer = (char *) malloc(s->frame->tiles[0].data_len);
+                if (s->backend == BACKEND_CPU) {
+                        fill_black(buffer, s->frame->tiles[0].width, s->frame->tiles[0].height, s->frame->color_spec);
+                }
                 simple_linked_list_append(s->free_buffer_queue, buffer);
         }
 
@@ -1272,25 +1623,32 @@ vidcap_swmix_done(void *state)
 
         vf_free(s->frame);
 
-        gl_context_make_current(&s->gl_context);
+#ifdef HAVE_SWMIX_GL
+        if (s->backend != BACKEND_CPU) {
+                gl_context_make_current(&s->gl_context);
 
-        destroy_slave_data(s->slaves_data, s->devices_cnt);
+                destroy_slave_data(s->slaves_data, s->devices_cnt, true);
+                s->slaves_data = NULL;
 
-        if (s->tex_output) {
-                glDeleteTextures(1, &s->tex_output);
-        }
-        if (s->tex_output_uyvy) {
-                glDeleteTextures(1, &s->tex_output_uyvy);
-        }
-        if (s->fbo) {
-                glDeleteFramebuffers(1, &s->fbo);
-        }
-        if (s->fbo_uyvy) {
-                glDeleteFramebuffers(1, &s->fbo_uyvy);
-        }
+                if (s->tex_output) {
+                        glDeleteTextures(1, &s->tex_output);
+                }
+                if (s->tex_output_uyvy) {
+                        glDeleteTextures(1, &s->tex_output_uyvy);
+                }
+                if (s->fbo) {
+                        glDeleteFramebuffers(1, &s->fbo);
+                }
+                if (s->fbo_uyvy) {
+                        glDeleteFramebuffers(1, &s->fbo_uyvy);
+                }
 
-        gl_context_make_current(NULL);
-        destroy_gl_context(&s->gl_context);
+                gl_context_make_current(NULL);
+                destroy_gl_context(&s->gl_context);
+        }
+#endif
+        destroy_slave_data(s->slaves_data, s->devices_cnt, false);
+        destroy_cpu_cells(s);
 
         pthread_mutex_destroy(&s->lock);
         pthread_cond_destroy(&s->frame_ready_cv);
@@ -129,6 +129,10 @@ struct testcard_state {
         bool grab_audio;
         bool still_image;
         char pattern[128];
+
+        int slices;               ///< >1 - frame is passed as horizontal stripes
+        int slice_idx;            ///< next slice to be returned
+        struct video_frame *slice;
 };
 
 static void
@@ -466,6 +470,8 @@ static void show_help(bool full) {
         color_printf(TBOLD("\t   p   ") "      - pan with frame\n");
         color_printf(TBOLD("\tpattern") "      - pattern to use, use \"" TBOLD("pattern=help") "\" for options\n");
         color_printf(TBOLD("\t   s   ") "      - split the frames into XxY separate tiles (currently defunct)\n");
+        color_printf(TBOLD("\t slices") "      - pass every frame as <n> horizontal stripes as soon as they are\n"
+                               "\t               \"captured\" (low-latency, uncompressed only)\n");
         color_printf(TBOLD("\t still ") "      - send still image\n");
         if (full) {
                 color_printf(TBOLD("       afrequency") "    - embedded audio frequency\n");
@@ -587,6 +593,8 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                 } else if (IS_KEY_PREFIX(tmp, "frames")) {
                         s->capture_frames =
                             strtoll(strchr(tmp, '=') + 1, NULL, 0);
+                } else if (IS_KEY_PREFIX(tmp, "slices")) {
+                        s->slices = atoi(strchr(tmp, '=') + 1);
                 } else {
                         fprintf(stderr, "[testcard] Unknown option: %s\n", tmp);
                         goto error;
@@ -614,6 +622,17 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
         s->frame = vf_alloc_desc(desc);
         s->frame->flags |= TIMESTAMP_VALID;
 
+        if (s->slices > 1) {
+                if (codec_is_planar(desc.color_spec) || s->slices > (int) desc.height) {
+                        MSG(ERROR, "Slices are not supported for %s or %d lines!\n",
+                            get_codec_name(desc.color_spec), desc.height);
+                        goto error;
+                }
+                s->slice = vf_alloc_desc(desc);
+                s->slice->fragment = 1;
+                s->slice->flags |= TIMESTAMP_VALID;
+        }
+
         s->generator = video_pattern_generator_create(s->pattern, s->frame->tiles[0].width, s->frame->tiles[0].height, s->frame->color_spec,
                         s->still_image ? 0 : vc_get_linesize(desc.width, desc.color_spec) + s->pan);
         if (!s->generator) {
@@ -658,6 +677,7 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
 error:
         free(fmt);
         vf_free(s->frame);
+        vf_free(s->slice);
         free(in_file_contents);
         free(s);
         return ret;
@@ -674,6 +694,7 @@ static void vidcap_testcard_done(void *state)
                 vf_free(s->tiled);
         }
         vf_free(s->frame);
+        vf_free(s->slice);
         video_pattern_generator_destroy(s->generator);
         free(s->audio_data);
         free(s);
@@ -703,10 +724,43 @@ static audio_frame *vidcap_testcard_get_audio(struct testcard_state *s)
         return &s->audio;
 }
 
+/**
+ * Returns next stripe of the current frame, stripe n is returned
+ * n/slices of frame time after the frame start (as if it were scanned out).
+ */
+static struct video_frame *vidcap_testcard_next_slice(struct testcard_state *s)
+{
+        const time_ns_t release = s->last_frame_time + (time_ns_t) (NS_IN_SEC_DBL / s->frame->fps *
+                                                                    s->slice_idx / s->slices);
+        while (get_time_in_ns() < release) {
+                // busy wait as for whole frames
+        }
+        const size_t linesize = vc_get_linesize(s->frame->tiles[0].width, s->frame->color_spec);
+        const unsigned rows = (s->frame->tiles[0].height + s->slices - 1) / s->slices;
+        const unsigned first_row = s->slice_idx * rows;
+        struct tile *tile = &s->slice->tiles[0];
+        tile->offset = first_row * linesize;
+        tile->data = s->frame->tiles[0].data + tile->offset;
+        tile->data_len = MIN(rows, s->frame->tiles[0].height - first_row) * linesize;
+        s->slice->timestamp = s->frame->timestamp;
+        s->slice->frame_fragment_id = s->video_frames & 0x3FFF;
+        s->slice_idx += 1;
+        s->slice->last_fragment = s->slice_idx == s->slices || first_row + rows >= s->frame->tiles[0].height;
+        if (s->slice->last_fragment) {
+                s->slice_idx = 0;
+                s->video_frames += 1;
+        }
+        return s->slice;
+}
+
 static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **audio)
 {
         struct testcard_state *state = arg;
 
+        if (state->slice_idx > 0) {
+                *audio = NULL;
+                return vidcap_testcard_next_slice(state);
+        }
         if (state->video_frames + 1 == state->capture_frames) {
                 return NULL;
         }
@@ -745,6 +799,12 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
                 return state->tiled;
         }
 
+        if (state->slice != NULL) {
+                return vidcap_testcard_next_slice(state);
+        }
+        if (state->still_image && state->video_frames > 0) {
+                state->frame->flags |= FRAME_UNCHANGED;
+        }
         state->video_frames += 1;
         return state->frame;
 }
@@ -47,9 +47,12 @@
 #include <thread>
 #include <vector>
 
+#include "host.h"
 #include "messaging.h"
 #include "module.h"
 #include "tv.h"
+#include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
@@ -102,6 +105,9 @@ struct compress_state {
         struct compress_state_real *ptr; ///< pointer to real compress state
         synchronized_queue<shared_ptr<video_frame>, 1> queue;
         bool poisoned = false;
+
+        long long skip_unchanged_refresh_ns = -1; ///< -1 - unchanged frames are not skipped
+        time_ns_t last_passed = 0; ///< last frame passed to compression
 };
 
 static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy,
@@ -190,9 +196,15 @@ static void compress_process_message(struct compress_state *proxy, struct msg_ch
  * @retval    <0            if error occured
  * @retval    >0            finished successfully, no state created (eg. displayed help)
  */
+ADD_TO_PARAM("skip-unchanged", "* skip-unchanged[=<ms>]\n"
+                "  Do not compress and send frames marked unchanged by the capture (screen, testcard:still,\n"
+                "  file:loop of a picture, capture filter unchanged); the picture is resent at least every <ms> (default 1000)\n");
 int compress_init(struct module *parent, const char *config_string, struct compress_state **state) {
         struct compress_state *proxy;
         proxy = new struct compress_state();
+        if (const char *refresh = get_commandline_param("skip-unchanged")) {
+                proxy->skip_unchanged_refresh_ns = (strlen(refresh) > 0 ? atoll(refresh) : 1000) * MS_IN_NS;
+        }
 
         module_init_default(&proxy->mod);
         proxy->mod.cls = MODULE_CLASS_COMPRESS;
@@ -330,8 +342,19 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
         if (!frame) {
                 proxy->poisoned = true;
         }
+        if (frame && frame->fragment && strcmp(s->funcs->name, "none") != 0) {
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('C', 'F', 'R', 'G'),
+                             MOD_NAME "Slices can be passed only uncompressed, dropping!\n");
+                return;
+        }
         if (frame) {
                 frame->compress_start = get_time_in_ns();
+                if ((frame->flags & FRAME_UNCHANGED) != 0 && proxy->skip_unchanged_refresh_ns >= 0 &&
+                                frame->compress_start - proxy->last_passed < proxy->skip_unchanged_refresh_ns) {
+                        // receiver still shows the same picture, don't waste CPU and bandwidth
+                        return;
+                }
+                proxy->last_passed = frame->compress_start;
         }
 
         if (s->funcs->compress_frame_async_push_func) {
@@ -593,6 +616,10 @@ shared_ptr<video_frame> compress_pop(struct compress_state *proxy)
                 MSG(DEBUG, "Compressed frame size: %8u; duration: %7.3f ms\n",
                     vf_get_data_len(f.get()),
                     (f->compress_end - f->compress_start) / MS_IN_NS_DBL);
+                if (f->compress_start != 0) {
+                        metric_observe_ns(METRIC_VIDEO_COMPRESS_TIME,
+                                          f->compress_end - f->compress_start);
+                }
         }
         return f;
 }
@@ -538,6 +538,8 @@ bool display_ctl_property(struct display *d, int property, void *val, size_t *le
                                 return false;
                         }
 			break;
+                case DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES:
+                        return false; // postprocessor input is always its own frame
                 default:
                         return d->funcs->ctl_property(d->state, property, val, len);
                 }
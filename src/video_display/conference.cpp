@@ -48,11 +48,16 @@
 #include "module.h"
 #include "utils/misc.h"
 #include "utils/string_view_utils.hpp"
+#include "utils/video_scale.h"
+#include "utils/worker.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <cmath>
 #include <condition_variable>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <list>
 #include <map>
 #include <memory>
@@ -60,21 +65,7 @@
 #include <queue>
 #include <thread>
 #include <string_view>
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wcast-align"
-#pragma GCC diagnostic ignored "-Wcast-qual"
-#ifdef HAVE_OPENCV2_OPENCV_HPP
-#include <opencv2/opencv.hpp>
-#else
-#include <opencv2/core/mat.hpp>
-#include <opencv2/imgproc.hpp>
-#endif
-#pragma GCC diagnostic pop
-
-#ifdef __SSSE3__
-#include "tmmintrin.h"
-#endif
+#include <vector>
 
 #include "utils/profile_timer.hpp"
 
@@ -86,8 +77,10 @@ using clock = std::chrono::steady_clock;
 struct frame_deleter{ void operator()(video_frame *f){ vf_free(f); } };
 using unique_frame = std::unique_ptr<video_frame, frame_deleter>;
 
+struct scale_deleter{ void operator()(struct video_scale *s){ video_scale_done(s); } };
+using unique_scale = std::unique_ptr<struct video_scale, scale_deleter>;
+
 struct Participant{
-        void to_cv_frame();
         void frame_recieved(unique_frame &&f);
         void set_pos_keep_aspect(int x, int y, int w, int h);
 
@@ -101,13 +94,17 @@ struct Participant{
         unsigned width = 0;
         unsigned height = 0;
 
-        cv::Mat luma;
-        cv::Mat chroma;
+        unique_scale scaler; ///< created for current layout and source size
+        bool changed = false; ///< frame not yet drawn to the mixed image
 };
 
 void Participant::frame_recieved(unique_frame &&f){
+        assert(f->color_spec == UYVY);
+        assert(f->tile_count == 1);
+
         frame = std::move(f);
         last_time_recieved = clock::now();
+        changed = true;
 
         src_w = frame->tiles[0].width;
         src_h = frame->tiles[0].height;
@@ -127,63 +124,10 @@ void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
                 y += (h - height) / 2;
         }
 
-        this->x = x;
+        // UYVY pixel pairs
+        this->x = x & ~1;
         this->y = y;
-}
-
-void Participant::to_cv_frame(){
-        if(!frame)
-                return;
-
-        assert(frame->color_spec == UYVY);
-        assert(frame->tile_count == 1);
-
-        PROFILE_FUNC;
-
-        auto& frame_tile = frame->tiles[0];
-        luma.create(cv::Size(frame_tile.width, frame_tile.height), CV_8UC1);
-        chroma.create(cv::Size(frame_tile.width / 2, frame_tile.height), CV_8UC2);
-
-        assert(luma.isContinuous() && chroma.isContinuous());
-        unsigned char *src = reinterpret_cast<unsigned char *>(frame_tile.data);
-        unsigned char *luma_dst = luma.ptr(0);
-        unsigned char *chroma_dst = chroma.ptr(0);
-
-        unsigned src_len = frame_tile.data_len;
-
-#ifdef __SSSE3__
-        __m128i uv_shuff = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 14, 12, 10, 8, 6, 4, 2, 0);
-        __m128i y_shuff = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 15, 13, 11, 9, 7, 5, 3, 1);
-        while(src_len >= 32){
-                __m128i uyvy = _mm_lddqu_si128((__m128i *)(void *) src);
-                src += 16;
-
-                __m128i y_low = _mm_shuffle_epi8(uyvy, y_shuff);
-                __m128i uv_low = _mm_shuffle_epi8(uyvy, uv_shuff);
-                
-                uyvy = _mm_lddqu_si128((__m128i *)(void *) src);
-                src += 16;
-
-                __m128i y_high = _mm_shuffle_epi8(uyvy, y_shuff);
-                __m128i uv_high = _mm_shuffle_epi8(uyvy, uv_shuff);
-
-                _mm_store_si128((__m128i *)(void *) luma_dst, _mm_or_si128(y_low, _mm_bslli_si128(y_high, 8)));
-                luma_dst += 16;
-                _mm_store_si128((__m128i *)(void *) chroma_dst, _mm_or_si128(uv_low, _mm_bslli_si128(uv_high, 8)));
-                chroma_dst += 16;
-
-                src_len -= 32;
-        }
-#endif
-
-        while(src_len >= 4){
-                *chroma_dst++ = *src++;
-                *luma_dst++ = *src++;
-                *chroma_dst++ = *src++;
-                *luma_dst++ = *src++;
-
-                src_len -= 4;
-        }
+        width &= ~1;
 }
 
 class Video_mixer{
@@ -195,10 +139,10 @@ public:
         void process_frame(unique_frame&& f);
         void get_mixed(video_frame *result);
 
-        void set_layout(Layout new_layout) { layout = new_layout; recompute_layout(); }
+        void set_layout(Layout new_layout) { layout = new_layout; layout_changed = true; }
         Layout get_layout() const { return layout; }
 
-        void set_primary_ssrc(uint32_t ssrc) { primary_ssrc = ssrc; recompute_layout(); }
+        void set_primary_ssrc(uint32_t ssrc) { primary_ssrc = ssrc; layout_changed = true; }
         uint32_t get_primary_ssrc() const { return primary_ssrc; }
 
         std::vector<uint32_t> get_participant_ssrc_list() const;
@@ -211,11 +155,11 @@ private:
         unsigned width;
         unsigned height;
         Layout layout = Layout::Tiled;
+        bool layout_changed = true;
 
         uint32_t primary_ssrc = 0;
 
-        cv::Mat mixed_luma;
-        cv::Mat mixed_chroma;
+        std::vector<char> mixed; ///< UYVY, participants are redrawn only when changed
 
         std::map<uint32_t, Participant> participants;
 };
@@ -223,10 +167,9 @@ private:
 Video_mixer::Video_mixer(int width, int height, Layout layout):
         width(width),
         height(height),
-        layout(layout)
+        layout(layout),
+        mixed(vc_get_linesize(width, UYVY) * height)
 {
-        mixed_luma.create(cv::Size(width, height), CV_8UC1);
-        mixed_chroma.create(cv::Size(width / 2, height), CV_8UC2);
 }
 
 void Video_mixer::tiled_layout(){
@@ -266,38 +209,64 @@ void Video_mixer::one_big_layout(){
 }
 
 void Video_mixer::recompute_layout(){
-        mixed_luma.setTo(16);
-        mixed_chroma.setTo(128);
+        PROFILE_FUNC;
+        layout_changed = false;
+
+        for(size_t i = 0; i < mixed.size(); i += 4){
+                mixed[i] = mixed[i + 2] = (char) 128;
+                mixed[i + 1] = mixed[i + 3] = 16;
+        }
 
         if(!primary_ssrc && !participants.empty()){
                 primary_ssrc = participants.begin()->first;
         }
 
+        for(auto& [ssrc, p] : participants){
+                (void) ssrc;
+                p.width = p.height = 0;
+        }
+
         if(participants.size() == 1){
                 participants.begin()->second.set_pos_keep_aspect(0, 0, width, height);
-                return;
+        } else {
+                switch(layout){
+                case Layout::Tiled:
+                        tiled_layout();
+                        break;
+                case Layout::One_big:
+                        one_big_layout();
+                        break;
+                case Layout::Invalid:
+                        assert("Invalid layout" && false);
+                        break;
+                }
         }
 
-        switch(layout){
-        case Layout::Tiled:
-                tiled_layout();
-                break;
-        case Layout::One_big:
-                one_big_layout();
-                break;
-        case Layout::Invalid:
-                assert("Invalid layout" && false);
-                break;
+        /* Participants are scaled concurrently, so each gets stripes according
+         * to its share of the output area to keep all cores busy. */
+        const double cores = get_cpu_core_count();
+        for(auto& [ssrc, p] : participants){
+                (void) ssrc;
+                p.changed = true;
+                p.scaler.reset();
+                if(p.width == 0 || p.height == 0){
+                        continue;
+                }
+                int threads = std::max<int>(1, cores * p.width * p.height / (width * height) + 0.5);
+                p.scaler.reset(video_scale_init(UYVY, p.src_w, p.src_h, p.width, p.height,
+                                        false, VIDEO_SCALE_ALGO_DEFAULT, threads));
         }
 }
 
 void Video_mixer::process_frame(unique_frame&& f){
         auto iter = participants.find(f->ssrc);
         auto& p = participants[f->ssrc];
+        const unsigned old_w = p.src_w;
+        const unsigned old_h = p.src_h;
         p.frame_recieved(std::move(f));
 
-        if(iter == participants.end()){
-                recompute_layout();
+        if(iter == participants.end() || p.src_w != old_w || p.src_h != old_h){
+                layout_changed = true;
         }
 }
 
@@ -306,7 +275,6 @@ void Video_mixer::get_mixed(video_frame *result){
 
         auto now = clock::now();
 
-        bool recompute = false;
         for(auto it = participants.begin(); it != participants.end();){
                 auto& p = it->second;
                 if(now - p.last_time_recieved > std::chrono::seconds(2)){
@@ -314,65 +282,41 @@ void Video_mixer::get_mixed(video_frame *result){
                                 primary_ssrc = 0;
 
                         it = participants.erase(it);
-                        recompute = true;
+                        layout_changed = true;
                         continue;
                 }
                 it++;
         }
-        if(recompute)
+        if(layout_changed)
                 recompute_layout();
 
+        struct draw_task{
+                Participant *p;
+                char *dst;
+                int pitch;
+        };
+        std::vector<draw_task> tasks;
+        const int pitch = vc_get_linesize(width, UYVY);
         for(auto&& [ssrc, p] : participants){
                 (void) ssrc;
-                p.to_cv_frame();
-
-                PROFILE_DETAIL("resize participant");
-                cv::Size l_size(p.width, p.height);
-                cv::Size c_size(p.width / 2, p.height);
-                cv::resize(p.luma, mixed_luma(cv::Rect(p.x, p.y, p.width, p.height)), l_size, 0, 0);
-                cv::resize(p.chroma, mixed_chroma(cv::Rect(p.x / 2, p.y, p.width / 2, p.height)), c_size, 0, 0);
-                PROFILE_DETAIL("");
+                if(!p.changed || !p.scaler)
+                        continue;
+                p.changed = false;
+                tasks.push_back({&p, mixed.data() + p.y * pitch + p.x * 2, pitch});
         }
 
-        unsigned char *dst = reinterpret_cast<unsigned char *>(result->tiles[0].data);
-        unsigned char *chroma_src = mixed_chroma.ptr(0);
-        unsigned char *luma_src = mixed_luma.ptr(0);
-        assert(mixed_luma.isContinuous() && mixed_chroma.isContinuous());
-        PROFILE_DETAIL("Convert to ug frame");
-        unsigned dst_len = result->tiles[0].data_len;
-
-#ifdef __SSSE3__
-        __m128i y_shuff = _mm_set_epi8(7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0, -1);
-        __m128i uv_shuff = _mm_set_epi8(-1, 7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0);
-        while(dst_len >= 32){
-               __m128i luma = _mm_load_si128((__m128i const*)(const void *) luma_src); 
-               luma_src += 16;
-               __m128i chroma = _mm_load_si128((__m128i const*)(const void *) chroma_src); 
-               chroma_src += 16;
-
-               __m128i res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               luma = _mm_bsrli_si128(luma, 8);
-               chroma = _mm_bsrli_si128(chroma, 8);
-
-               res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               dst_len -= 32;
+        PROFILE_DETAIL("resize participants");
+        if(!tasks.empty()){
+                auto draw = [](void *arg) -> void * {
+                        auto *t = static_cast<draw_task *>(arg);
+                        video_scale_pitch(t->p->scaler.get(), t->p->frame->tiles[0].data, t->dst, t->pitch);
+                        return nullptr;
+                };
+                task_run_parallel(draw, tasks.size(), tasks.data(), sizeof tasks[0], nullptr);
         }
-#endif
 
-        while(dst_len >= 4){
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
-
-                dst_len -= 4;
-        }
+        PROFILE_DETAIL("copy mixed frame to output");
+        memcpy(result->tiles[0].data, mixed.data(), std::min<size_t>(result->tiles[0].data_len, mixed.size()));
 }
 
 std::vector<uint32_t> Video_mixer::get_participant_ssrc_list() const{
@@ -213,10 +213,13 @@ static void dump_buf(unsigned char *buf, size_t len, int block_size) {
 
 static bool display_dummy_putf(void *state, struct video_frame *frame, long long flags)
 {
+        struct dummy_display_state *s = state;
         if (flags == PUTF_DISCARD || frame == NULL) {
+                if (frame != s->f) {
+                        vf_free(frame);
+                }
                 return true;
         }
-        struct dummy_display_state *s = state;
         if (s->dump_bytes > 0) {
                 dump_buf((unsigned char *)(frame->tiles[0].data), MIN(frame->tiles[0].data_len, s->dump_bytes), get_pf_block_bytes(frame->color_spec));
         }
@@ -234,6 +237,9 @@ static bool display_dummy_putf(void *state, struct video_frame *frame, long long
                         }
                 }
         }
+        if (frame != s->f) { // external frame (DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES)
+                vf_free(frame);
+        }
 
         return true;
 }
@@ -260,6 +266,13 @@ static bool display_dummy_get_property(void *state, int property, void *val, siz
                         *len = sizeof s->rgb_shift;
                         memcpy(val, s->rgb_shift, *len);
                         break;
+                case DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES:
+                        if (sizeof(bool) > *len) {
+                                return false;
+                        }
+                        *len = sizeof(bool);
+                        *(bool *) val = true;
+                        break;
                 default:
                         return false;
         }
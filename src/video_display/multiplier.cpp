@@ -45,6 +45,8 @@
 #include "video.h"
 #include "video_display.h"
 #include "utils/string_view_utils.hpp"
+#include "utils/thread.h"
+#include "utils/video_frame_pool.h"
 
 #include <condition_variable>
 #include <vector>
@@ -55,28 +57,40 @@
 
 using namespace std;
 
-static constexpr unsigned int IN_QUEUE_MAX_BUFFER_LEN = 5;
+static constexpr unsigned int DEFAULT_SLAVE_QUEUE_LEN = 5;
 static constexpr const char *MOD_NAME = "[multiplier] ";
 static constexpr int SKIP_FIRST_N_FRAMES_IN_STREAM = 5;
 
 namespace{
 struct disp_deleter{ void operator()(display *d){ display_done(d); } };
 using unique_disp = std::unique_ptr<struct display, disp_deleter>;
+
+/**
+ * Each slave display is fed by its own thread from its own bounded queue
+ * so that a slow display (eg. a recorder) doesn't stall the others. All
+ * queues share a single reference-counted frame; displays that accept
+ * external frames get it directly, others get a copy made by their feeder.
+ */
+struct slave {
+        explicit slave(unique_disp d) : disp(std::move(d)) {}
+        unique_disp disp;
+        queue<shared_ptr<video_frame>> frames; ///< nullptr is the poison pill
+        mutex lock;
+        condition_variable cv;
+        thread feeder;
+        unsigned long long dropped = 0;
+};
 }
 
 struct state_multiplier {
-        std::vector<unique_disp> displays;
+        video_frame_pool pool; ///< declared first - must outlive slaves holding its frames
+        std::vector<std::unique_ptr<slave>> slaves;
 
         struct video_desc desc;
-
-        queue<struct video_frame *> incoming_queue;
-        condition_variable in_queue_decremented_cv;
-
-        mutex lock;
-        condition_variable cv;
+        unsigned int queue_len = DEFAULT_SLAVE_QUEUE_LEN;
+        int skipped = 0;
 
         struct module *parent;
-        thread worker_thread;
 };
 
 static void show_help(){
@@ -85,6 +99,8 @@ static void show_help(){
         printf("\t-d multiplier:<display1>[:<display_config1>][#<display2>[:<display_config2>]]...\n");
 }
 
+ADD_TO_PARAM("multiplier-queue-len", "* multiplier-queue-len=<n>\n"
+                "  Number of frames buffered for each multiplier slave display, oldest frame is dropped when full (default 5)\n");
 static void *display_multiplier_init(struct module *parent, const char *fmt, unsigned int flags)
 {
         auto s = std::make_unique<state_multiplier>();
@@ -102,6 +118,13 @@ static void *display_multiplier_init(struct module *parent, const char *fmt, uns
         }
 
         s->parent = parent;
+        if (const char *queue_len = get_commandline_param("multiplier-queue-len")) {
+                s->queue_len = atoi(queue_len);
+                if (s->queue_len == 0) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong queue length: " << queue_len << "\n";
+                        return nullptr;
+                }
+        }
 
         for(auto tok = tokenize(fmt_sv, '#'); !tok.empty(); tok = tokenize(fmt_sv, '#')){
                 LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Initializing display " << tok << "\n";
@@ -114,75 +137,89 @@ static void *display_multiplier_init(struct module *parent, const char *fmt, uns
                         return nullptr;
                 }
                 unique_disp disp(d_ptr);
-                if (display_needs_mainloop(disp.get()) && !s->displays.empty()) {
+                if (display_needs_mainloop(disp.get()) && !s->slaves.empty()) {
                         LOG(LOG_LEVEL_ERROR) << "[multiplier] Display " << display << " needs mainloop and should be given first!\n";
                 }
 
-                s->displays.push_back(std::move(disp));
+                s->slaves.push_back(std::make_unique<slave>(std::move(disp)));
         }
 
         return s.release();
 }
 
-static void check_reconf(struct state_multiplier *s, struct video_desc *current_desc,
-             struct video_desc desc)
+/// @returns whether the display accepts the shared frame without copying
+static bool check_reconf(struct display *disp, struct video_desc *current_desc,
+             struct video_desc desc, bool accepts_external)
 {
         if (video_desc_eq(desc, *current_desc)) {
-                return;
+                return accepts_external;
         }
         *current_desc = desc;
-        fprintf(stderr, "RECONFIGURED\n");
-        for (auto &disp : s->displays) {
-                display_reconfigure(disp.get(), desc, VIDEO_NORMAL);
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Reconfiguring display to " << desc << "\n";
+        display_reconfigure(disp, desc, VIDEO_NORMAL);
+        bool ret = false;
+        size_t len = sizeof ret;
+        if (!display_ctl_property(disp, DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES, &ret, &len)) {
+                ret = false;
         }
+        return ret;
 }
 
-static void display_multiplier_worker(void *state)
+/// @returns frame header referencing data of shared frame, vf_free() drops the reference
+static struct video_frame *get_shared_frame(shared_ptr<video_frame> const &frame)
 {
-        auto *s = (struct state_multiplier *)state;
-        int skipped = 0;
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(frame.get()));
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                out->tiles[i].data = frame->tiles[i].data;
+                out->tiles[i].data_len = frame->tiles[i].data_len;
+        }
+        out->timestamp = frame->timestamp;
+        out->callbacks.dispose_udata = new shared_ptr<video_frame>(frame);
+        out->callbacks.data_deleter = [](video_frame *f) { delete static_cast<shared_ptr<video_frame> *>(f->callbacks.dispose_udata); };
+        return out;
+}
+
+static void display_multiplier_feeder(struct slave *sl)
+{
+        set_thread_name("multiplier_feed");
         struct video_desc display_desc{};
+        bool accepts_external = false;
 
         while (1) {
-                struct video_frame *frame;
+                shared_ptr<video_frame> frame;
                 {
-                        unique_lock<mutex> lg(s->lock);
-                        s->cv.wait(lg, [s]{return s->incoming_queue.size() > 0;});
-                        frame = s->incoming_queue.front();
-                        s->incoming_queue.pop();
-                        s->in_queue_decremented_cv.notify_one();
+                        unique_lock<mutex> lg(sl->lock);
+                        sl->cv.wait(lg, [sl]{return sl->frames.size() > 0;});
+                        frame = std::move(sl->frames.front());
+                        sl->frames.pop();
                 }
 
                 if (!frame) {
-                        for (auto& disp : s->displays) {
-                                display_put_frame(disp.get(), NULL, PUTF_BLOCKING);
-                        }
+                        display_put_frame(sl->disp.get(), NULL, PUTF_BLOCKING);
                         break;
                 }
 
-                if (skipped < SKIP_FIRST_N_FRAMES_IN_STREAM){
-                        skipped++;
-                        vf_free(frame);
-                        continue;
-                }
-
-                check_reconf(s, &display_desc, video_desc_from_frame(frame));
+                accepts_external = check_reconf(sl->disp.get(), &display_desc, video_desc_from_frame(frame.get()), accepts_external);
 
-                for (auto& disp : s->displays) {
-                        struct video_frame *real_display_frame = display_get_frame(disp.get());
-                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                        display_put_frame(disp.get(), real_display_frame, PUTF_BLOCKING);
+                struct video_frame *real_display_frame = nullptr;
+                if (accepts_external) {
+                        real_display_frame = get_shared_frame(frame);
+                } else {
+                        real_display_frame = display_get_frame(sl->disp.get());
+                        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                                memcpy(real_display_frame->tiles[i].data, frame->tiles[i].data, frame->tiles[i].data_len);
+                        }
                 }
-
-                vf_free(frame);
+                frame.reset(); // don't hold the frame longer than needed
+                display_put_frame(sl->disp.get(), real_display_frame, PUTF_BLOCKING);
         }
 }
 
 /**
  * Multiplier main loop
  *
- * Runs threads for all slave displays except the first one and an additional
- * one for this display. For the first display given on command-line it then
+ * Runs threads for all slave displays except the first one and a feeder
+ * thread for each slave. For the first display given on command-line it then
  * switches to its run-loop. This allows a flawless run on macOS where a GUI
  * worker (GL/SDL) needs to be run in the main thread to work properly.
  */
@@ -190,19 +227,23 @@ static void display_multiplier_run(void *state)
 {
         auto *s = (state_multiplier *) state; 
 
-        assert(!s->displays.empty());
+        assert(!s->slaves.empty());
 
-        for (size_t i = 1; i < s->displays.size(); i++) {
-                display_run_new_thread(s->displays[i].get());
+        for (size_t i = 1; i < s->slaves.size(); i++) {
+                display_run_new_thread(s->slaves[i]->disp.get());
         }
 
-        s->worker_thread = thread(display_multiplier_worker, state);
+        for (auto &sl : s->slaves) {
+                sl->feeder = thread(display_multiplier_feeder, sl.get());
+        }
 
-        display_run_mainloop(s->displays[0].get());
+        display_run_mainloop(s->slaves[0]->disp.get());
 
-        s->worker_thread.join();
-        for (size_t i = 1; i < s->displays.size(); i++) {
-                display_join(s->displays[i].get());
+        for (auto &sl : s->slaves) {
+                sl->feeder.join();
+        }
+        for (size_t i = 1; i < s->slaves.size(); i++) {
+                display_join(s->slaves[i]->disp.get());
         }
 }
 
@@ -216,7 +257,7 @@ static struct video_frame *display_multiplier_getf(void *state)
 {
         auto *s = (state_multiplier *) state;
 
-        return vf_alloc_desc_data(s->desc);
+        return s->pool.get_pod_frame();
 }
 
 static bool display_multiplier_putf(void *state, struct video_frame *frame, long long flags)
@@ -225,19 +266,28 @@ static bool display_multiplier_putf(void *state, struct video_frame *frame, long
 
         if (flags == PUTF_DISCARD) {
                 vf_free(frame);
-        } else {
-                unique_lock<mutex> lg(s->lock);
-                if (s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
-                        fprintf(stderr, "Multiplier: queue full!\n");
-                }
-                if (flags != PUTF_BLOCKING && s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
-                        vf_free(frame);
-                        return false;
+                return true;
+        }
+
+        if (frame != nullptr && s->skipped < SKIP_FIRST_N_FRAMES_IN_STREAM) {
+                s->skipped++;
+                vf_free(frame);
+                return true;
+        }
+
+        shared_ptr<video_frame> shared(frame, vf_free);
+        for (size_t i = 0; i < s->slaves.size(); ++i) {
+                auto &sl = s->slaves[i];
+                unique_lock<mutex> lg(sl->lock);
+                if (frame != nullptr && sl->frames.size() >= s->queue_len) {
+                        sl->frames.pop();
+                        sl->dropped += 1;
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Display " << i << " queue full, dropped "
+                                << sl->dropped << " frames in total.\n";
                 }
-                s->in_queue_decremented_cv.wait(lg, [s]{return s->incoming_queue.size() < IN_QUEUE_MAX_BUFFER_LEN;});
-                s->incoming_queue.push(frame);
+                sl->frames.push(shared);
                 lg.unlock();
-                s->cv.notify_one();
+                sl->cv.notify_one();
         }
 
         return true;
@@ -247,8 +297,17 @@ static bool display_multiplier_get_property(void *state, int property, void *val
 {
         auto *s = (state_multiplier *) state;
 
+        if (property == DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES) {
+                if (*len < sizeof(bool)) {
+                        return false;
+                }
+                *(bool *) val = true; // putf takes any frame freeable by vf_free()
+                *len = sizeof(bool);
+                return true;
+        }
+
         //TODO Find common properties, for now just return properties of the first display
-        return display_ctl_property(s->displays[0].get(), property, val, len);
+        return display_ctl_property(s->slaves[0]->disp.get(), property, val, len);
 }
 
 static bool display_multiplier_reconfigure(void *state, struct video_desc desc)
@@ -256,10 +315,8 @@ static bool display_multiplier_reconfigure(void *state, struct video_desc desc)
         auto *s = (state_multiplier *) state;
 
         s->desc = desc;
-
-        for (auto &disp : s->displays) {
-                display_reconfigure(disp.get(), desc, VIDEO_NORMAL);
-        }
+        s->pool.reconfigure(desc);
+        // slave displays are reconfigured by their feeders in order with the frames
 
         return true;
 }
@@ -268,7 +325,7 @@ static void display_multiplier_put_audio_frame(void *state, const struct audio_f
 {
         auto *s = static_cast<struct state_multiplier*>(state);
 
-        display_put_audio_frame(s->displays.at(0).get(), frame);
+        display_put_audio_frame(s->slaves.at(0)->disp.get(), frame);
 }
 
 static bool display_multiplier_reconfigure_audio(void *state, int quant_samples, int channels,
@@ -276,7 +333,7 @@ static bool display_multiplier_reconfigure_audio(void *state, int quant_samples,
 {
         auto *s = static_cast<struct state_multiplier *>(state);
 
-        return display_reconfigure_audio(s->displays.at(0).get(), quant_samples, channels, sample_rate);
+        return display_reconfigure_audio(s->slaves.at(0)->disp.get(), quant_samples, channels, sample_rate);
 }
 
 static void display_multiplier_probe(struct device_info **available_cards, int *count, void (**deleter)(void *)) {
@@ -189,10 +189,16 @@ void *video_rxtx::sender_loop() {
                         break;
                 }
 
-                export_video(m_exporter, tx_frame.get());
+                // slices (fragments) of a frame are accounted once, with the last one
+                const bool whole_frame = !tx_frame->fragment || tx_frame->last_fragment;
+                if (whole_frame) {
+                        export_video(m_exporter, tx_frame.get());
+                }
 
                 send_frame(std::move(tx_frame));
-                m_frames_sent += 1;
+                if (whole_frame) {
+                        m_frames_sent += 1;
+                }
         }
 
         check_sender_messages();
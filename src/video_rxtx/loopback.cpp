@@ -53,6 +53,9 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "tv.h"
+#include "utils/bench_report.h"
+#include "utils/metrics.h"
 #include "utils/thread.h"
 #include "video_display.h"
 #include "video_frame.h"
@@ -117,7 +120,11 @@ void *loopback_video_rxtx::receiver_loop()
                 }
                 auto display_f = display_get_frame(m_display_device);
                 memcpy(display_f->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+                if ((frame->flags & TIMESTAMP_VALID) != 0) {
+                        bench_frame_displayed(get_local_mediatime_offset() + frame->timestamp);
+                }
                 display_put_frame(m_display_device, display_f, PUTF_BLOCKING);
+                metric_add(METRIC_VIDEO_FRAMES_DISPLAYED, 1);
         }
         display_put_frame(m_display_device, nullptr, PUTF_BLOCKING);
         return nullptr;
@@ -35,7 +35,10 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cerrno>
 #include <cinttypes>
+#include <climits>
+#include <cstdlib>
 #include <map>
 #include <mutex>
 #include <sstream>
@@ -188,16 +191,53 @@ rtp_video_rxtx::process_sender_message(struct msg_sender *msg)
         return new_response(RESPONSE_OK, nullptr);
 }
 
+#define DEFAULT_NACK_BUFFER_PKTS 8192
+ADD_TO_PARAM("nack", "* nack[=<packets>]\n"
+                "  Enable RTCP generic NACK (RFC 4585) retransmissions of lost video packets. Both sender\n"
+                "  and receiver need to set it, sender keeps last <packets> sent (default "
+                TOSTRING(DEFAULT_NACK_BUFFER_PKTS) ").\n"
+                "  Playout delay should exceed RTT for retransmissions to arrive in time (see pbuf-adaptive).\n");
+/**
+ * @returns number of packets kept for retransmission, 0 if NACK is disabled
+ *          or -1 on invalid value
+ */
+static int get_nack_buf_pkts()
+{
+        const char *nack = get_commandline_param("nack");
+        if (nack == nullptr) {
+                return 0;
+        }
+        if (strlen(nack) == 0) {
+                return DEFAULT_NACK_BUFFER_PKTS;
+        }
+        char *endptr = nullptr;
+        errno = 0;
+        const long val = strtol(nack, &endptr, 10);
+        if (errno != 0 || *endptr != '\0' || val <= 0 || val > INT_MAX) {
+                MSG(ERROR, "Wrong NACK buffer size: %s\n", nack);
+                return -1;
+        }
+        return (int) val;
+}
+
 rtp_video_rxtx::rtp_video_rxtx(map<string, param_u> const &params) :
         video_rxtx(params), m_fec_state(NULL), m_start_time(params.at("start_time").ll), m_video_desc{}
 {
+        m_nack_buf_pkts = get_nack_buf_pkts();
+        if (m_nack_buf_pkts < 0) {
+                throw ug_runtime_error("Invalid nack parameter", EXIT_FAIL_USAGE);
+        }
         m_participants = pdb_init((volatile int *) params.at("video_delay").vptr);
+        if (m_nack_buf_pkts > 0) {
+                pdb_enable_nack(m_participants);
+        }
         m_requested_receiver = params.at("receiver").str;
         m_recv_port_number = params.at("rx_port").i;
         m_send_port_number = params.at("tx_port").i;
         m_force_ip_version = params.at("force_ip_version").i;
         m_requested_mcast_if = params.at("mcast_if").str;
         m_requested_ttl = params.find("ttl") != params.end() ? params.at("ttl").i : -1;
+        m_mtu = params.at("mtu").i;
 
         m_network_device = initialize_network(
             m_requested_receiver.c_str(), m_recv_port_number,
@@ -266,7 +306,7 @@ void rtp_video_rxtx::display_buf_increase_warning(int size)
 
 struct rtp *rtp_video_rxtx::initialize_network(const char *addr, int recv_port,
                 int send_port, struct pdb *participants, int force_ip_version,
-                const char *mcast_if, int ttl)
+                const char *mcast_if, int ttl, bool sending)
 {
         double rtcp_bw = 5 * 1024 * 1024;       /* FIXME */
 
@@ -290,6 +330,10 @@ struct rtp *rtp_video_rxtx::initialize_network(const char *addr, int recv_port,
         if (strcmp(addr, IN6_BLACKHOLE_STR) == 0) {
                 rtp_set_option(device, RTP_OPT_SEND_BACK, TRUE);
         }
+        if (m_nack_buf_pkts > 0 && sending) { // RX shards don't send, no need for retransmission buffer
+                rtp_set_option(device, RTP_OPT_NACK_PACKET_LEN, m_mtu);
+                rtp_set_option(device, RTP_OPT_NACK, m_nack_buf_pkts);
+        }
 
         rtp_set_recv_buf(device, INITIAL_VIDEO_RECV_BUFFER_SIZE);
         rtp_set_send_buf(device, INITIAL_VIDEO_SEND_BUFFER_SIZE);
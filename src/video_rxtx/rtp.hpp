@@ -61,9 +61,9 @@ public:
         rtp_video_rxtx(std::map<std::string, param_u> const &params);
         virtual ~rtp_video_rxtx();
 
-        static struct rtp *initialize_network(const char *addrs, int recv_port_base,
+        struct rtp *initialize_network(const char *addrs, int recv_port_base,
                         int send_port_base, struct pdb *participants, int force_ip_version,
-                        const char *mcast_if, int ttl);
+                        const char *mcast_if, int ttl, bool sending = true);
         static void destroy_rtp_device(struct rtp * network_devices);
         static void display_buf_increase_warning(int size);
 
@@ -78,6 +78,8 @@ protected:
         int              m_force_ip_version;
         const char      *m_requested_mcast_if;
         int              m_requested_ttl;
+        int              m_mtu;
+        int              m_nack_buf_pkts; ///< 0 if NACK is disabled
         fec             *m_fec_state;
         time_ns_t        m_start_time;
         video_desc       m_video_desc;
@@ -57,12 +57,14 @@
 #include "pdb.h"
 #include "rtp/ldgm.h"
 #include "rtp/rtp.h"
+#include "rtp/rate_control.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/video_decoders.h"
 #include "rtp/pbuf.h"
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/macros.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
 #include "video.h"
@@ -75,11 +77,21 @@
 #include "utils/worker.h"
 
 #include <chrono>
+#include <cstring>
 #include <sstream>
+#include <thread>
 #include <utility>
 
+#define MOD_NAME "[ultragrid_rtp] "
+
 using namespace std;
 
+enum {
+        NACK_BATCH_MAX = 256, ///< max sequence numbers requested at once
+        IDLE_PARTICIPANT_VISIT_NS = 100 * NS_IN_MS, ///< receiver loop housekeeping interval
+        RTCP_POLL_US = 10'000,        ///< RTCP wait in sender-only mode
+};
+
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
         rtp_video_rxtx(params), m_send_bytes_total(0)
 {
@@ -94,13 +106,114 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         }
 
         m_control = (struct control_state *) get_module(get_root_module(static_cast<struct module *>(params.at("parent").ptr)), "control");
+
+        if ((m_rxtx_mode & MODE_SENDER) != 0) {
+                m_rate_ctl = rate_ctl_init();
+        }
+
+        init_rx_shards(params);
+
+        if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff
+                m_rtcp_thread = thread(&ultragrid_rtp_video_rxtx::rtcp_loop, this);
+        }
+}
+
+/**
+ * Services RTCP (reports, NACKs, rate control feedback) in sender-only mode
+ * independently of the frame rate so that retransmissions are not delayed
+ * until the next frame is sent.
+ */
+void ultragrid_rtp_video_rxtx::rtcp_loop()
+{
+        set_thread_name("rtcp_receiver");
+        while (!m_rtcp_exit) {
+                time_ns_t curr_time = get_time_in_ns();
+                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                rtp_update(m_network_device, curr_time);
+                rtp_send_ctrl(m_network_device, ts, nullptr, curr_time);
+
+                struct timeval timeout { 0, RTCP_POLL_US };
+                while (!m_rtcp_exit && rtcp_recv_r(m_network_device, &timeout, ts)) {
+                        timeout = { 0, 0 };
+                }
+                update_rate_control(m_participants);
+        }
+}
+
+void ultragrid_rtp_video_rxtx::stop_rtcp_thread()
+{
+        m_rtcp_exit = true;
+        if (m_rtcp_thread.joinable()) {
+                m_rtcp_thread.join();
+        }
+}
+
+ADD_TO_PARAM("video-rx-shards", "* video-rx-shards=<n>[:hash]\n"
+                "  Receive video with <n> sockets bound to the RX port (SO_REUSEPORT), each with own thread,\n"
+                "  playout buffers and decoders. Senders are distributed by SSRC, with \"hash\" by kernel\n"
+                "  address hash. Linux only, display must support multiple sources (eg. conference).\n");
+void ultragrid_rtp_video_rxtx::init_rx_shards(const map<string, param_u> &params)
+{
+        const char *cfg = get_commandline_param("video-rx-shards");
+        if (cfg == nullptr || (m_rxtx_mode & MODE_RECEIVER) == 0) {
+                return;
+        }
+        const int count = atoi(cfg);
+        if (count <= 1) {
+                return;
+        }
+#if !defined __linux__ || defined SHARED_DECODER
+        (void) params;
+        MSG(WARNING, "Sharded receive not supported, ignoring video-rx-shards!\n");
+#else
+        if (m_recv_port_number == 0) {
+                MSG(WARNING, "Sharded receive needs fixed RX port, ignoring video-rx-shards!\n");
+                return;
+        }
+        struct multi_sources_supp_info supp_for_mult_sources{};
+        size_t len = sizeof supp_for_mult_sources;
+        if (!display_ctl_property(m_display_device, DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES,
+                                &supp_for_mult_sources, &len) || !supp_for_mult_sources.val) {
+                MSG(WARNING, "Display doesn't support multiple sources, ignoring video-rx-shards!\n");
+                return;
+        }
+
+        for (int i = 1; i < count; ++i) {
+                auto shard = make_unique<rx_shard>();
+                shard->participants = pdb_init((volatile int *) params.at("video_delay").vptr);
+                if (m_nack_buf_pkts > 0) {
+                        pdb_enable_nack(shard->participants);
+                }
+                shard->network_device = initialize_network(
+                    m_requested_receiver.c_str(), m_recv_port_number,
+                    m_send_port_number, shard->participants, m_force_ip_version,
+                    m_requested_mcast_if, m_requested_ttl, false);
+                if (shard->network_device == nullptr) {
+                        pdb_destroy(&shard->participants);
+                        throw ug_runtime_error("Unable to open network", EXIT_FAIL_NETWORK);
+                }
+                m_rx_shards.push_back(std::move(shard));
+        }
+
+        const bool steer_by_ssrc = strstr(cfg, ":hash") == nullptr;
+        if (steer_by_ssrc && !rtp_set_option(m_network_device, RTP_OPT_SSRC_STEERING, count)) {
+                MSG(WARNING, "Unable to steer by SSRC, using kernel hash.\n");
+        }
+        MSG(INFO, "Receiving video with %d shards\n", count);
+#endif
 }
 
 ultragrid_rtp_video_rxtx::~ultragrid_rtp_video_rxtx()
 {
+        stop_rtcp_thread();
+        for (auto &shard : m_rx_shards) {
+                destroy_rtp_device(shard->network_device);
+                pdb_destroy(&shard->participants);
+        }
         for (auto d : m_display_copies) {
                 display_done(d);
         }
+        rate_ctl_done(m_rate_ctl);
 }
 
 void ultragrid_rtp_video_rxtx::join()
@@ -108,6 +221,7 @@ void ultragrid_rtp_video_rxtx::join()
         video_rxtx::join();
         unique_lock<mutex> lk(m_async_sending_lock);
         m_async_sending_cv.wait(lk, [this]{return !m_async_sending;});
+        stop_rtcp_thread();
 }
 
 void *ultragrid_rtp_video_rxtx::receiver_thread(void *arg) {
@@ -124,6 +238,11 @@ void
 ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame) noexcept
 {
         m_video_desc = video_desc_from_frame(tx_frame.get());
+        if (tx_frame->fragment && m_fec_state) {
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('U', 'R', 'F', 'S'),
+                             MOD_NAME "FEC cannot be used with slices, dropping!\n");
+                return;
+        }
         if (m_fec_state) {
                 tx_frame = m_fec_state->encode(tx_frame);
         }
@@ -153,26 +272,64 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
 
         tx_send(m_tx, tx_frame.get(), m_network_device);
 
-        if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
-                time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
-                rtp_update(m_network_device, curr_time);
-                rtp_send_ctrl(m_network_device, ts, nullptr, curr_time);
-
-                // receive RTCP
-                bool ret = true;
-                do {
-                        struct timeval timeout { 0, 0 };
-                        ret = rtcp_recv_r(m_network_device, &timeout, ts);
-                } while (!m_should_exit && ret);
-        }
-
         m_async_sending_lock.lock();
         m_async_sending = false;
         m_async_sending_lock.unlock();
         m_async_sending_cv.notify_all();
 }
 
+/**
+ * Retargets compression bitrate and TX pacing according to the feedback
+ * processed by rate control. Called from each thread receiving RTCP (main
+ * receiver and RX shards) with its participants.
+ */
+void ultragrid_rtp_video_rxtx::update_rate_control(struct pdb *participants)
+{
+        if (m_rate_ctl == nullptr) {
+                return;
+        }
+        struct rate_ctl_stats stats{};
+        {
+                lock_guard<mutex> lk(m_rate_ctl_lock);
+                if (!rate_ctl_update(m_rate_ctl, participants, &stats)) {
+                        return;
+                }
+        }
+
+        auto *compress_msg = (struct msg_change_compress_data *) new_message(
+            sizeof(struct msg_change_compress_data));
+        compress_msg->what = CHANGE_PARAMS;
+        snprintf(compress_msg->config_string, sizeof compress_msg->config_string,
+                 "bitrate=%lld", stats.bitrate);
+        free_response(send_message(&m_sender_mod, "compress", (struct message *) compress_msg));
+
+        // leave the pacer some headroom for bitrate fluctuations of the encoder
+        auto *tx_msg = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+        snprintf(tx_msg->text, sizeof tx_msg->text, MSG_UNIVERSAL_TAG_TX "rate %lld",
+                 stats.bitrate * 6 / 5);
+        free_response(send_message(&m_sender_mod, "tx", (struct message *) tx_msg));
+
+        MSG(VERBOSE, "Rate control: bitrate %lld bps (loss %.2f%%, RTT %u us, receive rate %u kbps)\n",
+            stats.bitrate, stats.loss * 100, stats.rtt_us, stats.rx_rate_kbps);
+        if (m_control != nullptr) {
+                ostringstream oss;
+                oss << "rate_control bitrate=" << stats.bitrate << " loss=" << stats.loss
+                    << " rtt_us=" << stats.rtt_us << " rx_rate_kbps=" << stats.rx_rate_kbps;
+                control_report_event(m_control, oss.str());
+        }
+}
+
+static void set_playout_delay(struct pdb *participants, double delay)
+{
+        pdb_iter_t it;
+        struct pdb_e *cp = pdb_iter_init(participants, &it);
+        while (cp) {
+                pbuf_set_playout_delay(cp->playout_buffer, delay);
+                cp = pdb_iter_next(&it);
+        }
+        pdb_iter_done(&it);
+}
+
 void ultragrid_rtp_video_rxtx::receiver_process_messages()
 {
         struct msg_receiver *msg;
@@ -184,6 +341,10 @@ void ultragrid_rtp_video_rxtx::receiver_process_messages()
                 case RECEIVER_MSG_CHANGE_RX_PORT:
                         {
                                 assert(m_rxtx_mode == MODE_RECEIVER); // receiver only
+                                if (!m_rx_shards.empty()) {
+                                        r = new_response(RESPONSE_NOT_IMPL, "Not supported with video-rx-shards!");
+                                        break;
+                                }
                                 auto *old_device = m_network_device;
                                 auto old_port = m_recv_port_number;
                                 m_recv_port_number = msg->new_rx_port;
@@ -203,16 +364,10 @@ void ultragrid_rtp_video_rxtx::receiver_process_messages()
                                 break;
                         }
                 case RECEIVER_MSG_VIDEO_PROP_CHANGED:
-                        {
-                                pdb_iter_t it;
-                                /// @todo should be set only to relevant participant, not all
-                                struct pdb_e *cp = pdb_iter_init(m_participants, &it);
-                                while (cp) {
-                                        pbuf_set_playout_delay(cp->playout_buffer,
-                                                        1.0 / msg->new_desc.fps);
-
-                                        cp = pdb_iter_next(&it);
-                                }
+                        /// @todo should be set only to relevant participant, not all
+                        set_playout_delay(m_participants, 1.0 / msg->new_desc.fps);
+                        for (auto &shard : m_rx_shards) { // applied by the shard thread
+                                shard->new_playout_delay = 1.0 / msg->new_desc.fps;
                         }
                         break;
                 default:
@@ -228,9 +383,16 @@ void ultragrid_rtp_video_rxtx::receiver_process_messages()
  * until new display assigned.
  */
 void ultragrid_rtp_video_rxtx::remove_display_from_decoders() {
-        if (m_participants != NULL) {
+        vector<struct pdb *> pdbs{m_participants};
+        for (auto &shard : m_rx_shards) {
+                pdbs.push_back(shard->participants);
+        }
+        for (struct pdb *participants : pdbs) {
+                if (participants == NULL) {
+                        continue;
+                }
                 pdb_iter_t it;
-                struct pdb_e *cp = pdb_iter_init(m_participants, &it);
+                struct pdb_e *cp = pdb_iter_init(participants, &it);
                 while (cp != NULL) {
                         if(cp->decoder_state)
                                 video_decoder_remove_display(
@@ -273,25 +435,99 @@ struct vcodec_state *ultragrid_rtp_video_rxtx::new_video_decoder(struct display
         return state;
 }
 
+void ultragrid_rtp_video_rxtx::assign_decoder(struct pdb_e *cp)
+{
+#ifdef SHARED_DECODER
+        cp->decoder_state = m_shared_decoder;
+#else
+        lock_guard<mutex> lock(m_decoders_lock);
+        // we are assigning our display so we make sure it is removed from other dispaly
+
+        struct multi_sources_supp_info supp_for_mult_sources;
+        size_t len = sizeof(multi_sources_supp_info);
+        int ret = display_ctl_property(m_display_device,
+                        DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES, &supp_for_mult_sources, &len);
+        if (!ret) {
+                supp_for_mult_sources.val = false;
+        }
+
+        struct display *d;
+        if (supp_for_mult_sources.val == false) {
+                remove_display_from_decoders(); // must be called before creating new decoder state
+                d = m_display_device;
+        } else {
+                d = supp_for_mult_sources.fork_display(supp_for_mult_sources.state);
+                assert(d != NULL);
+                m_display_copies.push_back(d);
+        }
+
+        cp->decoder_state = new_video_decoder(d);
+        cp->decoder_state_deleter = destroy_video_decoder;
+
+        if (cp->decoder_state == NULL) {
+                log_msg(LOG_LEVEL_FATAL, "Fatal: unable to create decoder state for "
+                                "participant %u.\n", cp->ssrc);
+                exit_uv(1);
+        }
+#endif // SHARED_DECODER
+}
+
 void *ultragrid_rtp_video_rxtx::receiver_loop()
 {
         set_thread_name(__func__);
-        struct pdb_e *cp;
-        int fr;
-        int last_buf_size = rtp_get_recv_buf(m_network_device);
 
 #ifdef SHARED_DECODER
-        struct vcodec_state *shared_decoder = new_video_decoder(m_display_device);
-        if(shared_decoder == NULL) {
+        m_shared_decoder = new_video_decoder(m_display_device);
+        if(m_shared_decoder == NULL) {
                 fprintf(stderr, "Unable to create decoder!\n");
                 exit_uv(1);
                 return NULL;
         }
 #endif // SHARED_DECODER
 
+        vector<thread> shard_threads;
+        for (auto &shard : m_rx_shards) {
+                shard_threads.emplace_back(&ultragrid_rtp_video_rxtx::receive_packets, this, shard.get());
+        }
+        receive_packets(nullptr);
+        for (auto &t : shard_threads) {
+                t.join();
+        }
+
+#ifdef SHARED_DECODER
+        destroy_video_decoder(m_shared_decoder);
+#else
+        /* Because decoders work asynchronously we need to make sure
+         * that display won't be called */
+        remove_display_from_decoders();
+#endif //  SHARED_DECODER
+
+        // pass posioned pill to display
+        display_put_frame(m_display_device, NULL, PUTF_BLOCKING);
+
+        return 0;
+}
+
+/**
+ * Receives, decodes and displays video of participants of either the main
+ * session (shard == nullptr) or of an additional receiving shard.
+ */
+void ultragrid_rtp_video_rxtx::receive_packets(struct rx_shard *shard)
+{
+        if (shard != nullptr) {
+                set_thread_name("receiver_shard");
+        }
+        struct pdb_e *cp;
+        int fr;
+        struct rtp *network_device = shard ? shard->network_device : m_network_device;
+        struct pdb *participants = shard ? shard->participants : m_participants;
+        int last_buf_size = rtp_get_recv_buf(network_device);
+
         fr = 1;
 
         time_ns_t last_not_timeout = 0;
+        time_ns_t last_pbuf_report = 0;
+        time_ns_t last_visit_all = 0;
 
         while (!m_should_exit) {
                 struct timeval timeout;
@@ -299,16 +535,26 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 time_ns_t curr_time = get_time_in_ns();
                 uint32_t ts = (m_start_time - curr_time) / 100'000 * 9; // at 90000 Hz
 
-                rtp_update(m_network_device, curr_time);
-                rtp_send_ctrl(m_network_device, ts, nullptr, curr_time);
+                if (shard == nullptr) { // may have been changed by a message
+                        network_device = m_network_device;
+                }
+                rtp_update(network_device, curr_time);
+                rtp_send_ctrl(network_device, ts, nullptr, curr_time);
 
                 /* Receive packets from the network... The timeout is adjusted */
                 /* to match the video capture rate, so the transmitter works.  */
                 if (fr) {
                         curr_time = get_time_in_ns();
-                        receiver_process_messages();
+                        if (shard == nullptr) {
+                                receiver_process_messages();
+                        }
                         fr = 0;
                 }
+                if (shard != nullptr) {
+                        if (double delay = shard->new_playout_delay.exchange(0.0)) {
+                                set_playout_delay(participants, delay);
+                        }
+                }
 
                 timeout.tv_sec = 0;
                 //timeout.tv_usec = 999999 / 59.94;
@@ -318,20 +564,38 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 } else {
                         timeout.tv_usec = 1000;
                 }
-                const bool ret = rtp_recv_r(m_network_device, &timeout, ts);
+                const bool ret = rtp_recv_r(network_device, &timeout, ts);
 
                 // timeout
                 if (!ret) {
                         // processing is needed here in case we are not receiving any data
-                        receiver_process_messages();
+                        if (shard == nullptr) {
+                                receiver_process_messages();
+                        }
                         //printf("Failed to receive data\n");
                 } else {
                         last_not_timeout = curr_time;
                 }
 
+                const bool report_pbuf = m_control != nullptr &&
+                                         control_stats_enabled(m_control) &&
+                                         curr_time - last_pbuf_report > NS_IN_SEC;
+                if (report_pbuf) {
+                        last_pbuf_report = curr_time;
+                }
+
+                // participants without buffered data need only periodic
+                // housekeeping (feedback, stats), not a visit per packet
+                const bool visit_all = report_pbuf ||
+                                       curr_time - last_visit_all > IDLE_PARTICIPANT_VISIT_NS;
+                if (visit_all) {
+                        last_visit_all = curr_time;
+                }
+
                 /* Decode and render for each participant in the conference... */
                 pdb_iter_t it;
-                cp = pdb_iter_init(m_participants, &it);
+                cp = visit_all ? pdb_iter_init(participants, &it)
+                               : pdb_iter_init_active(participants, &it);
                 while (cp != NULL) {
                         if (tfrc_feedback_is_due(cp->tfrc_state, curr_time)) {
                                 debug_msg("tfrc rate %f\n",
@@ -341,43 +605,20 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
 
                         if(cp->decoder_state == NULL &&
                                         !pbuf_is_empty(cp->playout_buffer)) { // the second check is needed because we want to assign display to participant that really sends data
-#ifdef SHARED_DECODER
-                                cp->decoder_state = shared_decoder;
-#else
-                                // we are assigning our display so we make sure it is removed from other dispaly
-
-                                struct multi_sources_supp_info supp_for_mult_sources;
-                                size_t len = sizeof(multi_sources_supp_info);
-                                int ret = display_ctl_property(m_display_device,
-                                                DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES, &supp_for_mult_sources, &len);
-                                if (!ret) {
-                                        supp_for_mult_sources.val = false;
-                                }
-
-                                struct display *d;
-                                if (supp_for_mult_sources.val == false) {
-                                        remove_display_from_decoders(); // must be called before creating new decoder state
-                                        d = m_display_device;
-                                } else {
-                                        d = supp_for_mult_sources.fork_display(supp_for_mult_sources.state);
-                                        assert(d != NULL);
-                                        m_display_copies.push_back(d);
-                                }
-
-                                cp->decoder_state = new_video_decoder(d);
-                                cp->decoder_state_deleter = destroy_video_decoder;
-
+                                assign_decoder(cp);
                                 if (cp->decoder_state == NULL) {
-                                        log_msg(LOG_LEVEL_FATAL, "Fatal: unable to create decoder state for "
-                                                        "participant %u.\n", cp->ssrc);
-                                        exit_uv(1);
                                         break;
                                 }
-#endif // SHARED_DECODER
                         }
 
                         struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
 
+                        /* Request retransmission of missing packets... */
+                        uint16_t nack_seqs[NACK_BATCH_MAX];
+                        if (int nack_count = pbuf_get_nacks(cp->playout_buffer, curr_time, nack_seqs, NACK_BATCH_MAX)) {
+                                rtp_send_nack(network_device, cp->ssrc, nack_seqs, nack_count);
+                        }
+
                         /* Decode and render video... */
                         if (pbuf_decode
                             (cp->playout_buffer, curr_time, decode_video_frame, vdecoder_state)) {
@@ -387,7 +628,7 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                         if(vdecoder_state && vdecoder_state->decoded % 100 == 99) {
                                 int new_size = vdecoder_state->max_frame_size * 110ull / 100;
                                 if(new_size > last_buf_size) {
-                                        if (rtp_set_recv_buf(m_network_device, new_size)) {
+                                        if (rtp_set_recv_buf(network_device, new_size)) {
                                                 debug_msg("Recv buffer adjusted to %d\n", new_size);
                                         } else {
                                                 display_buf_increase_warning(new_size);
@@ -397,23 +638,31 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                         }
 
                         pbuf_remove(cp->playout_buffer, curr_time);
+                        if (pbuf_is_empty(cp->playout_buffer)) {
+                                pdb_set_active(participants, cp, false);
+                        }
+                        if (report_pbuf) {
+                                report_pbuf_stats(cp);
+                        }
+                        rate_ctl_send_feedback(network_device, cp, curr_time);
                         cp = pdb_iter_next(&it);
                 }
                 pdb_iter_done(&it);
+                update_rate_control(participants);
         }
+}
 
-#ifdef SHARED_DECODER
-        destroy_video_decoder(shared_decoder);
-#else
-        /* Because decoders work asynchronously we need to make sure
-         * that display won't be called */
-        remove_display_from_decoders();
-#endif //  SHARED_DECODER
-
-        // pass posioned pill to display
-        display_put_frame(m_display_device, NULL, PUTF_BLOCKING);
-
-        return 0;
+void ultragrid_rtp_video_rxtx::report_pbuf_stats(struct pdb_e *cp)
+{
+        struct pbuf_stats stats;
+        pbuf_get_stats(cp->playout_buffer, &stats);
+        ostringstream oss;
+        oss << "pbuf " << hex << cp->ssrc << dec
+            << " delay_us " << stats.playout_delay_us
+            << " jitter_us " << stats.jitter_us
+            << " late_frames " << stats.late_frames
+            << " late_pkts " << stats.late_pkts;
+        control_report_stats(m_control, oss.str());
 }
 
 uint32_t ultragrid_rtp_video_rxtx::get_ssrc()
@@ -41,13 +41,18 @@
 #include "video_rxtx.hpp"
 #include "video_rxtx/rtp.hpp"
 
+#include <atomic>
 #include <condition_variable>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 struct control_state;
+struct rate_ctl;
 
 class ultragrid_rtp_video_rxtx : public rtp_video_rxtx {
 public:
@@ -59,17 +64,31 @@ public:
         // transcoder functions
         friend ssize_t hd_rum_decompress_write(void *state, void *buf, size_t count);
 private:
+        /// additional receiving session bound to the RX port (see video-rx-shards)
+        struct rx_shard {
+                struct rtp *network_device;
+                struct pdb *participants;
+                std::atomic<double> new_playout_delay{0.0}; ///< set from control thread, 0 = no change
+        };
+
         static void *receiver_thread(void *arg);
         virtual void send_frame(std::shared_ptr<video_frame>) noexcept override;
         void *receiver_loop();
+        void receive_packets(struct rx_shard *shard);
+        void init_rx_shards(std::map<std::string, param_u> const &params);
         static void *send_frame_async_callback(void *arg);
         virtual void send_frame_async(std::shared_ptr<video_frame>);
         virtual void *(*get_receiver_thread() noexcept)(void *arg) override;
 
         void receiver_process_messages();
         void remove_display_from_decoders();
+        void assign_decoder(struct pdb_e *cp);
         struct vcodec_state *new_video_decoder(struct display *d);
         static void destroy_video_decoder(void *state);
+        void report_pbuf_stats(struct pdb_e *cp);
+        void update_rate_control(struct pdb *participants);
+        void rtcp_loop();
+        void stop_rtcp_thread();
 
         enum video_mode  m_decoder_mode;
         struct display  *m_display_device;
@@ -79,6 +98,12 @@ private:
                                                       ///< saved forked states
         const char      *m_requested_encryption;
 
+        std::vector<std::unique_ptr<rx_shard>> m_rx_shards;
+        std::mutex       m_decoders_lock; ///< serializes decoder creation among shards
+#ifdef SHARED_DECODER
+        struct vcodec_state *m_shared_decoder = nullptr;
+#endif
+
         /**
          * This variables serve as a notification when asynchronous sending exits
          * @{ */
@@ -89,6 +114,10 @@ private:
 
         long long int m_send_bytes_total;
         struct control_state *m_control;
+        struct rate_ctl *m_rate_ctl = nullptr; ///< sender rate control, if enabled
+        std::mutex       m_rate_ctl_lock; ///< rate control is updated by all receiving threads
+        std::thread      m_rtcp_thread; ///< sender-only mode
+        std::atomic<bool> m_rtcp_exit{false};
 
         long long int m_nano_per_frame_actual_cumul = 0;
         long long int m_nano_per_frame_expected_cumul = 0;
@@ -0,0 +1,707 @@
+/**
+ * @file   vo_postprocess/deinterlace_yadif.c
+ *
+ * Motion-adaptive deinterlacer based on the YADIF algorithm. A missing line
+ * is interpolated spatially along the best matching edge direction and the
+ * result is clamped by the temporal prediction from surrounding fields, so
+ * static areas keep full vertical resolution while moving areas do not comb.
+ *
+ * 4:2:2 formats are processed natively - UYVY/YUYV as 8-bit, Y216 as 16-bit
+ * and v210 is unpacked to 16-bit samples on input. The frame is split into
+ * stripes processed by the worker pool, the kernels use GCC generic vectors
+ * compiled additionally for AVX2 and selected at runtime.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_filter.h"
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "tv.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_display.h"
+#include "vo_postprocess.h"
+
+#define MOD_NAME "[deinterlace_yadif] "
+#define TIMEOUT "20ms"
+#define STEP 4 ///< horizontal step of the edge search in samples (one 4:2:2 macropixel)
+#define EDGE (3 * STEP) ///< samples at line ends processed by the scalar code
+
+/// arguments for interpolating one missing line, sample offsets are relative to line pointers
+struct yadif_line {
+        void *dst;
+        const void *prev, *cur, *next; ///< frames surrounding the output one, pointing to the missing line
+        const void *prev2, *next2;     ///< the pair of fields temporally adjacent to the missing one
+        ptrdiff_t mrefs, prefs;        ///< offset to the line above and below
+        bool spatial_check;            ///< lines 2 rows above and below are available
+        int samples;                   ///< line length
+};
+
+/// @returns first sample not processed
+typedef int (*yadif_kernel_t)(const struct yadif_line *l, int x, int end);
+
+// 128-bit working vectors for the generic version
+typedef int16_t v8s16 __attribute__((vector_size(16)));
+typedef uint8_t v8u8 __attribute__((vector_size(8)));
+typedef int32_t v4s32 __attribute__((vector_size(16)));
+typedef uint16_t v4u16 __attribute__((vector_size(8)));
+// 256-bit for AVX2
+typedef int16_t v16s16 __attribute__((vector_size(32)));
+typedef uint8_t v16u8 __attribute__((vector_size(16)));
+typedef int32_t v8s32 __attribute__((vector_size(32)));
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+
+/* C doesn't have a vector ternary operator, comparison results are used as masks
+ * instead - operands must not have side effects */
+#define VSEL(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+#define VMIN(a, b) VSEL((a) < (b), a, b)
+#define VMAX(a, b) VSEL((a) > (b), a, b)
+#define VABSDIFF(a, b) (VMAX(a, b) - VMIN(a, b))
+
+#define SCALAR_ABS(a) ((a) < 0 ? -(a) : (a))
+
+/**
+ * Defines the scalar version handling any range of samples. Horizontal
+ * neighbours outside the line are replaced by the nearest sample of the same
+ * component.
+ */
+#define DEFINE_YADIF_SCALAR(name, T) \
+static int name(const struct yadif_line *l, int x, int end) \
+{ \
+        const T *prev = l->prev, *cur = l->cur, *next = l->next, *prev2 = l->prev2, *next2 = l->next2; \
+        T *dst = l->dst; \
+        const ptrdiff_t m = l->mrefs, p = l->prefs; \
+        for ( ; x < end; ++x) { \
+                int idx[7]; /* sample indices for horizontal offsets -3..3 steps */ \
+                for (int i = 0; i < 7; ++i) { \
+                        idx[i] = x + (i - 3) * STEP; \
+                        while (idx[i] < 0) idx[i] += STEP; \
+                        while (idx[i] >= l->samples) idx[i] -= STEP; \
+                } \
+                const int c = cur[m + x], e = cur[p + x]; \
+                const int d = (prev2[x] + next2[x]) >> 1; \
+                const int td0 = SCALAR_ABS(prev2[x] - next2[x]); \
+                const int td1 = (SCALAR_ABS(prev[m + x] - c) + SCALAR_ABS(prev[p + x] - e)) >> 1; \
+                const int td2 = (SCALAR_ABS(next[m + x] - c) + SCALAR_ABS(next[p + x] - e)) >> 1; \
+                int diff = MAX(MAX(td0 >> 1, td1), td2); \
+                int pred = (c + e) >> 1; \
+                int score = SCALAR_ABS(cur[m + idx[2]] - cur[p + idx[2]]) + SCALAR_ABS(c - e) \
+                        + SCALAR_ABS(cur[m + idx[4]] - cur[p + idx[4]]) - 1; \
+                for (int dir = -1; dir <= 1; dir += 2) { \
+                        for (int j = dir; j == dir || j == 2 * dir; j += dir) { \
+                                const int sc = SCALAR_ABS(cur[m + idx[2 + j]] - cur[p + idx[2 - j]]) \
+                                        + SCALAR_ABS(cur[m + idx[3 + j]] - cur[p + idx[3 - j]]) \
+                                        + SCALAR_ABS(cur[m + idx[4 + j]] - cur[p + idx[4 - j]]); \
+                                if (sc >= score) { \
+                                        break; \
+                                } \
+                                score = sc; \
+                                pred = (cur[m + idx[3 + j]] + cur[p + idx[3 - j]]) >> 1; \
+                        } \
+                } \
+                if (l->spatial_check) { \
+                        const int b = (prev2[2 * m + x] + next2[2 * m + x]) >> 1; \
+                        const int f = (prev2[2 * p + x] + next2[2 * p + x]) >> 1; \
+                        const int max = MAX(MAX(d - e, d - c), MIN(b - c, f - e)); \
+                        const int min = MIN(MIN(d - e, d - c), MAX(b - c, f - e)); \
+                        diff = MAX(MAX(diff, min), -max); \
+                } \
+                dst[x] = MAX(MIN(pred, d + diff), d - diff); \
+        } \
+        return x; \
+}
+
+/**
+ * Defines the vector version, it processes samples from x while all
+ * horizontal neighbours are inside [x - EDGE, end + EDGE).
+ *
+ * @param VS signed working vector
+ * @param VU unsigned vector of T with the same lane count
+ */
+#define DEFINE_YADIF_VECTOR(name, T, VS, VU, attr) \
+attr static int name(const struct yadif_line *l, int x, int end) \
+{ \
+        enum { N = sizeof(VU) / sizeof(T) }; \
+        const T *prev = l->prev, *cur = l->cur, *next = l->next, *prev2 = l->prev2, *next2 = l->next2; \
+        T *dst = l->dst; \
+        const ptrdiff_t m = l->mrefs, p = l->prefs; \
+        for ( ; x + N <= end; x += N) { \
+                VU u; \
+                VS cm[7], cp[7]; /* line above and below at offsets -3..3 steps */ \
+                for (int i = 0; i < 7; ++i) { \
+                        memcpy(&u, cur + m + x + (i - 3) * STEP, sizeof u); \
+                        cm[i] = __builtin_convertvector(u, VS); \
+                        memcpy(&u, cur + p + x + (i - 3) * STEP, sizeof u); \
+                        cp[i] = __builtin_convertvector(u, VS); \
+                } \
+                VS c = cm[3], e = cp[3], p2, n2, t0, t1; \
+                memcpy(&u, prev2 + x, sizeof u); p2 = __builtin_convertvector(u, VS); \
+                memcpy(&u, next2 + x, sizeof u); n2 = __builtin_convertvector(u, VS); \
+                const VS d = (p2 + n2) >> 1; \
+                VS diff = VABSDIFF(p2, n2) >> 1; \
+                memcpy(&u, prev + m + x, sizeof u); t0 = __builtin_convertvector(u, VS); \
+                memcpy(&u, prev + p + x, sizeof u); t1 = __builtin_convertvector(u, VS); \
+                VS td = (VABSDIFF(t0, c) + VABSDIFF(t1, e)) >> 1; \
+                diff = VMAX(diff, td); \
+                memcpy(&u, next + m + x, sizeof u); t0 = __builtin_convertvector(u, VS); \
+                memcpy(&u, next + p + x, sizeof u); t1 = __builtin_convertvector(u, VS); \
+                td = (VABSDIFF(t0, c) + VABSDIFF(t1, e)) >> 1; \
+                diff = VMAX(diff, td); \
+                VS pred = (c + e) >> 1; \
+                VS score = VABSDIFF(cm[2], cp[2]) + VABSDIFF(c, e) + VABSDIFF(cm[4], cp[4]) - 1; \
+                for (int dir = -1; dir <= 1; dir += 2) { \
+                        VS better = score == score; /* all ones */ \
+                        for (int j = dir; j == dir || j == 2 * dir; j += dir) { \
+                                VS sc = VABSDIFF(cm[2 + j], cp[2 - j]) + VABSDIFF(cm[3 + j], cp[3 - j]) \
+                                        + VABSDIFF(cm[4 + j], cp[4 - j]); \
+                                better &= sc < score; \
+                                score = VSEL(better, sc, score); \
+                                VS avg = (cm[3 + j] + cp[3 - j]) >> 1; \
+                                pred = VSEL(better, avg, pred); \
+                        } \
+                } \
+                if (l->spatial_check) { \
+                        memcpy(&u, prev2 + 2 * m + x, sizeof u); t0 = __builtin_convertvector(u, VS); \
+                        memcpy(&u, next2 + 2 * m + x, sizeof u); t1 = __builtin_convertvector(u, VS); \
+                        const VS b = (t0 + t1) >> 1; \
+                        memcpy(&u, prev2 + 2 * p + x, sizeof u); t0 = __builtin_convertvector(u, VS); \
+                        memcpy(&u, next2 + 2 * p + x, sizeof u); t1 = __builtin_convertvector(u, VS); \
+                        const VS f = (t0 + t1) >> 1; \
+                        const VS de = d - e, dc = d - c, bc = b - c, fe = f - e; \
+                        VS max = VMAX(de, dc), min = VMIN(de, dc); \
+                        t0 = VMIN(bc, fe); \
+                        max = VMAX(max, t0); \
+                        t0 = VMAX(bc, fe); \
+                        min = VMIN(min, t0); \
+                        diff = VMAX(diff, min); \
+                        max = -max; \
+                        diff = VMAX(diff, max); \
+                } \
+                const VS hi = d + diff, lo = d - diff; \
+                pred = VMIN(pred, hi); \
+                pred = VMAX(pred, lo); \
+                u = __builtin_convertvector(pred, VU); \
+                memcpy(dst + x, &u, sizeof u); \
+        } \
+        return x; \
+}
+
+DEFINE_YADIF_SCALAR(yadif_scalar8, uint8_t)
+DEFINE_YADIF_SCALAR(yadif_scalar16, uint16_t)
+DEFINE_YADIF_VECTOR(yadif_vector8, uint8_t, v8s16, v8u8, )
+DEFINE_YADIF_VECTOR(yadif_vector16, uint16_t, v4s32, v4u16, )
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define HAVE_AVX2_DISPATCH 1
+DEFINE_YADIF_VECTOR(yadif_avx2_8, uint8_t, v16s16, v16u8, __attribute__((target("avx2"))))
+DEFINE_YADIF_VECTOR(yadif_avx2_16, uint16_t, v8s32, v8u16, __attribute__((target("avx2"))))
+#endif
+
+struct state_yadif {
+        bool field_rate;
+        bool force;
+        bool nodelay;
+        int threads;
+
+        struct video_desc desc;
+        bool deinterlace;        ///< input is interlaced or forced
+        int bps;                 ///< bytes per work sample
+        int samples;             ///< work samples per line
+        yadif_kernel_t kernel;
+        yadif_kernel_t scalar;
+        char *work[3];           ///< ring of last frames in work format
+        char *raw;               ///< v210 receive buffer, input of other formats is received directly to work
+        uint16_t *line_tmp;      ///< per-stripe line for v210 packing
+        unsigned long long frames;
+        struct video_frame *in;
+        struct video_frame *last_in; ///< for passthrough of the other output frame
+        void *out_pool;          ///< output frames of the capture filter, created on first use
+
+
+        time_ns_t frame_received;
+};
+
+struct yadif_stripe {
+        const struct state_yadif *s;
+        const char *prev, *cur, *next;
+        const char *src;   ///< v210 input when unpacking
+        char *dst;         ///< output frame or work buffer when unpacking
+        int dst_pitch;
+        int parity;        ///< lines of this parity are interpolated
+        int y_start, y_end;
+        uint16_t *tmp;
+};
+
+static void usage(bool for_postprocessor)
+{
+        color_printf(TBOLD("deinterlace_yadif") " is a motion-adaptive deinterlacer - static "
+                        "parts of the picture keep full resolution, moving parts are "
+                        "interpolated along edges. Output is delayed by one frame.\n\n");
+        color_printf("Usage:\n");
+        if (for_postprocessor) {
+                color_printf("\t" TBOLD(TRED("-p deinterlace_yadif") "[:field][:force][:nodelay][:threads=<n>]") "\n");
+        } else {
+                color_printf("\t" TBOLD(TRED("--capture-filter deinterlace_yadif") "[:force][:threads=<n>]") " -t <capture>\n");
+        }
+        color_printf("\nwhere:\n");
+        if (for_postprocessor) {
+                color_printf("\t" TBOLD("field    ") " - output every field as a frame (doubles frame rate)\n");
+                color_printf("\t" TBOLD("nodelay  ") " - do not delay the other field frame to keep timing\n");
+        }
+        color_printf("\t" TBOLD("force    ") " - apply deinterlacing even if input is not interlaced\n");
+        color_printf("\t" TBOLD("threads  ") " - number of stripes processed in parallel (default: CPU core count)\n");
+        color_printf("\nSupported pixel formats: UYVY, YUYV, v210, Y216\n");
+}
+
+static void *yadif_init_common(const char *config, bool for_postprocessor)
+{
+        if (strcmp(config, "help") == 0) {
+                usage(for_postprocessor);
+                return NULL;
+        }
+
+        struct state_yadif *s = calloc(1, sizeof *s);
+        assert(s != NULL);
+        s->threads = get_cpu_core_count();
+
+        char *tmp = strdup(config);
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *cfg = tmp;
+        while ((item = strtok_r(cfg, ":", &save_ptr)) != NULL) {
+                cfg = NULL;
+                if (strcmp(item, "field") == 0 && for_postprocessor) {
+                        s->field_rate = true;
+                } else if (strcmp(item, "nodelay") == 0 && for_postprocessor) {
+                        s->nodelay = true;
+                } else if (strcmp(item, "force") == 0) {
+                        s->force = true;
+                } else if (strstr(item, "threads=") == item) {
+                        s->threads = atoi(item + strlen("threads="));
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        free(tmp);
+                        free(s);
+                        return NULL;
+                }
+        }
+        free(tmp);
+        s->threads = MAX(s->threads, 1);
+
+        if (s->field_rate && s->nodelay && get_commandline_param("decoder-drop-policy") == NULL) {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "nodelay option used, setting drop policy to %s timeout.\n", TIMEOUT);
+                set_commandline_param("decoder-drop-policy", TIMEOUT);
+        }
+
+        s->in = vf_alloc(1);
+        return s;
+}
+
+static void *yadif_init(const char *config)
+{
+        return yadif_init_common(config, true);
+}
+
+static void yadif_done(void *state)
+{
+        struct state_yadif *s = state;
+
+        for (int i = 0; i < 3; ++i) {
+                free(s->work[i]);
+        }
+        free(s->raw);
+        free(s->line_tmp);
+        if (s->out_pool) {
+                video_frame_pool_destroy(s->out_pool);
+        }
+        vf_free(s->in);
+        free(s);
+}
+
+static bool yadif_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        codec_t supported[] = { UYVY, YUYV, v210, Y216 };
+
+        if (property != VO_PP_PROPERTY_CODECS) {
+                return false;
+        }
+        if (*len < sizeof supported) {
+                *len = 0;
+        } else {
+                memcpy(val, supported, sizeof supported);
+                *len = sizeof supported;
+        }
+        return true;
+}
+
+static bool yadif_reconfigure(void *state, struct video_desc desc)
+{
+        struct state_yadif *s = state;
+        assert(desc.tile_count == 1);
+
+        for (int i = 0; i < 3; ++i) {
+                free(s->work[i]);
+                s->work[i] = NULL;
+        }
+        free(s->raw);
+        free(s->line_tmp);
+        s->raw = NULL;
+        s->line_tmp = NULL;
+        if (s->out_pool) {
+                video_frame_pool_destroy(s->out_pool);
+                s->out_pool = NULL;
+        }
+
+        s->deinterlace = desc.interlacing == INTERLACED_MERGED || s->force;
+        if (!s->deinterlace) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "%s video detected, passing through.\n",
+                                get_interlacing_description(desc.interlacing));
+        }
+
+        const int linesize = vc_get_linesize(desc.width, desc.color_spec);
+        switch (desc.color_spec) {
+        case UYVY:
+        case YUYV:
+                s->bps = 1;
+                s->samples = linesize; // odd widths are padded to whole macropixels
+                break;
+        case Y216:
+                s->bps = 2;
+                s->samples = linesize / 2;
+                break;
+        case v210:
+                s->bps = 2;
+                s->samples = linesize / 16 * 12;
+                s->raw = malloc((size_t) linesize * desc.height);
+                s->line_tmp = malloc((size_t) s->threads * s->samples * sizeof(uint16_t));
+                break;
+        default:
+                if (s->deinterlace) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported pixel format '%s'!\n", get_codec_name(desc.color_spec));
+                        return false;
+                }
+                s->bps = 1;
+                s->samples = linesize;
+        }
+
+        s->scalar = s->bps == 1 ? yadif_scalar8 : yadif_scalar16;
+        s->kernel = s->bps == 1 ? yadif_vector8 : yadif_vector16;
+#ifdef HAVE_AVX2_DISPATCH
+        if (__builtin_cpu_supports("avx2")) {
+                s->kernel = s->bps == 1 ? yadif_avx2_8 : yadif_avx2_16;
+        }
+#endif
+        const char *kernel = get_commandline_param("yadif-kernel");
+        if (kernel != NULL && strcmp(kernel, "scalar") == 0) {
+                s->kernel = s->scalar;
+        } else if (kernel != NULL && strcmp(kernel, "vector") == 0) {
+                s->kernel = s->bps == 1 ? yadif_vector8 : yadif_vector16;
+        }
+
+        for (int i = 0; i < 3; ++i) {
+                s->work[i] = malloc((size_t) s->samples * s->bps * desc.height);
+        }
+        s->desc = desc;
+        s->frames = 0;
+
+        s->in->color_spec = desc.color_spec;
+        s->in->fps = desc.fps;
+        s->in->interlacing = desc.interlacing;
+        s->in->tiles[0].width = desc.width;
+        s->in->tiles[0].height = desc.height;
+        s->in->tiles[0].data_len = linesize * desc.height;
+        s->in->tiles[0].data = s->raw ? s->raw : s->work[0];
+        s->last_in = NULL;
+
+        return true;
+}
+
+static struct video_frame *yadif_getf(void *state)
+{
+        struct state_yadif *s = state;
+
+        if (s->raw == NULL) {
+                s->in->tiles[0].data = s->work[s->frames % 3];
+        }
+        return s->in;
+}
+
+static void yadif_filter_line(const struct state_yadif *s, struct yadif_line *l)
+{
+        int x = s->scalar(l, 0, MIN(EDGE, s->samples));
+        if (s->samples > 2 * EDGE) {
+                x = s->kernel(l, x, s->samples - EDGE);
+        }
+        s->scalar(l, x, s->samples);
+}
+
+static void v210_unpack_line(const uint32_t *in, uint16_t *out, int samples)
+{
+        for (int x = 0; x < samples; x += 3) {
+                uint32_t w = *in++;
+                *out++ = w & 0x3ff;
+                *out++ = w >> 10 & 0x3ff;
+                *out++ = w >> 20 & 0x3ff;
+        }
+}
+
+static void v210_pack_line(const uint16_t *in, uint32_t *out, int samples)
+{
+        for (int x = 0; x < samples; x += 3) {
+                *out++ = in[0] | in[1] << 10 | (uint32_t) in[2] << 20;
+                in += 3;
+        }
+}
+
+static void *unpack_stripe(void *arg)
+{
+        struct yadif_stripe *st = arg;
+        const int linesize = vc_get_linesize(st->s->desc.width, v210);
+        for (int y = st->y_start; y < st->y_end; ++y) {
+                v210_unpack_line((const uint32_t *)(const void *) (st->src + (size_t) y * linesize),
+                                (uint16_t *)(void *) (st->dst + (size_t) y * st->dst_pitch), st->s->samples);
+        }
+        return NULL;
+}
+
+static void *deinterlace_stripe(void *arg)
+{
+        struct yadif_stripe *st = arg;
+        const struct state_yadif *s = st->s;
+        const int h = s->desc.height;
+        const ptrdiff_t stride = (ptrdiff_t) s->samples; // in samples
+        const size_t line_bytes = (size_t) s->samples * s->bps;
+
+        for (int y = st->y_start; y < st->y_end; ++y) {
+                char *dst = st->tmp ? (char *) st->tmp : st->dst + (size_t) y * st->dst_pitch;
+                const size_t off = y * line_bytes;
+                if ((y & 1) != st->parity) {
+                        memcpy(dst, st->cur + off, line_bytes);
+                } else {
+                        struct yadif_line l = {
+                                .dst = dst,
+                                .prev = st->prev + off, .cur = st->cur + off, .next = st->next + off,
+                                .prev2 = st->parity ? st->prev + off : st->cur + off,
+                                .next2 = st->parity ? st->cur + off : st->next + off,
+                                .mrefs = y > 0 ? -stride : stride,
+                                .prefs = y + 1 < h ? stride : -stride,
+                                .spatial_check = y >= 2 && y + 2 < h,
+                                .samples = s->samples,
+                        };
+                        yadif_filter_line(s, &l);
+                }
+                if (st->tmp) {
+                        v210_pack_line(st->tmp, (uint32_t *)(void *) (st->dst + (size_t) y * st->dst_pitch), s->samples);
+                }
+        }
+        return NULL;
+}
+
+/// splits lines to stripes with even boundaries and runs them in the worker pool
+static void run_stripes(const struct state_yadif *s, runnable_t task, struct yadif_stripe *tmpl)
+{
+        const int count = s->threads;
+        struct yadif_stripe stripes[count];
+        const int lines = ((s->desc.height + count - 1) / count + 1) & ~1;
+        for (int i = 0; i < count; ++i) {
+                stripes[i] = *tmpl;
+                stripes[i].y_start = MIN(i * lines, (int) s->desc.height);
+                stripes[i].y_end = MIN((i + 1) * lines, (int) s->desc.height);
+                if (s->line_tmp && task == deinterlace_stripe) {
+                        stripes[i].tmp = s->line_tmp + (size_t) i * s->samples;
+                }
+        }
+        task_run_parallel(task, count, stripes, sizeof stripes[0], NULL);
+}
+
+/// stores the frame currently in s->in to the work ring
+static void yadif_push(struct state_yadif *s)
+{
+        if (s->raw) {
+                struct yadif_stripe st = { .s = s, .src = s->raw, .dst = s->work[s->frames % 3],
+                        .dst_pitch = s->samples * s->bps };
+                run_stripes(s, unpack_stripe, &st);
+        }
+        s->frames += 1;
+}
+
+/**
+ * Deinterlaces the frame before the last received one (or the only one at
+ * the beginning, which is then output twice).
+ * @param field 0 - keep first field, 1 - keep second field
+ */
+static void yadif_output(struct state_yadif *s, char *out, int pitch, int field)
+{
+        const unsigned long long n = s->frames;
+        struct yadif_stripe st = {
+                .s = s,
+                .next = s->work[(n - 1) % 3],
+                .cur = s->work[(n >= 2 ? n - 2 : n - 1) % 3],
+                .prev = s->work[(n >= 3 ? n - 3 : n >= 2 ? n - 2 : n - 1) % 3],
+                .dst = out,
+                .dst_pitch = pitch,
+                .parity = field == 0 ? 1 : 0,
+        };
+        run_stripes(s, deinterlace_stripe, &st);
+}
+
+static void copy_frame(const struct state_yadif *s, const char *in, char *out, int pitch)
+{
+        const int linesize = vc_get_linesize(s->desc.width, s->desc.color_spec);
+        for (unsigned y = 0; y < s->desc.height; ++y) {
+                memcpy(out + (size_t) y * pitch, in + (size_t) y * linesize, linesize);
+        }
+}
+
+/// @param in  NULL for the second field in field-rate mode
+static bool yadif_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
+{
+        struct state_yadif *s = state;
+
+        if (!s->deinterlace) {
+                if (in) {
+                        s->last_in = in;
+                }
+                copy_frame(s, s->last_in->tiles[0].data, out->tiles[0].data, req_pitch);
+        } else {
+                if (in) {
+                        yadif_push(s);
+                }
+                yadif_output(s, out->tiles[0].data, req_pitch, in ? 0 : 1);
+        }
+
+        if (s->field_rate && !s->nodelay) {
+                // do not pass both frames in bulk but busy-wait half of the frame time (as temporal-deint does)
+                if (in) {
+                        s->frame_received = get_time_in_ns();
+                } else {
+                        time_ns_t t = 0;
+                        do {
+                                t = get_time_in_ns();
+                        } while ((t - s->frame_received) / NS_IN_SEC_DBL <= 0.5 / out->fps);
+                }
+        }
+
+        return true;
+}
+
+static void yadif_get_out_desc(void *state, struct video_desc *out, int *in_display_mode, int *out_frames)
+{
+        struct state_yadif *s = state;
+
+        *out = s->desc;
+        out->interlacing = PROGRESSIVE;
+        if (s->field_rate) {
+                out->fps *= 2.0;
+        }
+        *in_display_mode = DISPLAY_PROPERTY_VIDEO_MERGED;
+        *out_frames = s->field_rate ? 2 : 1;
+}
+
+static int cf_yadif_init(struct module *parent, const char *cfg, void **state)
+{
+        UNUSED(parent);
+        void *s = yadif_init_common(cfg, false);
+        if (!s) {
+                return 1;
+        }
+        *state = s;
+        return 0;
+}
+
+static struct video_frame *cf_yadif_filter(void *state, struct video_frame *f)
+{
+        struct state_yadif *s = state;
+        struct video_desc desc = video_desc_from_frame(f);
+
+        if (!video_desc_eq(desc, s->desc) && !yadif_reconfigure(s, desc)) {
+                VIDEO_FRAME_DISPOSE(f);
+                return NULL;
+        }
+        if (!s->deinterlace) {
+                return f;
+        }
+
+        memcpy(yadif_getf(s)->tiles[0].data, f->tiles[0].data, f->tiles[0].data_len);
+        VIDEO_FRAME_DISPOSE(f);
+        yadif_push(s);
+
+        if (s->out_pool == NULL) {
+                desc.interlacing = PROGRESSIVE;
+                s->out_pool = video_frame_pool_init(desc, 0);
+        }
+        struct video_frame *out = video_frame_pool_get_disposable_frame(s->out_pool);
+        yadif_output(s, out->tiles[0].data, vc_get_linesize(desc.width, desc.color_spec), 0);
+        return out;
+}
+
+ADD_TO_PARAM("yadif-kernel", "* yadif-kernel=scalar|vector\n"
+                "  Use the scalar or the generic vector yadif line kernel instead of the fastest supported one\n");
+
+static const struct vo_postprocess_info vo_pp_yadif_info = {
+        yadif_init,
+        yadif_reconfigure,
+        yadif_getf,
+        yadif_get_out_desc,
+        yadif_get_property,
+        yadif_postprocess,
+        yadif_done,
+};
+
+static const struct capture_filter_info capture_filter_yadif_info = {
+        cf_yadif_init,
+        yadif_done,
+        cf_yadif_filter,
+};
+
+REGISTER_MODULE(deinterlace_yadif, &vo_pp_yadif_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
+REGISTER_MODULE(deinterlace_yadif, &capture_filter_yadif_info, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
+
+/* vim: set expandtab sw=8 tw=120: */
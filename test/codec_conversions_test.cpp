@@ -4,13 +4,16 @@
 #include "config_win32.h"
 #endif
 
+#include <cmath>
 #include <iostream>
 #include <list>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "unit_common.h"
+#include "pixfmt_conv.h"
 #include "video_codec.h"
 #include "video_capture/testcard_common.h"
 
@@ -20,6 +23,7 @@ using std::pair;
 using std::string;
 using std::to_string;
 using std::ostringstream;
+using std::vector;
 
 extern "C" int codec_conversion_test_testcard_uyvy_to_i420(void);
 
@@ -77,3 +81,61 @@ int codec_conversion_test_testcard_uyvy_to_i420(void)
         return 0;
 }
 
+
+extern "C" int codec_conversion_test_multistep_plan(void);
+
+/**
+ * BGR->RG48 has no direct decoder so a plan is used, the line is longer
+ * than one chunk of the fused execution.
+ */
+int codec_conversion_test_multistep_plan(void)
+{
+        const codec_t candidates[] = { RG48, VIDEO_CODEC_NONE };
+        codec_t out = VIDEO_CODEC_NONE;
+        const struct pixfmt_conv_plan *plan = nullptr;
+        ASSERT_MESSAGE("BGR->RG48 unexpectedly direct", get_best_conv_plan_from(BGR, candidates, &out, &plan) == nullptr);
+        ASSERT_MESSAGE("no BGR->RG48 plan", plan != nullptr);
+        ASSERT_EQUAL(RG48, out);
+
+        const int width = 1000;
+        vector<unsigned char> src(vc_get_linesize(width, BGR) + MAX_PADDING);
+        vector<unsigned char> dst(vc_get_linesize(width, RG48) + MAX_PADDING);
+        for (size_t i = 0; i < src.size(); ++i) {
+                src[i] = i * 7 % 256;
+        }
+        pixfmt_conv_plan_run(plan, dst.data(), src.data(), vc_get_linesize(width, RG48),
+                             DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+        for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                        const unsigned char expected = src[3 * x + 2 - c];
+                        const unsigned char actual = dst[6 * x + 2 * c + 1]; // MSB
+                        ASSERT_EQUAL_MESSAGE("pixel " + to_string(x) + " channel " + to_string(c),
+                                             (int) expected, (int) actual);
+                }
+        }
+        return 0;
+}
+
+extern "C" int codec_conversion_test_plan_cost_tiebreak(void);
+
+/**
+ * From candidates of the same quality, the one with the cheapest conversion
+ * plan must be selected (not just the first in codec order), worse quality
+ * candidates are not considered even if cheaper.
+ */
+int codec_conversion_test_plan_cost_tiebreak(void)
+{
+        const struct pixfmt_desc src_desc = get_pixfmt_desc(RGB);
+        const codec_t candidates[] = { UYVY, YUYV, I420 }; // ordered by quality
+        const struct pixfmt_desc desc_uyvy = get_pixfmt_desc(UYVY);
+        const struct pixfmt_desc desc_yuyv = get_pixfmt_desc(YUYV);
+        ASSERT_EQUAL(0, compare_pixdesc(&desc_uyvy, &desc_yuyv, &src_desc));
+
+        const double cost_yuyv_cheaper[] = { 5.0, 3.0, 1.0 };
+        ASSERT_EQUAL(1U, pixfmt_conv_select_cheapest(candidates, 3, cost_yuyv_cheaper, &src_desc));
+        const double cost_uyvy_cheaper[] = { 3.0, 5.0, 1.0 };
+        ASSERT_EQUAL(0U, pixfmt_conv_select_cheapest(candidates, 3, cost_uyvy_cheaper, &src_desc));
+        const double cost_no_plan[] = { INFINITY, 5.0, 1.0 };
+        ASSERT_EQUAL(1U, pixfmt_conv_select_cheapest(candidates, 3, cost_no_plan, &src_desc));
+        return 0;
+}
@@ -4,25 +4,141 @@
 #include "config_win32.h"
 #endif
 
+#include <cstdlib>
+#include <cstring>
 #include <list>
 #include <sstream>
+#include <thread>
+#include <vector>
 
+#include "host.h"
+#include "pdb.h"
+#include "rtp/rate_control.h"
 #include "types.h"
 #include "utils/string.h"
+#include "utils/video_frame_pool.h"
+#include "utils/video_scale.h"
 #include "unit_common.h"
 #include "video.h"
+#include "video_codec.h"
 #include "video_frame.h"
+#include "vo_postprocess.h"
 
 extern "C" {
+        int misc_test_pdb();
+        int misc_test_rate_control();
         int misc_test_replace_all();
         int misc_test_video_desc_io_op_symmetry();
+        int misc_test_video_frame_pool();
+        int misc_test_video_scale();
+        int misc_test_yadif_kernels();
 }
 
 using namespace std;
 
+/// checks participant lookup and active iteration across table growth and removals
+int misc_test_pdb()
+{
+        struct pdb *db = pdb_init(nullptr);
+        const int count = 1000;
+        for (int i = 0; i < count; ++i) {
+                ASSERT(pdb_add(db, i * 16) == 0); // non-random SSRCs collide more
+        }
+        ASSERT(pdb_add(db, 16) == 1);
+        for (int i = 0; i < count; i += 3) {
+                pdb_set_active(db, pdb_get(db, i * 16), true);
+        }
+        for (int i = 0; i < count; i += 2) {
+                struct pdb_e *item = nullptr;
+                ASSERT(pdb_remove(db, i * 16, &item) == 0);
+                ASSERT(item != nullptr && item->ssrc == (uint32_t) i * 16);
+                pdb_destroy_item(item);
+        }
+        int total = 0;
+        int active = 0;
+        pdb_iter_t it;
+        for (struct pdb_e *e = pdb_iter_init(db, &it); e != nullptr; e = pdb_iter_next(&it)) {
+                ASSERT(pdb_get(db, e->ssrc) == e);
+                total++;
+        }
+        pdb_iter_done(&it);
+        for (struct pdb_e *e = pdb_iter_init_active(db, &it); e != nullptr; e = pdb_iter_next(&it)) {
+                ASSERT(e->ssrc / 16 % 3 == 0 && e->ssrc / 16 % 2 == 1);
+                active++;
+        }
+        pdb_iter_done(&it);
+        ASSERT_EQUAL(count / 2, total);
+        ASSERT_EQUAL(167, active); // odd multiples of 3 below 1000
+        ASSERT(pdb_get(db, 0) == nullptr);
+        pdb_destroy(&db);
+        return 0;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wstring-concatenation"
 #endif
+/// sets feedback of a receiver as if a RTCP RR and UGCC APP packet were received
+static void rate_control_test_feedback(struct pdb *db, uint32_t ssrc, double loss, uint32_t rtt_us)
+{
+        struct pdb_e *e = pdb_get(db, ssrc);
+        e->cc.fb_loss = loss;
+        e->cc.rtt_us = rtt_us;
+        e->cc.fb_rx_rate = 100000; // kbps, the stream is not application-limited
+        e->cc.fb_count += 1;
+}
+
+/// rate decreases on loss and RTT growth (of any RX shard) and recovers afterwards
+int misc_test_rate_control()
+{
+        commandline_params["rate-control"] = "1M:100M:50M";
+        struct rate_ctl *rc = rate_ctl_init();
+        commandline_params.erase("rate-control");
+        ASSERT(rc != nullptr);
+        struct pdb *db = pdb_init(nullptr);
+        struct pdb *shard = pdb_init(nullptr);
+        ASSERT(pdb_add(db, 1) == 0);
+        ASSERT(pdb_add(shard, 2) == 0);
+        struct rate_ctl_stats stats{};
+
+        ASSERT(!rate_ctl_update(rc, db, &stats)); // no feedback yet
+        rate_control_test_feedback(db, 1, 0.0, 20000);
+        ASSERT(rate_ctl_update(rc, db, &stats));
+        long long rate = stats.bitrate;
+        ASSERT(!rate_ctl_update(rc, db, &stats)); // the same feedback is not processed twice
+
+        for (int i = 0; i < 3; ++i) { // heavy loss
+                rate_control_test_feedback(db, 1, 0.3, 20000);
+                ASSERT(rate_ctl_update(rc, db, &stats));
+                ASSERT(stats.bitrate < rate);
+                rate = stats.bitrate;
+        }
+        rate_control_test_feedback(db, 1, 0.0, 20000);
+        rate_control_test_feedback(shard, 2, 0.0, 200000); // queue building behind the other shard
+        rate_ctl_update(rc, db, &stats);
+        ASSERT(rate_ctl_update(rc, shard, &stats));
+        ASSERT_EQUAL(200000U, stats.rtt_us);
+        ASSERT(stats.bitrate < rate);
+        rate = stats.bitrate;
+        const long long lowest = rate;
+
+        for (int i = 0; i < 100; ++i) { // loss and queue gone
+                rate_control_test_feedback(db, 1, 0.0, 20000);
+                rate_control_test_feedback(shard, 2, 0.0, 20000);
+                rate_ctl_update(rc, shard, &stats);
+                if (rate_ctl_update(rc, db, &stats)) {
+                        ASSERT(stats.bitrate > rate);
+                        rate = stats.bitrate;
+                }
+        }
+        ASSERT(rate > 2 * lowest);
+        ASSERT(rate <= 100'000'000);
+
+        pdb_destroy(&shard);
+        pdb_destroy(&db);
+        rate_ctl_done(rc);
+        return 0;
+}
+
 int misc_test_replace_all()
 {
         char test[][20] =         { DELDEL DELDEL DELDEL, DELDEL DELDEL,               "XYZX" DELDEL, "XXXyX" };
@@ -58,3 +174,162 @@ int misc_test_video_desc_io_op_symmetry()
         }
         return 0;
 }
+
+/// fills frame with a constant color, v210 and UYVY are handled as a sequence of 10-bit/8-bit samples
+static vector<unsigned char> video_scale_test_fill(codec_t codec, int width, int height)
+{
+        vector<unsigned char> buf(vc_get_datalen(width, height, codec));
+        const int uyvy[] = { 90, 200, 60, 200 };
+        const unsigned char rgba[] = { 10, 20, 30, 255 };
+        switch (codec) {
+        case UYVY:
+                for (size_t i = 0; i < buf.size(); ++i) {
+                        buf[i] = uyvy[i % 4];
+                }
+                break;
+        case v210:
+                for (size_t i = 0; i < buf.size() / 4; ++i) {
+                        uint32_t w = 0;
+                        for (int j = 0; j < 3; ++j) {
+                                w |= (uint32_t) uyvy[(i * 3 + j) % 4] * 4 << (10 * j);
+                        }
+                        memcpy(&buf[i * 4], &w, sizeof w);
+                }
+                break;
+        case RGBA:
+                for (size_t i = 0; i < buf.size(); ++i) {
+                        buf[i] = rgba[i % 4];
+                }
+                break;
+        case I420:
+                memset(buf.data(), 200, (size_t) width * height);
+                memset(buf.data() + (size_t) width * height, 90, (size_t) width * height / 4);
+                memset(buf.data() + (size_t) width * height * 5 / 4, 60, (size_t) width * height / 4);
+                break;
+        default:
+                abort();
+        }
+        return buf;
+}
+
+/// frames returned from other threads are reused, in-flight frames survive reconfigure
+int misc_test_video_frame_pool()
+{
+        const struct video_desc desc1 = { 64, 32, UYVY, 30, PROGRESSIVE, 1 };
+        const struct video_desc desc2 = { 128, 64, RGBA, 30, PROGRESSIVE, 1 };
+        auto *pool = new video_frame_pool(2);
+        pool->reconfigure(desc1);
+        std::shared_ptr<video_frame> in_flight = pool->get_frame();
+        void *first_data = in_flight->tiles[0].data;
+        for (int i = 0; i < 100; ++i) {
+                std::shared_ptr<video_frame> f = pool->get_frame(); // blocks if not returned
+                ASSERT(f->tiles[0].data != first_data);
+                std::thread([f = std::move(f)]() mutable { f.reset(); }).detach();
+        }
+        pool->reconfigure(desc2);
+        std::shared_ptr<video_frame> f = pool->get_frame();
+        ASSERT_EQUAL(vc_get_datalen(128, 64, RGBA), f->tiles[0].data_len);
+        ASSERT_EQUAL(RGBA, f->color_spec);
+        memset(in_flight->tiles[0].data, 0, in_flight->tiles[0].data_len); // still owned
+        std::thread([f = std::move(in_flight)]() mutable { f.reset(); }).join();
+        f.reset();
+        f = pool->get_frame(); // old-generation frame must not be handed out
+        ASSERT_EQUAL(RGBA, f->color_spec);
+        f.reset();
+        delete pool;
+        return 0;
+}
+
+int misc_test_video_scale()
+{
+        const codec_t codecs[] = { VIDEO_SCALE_SUPPORTED_PIXFMT_INIT };
+        const int sizes[][2] = { { 48, 30 }, { 96, 60 }, { 156, 92 } };
+        for (codec_t codec : codecs) {
+                auto in = video_scale_test_fill(codec, sizes[1][0], sizes[1][1]);
+                for (auto const &size : sizes) {
+                        for (int algo = 0; algo < VIDEO_SCALE_ALGO_COUNT; ++algo) {
+                                ostringstream oss;
+                                oss << get_codec_name(codec) << " " << video_scale_algo_to_string((enum video_scale_algo) algo) << " " << size[0] << "x" << size[1];
+                                struct video_scale *s = video_scale_init(codec, sizes[1][0], sizes[1][1], size[0], size[1], false, (enum video_scale_algo) algo, 2);
+                                ASSERT_MESSAGE(oss.str(), s != nullptr);
+                                auto expected = video_scale_test_fill(codec, size[0], size[1]);
+                                vector<unsigned char> out(expected.size());
+                                video_scale(s, (const char *) in.data(), (char *) out.data());
+                                video_scale_done(s);
+                                // a constant picture must stay constant (v210 line padding is not compared)
+                                const int linesize = vc_get_linesize(size[0], codec);
+                                const int cmp_len = codec == v210 ? size[0] / 6 * 16 : codec == I420 ? (int) out.size() : linesize;
+                                for (int y = 0; y < (codec == I420 ? 1 : size[1]); ++y) {
+                                        ASSERT_MESSAGE(oss.str(), memcmp(&out[y * linesize], &expected[y * linesize], cmp_len) == 0);
+                                }
+                        }
+                }
+        }
+
+        // identity must not change the picture
+        vector<unsigned char> in(vc_get_datalen(64, 32, UYVY));
+        for (auto &i : in) {
+                i = rand();
+        }
+        vector<unsigned char> out(in.size());
+        struct video_scale *s = video_scale_init(UYVY, 64, 32, 64, 32, false, VIDEO_SCALE_LANCZOS4, 0);
+        video_scale(s, (const char *) in.data(), (char *) out.data());
+        video_scale_done(s);
+        ASSERT(in == out);
+        return 0;
+}
+
+/// deinterlaces both fields of a few random frames with the given yadif kernel, returns concatenated output
+static vector<unsigned char> yadif_test_run(const char *kernel, struct video_desc desc)
+{
+        commandline_params["yadif-kernel"] = kernel;
+        struct vo_postprocess_state *pp = vo_postprocess_init("deinterlace_yadif:field:nodelay:force:threads=3");
+        vector<unsigned char> ret;
+        if (pp == nullptr || !vo_postprocess_reconfigure(pp, desc)) {
+                return ret;
+        }
+        struct video_desc out_desc{};
+        int display_mode = 0;
+        int out_frames = 0;
+        vo_postprocess_get_out_desc(pp, &out_desc, &display_mode, &out_frames);
+        struct video_frame *out = vf_alloc_desc_data(out_desc);
+        const int pitch = vc_get_linesize(desc.width, desc.color_spec);
+        srand(desc.width * desc.height);
+        for (int i = 0; i < 4; ++i) {
+                struct video_frame *in = vo_postprocess_getf(pp);
+                for (unsigned j = 0; j < in->tiles[0].data_len; ++j) {
+                        in->tiles[0].data[j] = rand();
+                }
+                for (struct video_frame *f : { in, (struct video_frame *) nullptr }) {
+                        vo_postprocess(pp, f, out, pitch);
+                        ret.insert(ret.end(), out->tiles[0].data, out->tiles[0].data + out->tiles[0].data_len);
+                }
+        }
+        vf_free(out);
+        vo_postprocess_done(pp);
+        return ret;
+}
+
+/// vectorized yadif kernels must match the scalar one bit for bit, including line ends and edge lines
+int misc_test_yadif_kernels()
+{
+        const struct video_desc descs[] = {
+                { 5, 7, UYVY, 25, INTERLACED_MERGED, 1 },     // line shorter than the scalar edges
+                { 37, 7, UYVY, 25, INTERLACED_MERGED, 1 },
+                { 101, 9, YUYV, 25, INTERLACED_MERGED, 1 },
+                { 53, 11, Y216, 25, INTERLACED_MERGED, 1 },
+                { 50, 5, v210, 25, INTERLACED_MERGED, 1 },
+        };
+        for (const auto &desc : descs) {
+                vector<unsigned char> ref = yadif_test_run("scalar", desc);
+                ASSERT(!ref.empty());
+                for (const char *kernel : { "vector", "default" }) {
+                        std::ostringstream oss;
+                        oss << kernel << " " << desc;
+                        ASSERT_MESSAGE(oss.str(), yadif_test_run(kernel, desc) == ref);
+                }
+        }
+        commandline_params.erase("yadif-kernel");
+        commandline_params.erase("decoder-drop-policy");
+        return 0;
+}
@@ -76,6 +76,8 @@ long packet_rate = 13600;
 #define DEFINE_TEST(func) { #func, func, false }
 
 DECLARE_TEST(codec_conversion_test_testcard_uyvy_to_i420);
+DECLARE_TEST(codec_conversion_test_multistep_plan);
+DECLARE_TEST(codec_conversion_test_plan_cost_tiebreak);
 DECLARE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r10k);
 DECLARE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r12l);
 DECLARE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48);
@@ -86,8 +88,13 @@ DECLARE_TEST(get_framerate_test_3000);
 DECLARE_TEST(get_framerate_test_free);
 DECLARE_TEST(gpujpeg_test_simple);
 DECLARE_TEST(libavcodec_test_get_decoder_from_uv_to_uv);
+DECLARE_TEST(misc_test_pdb);
+DECLARE_TEST(misc_test_rate_control);
 DECLARE_TEST(misc_test_replace_all);
 DECLARE_TEST(misc_test_video_desc_io_op_symmetry);
+DECLARE_TEST(misc_test_video_frame_pool);
+DECLARE_TEST(misc_test_video_scale);
+DECLARE_TEST(misc_test_yadif_kernels);
 
 struct {
         const char *name;
@@ -107,6 +114,8 @@ struct {
         DEFINE_QUIET_TEST(test_video_display),
 #endif
         DEFINE_TEST(codec_conversion_test_testcard_uyvy_to_i420),
+        DEFINE_TEST(codec_conversion_test_multistep_plan),
+        DEFINE_TEST(codec_conversion_test_plan_cost_tiebreak),
 #if defined HAVE_LAVC
         DEFINE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r10k),
         DEFINE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r12l),
@@ -119,8 +128,13 @@ struct {
         DEFINE_TEST(get_framerate_test_free),
         DEFINE_TEST(gpujpeg_test_simple),
         DEFINE_TEST(libavcodec_test_get_decoder_from_uv_to_uv),
+        DEFINE_TEST(misc_test_pdb),
+        DEFINE_TEST(misc_test_rate_control),
         DEFINE_TEST(misc_test_replace_all),
         DEFINE_TEST(misc_test_video_desc_io_op_symmetry),
+        DEFINE_TEST(misc_test_video_frame_pool),
+        DEFINE_TEST(misc_test_video_scale),
+        DEFINE_TEST(misc_test_yadif_kernels),
 };
 
 static bool test_helper(const char *name, int (*func)(), bool quiet) {
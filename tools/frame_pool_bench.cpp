@@ -0,0 +1,112 @@
+/**
+ * Benchmarks pixel format conversion throughput on buffers allocated with
+ * the particular frame pool backings (see utils/huge_alloc.h), ie. the effect
+ * of huge pages and NUMA-local placement on big frames.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "../src/config_unix.h"
+#include "../src/pixfmt_conv.h"
+#include "../src/utils/huge_alloc.h"
+#include "../src/video_codec.h"
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::cout;
+using std::min;
+using std::stoi;
+using std::string;
+
+template <typename F>
+static double measure_ms(int iterations, F &&func) {
+        auto t0 = steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+                func();
+        }
+        return duration<double, std::milli>(steady_clock::now() - t0).count() / iterations;
+}
+
+int main(int argc, char *argv[]) {
+        if (argc != 1 && argc != 4 && argc != 5) {
+                cout << "Benchmark of pixel format conversion on malloc, THP and hugetlb buffers.\n\n"
+                        "Usage:\n"
+                        "\t" << argv[0] << " [<width> <height> <iterations> [numa]]\n"
+                        "\t\t" << "Eg.: " << argv[0] << " 7680 4320 20 numa\n";
+                return argc == 2 && string("help") == argv[1] ? 0 : 1;
+        }
+        int width = 7680;
+        int height = 4320;
+        int iterations = 20;
+        bool numa = false;
+        if (argc >= 4) {
+                width = stoi(argv[1]);
+                height = stoi(argv[2]);
+                iterations = stoi(argv[3]);
+        }
+        if (argc == 5) {
+                numa = string("numa") == argv[4];
+        }
+
+        const codec_t in_codec = RGBA;
+        const codec_t out_codec = UYVY;
+        decoder_t dec = get_decoder_from_to(in_codec, out_codec);
+        if (dec == nullptr) {
+                return 1;
+        }
+        const int in_linesize = vc_get_linesize(width, in_codec);
+        const int out_linesize = vc_get_linesize(width, out_codec);
+        const size_t in_len = (size_t) in_linesize * height;
+        const size_t out_len = (size_t) out_linesize * height;
+
+        cout << width << "x" << height << " " << get_codec_name(in_codec) << " -> "
+                << get_codec_name(out_codec) << (numa ? ", NUMA-local" : "") << "\n";
+        const enum huge_alloc_mode modes[] = { HUGE_ALLOC_MALLOC, HUGE_ALLOC_THP,
+                HUGE_ALLOC_HUGETLB, HUGE_ALLOC_HUGETLB_1G };
+        for (auto mode : modes) {
+                struct huge_alloc_cfg cfg = { mode, numa };
+                cout << huge_alloc_mode_to_str(mode) << ": ";
+                auto t0 = steady_clock::now();
+                auto *in = (unsigned char *) huge_alloc(in_len, &cfg);
+                auto *out = (unsigned char *) huge_alloc(out_len, &cfg);
+                if (in == nullptr || out == nullptr) {
+                        cout << "unavailable\n";
+                        huge_free(in);
+                        huge_free(out);
+                        continue;
+                }
+                // huge_alloc() silently falls back, report what was really measured
+                const struct huge_alloc_cfg used_in = huge_alloc_get_cfg(in);
+                const struct huge_alloc_cfg used_out = huge_alloc_get_cfg(out);
+                if (used_in.mode != mode || used_out.mode != mode) {
+                        cout << "unavailable (falls back to "
+                                << huge_alloc_mode_to_str(min(used_in.mode, used_out.mode)) << ")\n";
+                        huge_free(in);
+                        huge_free(out);
+                        continue;
+                }
+                if (numa && !(used_in.numa_local && used_out.numa_local)) {
+                        cout << "(NUMA binding unavailable) ";
+                }
+                memset(in, 0, in_len);
+                memset(out, 0, out_len);
+                double fault_ms = duration<double, std::milli>(steady_clock::now() - t0).count();
+                for (size_t i = 0; i < in_len; ++i) {
+                        in[i] = rand();
+                }
+                double ms = measure_ms(iterations, [&]() {
+                        for (int y = 0; y < height; ++y) {
+                                dec(out + (size_t) y * out_linesize, in + (size_t) y * in_linesize,
+                                                out_linesize, 0, 8, 16);
+                        }
+                });
+                cout << ms << " ms per frame, " << (in_len + out_len) / ms / 1E6
+                        << " GB/s (alloc + first touch " << fault_ms << " ms)\n";
+                huge_free(in);
+                huge_free(out);
+        }
+}
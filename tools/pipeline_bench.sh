@@ -0,0 +1,37 @@
+#!/bin/sh -eu
+#
+# Runs pipeline benchmark scenarios and prints the results as a JSON array.
+#
+# usage: pipeline_bench.sh [<uv_binary> [<scenario_file>]]
+
+UV=${1:-bin/uv}
+SCENARIOS=${2:-$(dirname "$0")/pipeline_bench.scenarios}
+REPORT=$(mktemp)
+trap 'rm -f "$REPORT"' EXIT
+
+# escapes backslashes and double quotes to be usable in a JSON string
+json_escape() {
+        printf '%s' "$1" | sed -e 's/\\/\\\\/g' -e 's/"/\\"/g'
+}
+
+echo '['
+SEP=
+grep -v -e '^#' -e '^[[:space:]]*$' "$SCENARIOS" | while read -r NAME DURATION ARGS; do
+        echo "Running $NAME ($DURATION s)..." >&2
+        : > "$REPORT"
+        # shellcheck disable=SC2086 # ARGS intentionally split
+        STATUS=0
+        timeout -s INT -k 10 "$DURATION" "$UV" --param bench-report="$REPORT" $ARGS >/dev/null 2>&1 || STATUS=$?
+        # timeout exits with 124 if UG ran for the whole duration
+        COMPLETED=$([ $STATUS -eq 124 ] && echo true || echo false)
+        printf '%s{ "scenario": "%s", "args": "%s", "completed": %s,\n' "$SEP" "$(json_escape "$NAME")" "$(json_escape "$ARGS")" "$COMPLETED"
+        if [ -s "$REPORT" ]; then
+                printf '"report": '
+                cat "$REPORT"
+        else
+                echo '"error": "no report, see the UltraGrid output"'
+        fi
+        echo '}'
+        SEP=,
+done
+echo ']'
@@ -0,0 +1,92 @@
+/**
+ * Benchmarks the native scaler (utils/video_scale) against the OpenCV path
+ * of the resize capture filter (conversion to RGB + cv::resize).
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/config_unix.h"
+#include "../src/utils/video_scale.h"
+#include "../src/video_codec.h"
+#ifdef HAVE_RESIZE_OPENCV
+#include "../src/capture_filter/resize_utils.h"
+#endif
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::cout;
+using std::stoi;
+using std::string;
+using std::vector;
+
+template <typename F>
+static double measure_ms(int iterations, F &&func) {
+        func(); // warm-up (allocations, page faults)
+        auto t0 = steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+                func();
+        }
+        return duration<double, std::milli>(steady_clock::now() - t0).count() / iterations;
+}
+
+int main(int argc, char *argv[]) {
+        if (argc != 1 && argc != 6 && argc != 7) {
+                cout << "Benchmark of the native scaler vs. OpenCV resize.\n\n"
+                        "Usage:\n"
+                        "\t" << argv[0] << " [<in_width> <in_height> <out_width> <out_height> <iterations> [<threads>]]\n"
+                        "\t\t" << "Eg.: " << argv[0] << " 3840 2160 1920 1080 20\n";
+                return argc == 2 && string("help") == argv[1] ? 0 : 1;
+        }
+        int in_w = 3840;
+        int in_h = 2160;
+        int out_w = 1920;
+        int out_h = 1080;
+        int iterations = 20;
+        int threads = 0;
+        if (argc >= 6) {
+                in_w = stoi(argv[1]);
+                in_h = stoi(argv[2]);
+                out_w = stoi(argv[3]);
+                out_h = stoi(argv[4]);
+                iterations = stoi(argv[5]);
+        }
+        if (argc == 7) {
+                threads = stoi(argv[6]);
+        }
+
+        const codec_t codecs[] = { VIDEO_SCALE_SUPPORTED_PIXFMT_INIT };
+        const enum video_scale_algo algos[] = { VIDEO_SCALE_LINEAR, VIDEO_SCALE_CUBIC, VIDEO_SCALE_LANCZOS4 };
+        vector<char> in(vc_get_datalen(in_w, in_h, RG48));
+        vector<char> out(vc_get_datalen(out_w, out_h, RG48));
+        for (auto &c : in) {
+                c = rand();
+        }
+        cout << in_w << "x" << in_h << " -> " << out_w << "x" << out_h << ", ms per frame\n";
+        for (codec_t codec : codecs) {
+                for (auto algo : algos) {
+                        cout << get_codec_name(codec) << " " << video_scale_algo_to_string(algo) << ": native ";
+                        struct video_scale *s = video_scale_init(codec, in_w, in_h, out_w, out_h, false, algo, threads);
+                        if (s == nullptr) {
+                                return 1;
+                        }
+                        cout << measure_ms(iterations, [&]() { video_scale(s, in.data(), out.data()); });
+                        video_scale_done(s);
+#ifdef HAVE_RESIZE_OPENCV
+                        if (codec != v210) { // OpenCV path requires conversion to a supported format first
+                                struct resize_param param{};
+                                param.mode = USE_DIMENSIONS;
+                                param.target_width = out_w;
+                                param.target_height = out_h;
+                                param.algo = algo;
+                                cout << ", OpenCV " << measure_ms(iterations, [&]() {
+                                        resize_frame(in.data(), codec, out.data(), in_w, in_h, &param);
+                                });
+                        }
+#endif
+                        cout << "\n";
+                }
+        }
+}